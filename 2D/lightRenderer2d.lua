@@ -1,11 +1,19 @@
 local Vector2    = require "engine.math.vector2"
-local Inter2d    = require "engine.math.intersection2d"
 local Utils      = require "engine.misc.utils"
 local Object     = require "engine.3rdparty.classic.classic"
+local ffi        = require "ffi"
 local lg         = love.graphics
+local floor, min, max, ceil = math.floor, math.min, math.max, math.ceil
 
----@alias Light2D {pos: Vector2, radius: number, color: number[], shadowMap: love.Canvas}
----@alias Occluder2D {pos: Vector2, poly: number[], boundingMin: Vector2, boundingMax: Vector2, culling: "cw"|"ccw"}
+---@alias Light2D {pos: Vector2, radius: number, color: number[], tile: integer}
+---@alias Occluder2D {pos: Vector2, poly: number[], boundingMin: Vector2, boundingMax: Vector2, culling: "cw"|"ccw"|"noCulling"}
+---@alias LightRenderer2DStats {shadowMapsRendered: integer, shadowMapsSkipped: integer, occludersVisited: integer, edgesDrawn: integer, drawCalls: integer}
+
+ffi.cdef [[
+    typedef struct {
+        float x, y, distance;
+    } shadow_vertex;
+]]
 
 local shadowShader = lg.newShader [[
 attribute float a_distance;
@@ -13,7 +21,7 @@ uniform vec2 u_lightpos;
 
 vec4 position(mat4 transform_projection, vec4 vertex_pos) {
     vec4 outPos = vec4(vertex_pos.xy - a_distance * u_lightpos, 0.0, 1.0 - a_distance);
-    
+
     return transform_projection * outPos;
 }
 ]]
@@ -25,12 +33,13 @@ local lightShader = Utils.newPreProcessedShader [[
 uniform vec2 u_lightpos;
 uniform float u_radius;
 uniform sampler2D u_shadowMap;
+uniform vec4 u_shadowRect;
 
 vec4 effect(vec4 color, sampler2D tex, vec2 texcoords, vec2 screencoords) {
     float dist = distance(screencoords, u_lightpos);
     float attenuation = max(1.0 - dist / u_radius, 0.0);
-    float visibility = BoxBlur(u_shadowMap, texcoords, 2).r;
-    
+    float visibility = BoxBlur(u_shadowMap, u_shadowRect.xy + texcoords * u_shadowRect.zw, 2).r;
+
     return Texel(tex, texcoords) * color * (attenuation * attenuation) * visibility;
 }
 ]]
@@ -40,34 +49,35 @@ local vformat = {
     {"VertexPosition", "float", 2},
     {"a_distance", "float", 1},
 }
-local shadowMesh = lg.newMesh(vformat, 4, "strip", "stream")
-
-
-
-local vdata = {
-    {0, 0, 0},
-    {0, 0, 1},
-    {0, 0, 0},
-    {0, 0, 1},
-}
-local function updateVertices(v1, v2)
-    vdata[1][1], vdata[1][2] = v1.x, v1.y
-    vdata[2][1], vdata[2][2] = v1.x, v1.y
 
-    vdata[3][1], vdata[3][2] = v2.x, v2.y
-    vdata[4][1], vdata[4][2] = v2.x, v2.y
-
-    shadowMesh:setVertices(vdata)
-end
+-- Space around each shadow map in the atlas, so the blur doesn't read the neighbor ones
+local TILE_PADDING = 2
 
 
 ---@class LightRenderer2D : Object
 ---
 ---@field public ambientColor number[]
 ---@field public lightMap love.Canvas
+---@field public shadowAtlas love.Canvas: Half resolution shadow maps of all lights
+---@field public stats LightRenderer2DStats: Counters of the last render
 ---@field private size Vector2
 ---@field private lights table<Light2D, boolean>
 ---@field private occluders table<Occluder2D, boolean>
+---@field private _occluderCellSize number: Size of the cells of the occluder grid, see `setOccluderCellSize`
+---@field private _grid table<integer, table<Occluder2D, boolean>>: Occluders that touch each cell
+---@field private _occluderCells table<Occluder2D, integer[]>: Cells of each occluder
+---@field private _occluderBounds table<Occluder2D, number[]>: Hashed position and world bounds of each occluder
+---@field private _dirtyBounds number[]: Bounds of the occluders changed since the last render, 4 numbers each
+---@field private _lightStates table<Light2D, {x: number, y: number, radius: number}>: State of the last shadow map of each light
+---@field private _visited table<Occluder2D, integer>: Last query that visited each occluder
+---@field private _query integer
+---@field private _tileCapacity integer
+---@field private _tileColumns integer
+---@field private _freeTiles integer[]
+---@field private _edgeCapacity integer
+---@field private _vertexData love.ByteData
+---@field private _vertices ffi.cdata*
+---@field private _shadowMesh love.Mesh
 ---
 ---@overload fun(size: Vector2, ambientColor: number[]): LightRenderer2D
 local Renderer2d = Object:extend("LightRenderer2D")
@@ -78,26 +88,42 @@ function Renderer2d:new(size, ambientColor)
     self.size = size
     self.lightMap = lg.newCanvas(size.width, size.height, {format = "rgba16f"})
     self.ambientColor = ambientColor
+    self._occluderCellSize = 128
+
+    self.stats = {
+        shadowMapsRendered = 0, -- Lights whose shadows were drawn again
+        shadowMapsSkipped = 0,  -- Lights that kept their shadow map from the previous render
+        occludersVisited = 0,   -- Occluders found near the rendered lights
+        edgesDrawn = 0,         -- Shadow quads drawn
+        drawCalls = 0,          -- Shadow draw calls
+    }
+
+    self._grid = {}
+    self._occluderCells = {}
+    self._occluderBounds = {}
+    self._dirtyBounds = {}
+    self._lightStates = {}
+    self._visited = {}
+    self._query = 0
+    self._tileCapacity = 0
+    self._tileColumns = 1
+    self._freeTiles = {}
+    self._edgeCapacity = 0
+
+    self:_growAtlas(4)
+    self:_growShadowMesh(256)
 end
 
 
 function Renderer2d:addOccluder(pos, polygon, cullingOrder)
-    local min, max = Vector2(math.huge), Vector2(-math.huge)
-
-    for i, p in ipairs(polygon) do
-        min = Vector2.Min(min, p)
-        max = Vector2.Max(max, p)
-    end
-
     local occluder = {
         pos = pos,
         poly = polygon,
         culling = cullingOrder,
-        boundingMin = min,
-        boundingMax = max
     }
 
     self.occluders[occluder] = true
+    self:updateOccluder(occluder)
     return occluder
 end
 
@@ -127,12 +153,30 @@ function Renderer2d:addCircleOccluder(pos, radius, segments)
 end
 
 
+--- Must be called after the polygon of an occluder changes. Changes of its position are detected automatically
+---@param occluder Occluder2D
+function Renderer2d:updateOccluder(occluder)
+    local boundingMin, boundingMax = Vector2(math.huge), Vector2(-math.huge)
+
+    for i, p in ipairs(occluder.poly) do
+        boundingMin = Vector2.Min(boundingMin, p)
+        boundingMax = Vector2.Max(boundingMax, p)
+    end
+
+    occluder.boundingMin = boundingMin
+    occluder.boundingMax = boundingMax
+
+    self:_unhashOccluder(occluder)
+    self:_hashOccluder(occluder)
+end
+
+
 function Renderer2d:addLight(position, radius, color)
     local light = {
         pos = position,
         radius = radius,
         color = color,
-        shadowMap = lg.newCanvas(self.size.x/2, self.size.y/2, {format = "r8"})
+        tile = self:_allocateTile(),
     }
 
     self.lights[light] = true
@@ -141,51 +185,393 @@ end
 
 
 function Renderer2d:removeOccluder(occluder)
+    self:_unhashOccluder(occluder)
     self.occluders[occluder] = nil
+    self._visited[occluder] = nil
 end
 
 
 function Renderer2d:removeLight(light)
     self.lights[light] = nil
+    self._lightStates[light] = nil
+    table.insert(self._freeTiles, light.tile)
+end
+
+
+--- Changes the size of the cells of the occluder grid, filing all the occluders again.
+--- Cells should be around the size of the lights, smaller cells make light queries visit fewer distant occluders
+---@param size number
+function Renderer2d:setOccluderCellSize(size)
+    assert(size > 0, "Cell size must be positive")
+
+    if size == self._occluderCellSize then
+        return
+    end
+
+    self._occluderCellSize = size
+    self._grid = {}
+
+    -- Occluder bounds don't change, so the shadow maps are still valid
+    for occluder, bounds in pairs(self._occluderBounds) do
+        self._occluderCells[occluder] = self:_insertOccluderCells(occluder, bounds[3], bounds[4], bounds[5], bounds[6])
+    end
+end
+
+
+---@return number
+function Renderer2d:getOccluderCellSize()
+    return self._occluderCellSize
+end
+
+
+
+---@param cx integer
+---@param cy integer
+---@return integer
+local function getCellKey(cx, cy)
+    return cx * 4194304 + cy
+end
+
+
+---@private
+---@param minX number
+---@param minY number
+---@param maxX number
+---@param maxY number
+function Renderer2d:_addDirtyBounds(minX, minY, maxX, maxY)
+    local dirty = self._dirtyBounds
+
+    dirty[#dirty+1] = minX
+    dirty[#dirty+1] = minY
+    dirty[#dirty+1] = maxX
+    dirty[#dirty+1] = maxY
+end
+
+
+---@private
+---@param occluder Occluder2D
+---@param minX number
+---@param minY number
+---@param maxX number
+---@param maxY number
+---@return integer[]: Keys of the cells
+function Renderer2d:_insertOccluderCells(occluder, minX, minY, maxX, maxY)
+    local cellSize = self._occluderCellSize
+    local cells = {}
+
+    for cx=floor(minX / cellSize), floor(maxX / cellSize) do
+        for cy=floor(minY / cellSize), floor(maxY / cellSize) do
+            local key = getCellKey(cx, cy)
+            local cell = self._grid[key]
+
+            if not cell then
+                cell = {}
+                self._grid[key] = cell
+            end
+
+            cell[occluder] = true
+            cells[#cells+1] = key
+        end
+    end
+
+    return cells
+end
+
+
+---@private
+---@param occluder Occluder2D
+function Renderer2d:_hashOccluder(occluder)
+    local pos = occluder.pos
+    local minX, minY = pos.x + occluder.boundingMin.x, pos.y + occluder.boundingMin.y
+    local maxX, maxY = pos.x + occluder.boundingMax.x, pos.y + occluder.boundingMax.y
+
+    self._occluderCells[occluder] = self:_insertOccluderCells(occluder, minX, minY, maxX, maxY)
+    self._occluderBounds[occluder] = {pos.x, pos.y, minX, minY, maxX, maxY}
+    self:_addDirtyBounds(minX, minY, maxX, maxY)
+end
+
+
+---@private
+---@param occluder Occluder2D
+function Renderer2d:_unhashOccluder(occluder)
+    local cells = self._occluderCells[occluder]
+
+    if not cells then
+        return
+    end
+
+    for _, key in ipairs(cells) do
+        local cell = self._grid[key]
+        cell[occluder] = nil
+
+        if next(cell) == nil then
+            self._grid[key] = nil
+        end
+    end
+
+    local bounds = self._occluderBounds[occluder]
+    self:_addDirtyBounds(bounds[3], bounds[4], bounds[5], bounds[6])
+
+    self._occluderCells[occluder] = nil
+    self._occluderBounds[occluder] = nil
+end
+
+
+-- Hashes again the occluders that moved
+---@private
+function Renderer2d:_updateMovedOccluders()
+    for occluder in pairs(self.occluders) do
+        local bounds = self._occluderBounds[occluder]
+
+        if occluder.pos.x ~= bounds[1] or occluder.pos.y ~= bounds[2] then
+            self:_unhashOccluder(occluder)
+            self:_hashOccluder(occluder)
+        end
+    end
+end
+
+
+
+---@private
+---@param capacity integer: Number of tiles
+function Renderer2d:_growAtlas(capacity)
+    local tileWidth = ceil(self.size.x / 2) + TILE_PADDING * 2
+    local tileHeight = ceil(self.size.y / 2) + TILE_PADDING * 2
+    local limit = lg.getSystemLimits().texturesize
+    local columns = max(min(capacity, floor(limit / tileWidth)), 1)
+    local rows = ceil(capacity / columns)
+
+    assert(rows * tileHeight <= limit, "Too many lights for the shadow atlas")
+
+    for tile=self._tileCapacity, capacity-1 do
+        table.insert(self._freeTiles, 1, tile)
+    end
+
+    self.shadowAtlas = lg.newCanvas(columns * tileWidth, rows * tileHeight, {format = "r8"})
+    self._tileCapacity = capacity
+    self._tileColumns = columns
+
+    -- The shadow maps were lost, and the tiles moved
+    for light in pairs(self._lightStates) do
+        self._lightStates[light] = nil
+    end
+end
+
+
+---@private
+---@return integer
+function Renderer2d:_allocateTile()
+    if #self._freeTiles == 0 then
+        self:_growAtlas(self._tileCapacity * 2)
+    end
+
+    return table.remove(self._freeTiles)
+end
+
+
+--- Area of the shadow map of a tile in the atlas, without the padding
+---@private
+---@param tile integer
+---@return number x, number y, number width, number height
+function Renderer2d:_getTileRect(tile)
+    local width, height = ceil(self.size.x / 2), ceil(self.size.y / 2)
+    local column, row = tile % self._tileColumns, floor(tile / self._tileColumns)
+
+    return column * (width + TILE_PADDING * 2) + TILE_PADDING, row * (height + TILE_PADDING * 2) + TILE_PADDING, width, height
 end
 
+
+---@private
+---@param edgeCapacity integer
+function Renderer2d:_growShadowMesh(edgeCapacity)
+    local vertexCount = edgeCapacity * 4
+    local indexType = vertexCount > 65536 and "uint32" or "uint16"
+    local indexData = love.data.newByteData(edgeCapacity * 6 * (indexType == "uint32" and 4 or 2))
+    local indices = ffi.cast(indexType == "uint32" and "uint32_t*" or "uint16_t*", indexData:getFFIPointer())
+
+    -- Two triangles per edge, between its points on the occluder (distance 0) and projected to infinity (distance 1)
+    for edge=0, edgeCapacity-1 do
+        local vertex, index = edge * 4, edge * 6
+
+        indices[index],   indices[index+1], indices[index+2] = vertex,   vertex+1, vertex+2
+        indices[index+3], indices[index+4], indices[index+5] = vertex+2, vertex+1, vertex+3
+    end
+
+    self._shadowMesh = lg.newMesh(vformat, vertexCount, "triangles", "stream")
+    self._shadowMesh:setVertexMap(indexData, indexType)
+    self._vertexData = love.data.newByteData(vertexCount * ffi.sizeof("shadow_vertex"))
+    self._vertices = ffi.cast("shadow_vertex*", self._vertexData:getFFIPointer())
+    self._edgeCapacity = edgeCapacity
+end
+
+
+--- Checks if a light must render its shadow map again
+---@private
+---@param light Light2D
+---@return boolean
+function Renderer2d:_isShadowMapValid(light)
+    local state = self._lightStates[light]
+
+    if not state or state.x ~= light.pos.x or state.y ~= light.pos.y or state.radius ~= light.radius then
+        return false
+    end
+
+    local dirty = self._dirtyBounds
+    local x, y, radius = light.pos.x, light.pos.y, light.radius
+
+    for i=1, #dirty, 4 do
+        local nearestX = min(max(x, dirty[i]),   dirty[i+2])
+        local nearestY = min(max(y, dirty[i+1]), dirty[i+3])
+
+        if (nearestX - x)^2 + (nearestY - y)^2 <= radius * radius then
+            return false
+        end
+    end
+
+    return true
+end
+
+
+-- Writes the shadow quads of the edges of an occluder facing the light, returns the new edge count
+---@private
+---@param occluder Occluder2D
+---@param light Light2D
+---@param edgeCount integer
+---@return integer
+function Renderer2d:_writeOccluderEdges(occluder, light, edgeCount)
+    local poly, culling = occluder.poly, occluder.culling
+    local ox, oy = occluder.pos.x, occluder.pos.y
+    local lx, ly = light.pos.x, light.pos.y
+    local count = #poly
+
+    if edgeCount + count > self._edgeCapacity then
+        local vertices = self._vertexData
+        self:_growShadowMesh(max(self._edgeCapacity * 2, edgeCount + count))
+        ffi.copy(self._vertices, vertices:getFFIPointer(), edgeCount * 4 * ffi.sizeof("shadow_vertex"))
+    end
+
+    local vertices = self._vertices
+
+    for i=1, count do
+        local p1, p2 = poly[i], poly[i < count and i+1 or 1]
+        local x1, y1 = ox + p1.x, oy + p1.y
+        local x2, y2 = ox + p2.x, oy + p2.y
+        local isFacing = true
+
+        -- Edge normal (rotated by +-90 degrees) against the direction from the light
+        if culling == "ccw" then
+            isFacing = (y1 - y2) * (x1 - lx) + (x2 - x1) * (y1 - ly) <= 0
+        elseif culling ~= "noCulling" then
+            isFacing = (y2 - y1) * (x1 - lx) + (x1 - x2) * (y1 - ly) <= 0
+        end
+
+        if isFacing then
+            local v = vertices + edgeCount * 4
+
+            v[0].x, v[0].y, v[0].distance = x1 / 2, y1 / 2, 0
+            v[1].x, v[1].y, v[1].distance = x1 / 2, y1 / 2, 1
+            v[2].x, v[2].y, v[2].distance = x2 / 2, y2 / 2, 0
+            v[3].x, v[3].y, v[3].distance = x2 / 2, y2 / 2, 1
+
+            edgeCount = edgeCount + 1
+        end
+    end
+
+    return edgeCount
+end
+
+
+---@private
+---@param light Light2D
+function Renderer2d:_renderShadowMap(light)
+    local stats = self.stats
+    local cellSize = self._occluderCellSize
+    local x, y, radius = light.pos.x, light.pos.y, light.radius
+    local visited = self._visited
+    local edgeCount = 0
+
+    self._query = self._query + 1
+
+    for cx=floor((x - radius) / cellSize), floor((x + radius) / cellSize) do
+        for cy=floor((y - radius) / cellSize), floor((y + radius) / cellSize) do
+            local cell = self._grid[getCellKey(cx, cy)]
+
+            if cell then
+                for occluder in pairs(cell) do
+                    if visited[occluder] ~= self._query then
+                        visited[occluder] = self._query
+
+                        local bounds = self._occluderBounds[occluder]
+                        local nearestX = min(max(x, bounds[3]), bounds[5])
+                        local nearestY = min(max(y, bounds[4]), bounds[6])
+
+                        if (nearestX - x)^2 + (nearestY - y)^2 <= radius * radius then
+                            edgeCount = self:_writeOccluderEdges(occluder, light, edgeCount)
+                            stats.occludersVisited = stats.occludersVisited + 1
+                        end
+                    end
+                end
+            end
+        end
+    end
+
+    local tileX, tileY, tileWidth, tileHeight = self:_getTileRect(light.tile)
+
+    lg.setScissor(tileX - TILE_PADDING, tileY - TILE_PADDING, tileWidth + TILE_PADDING * 2, tileHeight + TILE_PADDING * 2)
+    lg.clear(1,1,1,1)
+
+    if edgeCount > 0 then
+        local vertexBytes = edgeCount * 4 * ffi.sizeof("shadow_vertex")
+
+        self._shadowMesh:setVertices(love.data.newDataView(self._vertexData, 0, vertexBytes))
+        self._shadowMesh:setDrawRange(1, edgeCount * 6)
+
+        lg.setScissor(tileX, tileY, tileWidth, tileHeight)
+        shadowShader:send("u_lightpos", {x / 2, y / 2})
+
+        lg.push()
+        lg.origin()
+        lg.translate(tileX, tileY)
+        lg.draw(self._shadowMesh)
+        lg.pop()
+
+        stats.edgesDrawn = stats.edgesDrawn + edgeCount
+        stats.drawCalls = stats.drawCalls + 1
+    end
+
+    self._lightStates[light] = {x = x, y = y, radius = radius}
+    stats.shadowMapsRendered = stats.shadowMapsRendered + 1
+end
+
+
 function Renderer2d:_updateShadows()
+    local stats = self.stats
+    stats.shadowMapsRendered = 0
+    stats.shadowMapsSkipped = 0
+    stats.occludersVisited = 0
+    stats.edgesDrawn = 0
+    stats.drawCalls = 0
+
+    self:_updateMovedOccluders()
+
+    lg.setCanvas(self.shadowAtlas)
     lg.setShader(shadowShader)
     lg.setBlendMode("alpha", "alphamultiply")
     lg.setColor(0,0,0,1)
 
     for light in pairs(self.lights) do
-        lg.setCanvas(light.shadowMap)
-        lg.clear(1,1,1,1)
-        shadowShader:send("u_lightpos", (light.pos/2):toFlatTable())
-
-        for occluder in pairs(self.occluders) do
-            -- if Inter2d.AABB_circle(occluder.boundingMin + occluder.pos.x, occluder.boundingMax + occluder.pos.y, light.pos, light.radius) then
-                local poly = occluder.poly
-    
-                for i=1, #poly do
-                    local p1 = occluder.pos + poly[i]
-                    local p2 = occluder.pos + (i < #poly and poly[i+1] or poly[1])
-    
-                    if occluder.culling ~= "noCulling" then
-                        local normalAngle = math.rad(occluder.culling == "ccw" and 90 or -90)
-                        local segNormal = (p2 - p1):rotateBy(normalAngle)
-                        local lightDir = (p1 - light.pos)
-    
-                        if Vector2.Dot(segNormal, lightDir) > 0 then
-                            goto ignore
-                        end
-                    end
-
-                    updateVertices(p1/2, p2/2)
-    
-                    lg.draw(shadowMesh)
-    
-                    ::ignore::
-                end
-            -- end
+        if self:_isShadowMapValid(light) then
+            stats.shadowMapsSkipped = stats.shadowMapsSkipped + 1
+        else
+            self:_renderShadowMap(light)
         end
     end
+
+    lg.setScissor()
+
+    for i=#self._dirtyBounds, 1, -1 do
+        self._dirtyBounds[i] = nil
+    end
 end
 
 function Renderer2d:render(canvas)
@@ -194,17 +580,22 @@ function Renderer2d:render(canvas)
     lg.setCanvas({self.lightMap, stencil = true})
     lg.setBlendMode("add", "premultiplied")
     lg.clear(0,0,0,1)
-    
+
     -- Ambient pass
     lg.setShader()
     lg.setColor(self.ambientColor)
     lg.draw(canvas)
 
+    local atlasWidth, atlasHeight = self.shadowAtlas:getDimensions()
+
     for light in pairs(self.lights) do
+        local tileX, tileY, tileWidth, tileHeight = self:_getTileRect(light.tile)
+
         lg.setShader(lightShader)
         lightShader:send("u_lightpos", light.pos:toFlatTable())
         lightShader:send("u_radius", light.radius)
-        lightShader:send("u_shadowMap", light.shadowMap)
+        lightShader:send("u_shadowMap", self.shadowAtlas)
+        lightShader:send("u_shadowRect", {tileX / atlasWidth, tileY / atlasHeight, tileWidth / atlasWidth, tileHeight / atlasHeight})
 
         lg.setColor(light.color)
         lg.draw(canvas)
@@ -216,4 +607,4 @@ function Renderer2d:render(canvas)
     lg.setCanvas()
 end
 
-return Renderer2d
\ No newline at end of file
+return Renderer2d
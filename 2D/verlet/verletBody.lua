@@ -2,28 +2,132 @@ local Object = require "engine.3rdparty.classic.classic"
 local Vector2 = require "engine.math.vector2"
 
 -- https://pikuma.com/blog/verlet-integration-2d-cloth-physics-simulation
+--- Handle to a particle of a `VerletWorld`, which simulates it.
+---
+--- Vector properties (`position`, `prevPosition` and `force`) are new copies of the world data on every read,
+--- so changing them in place does nothing, e.g `body.position:add(v)` doesn't move the body. Assign them back,
+--- or use the number accessors (`getPosition`, `setPosition`, `applyForce`...), which don't create objects.
+---
 ---@class VerletBody: Object
 ---
----@field position Vector2
----@field prevPosition Vector2
+---@field world VerletWorld
+---@field index integer: Particle index in the world
+---@field position Vector2: Copy, see `getPosition`
+---@field prevPosition Vector2: Copy, see `getPrevPosition`
 ---@field mass number
+---@field force Vector2: Copy, see `getForce`. Applied every substep until changed
+---@field radius number: Collision radius, 0 to disable collisions
+---@field pinned boolean
 ---
----@overload fun(pos: Vector2, mass: number): VerletBody
+---@overload fun(world: VerletWorld, pos: Vector2, mass: number, radius: number?): VerletBody
 local VerletBody = Object:extend("VerletBody")
 
-function VerletBody:new(pos, mass)
-    self.position = pos
-    self.prevPosition = pos
-    self.mass = mass
-    self.force = Vector2()
+function VerletBody:new(world, pos, mass, radius)
+    rawset(self, "world", world)
+    rawset(self, "index", world:addParticle(pos.x, pos.y, mass, radius))
+end
+
+
+---@return number x, number y
+function VerletBody:getPosition()
+    return self.world:getPosition(self.index)
+end
+
+
+--- Moves the body. Its velocity is kept unless `resetVelocity` is set
+---@param x number
+---@param y number
+---@param resetVelocity boolean?
+function VerletBody:setPosition(x, y, resetVelocity)
+    self.world:setPosition(self.index, x, y, resetVelocity)
 end
 
-function VerletBody:update(dt)
-    local acc = self.force / self.mass
-    local prevPos = self.position
 
-    self.position = 2 * self.position - self.prevPosition + acc * dt*dt
-    self.prevPosition = prevPos
+---@return number x, number y
+function VerletBody:getPrevPosition()
+    local world, index = self.world, self.index
+    return world.prevX[index], world.prevY[index]
+end
+
+
+---@param x number
+---@param y number
+function VerletBody:setPrevPosition(x, y)
+    local world, index = self.world, self.index
+    world.prevX[index], world.prevY[index] = x, y
+end
+
+
+---@return number x, number y
+function VerletBody:getForce()
+    local world, index = self.world, self.index
+    return world.forceX[index], world.forceY[index]
+end
+
+
+---@param x number
+---@param y number
+function VerletBody:setForce(x, y)
+    local world, index = self.world, self.index
+    world.forceX[index], world.forceY[index] = x, y
+end
+
+
+--- Adds to the force applied every substep
+---@param x number
+---@param y number
+function VerletBody:applyForce(x, y)
+    local world, index = self.world, self.index
+    world.forceX[index], world.forceY[index] = world.forceX[index] + x, world.forceY[index] + y
+end
+
+
+---@private
+function VerletBody:__index(k)
+    local world, index = rawget(self, "world"), rawget(self, "index")
+
+    if k == "position" then
+        return Vector2(world.positionX[index], world.positionY[index])
+    end
+    if k == "prevPosition" then
+        return Vector2(world.prevX[index], world.prevY[index])
+    end
+    if k == "force" then
+        return Vector2(world.forceX[index], world.forceY[index])
+    end
+    if k == "mass" then
+        return world.mass[index]
+    end
+    if k == "radius" then
+        return world.radius[index]
+    end
+    if k == "pinned" then
+        return world:isPinned(index)
+    end
+
+    return VerletBody[k]
+end
+
+
+---@private
+function VerletBody:__newindex(k, v)
+    local world, index = self.world, self.index
+
+    if k == "position" then
+        world.positionX[index], world.positionY[index] = v.x, v.y
+    elseif k == "prevPosition" then
+        world.prevX[index], world.prevY[index] = v.x, v.y
+    elseif k == "force" then
+        world.forceX[index], world.forceY[index] = v.x, v.y
+    elseif k == "mass" then
+        world:setMass(index, v)
+    elseif k == "radius" then
+        world:setRadius(index, v)
+    elseif k == "pinned" then
+        if v then world:pin(index) else world:unpin(index) end
+    else
+        rawset(self, k, v)
+    end
 end
 
-return VerletBody
\ No newline at end of file
+return VerletBody
@@ -1,29 +1,75 @@
 local Object = require "engine.3rdparty.classic.classic"
 
 
+--- Handle to a distance constraint of a `VerletWorld`, which solves it.
+---
 ---@class VerletConstraint: Object
 ---
+---@field world VerletWorld
+---@field id integer: Constraint id in the world
 ---@field body1 VerletBody
 ---@field body2 VerletBody
----@field distance number
+---@field distance number: Rest length
+---@field stiffness number: 0 to 1
+---@field tearFactor number: Stretch ratio that tears the constraint, 0 if it never tears
+---@field isTorn boolean: Whether the constraint was torn or removed
 ---
----@overload fun(): VerletConstraint
+---@overload fun(world: VerletWorld, b1: VerletBody, b2: VerletBody, dist: number?, stiffness: number?, tearFactor: number?): VerletConstraint
 local VerletConstraint = Object:extend("VerletConstraint")
 
-function VerletConstraint:new(b1, b2, dist)
-    self.body1 = b1
-    self.body2 = b2
-    self.distance = dist or (b1.position - b2.position).length
+function VerletConstraint:new(world, b1, b2, dist, stiffness, tearFactor)
+    rawset(self, "world", world)
+    rawset(self, "body1", b1)
+    rawset(self, "body2", b2)
+    rawset(self, "id", world:addConstraint(b1.index, b2.index, dist, stiffness, tearFactor))
+end
+
+
+function VerletConstraint:remove()
+    if self.world:hasConstraint(self.id) then
+        self.world:removeConstraint(self.id)
+    end
+end
+
+
+---@private
+function VerletConstraint:__index(k)
+    local world = rawget(self, "world")
+    local slot = world and world:getConstraintSlot(rawget(self, "id"))
+
+    if k == "isTorn" then
+        return slot == nil
+    end
+    if slot then
+        if k == "distance" then
+            return world.restLength[slot]
+        end
+        if k == "stiffness" then
+            return world.stiffness[slot]
+        end
+        if k == "tearFactor" then
+            return world.tearFactor[slot]
+        end
+    end
+
+    return VerletConstraint[k]
 end
 
-function VerletConstraint:update(dt)
-    local diff = self.body1.position - self.body2.position
-    local diffLen = diff.length
-    local diffFactor = (self.distance - diffLen) / diffLen
-    local offset = diff * diffFactor*0.5
 
-    self.body1.position:add(offset)
-    self.body2.position:subtract(offset)
+---@private
+function VerletConstraint:__newindex(k, v)
+    local world = self.world
+    local slot = world:getConstraintSlot(self.id)
+
+    if k == "distance" then
+        world.restLength[assert(slot, "Constraint was removed")] = v
+    elseif k == "stiffness" then
+        world:setStiffness(self.id, v)
+    elseif k == "tearFactor" then
+        world.tearFactor[assert(slot, "Constraint was removed")] = v
+    else
+        rawset(self, k, v)
+    end
 end
 
-return VerletConstraint
\ No newline at end of file
+return VerletConstraint
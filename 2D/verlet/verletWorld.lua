@@ -0,0 +1,829 @@
+local Object  = require "engine.3rdparty.classic.classic"
+local Event   = require "engine.misc.event"
+local Vector2 = require "engine.math.vector2"
+local ffi     = require "ffi"
+local bit     = require "bit"
+local floor, sqrt, max, min = math.floor, math.sqrt, math.max, math.min
+local band, bxor = bit.band, bit.bxor
+
+
+--- @alias VerletWorldStats {steps: integer, pairTests: integer, particleContacts: integer, segmentContacts: integer, torn: integer}
+
+
+local PARTICLE_FIELDS = {"positionX", "positionY", "prevX", "prevY", "forceX", "forceY", "mass", "invMass", "radius"}
+local CONSTRAINT_FIELDS = {"restLength", "stiffness", "tearFactor", "_iterationStiffness"}
+local SEGMENT_FIELDS = {"segmentX1", "segmentY1", "segmentX2", "segmentY2"}
+
+
+---
+--- Verlet physics world with all its data stored in FFI arrays (one per field), so the whole simulation runs in
+--- tight loops without creating objects. `VerletBody` and `VerletConstraint` are handles to its particles and constraints.
+---
+--- `update` advances the simulation in fixed steps, each split into `substeps`. Every substep integrates the particles,
+--- relaxes the distance constraints `iterations` times and solves collisions, found with a uniform spatial hash:
+--- - Between particles, if `particleCollisions` is enabled
+--- - Between particles and static segments (`addSegment`), e.g level geometry
+---
+--- Particles and constraints are referenced by index (0-based) and id respectively. A particle with `radius` 0 doesn't collide.
+--- Pinned particles have an inverse mass of 0, so they don't move unless they're moved directly.
+--- Constraints stretched beyond `restLength * tearFactor` by the integration are torn (removed).
+--- ```lua
+--- local world = VerletWorld()
+--- world.gravity = Vector2(0, 980)
+---
+--- local a = world:addParticle(0, 0, 1)
+--- local b = world:addParticle(10, 0, 1)
+--- world:pin(a)
+--- world:addConstraint(a, b, nil, 1, 2)
+---
+--- world:update(dt)
+--- ```
+---
+--- @class VerletWorld: Object
+---
+--- @field public gravity Vector2
+--- @field public damping number: Fraction of the velocity kept after each substep
+--- @field public timestep number: Duration of a step
+--- @field public substeps integer
+--- @field public iterations integer: Constraint relaxation passes per substep
+--- @field public maxSteps integer: Steps per `update`, remaining time is dropped
+--- @field public particleCollisions boolean
+--- @field public cellSize number?: Size of the spatial hash cells, at least the largest particle diameter. Automatic if `nil`
+--- @field public particleCount integer
+--- @field public constraintCount integer
+--- @field public segmentCount integer
+--- @field public positionX ffi.cdata*
+--- @field public positionY ffi.cdata*
+--- @field public prevX ffi.cdata*: Position in the previous substep
+--- @field public prevY ffi.cdata*
+--- @field public forceX ffi.cdata*: Force applied in every substep
+--- @field public forceY ffi.cdata*
+--- @field public mass ffi.cdata*
+--- @field public invMass ffi.cdata*: 0 for pinned particles
+--- @field public radius ffi.cdata*
+--- @field public constraintA ffi.cdata*: Particle index
+--- @field public constraintB ffi.cdata*
+--- @field public restLength ffi.cdata*
+--- @field public stiffness ffi.cdata*: 0 to 1
+--- @field public tearFactor ffi.cdata*: 0 for constraints that never tear
+--- @field public segmentX1 ffi.cdata*
+--- @field public segmentY1 ffi.cdata*
+--- @field public segmentX2 ffi.cdata*
+--- @field public segmentY2 ffi.cdata*
+--- @field public onConstraintTornEvent Event: Triggered with the id and the particles of each torn constraint, before removing it
+--- @field public stats VerletWorldStats: Counters of the last update
+--- @field private _particleCapacity integer
+--- @field private _constraintCapacity integer
+--- @field private _segmentCapacity integer
+--- @field private _iterationStiffness ffi.cdata*: Stiffness of a single relaxation pass
+--- @field private _stiffnessIterations integer: `iterations` used for `_iterationStiffness`
+--- @field private _constraintIds ffi.cdata*: Id of the constraint in each slot
+--- @field private _constraintSlots table<integer, integer>: Slot of each constraint id
+--- @field private _nextId integer
+--- @field private _maxRadius number
+--- @field private _accumulator number
+--- @field private _hashSize integer
+--- @field private _hashStarts ffi.cdata*
+--- @field private _hashEntries ffi.cdata*
+--- @field private _particleBuckets ffi.cdata*
+--- @field private _cellX ffi.cdata*: Hash cell of each particle
+--- @field private _cellY ffi.cdata*
+--- @field private _segmentHashSize integer
+--- @field private _segmentStarts ffi.cdata*
+--- @field private _segmentEntries ffi.cdata*
+--- @field private _segmentCellSize number: Cell size used by the segment hash, 0 if it must be rebuilt
+---
+--- @overload fun(): VerletWorld
+local VerletWorld = Object:extend("VerletWorld")
+
+
+function VerletWorld:new()
+    self.gravity = Vector2(0, 0)
+    self.damping = 0.999
+    self.timestep = 1 / 60
+    self.substeps = 2
+    self.iterations = 8
+    self.maxSteps = 4
+    self.particleCollisions = false
+    self.cellSize = nil
+
+    self.particleCount = 0
+    self.constraintCount = 0
+    self.segmentCount = 0
+    self.onConstraintTornEvent = Event()
+
+    self.stats = {
+        steps = 0,            -- Fixed steps simulated
+        pairTests = 0,        -- Particle pairs tested for collision
+        particleContacts = 0, -- Colliding particle pairs
+        segmentContacts = 0,  -- Particles pushed out of segments
+        torn = 0,             -- Constraints torn
+    }
+
+    self._particleCapacity = 0
+    self._constraintCapacity = 0
+    self._segmentCapacity = 0
+    self._stiffnessIterations = 0
+    self._constraintSlots = {}
+    self._nextId = 1
+    self._maxRadius = 0
+    self._accumulator = 0
+    self._hashSize = 0
+    self._segmentHashSize = 0
+    self._segmentCellSize = 0
+
+    self:_growParticles(64)
+    self:_growConstraints(64)
+    self:_growSegments(8)
+end
+
+
+-- Reallocates FFI arrays, keeping the first `count` elements
+---@param self table
+---@param fields string[]
+---@param ctype string
+---@param count integer
+---@param capacity integer
+local function growArrays(self, fields, ctype, count, capacity)
+    for _, field in ipairs(fields) do
+        local old = self[field]
+        local new = ffi.new(ctype.."[?]", capacity)
+
+        if old then
+            ffi.copy(new, old, count * ffi.sizeof(ctype))
+        end
+
+        self[field] = new
+    end
+end
+
+
+---@private
+---@param capacity integer
+function VerletWorld:_growParticles(capacity)
+    growArrays(self, PARTICLE_FIELDS, "double", self.particleCount, capacity)
+    growArrays(self, {"_particleBuckets", "_hashEntries", "_cellX", "_cellY"}, "int32_t", 0, capacity)
+    self._particleCapacity = capacity
+end
+
+
+---@private
+---@param capacity integer
+function VerletWorld:_growConstraints(capacity)
+    growArrays(self, CONSTRAINT_FIELDS, "double", self.constraintCount, capacity)
+    growArrays(self, {"constraintA", "constraintB", "_constraintIds"}, "int32_t", self.constraintCount, capacity)
+    self._constraintCapacity = capacity
+end
+
+
+---@private
+---@param capacity integer
+function VerletWorld:_growSegments(capacity)
+    growArrays(self, SEGMENT_FIELDS, "double", self.segmentCount, capacity)
+    self._segmentCapacity = capacity
+end
+
+
+
+--- Adds a particle at rest
+---@param x number
+---@param y number
+---@param mass number?: 1 by default
+---@param radius number?: Collision radius, 0 by default (no collisions)
+---@return integer index
+function VerletWorld:addParticle(x, y, mass, radius)
+    local index = self.particleCount
+
+    if index >= self._particleCapacity then
+        self:_growParticles(self._particleCapacity * 2)
+    end
+
+    mass = mass or 1
+    radius = radius or 0
+
+    self.positionX[index], self.positionY[index] = x, y
+    self.prevX[index], self.prevY[index] = x, y
+    self.forceX[index], self.forceY[index] = 0, 0
+    self.mass[index] = mass
+    self.invMass[index] = 1 / mass
+    self.radius[index] = radius
+
+    self.particleCount = index + 1
+    self:_updateMaxRadius(radius)
+
+    return index
+end
+
+
+---@private
+---@param radius number
+function VerletWorld:_updateMaxRadius(radius)
+    if radius > self._maxRadius then
+        self._maxRadius = radius
+        self._segmentCellSize = 0
+    end
+end
+
+
+--- Moves a particle. Its velocity is kept unless `resetVelocity` is set
+---@param index integer
+---@param x number
+---@param y number
+---@param resetVelocity boolean?
+function VerletWorld:setPosition(index, x, y, resetVelocity)
+    if resetVelocity then
+        self.prevX[index], self.prevY[index] = x, y
+    else
+        self.prevX[index] = self.prevX[index] + x - self.positionX[index]
+        self.prevY[index] = self.prevY[index] + y - self.positionY[index]
+    end
+
+    self.positionX[index], self.positionY[index] = x, y
+end
+
+
+---@param index integer
+---@return number x, number y
+function VerletWorld:getPosition(index)
+    return self.positionX[index], self.positionY[index]
+end
+
+
+---@param index integer
+---@param mass number
+function VerletWorld:setMass(index, mass)
+    self.mass[index] = mass
+
+    if self.invMass[index] ~= 0 then
+        self.invMass[index] = 1 / mass
+    end
+end
+
+
+---@param index integer
+---@param radius number
+function VerletWorld:setRadius(index, radius)
+    self.radius[index] = radius
+    self:_updateMaxRadius(radius)
+end
+
+
+--- Fixes a particle in place, optionally moving it first
+---@param index integer
+---@param x number?
+---@param y number?
+function VerletWorld:pin(index, x, y)
+    self.invMass[index] = 0
+
+    if x then
+        self:setPosition(index, x, y, true)
+    else
+        self.prevX[index], self.prevY[index] = self.positionX[index], self.positionY[index]
+    end
+end
+
+
+---@param index integer
+function VerletWorld:unpin(index)
+    self.invMass[index] = 1 / self.mass[index]
+end
+
+
+---@param index integer
+---@return boolean
+function VerletWorld:isPinned(index)
+    return self.invMass[index] == 0
+end
+
+
+
+--- Adds a distance constraint between two particles
+---@param a integer: Particle index
+---@param b integer
+---@param restLength number?: Current distance between the particles by default
+---@param stiffness number?: 1 by default
+---@param tearFactor number?: Stretch ratio that tears the constraint, 0 (never) by default
+---@return integer id
+function VerletWorld:addConstraint(a, b, restLength, stiffness, tearFactor)
+    local slot = self.constraintCount
+
+    if slot >= self._constraintCapacity then
+        self:_growConstraints(self._constraintCapacity * 2)
+    end
+
+    if not restLength then
+        local dx, dy = self.positionX[a] - self.positionX[b], self.positionY[a] - self.positionY[b]
+        restLength = sqrt(dx*dx + dy*dy)
+    end
+
+    -- Ids are never reused, so handles of removed constraints stay invalid
+    local id = self._nextId
+    self._nextId = id + 1
+
+    self.constraintA[slot], self.constraintB[slot] = a, b
+    self.restLength[slot] = restLength
+    self.tearFactor[slot] = tearFactor or 0
+    self._constraintIds[slot] = id
+    self._constraintSlots[id] = slot
+    self.constraintCount = slot + 1
+
+    self:setStiffness(id, stiffness or 1)
+
+    return id
+end
+
+
+--- Removes a constraint, moving the last one into its slot
+---@param id integer
+function VerletWorld:removeConstraint(id)
+    local slot = assert(self._constraintSlots[id], "Constraint does not exist")
+    local last = self.constraintCount - 1
+
+    if slot ~= last then
+        local movedId = self._constraintIds[last]
+
+        self.constraintA[slot], self.constraintB[slot] = self.constraintA[last], self.constraintB[last]
+        self.restLength[slot] = self.restLength[last]
+        self.stiffness[slot] = self.stiffness[last]
+        self.tearFactor[slot] = self.tearFactor[last]
+        self._iterationStiffness[slot] = self._iterationStiffness[last]
+        self._constraintIds[slot] = movedId
+        self._constraintSlots[movedId] = slot
+    end
+
+    self._constraintSlots[id] = nil
+    self.constraintCount = last
+end
+
+
+---@param id integer
+---@return boolean
+function VerletWorld:hasConstraint(id)
+    return self._constraintSlots[id] ~= nil
+end
+
+
+--- Slot of a constraint in the constraint arrays. Changes when other constraints are removed
+---@param id integer
+---@return integer?
+function VerletWorld:getConstraintSlot(id)
+    return self._constraintSlots[id]
+end
+
+
+---@param id integer
+---@param stiffness number: 0 to 1
+function VerletWorld:setStiffness(id, stiffness)
+    local slot = self._constraintSlots[id]
+
+    self.stiffness[slot] = stiffness
+    self._iterationStiffness[slot] = 1 - (1 - stiffness) ^ (1 / max(self._stiffnessIterations, 1))
+end
+
+
+-- Stiffness applied by each relaxation pass, so the stiffness of the constraint doesn't depend on the number of iterations
+---@private
+function VerletWorld:_updateIterationStiffness()
+    local iterations = max(self.iterations, 1)
+
+    for slot=0, self.constraintCount-1 do
+        self._iterationStiffness[slot] = 1 - (1 - self.stiffness[slot]) ^ (1 / iterations)
+    end
+
+    self._stiffnessIterations = iterations
+end
+
+
+
+--- Adds a static segment that particles collide with
+---@param x1 number
+---@param y1 number
+---@param x2 number
+---@param y2 number
+---@return integer index
+function VerletWorld:addSegment(x1, y1, x2, y2)
+    local index = self.segmentCount
+
+    if index >= self._segmentCapacity then
+        self:_growSegments(self._segmentCapacity * 2)
+    end
+
+    self.segmentX1[index], self.segmentY1[index] = x1, y1
+    self.segmentX2[index], self.segmentY2[index] = x2, y2
+    self.segmentCount = index + 1
+    self._segmentCellSize = 0
+
+    return index
+end
+
+
+function VerletWorld:clearSegments()
+    self.segmentCount = 0
+    self._segmentCellSize = 0
+end
+
+
+--- Removes all particles, constraints and segments
+function VerletWorld:clear()
+    self.particleCount = 0
+    self.constraintCount = 0
+    self._constraintSlots = {}
+    self._maxRadius = 0
+    self._accumulator = 0
+    self:clearSegments()
+end
+
+
+
+---@param cx integer
+---@param cy integer
+---@param mask integer
+---@return integer
+local function hashCell(cx, cy, mask)
+    return band(bxor(cx * 92837111, cy * 689287499), mask)
+end
+
+
+---@param count integer
+---@return integer
+local function getHashSize(count)
+    local size = 64
+
+    while size < count * 2 do
+        size = size * 2
+    end
+
+    return size
+end
+
+
+---@private
+---@return number
+function VerletWorld:_getCellSize()
+    return max(self.cellSize or 0, self._maxRadius * 2, 1e-6)
+end
+
+
+-- Sorts the colliding particles by hash bucket (counting sort), the particles of a bucket are
+-- `_hashEntries[_hashStarts[bucket]]` to `_hashEntries[_hashStarts[bucket+1]-1]`
+---@private
+---@param cellSize number
+function VerletWorld:_buildParticleHash(cellSize)
+    local count = self.particleCount
+    local size = getHashSize(count)
+
+    if size ~= self._hashSize then
+        self._hashStarts = ffi.new("int32_t[?]", size + 1)
+        self._hashSize = size
+    end
+
+    local starts, entries, buckets = self._hashStarts, self._hashEntries, self._particleBuckets
+    local cellX, cellY = self._cellX, self._cellY
+    local posX, posY, radius = self.positionX, self.positionY, self.radius
+    local mask = size - 1
+
+    ffi.fill(starts, (size + 1) * 4)
+
+    for i=0, count-1 do
+        if radius[i] > 0 then
+            local x, y = floor(posX[i] / cellSize), floor(posY[i] / cellSize)
+            local bucket = hashCell(x, y, mask)
+
+            cellX[i], cellY[i] = x, y
+            buckets[i] = bucket
+            starts[bucket] = starts[bucket] + 1
+        else
+            buckets[i] = -1
+        end
+    end
+
+    -- End of each bucket, then moved back to its start while filling it
+    for bucket=1, size do
+        starts[bucket] = starts[bucket] + starts[bucket-1]
+    end
+
+    for i=count-1, 0, -1 do
+        local bucket = buckets[i]
+
+        if bucket >= 0 then
+            starts[bucket] = starts[bucket] - 1
+            entries[starts[bucket]] = i
+        end
+    end
+end
+
+
+-- Hashes the segments in every cell they touch, with the cells extended by the largest particle radius,
+-- so a particle only needs to check the segments of its own cell
+---@private
+---@param cellSize number
+function VerletWorld:_buildSegmentHash(cellSize)
+    local reach = self._maxRadius
+    local cells = {} ---@type integer[]
+    local ranges = {} ---@type integer[]
+
+    for s=0, self.segmentCount-1 do
+        local x1, y1, x2, y2 = self.segmentX1[s], self.segmentY1[s], self.segmentX2[s], self.segmentY2[s]
+        local minX, maxX = floor((min(x1, x2) - reach) / cellSize), floor((max(x1, x2) + reach) / cellSize)
+        local minY, maxY = floor((min(y1, y2) - reach) / cellSize), floor((max(y1, y2) + reach) / cellSize)
+
+        ranges[#ranges+1] = minX
+        ranges[#ranges+1] = maxX
+        ranges[#ranges+1] = minY
+        ranges[#ranges+1] = maxY
+        cells[#cells+1] = (maxX - minX + 1) * (maxY - minY + 1)
+    end
+
+    local total = 0
+    for s=1, #cells do
+        total = total + cells[s]
+    end
+
+    local size = getHashSize(total)
+    local mask = size - 1
+    local starts = ffi.new("int32_t[?]", size + 1)
+    local entries = ffi.new("int32_t[?]", max(total, 1))
+
+    -- Same counting sort as the particles
+    for pass=1, 2 do
+        for s=0, self.segmentCount-1 do
+            local minX, maxX, minY, maxY = ranges[s*4+1], ranges[s*4+2], ranges[s*4+3], ranges[s*4+4]
+
+            for cx=minX, maxX do
+                for cy=minY, maxY do
+                    local bucket = hashCell(cx, cy, mask)
+
+                    if pass == 1 then
+                        starts[bucket] = starts[bucket] + 1
+                    else
+                        starts[bucket] = starts[bucket] - 1
+                        entries[starts[bucket]] = s
+                    end
+                end
+            end
+        end
+
+        if pass == 1 then
+            for bucket=1, size do
+                starts[bucket] = starts[bucket] + starts[bucket-1]
+            end
+        end
+    end
+
+    self._segmentStarts = starts
+    self._segmentEntries = entries
+    self._segmentHashSize = size
+    self._segmentCellSize = cellSize
+end
+
+
+
+---@private
+---@param dt number
+function VerletWorld:_integrate(dt)
+    local posX, posY, prevX, prevY = self.positionX, self.positionY, self.prevX, self.prevY
+    local forceX, forceY, invMass = self.forceX, self.forceY, self.invMass
+    local gravityX, gravityY = self.gravity.x * dt*dt, self.gravity.y * dt*dt
+    local damping, dt2 = self.damping, dt*dt
+
+    for i=0, self.particleCount-1 do
+        local w = invMass[i]
+
+        if w > 0 then
+            local x, y = posX[i], posY[i]
+
+            posX[i] = x + (x - prevX[i]) * damping + gravityX + forceX[i] * w * dt2
+            posY[i] = y + (y - prevY[i]) * damping + gravityY + forceY[i] * w * dt2
+            prevX[i], prevY[i] = x, y
+        end
+    end
+end
+
+
+-- Relaxes the constraints. Constraints stretched beyond their tear length by the integration are
+-- stopped and added to `torn`, they're removed after the relaxation
+---@private
+---@param torn integer[]
+function VerletWorld:_solveConstraints(torn)
+    local posX, posY, invMass = self.positionX, self.positionY, self.invMass
+    local constraintA, constraintB = self.constraintA, self.constraintB
+    local restLength, stiffness, tearFactor = self.restLength, self._iterationStiffness, self.tearFactor
+    local count = self.constraintCount
+
+    for iteration=1, self.iterations do
+        for c=0, count-1 do
+            local a, b = constraintA[c], constraintB[c]
+            local wa, wb = invMass[a], invMass[b]
+            local dx, dy = posX[a] - posX[b], posY[a] - posY[b]
+            local length = sqrt(dx*dx + dy*dy)
+
+            if iteration == 1 and tearFactor[c] > 0 and length > restLength[c] * tearFactor[c] then
+                torn[#torn+1] = c
+                stiffness[c] = 0
+            end
+
+            if length > 0 and wa + wb > 0 then
+                local factor = (length - restLength[c]) / (length * (wa + wb)) * stiffness[c]
+                local fx, fy = dx * factor, dy * factor
+
+                posX[a], posY[a] = posX[a] - fx * wa, posY[a] - fy * wa
+                posX[b], posY[b] = posX[b] + fx * wb, posY[b] + fy * wb
+            end
+        end
+    end
+end
+
+
+---@private
+---@param cellSize number
+function VerletWorld:_solveParticleCollisions(cellSize)
+    self:_buildParticleHash(cellSize)
+
+    local stats = self.stats
+    local posX, posY, invMass, radius = self.positionX, self.positionY, self.invMass, self.radius
+    local starts, entries = self._hashStarts, self._hashEntries
+    local cellX, cellY = self._cellX, self._cellY
+    local mask = self._hashSize - 1
+    local tests, contacts = 0, 0
+
+    for i=0, self.particleCount-1 do
+        local ri = radius[i]
+
+        if ri > 0 then
+            local cx, cy = cellX[i], cellY[i]
+
+            for cell=0, 8 do
+                local x, y = cx + cell % 3 - 1, cy + floor(cell / 3) - 1
+                local bucket = hashCell(x, y, mask)
+
+                -- Entries of other cells that share the bucket are skipped, so each pair is tested
+                -- once (from its lowest index) even if two neighbor cells share a bucket
+                for e=starts[bucket], starts[bucket+1]-1 do
+                    local j = entries[e]
+
+                    if j > i and cellX[j] == x and cellY[j] == y then
+                        local dx, dy = posX[i] - posX[j], posY[i] - posY[j]
+                        local distanceSq = dx*dx + dy*dy
+                        local minDistance = ri + radius[j]
+                        tests = tests + 1
+
+                        if distanceSq < minDistance * minDistance and distanceSq > 0 then
+                            local wi, wj = invMass[i], invMass[j]
+
+                            if wi + wj > 0 then
+                                local distance = sqrt(distanceSq)
+                                local factor = (minDistance - distance) / (distance * (wi + wj))
+                                local fx, fy = dx * factor, dy * factor
+
+                                posX[i], posY[i] = posX[i] + fx * wi, posY[i] + fy * wi
+                                posX[j], posY[j] = posX[j] - fx * wj, posY[j] - fy * wj
+                                contacts = contacts + 1
+                            end
+                        end
+                    end
+                end
+            end
+        end
+    end
+
+    stats.pairTests = stats.pairTests + tests
+    stats.particleContacts = stats.particleContacts + contacts
+end
+
+
+---@private
+---@param cellSize number
+function VerletWorld:_solveSegmentCollisions(cellSize)
+    if self._segmentCellSize ~= cellSize then
+        self:_buildSegmentHash(cellSize)
+    end
+
+    local posX, posY, invMass, radius = self.positionX, self.positionY, self.invMass, self.radius
+    local x1s, y1s, x2s, y2s = self.segmentX1, self.segmentY1, self.segmentX2, self.segmentY2
+    local starts, entries = self._segmentStarts, self._segmentEntries
+    local mask = self._segmentHashSize - 1
+    local contacts = 0
+
+    for i=0, self.particleCount-1 do
+        local r = radius[i]
+
+        if r > 0 and invMass[i] > 0 then
+            local bucket = hashCell(floor(posX[i] / cellSize), floor(posY[i] / cellSize), mask)
+
+            for e=starts[bucket], starts[bucket+1]-1 do
+                local s = entries[e]
+                local x, y = posX[i], posY[i]
+                local x1, y1 = x1s[s], y1s[s]
+                local sx, sy = x2s[s] - x1, y2s[s] - y1
+                local lengthSq = sx*sx + sy*sy
+                local t = lengthSq > 0 and max(0, min(1, ((x - x1) * sx + (y - y1) * sy) / lengthSq)) or 0
+                local dx, dy = x - (x1 + sx * t), y - (y1 + sy * t)
+                local distanceSq = dx*dx + dy*dy
+
+                if distanceSq < r*r then
+                    local distance = sqrt(distanceSq)
+
+                    if distance > 0 then
+                        dx, dy = dx / distance, dy / distance
+                    elseif lengthSq > 0 then
+                        -- Exactly on the segment, pushed along its normal
+                        local length = sqrt(lengthSq)
+                        dx, dy = -sy / length, sx / length
+                    end
+
+                    posX[i], posY[i] = x + dx * (r - distance), y + dy * (r - distance)
+                    contacts = contacts + 1
+                end
+            end
+        end
+    end
+
+    self.stats.segmentContacts = self.stats.segmentContacts + contacts
+end
+
+
+---@private
+---@param torn integer[]: Slots of the torn constraints, in increasing order
+function VerletWorld:_tearConstraints(torn)
+    local ids = {}
+
+    -- Removing a constraint moves the last one, so the slots are converted to ids first
+    for i, slot in ipairs(torn) do
+        ids[i] = self._constraintIds[slot]
+        torn[i] = nil
+    end
+
+    for _, id in ipairs(ids) do
+        local slot = self._constraintSlots[id]
+
+        self.onConstraintTornEvent:trigger(id, self.constraintA[slot], self.constraintB[slot])
+        self:removeConstraint(id)
+    end
+
+    self.stats.torn = self.stats.torn + #ids
+end
+
+
+
+local tornConstraints = {}
+
+--- Simulates a single step of `dt` seconds, ignoring `timestep`
+---@param dt number
+function VerletWorld:step(dt)
+    if self._stiffnessIterations ~= max(self.iterations, 1) then
+        self:_updateIterationStiffness()
+    end
+
+    local substepDt = dt / self.substeps
+    local cellSize = self:_getCellSize()
+    local hasParticleCollisions = self.particleCollisions and self._maxRadius > 0
+    local hasSegmentCollisions = self.segmentCount > 0 and self._maxRadius > 0
+
+    for _=1, self.substeps do
+        self:_integrate(substepDt)
+        self:_solveConstraints(tornConstraints)
+
+        if #tornConstraints > 0 then
+            self:_tearConstraints(tornConstraints)
+        end
+
+        if hasParticleCollisions then
+            self:_solveParticleCollisions(cellSize)
+        end
+
+        if hasSegmentCollisions then
+            self:_solveSegmentCollisions(cellSize)
+        end
+    end
+
+    self.stats.steps = self.stats.steps + 1
+end
+
+
+--- Advances the simulation by `dt` seconds in steps of `timestep`. Time that doesn't fill a step is kept for the next update
+---@param dt number
+function VerletWorld:update(dt)
+    local stats = self.stats
+    stats.steps = 0
+    stats.pairTests = 0
+    stats.particleContacts = 0
+    stats.segmentContacts = 0
+    stats.torn = 0
+
+    self._accumulator = self._accumulator + dt
+
+    local steps = 0
+    while self._accumulator >= self.timestep and steps < self.maxSteps do
+        self:step(self.timestep)
+        self._accumulator = self._accumulator - self.timestep
+        steps = steps + 1
+    end
+
+    -- Too far behind, the remaining time is dropped instead of slowing down the next frames
+    if steps == self.maxSteps then
+        self._accumulator = min(self._accumulator, self.timestep)
+    end
+end
+
+
+return VerletWorld
@@ -96,9 +96,11 @@ end
 ---@param envMap love.Texture
 function IrradianceVolume:bakeFromEnvironmentMap(envMap)
     local irrMap = CubemapUtils.getIrradianceMap(envMap, Vector2(envMap:getPixelDimensions()))
+    local sh = SH9Color.CreateFromCubeMap(irrMap)
 
+    -- Every probe sees the same environment
     self:mapProbes(function(probe, index)
-        return SH9Color.CreateFromCubeMap(irrMap)
+        return SH9Color():add(sh)
     end)
 end
 
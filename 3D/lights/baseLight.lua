@@ -1,7 +1,18 @@
 local Object        = require "engine.3rdparty.classic.classic"
 local ShaderEffect  = require "engine.misc.shaderEffect"
+local tableclear    = require "table.clear"
 
-local shadowMapRendererShader = ShaderEffect("engine/shaders/3D/defaultVertexShader.vert", "engine/shaders/3D/shadowMapRenderer.frag", {CURRENT_RENDER_PASS = "RENDER_PASS_SHADOWMAPPING"})
+local shadowMapRendererShader = ShaderEffect("engine/shaders/3D/defaultVertexShader.vert", "engine/shaders/3D/shadowMapRenderer.frag", {CURRENT_RENDER_PASS = "RENDER_PASS_SHADOWMAPPING", MESH_INSTANCING = true})
+local shadowMapCopyShader = ShaderEffect("engine/shaders/3D/shadowMapCopy.glsl")
+
+local batches = setmetatable({}, {__mode = "k"}) ---@type table<MeshPart, Matrix4[][]>: Instances of each level of detail
+local batchedParts = {} ---@type MeshPart[]
+local batchedLods = {} ---@type integer[]
+local singleMatrix = {}
+local staticCasters = {} ---@type MeshPartConfig[]
+local dynamicCasters = {} ---@type MeshPartConfig[]
+local casterLists = {staticCasters, dynamicCasters}
+local copyCanvasTable = {depthstencil = {}}
 
 
 ---@alias LightTypeDefinition
@@ -12,13 +23,24 @@ local shadowMapRendererShader = ShaderEffect("engine/shaders/3D/defaultVertexSha
 
 
 
+--- Shadow maps are cached: static casters are rendered into a cache that is only updated when the light
+--- parameters change, or when a static caster enters, leaves or moves inside the light volume. Dynamic
+--- casters are drawn on top of a copy of the cache, and only while there are any of them in the volume.
+---
 --- @class BaseLight: Object
 ---
 --- @field public shadowMap love.Texture
 --- @field public typeDefinition LightTypeDefinition
 --- @field public enabled boolean
 --- @field public castShadows boolean
---- @field public isStatic boolean
+--- @field public isStatic boolean: Only static mesh parts cast shadows
+--- @field public framesSinceShadowUpdate integer
+--- @field private _staticShadowMap love.Texture?: Static casters cache, only created once a dynamic caster is found
+--- @field private _isShadowCacheDirty boolean
+--- @field private _hasDynamicCasters boolean: Whether dynamic casters were drawn in the last update
+--- @field private _staticCasters table<MeshPartConfig, boolean>: Static casters of the cache
+--- @field private _staticCasterCount integer
+--- @field private _shadowParameters number[]: Light parameters used to render the cache
 ---
 --- @overload fun(typeDefinition: LightTypeDefinition): BaseLight
 local BaseLight = Object:extend("BaseLight")
@@ -36,6 +58,14 @@ function BaseLight:new(typeDefinition)
     self.castShadows = false
     self.isStatic = false
     self.shadowMap = nil
+    self.framesSinceShadowUpdate = math.huge -- Lights that never rendered their shadows go first
+
+    self._staticShadowMap = nil
+    self._isShadowCacheDirty = true
+    self._hasDynamicCasters = false
+    self._staticCasters = {}
+    self._staticCasterCount = 0
+    self._shadowParameters = {}
 end
 
 
@@ -45,27 +75,178 @@ end
 function BaseLight:setShadowMapping(size, isStatic)
     self.castShadows = true
     self.isStatic = isStatic
+
+    self._staticShadowMap = nil
+    self:invalidateShadowCache()
     return self
 end
 
 
+--- Forces the static shadow cache to be rendered again on the next update
+function BaseLight:invalidateShadowCache()
+    self._isShadowCacheDirty = true
+end
+
+
+-- Attenuated intensity under which a light is considered to have no effect, 5/256
+local radiusThreshold = 256/5
+
+--- Gets the distance at which the attenuation of a light (`constant`, `linear` and `quadratic`) makes it
+--- negligible, used by point and spot lights as their range.
+---@return number
+function BaseLight:getLightRadius()
+    local linear, constant, quadratic = self.linear, self.constant, self.quadratic
+    local c, s = self.color, self.specular
+    local max = math.max(math.max(c[1]+s[1], c[2]+s[2]), c[3]+s[3])
+
+    return (-linear + math.sqrt(linear * linear - 4 * quadratic * (constant - radiusThreshold * max))) / (2 * quadratic)
+end
+
+
+--- Gets the values that change how this light renders its shadow map, used to know when the
+--- shadow cache is outdated.
+---@protected
+---@return number ...
+function BaseLight:getShadowParameters()
+    return
+end
+
+
+---@param params number[]
+---@param ... number
+---@return boolean
+local function updateParameters(params, ...)
+    local changed = false
+
+    for i=1, select("#", ...) do
+        local value = select(i, ...)
+
+        if params[i] ~= value then
+            params[i] = value
+            changed = true
+        end
+    end
+
+    return changed
+end
+
+
+--- Checks whether the shadow map must be updated this frame. Marks the static cache as dirty if
+--- the light changed or if its static casters are not the same ones used to render the cache.
+---@param meshparts MeshPartConfig[]: Shadow casters of this frame
+---@param movedConfigs table<MeshPartConfig, boolean>: Static mesh parts that were moved or removed since the last frame
+---@return boolean
+function BaseLight:needsShadowUpdate(meshparts, movedConfigs)
+    if not self.castShadows then
+        return false
+    end
+
+    if updateParameters(self._shadowParameters, self:getShadowParameters()) then
+        self._isShadowCacheDirty = true
+    end
+
+    local cached = self._staticCasters
+    local staticCount = 0
+    local hasDynamic = false
+
+    for config in pairs(movedConfigs) do
+        if cached[config] then
+            self._isShadowCacheDirty = true
+        end
+    end
+
+    for i, config in ipairs(meshparts) do
+        if self:canMeshCastShadow(config) then
+            if config.static then
+                staticCount = staticCount + 1
+
+                if not cached[config] or movedConfigs[config] then
+                    self._isShadowCacheDirty = true
+                end
+            else
+                hasDynamic = true
+            end
+        end
+    end
+
+    if staticCount ~= self._staticCasterCount then
+        self._isShadowCacheDirty = true
+    end
+
+    -- Dynamic casters must also be erased after they leave the light volume
+    return self._isShadowCacheDirty or hasDynamic or self._hasDynamicCasters
+end
+
+
 ---@param meshparts MeshPartConfig[]
 function BaseLight:generateShadowMap(meshparts)
     if not self.castShadows then
         return
     end
 
-    self.castShadows = not self.isStatic
+    for i, config in ipairs(meshparts) do
+        if self:canMeshCastShadow(config) then
+            table.insert(config.static and staticCasters or dynamicCasters, config)
+        end
+    end
+
+    local hasDynamic = dynamicCasters[1] ~= nil
+    local largestAnimator = nil
+
+    -- The BONE_TEXTURE variant works for every animator, so it's used for the whole pass if any caster needs it
+    for i, casters in ipairs(casterLists) do
+        for j, config in ipairs(casters) do
+            local animator = config.animator
+
+            if animator and (not largestAnimator or animator.maxBones > largestAnimator.maxBones) then
+                largestAnimator = animator
+            end
+        end
+    end
+
+    -- Lights that never had dynamic casters render the static ones straight into the shadow map
+    if hasDynamic and not self._staticShadowMap then
+        self._staticShadowMap = BaseLight.CreateShadowMapTexture(self.shadowMap:getWidth(), self.shadowMap:getTextureType())
+        self._isShadowCacheDirty = true
+    end
+
+    local cache = self._staticShadowMap or self.shadowMap
+    local isCacheUpdated = self._isShadowCacheDirty
 
     love.graphics.setDepthMode("lequal", true)
     love.graphics.setMeshCullMode("front")
     love.graphics.setBlendMode("replace")
 
+    shadowMapRendererShader:setAnimationDefines(largestAnimator)
     shadowMapRendererShader:use()
     shadowMapRendererShader:sendCommonUniforms()
     shadowMapRendererShader:sendUniform("u_lightType", self.typeDefinition)
 
-    self:drawShadows(shadowMapRendererShader, meshparts)
+    if isCacheUpdated then
+        self:drawShadows(shadowMapRendererShader, staticCasters, cache, true)
+
+        tableclear(self._staticCasters)
+        for i, config in ipairs(staticCasters) do
+            self._staticCasters[config] = true
+        end
+
+        self._staticCasterCount = #staticCasters
+        self._isShadowCacheDirty = false
+    end
+
+    if cache ~= self.shadowMap and (isCacheUpdated or hasDynamic or self._hasDynamicCasters) then
+        BaseLight.CopyShadowMap(cache, self.shadowMap)
+
+        if hasDynamic then
+            self:drawShadows(shadowMapRendererShader, dynamicCasters, self.shadowMap, false)
+        end
+    end
+
+    self._hasDynamicCasters = hasDynamic
+    self.framesSinceShadowUpdate = 0
+
+    tableclear(staticCasters)
+    tableclear(dynamicCasters)
 end
 
 
@@ -77,9 +258,80 @@ function BaseLight:canMeshCastShadow(config)
 end
 
 
+--- Draws all mesh parts inside `frustum` that can cast shadows, using their `shadowLod`. Copies of the same
+--- mesh part and level of detail are drawn with a single instanced draw call, except for animated ones.
+---@protected
+---@param shader ShaderEffect: Must be compiled with `MESH_INSTANCING`
+---@param meshparts MeshPartConfig[]
+---@param frustum CameraFrustum
+function BaseLight:drawShadowCasters(shader, meshparts, frustum)
+    for i, config in ipairs(meshparts) do
+        if self:canMeshCastShadow(config) and frustum:testIntersection(config.meshPart.aabb, config.worldMatrix) then
+            if config.animator then
+                singleMatrix[1] = config.worldMatrix
+                shader:sendMeshConfigUniforms(config)
+                config.meshPart:drawInstanced(singleMatrix, 1, config.shadowLod)
+            else
+                local lod = config.shadowLod or 1
+                local lodBatches = batches[config.meshPart]
+
+                if not lodBatches then
+                    lodBatches = {}
+                    batches[config.meshPart] = lodBatches
+                end
+
+                local batch = lodBatches[lod]
+
+                if not batch then
+                    batch = {}
+                    lodBatches[lod] = batch
+                end
+                if not batch[1] then
+                    table.insert(batchedParts, config.meshPart)
+                    table.insert(batchedLods, lod)
+                end
+
+                table.insert(batch, config.worldMatrix)
+            end
+        end
+    end
+
+    shader:trySendUniform("uHasAnimation", false)
+
+    for i, meshPart in ipairs(batchedParts) do
+        local lod = batchedLods[i]
+        local batch = batches[meshPart][lod]
+
+        meshPart:drawInstanced(batch, #batch, lod)
+        tableclear(batch)
+    end
+
+    tableclear(batchedParts)
+    tableclear(batchedLods)
+    singleMatrix[1] = nil
+end
+
+
+--- Gets a sphere containing the whole area affected by this light, used to find which meshes
+--- are lit by it. Returns nothing if the light affects everything (e.g directional lights).
+---@return number? x, number? y, number? z, number? radius
+function BaseLight:getBoundingSphere()
+    return nil
+end
+
+
+--- Gets the frustum used to render the shadow map of this light, if it only has one
+---@return CameraFrustum?
+function BaseLight:getShadowFrustum()
+    return nil
+end
+
+
 ---@param shader ShaderEffect
 ---@param meshparts MeshPartConfig[]
-function BaseLight:drawShadows(shader, meshparts)
+---@param target love.Texture: Shadow map to render into
+---@param clear boolean: Clears `target` before drawing
+function BaseLight:drawShadows(shader, meshparts, target, clear)
     error("Not implemented")
 end
 
@@ -105,4 +357,47 @@ function BaseLight.CreateShadowMapTexture(size, type)
 end
 
 
+--- Copies the depth of a shadow map into another one with the same size and type
+---@param source love.Texture
+---@param target love.Texture
+function BaseLight.CopyShadowMap(source, target)
+    local isCube = source:getTextureType() == "cube"
+    local size = target:getWidth()
+
+    love.graphics.push("all")
+    love.graphics.origin()
+    love.graphics.setDepthMode("always", true)
+    love.graphics.setMeshCullMode("none")
+
+    if isCube then
+        shadowMapCopyShader:define("SOURCE_IS_CUBE")
+    else
+        shadowMapCopyShader:undefine("SOURCE_IS_CUBE")
+    end
+
+    -- Comparison sampling only returns the test result, not the depth
+    source:setDepthSampleMode()
+
+    shadowMapCopyShader:use()
+    shadowMapCopyShader:sendUniform("u_source", source)
+
+    for face=1, isCube and 6 or 1 do
+        copyCanvasTable.depthstencil[1] = target
+        copyCanvasTable.depthstencil.face = isCube and face or nil
+
+        if isCube then
+            shadowMapCopyShader:sendUniform("u_face", face-1)
+        end
+
+        love.graphics.setCanvas(copyCanvasTable)
+        love.graphics.rectangle("fill", 0, 0, size, size)
+    end
+
+    source:setDepthSampleMode("less")
+    copyCanvasTable.depthstencil[1] = nil
+
+    love.graphics.pop()
+end
+
+
 return BaseLight
\ No newline at end of file
@@ -3,7 +3,6 @@ local Vector3 = require "engine.math.vector3"
 local BaseLight = require "engine.3D.lights.baseLight"
 local CameraFrustum = require "engine.misc.cameraFrustum"
 
-local frustum = CameraFrustum()
 local canvasTable = {}
 
 
@@ -16,6 +15,7 @@ local canvasTable = {}
 --- @field public nearPlane number
 --- @field public farPlane number
 ---
+--- @field public shadowFrustum CameraFrustum
 --- @field private viewProjMatrix Matrix4
 ---
 --- @overload fun(position: Vector3, direction: Vector3, color: table, specular: table): DirectionalLight
@@ -33,6 +33,7 @@ function Dirlight:new(position, direction, color, specular)
     self.nearPlane = 0.1
     self.farPlane = 100
     self.projectionSize = 20
+    self.shadowFrustum = CameraFrustum()
 end
 
 
@@ -47,27 +48,42 @@ function Dirlight:setShadowMapping(size, isStatic)
 end
 
 
----@param shader ShaderEffect
----@param meshparts MeshPartConfig[]
-function Dirlight:drawShadows(shader, meshparts)
+---@return CameraFrustum
+function Dirlight:getShadowFrustum()
     local viewMatrix = Matrix4.CreateLookAtDirection(self.position, -self.direction, Vector3(0,1,0))
     local projMatrix = Matrix4.CreateOrthographicOffCenter(-self.projectionSize, self.projectionSize, -self.projectionSize, self.projectionSize, self.nearPlane, self.farPlane)
 
     self.viewProjMatrix = viewMatrix:multiply(projMatrix)
-    canvasTable.depthstencil = self.shadowMap
+    self.shadowFrustum:updatePlanes(self.viewProjMatrix)
+
+    return self.shadowFrustum
+end
+
+
+---@protected
+---@return number ...
+function Dirlight:getShadowParameters()
+    local pos, dir = self.position, self.direction
+    return pos.x, pos.y, pos.z, dir.x, dir.y, dir.z, self.projectionSize, self.nearPlane, self.farPlane
+end
+
+
+---@param shader ShaderEffect
+---@param meshparts MeshPartConfig[]
+---@param target love.Texture
+---@param clear boolean
+function Dirlight:drawShadows(shader, meshparts, target, clear)
+    local frustum = self:getShadowFrustum()
+    canvasTable.depthstencil = target
 
     love.graphics.setCanvas(canvasTable)
-    love.graphics.clear()
+    if clear then
+        love.graphics.clear()
+    end
 
     shader:sendUniform("uViewProjMatrix", "column", self.viewProjMatrix)
-    frustum:updatePlanes(self.viewProjMatrix)
 
-    for i, config in ipairs(meshparts) do
-        if self:canMeshCastShadow(config) and frustum:testIntersection(config.meshPart.aabb, config.worldMatrix) then
-            shader:sendMeshConfigUniforms(config)
-            config.meshPart:draw()
-        end
-    end
+    self:drawShadowCasters(shader, meshparts, frustum)
 end
 
 
@@ -58,9 +58,19 @@ function PointLight:setShadowMapping(size, isStatic)
 end
 
 
+---@protected
+---@return number ...
+function PointLight:getShadowParameters()
+    local pos = self.position
+    return pos.x, pos.y, pos.z, self.nearPlane, self:getLightRadius()
+end
+
+
 ---@param shader ShaderEffect
 ---@param meshparts MeshPartConfig[]
-function PointLight:drawShadows(shader, meshparts)
+---@param target love.Texture
+---@param clear boolean
+function PointLight:drawShadows(shader, meshparts, target, clear)
     self.farPlane = self:getLightRadius()
     local proj = Matrix4.CreatePerspectiveFOV(math.pi/2, 1, self.nearPlane, self.farPlane)
 
@@ -69,22 +79,20 @@ function PointLight:drawShadows(shader, meshparts)
 
     
     for i = 1, 6 do
-        local viewProj = Matrix4.CreateLookAtDirection(self.position, dirs[i].dir, dirs[i].up):multiply(proj)
-        canvasTable.depthstencil[1] = self.shadowMap
+        local viewProj = Matrix4.CreateLookAtDirectionInto(Matrix4.Temp(), self.position, dirs[i].dir, dirs[i].up)
+        Matrix4.MultiplyInto(viewProj, viewProj, proj)
+        canvasTable.depthstencil[1] = target
         canvasTable.depthstencil.face = i
         
         love.graphics.setCanvas(canvasTable)
-        love.graphics.clear()
+        if clear then
+            love.graphics.clear()
+        end
         
         shader:sendUniform("uViewProjMatrix", "column", viewProj)
         frustum:updatePlanes(viewProj)
 
-        for j, config in ipairs(meshparts) do
-            if self:canMeshCastShadow(config) and frustum:testIntersection(config.meshPart.aabb, config.worldMatrix) then
-                shader:sendMeshConfigUniforms(config)
-                config.meshPart:draw()
-            end
-        end
+        self:drawShadowCasters(shader, meshparts, frustum)
     end
 end
 
@@ -108,13 +116,10 @@ function PointLight:sendLightData(shader, lightUniform)
 end
 
 
-local treshold = 256/5
-function PointLight:getLightRadius()
-    local linear, constant, quadratic = self.linear, self.constant, self.quadratic
-    local c, s = self.color, self.specular
-    local max = math.max(math.max(c[1]+s[1], c[2]+s[2]), c[3]+s[3])
-
-    return (-linear + math.sqrt(linear * linear - 4 * quadratic * (constant - treshold * max))) / (2 * quadratic)
+---@return number x, number y, number z, number radius
+function PointLight:getBoundingSphere()
+    local pos = self.position
+    return pos.x, pos.y, pos.z, self:getLightRadius()
 end
 
 
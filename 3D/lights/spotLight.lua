@@ -3,7 +3,6 @@ local Vector3 = require "engine.math.vector3"
 local BaseLight = require "engine.3D.lights.baseLight"
 local CameraFrustum = require "engine.misc.cameraFrustum"
 
-local frustum = CameraFrustum()
 local canvasTable = {}
 
 --- @class SpotLight: BaseLight
@@ -14,6 +13,7 @@ local canvasTable = {}
 --- @field specular number[]
 --- @field innerAngle number
 --- @field outerAngle number
+--- @field shadowFrustum CameraFrustum
 --- @overload fun(position: Vector3, direction: Vector3, innerAngle: number, outerAngle: number, color: table, specular: table): SpotLight
 local Spotlight = BaseLight:extend("SpotLight")
 
@@ -36,6 +36,7 @@ function Spotlight:new(position, direction, innerAngle, outerAngle, color, specu
 
     self.nearPlane = 0.1
     self.farPlane = 20
+    self.shadowFrustum = CameraFrustum()
 end
 
 
@@ -50,27 +51,61 @@ function Spotlight:setShadowMapping(size, isStatic)
 end
 
 
----@param shader ShaderEffect
----@param meshparts MeshPartConfig[]
-function Spotlight:drawShadows(shader, meshparts)
+---@return CameraFrustum
+function Spotlight:getShadowFrustum()
     local viewMatrix = Matrix4.CreateLookAtDirection(self.position, self.direction, Vector3(0,1,0))
     local projMatrix = Matrix4.CreatePerspectiveFOV(self.outerAngle * 2, 1, self.nearPlane, self.farPlane)
 
     self.viewProjMatrix = viewMatrix:multiply(projMatrix)
-    canvasTable.depthstencil = self.shadowMap
+    self.shadowFrustum:updatePlanes(self.viewProjMatrix)
+
+    return self.shadowFrustum
+end
+
+
+--- Bounding sphere of the light cone, up to the distance where the attenuation makes the light negligible
+---@return number x, number y, number z, number radius
+function Spotlight:getBoundingSphere()
+    local pos, dir = self.position, self.direction
+    local angle, range = self.outerAngle, self:getLightRadius()
+    local offset, radius
+
+    if angle > math.pi / 4 then
+        offset = range * math.cos(angle)
+        radius = range * math.sin(angle)
+    else
+        radius = range / (2 * math.cos(angle))
+        offset = radius
+    end
+
+    return pos.x + dir.x * offset, pos.y + dir.y * offset, pos.z + dir.z * offset, radius
+end
+
+
+---@protected
+---@return number ...
+function Spotlight:getShadowParameters()
+    local pos, dir = self.position, self.direction
+    return pos.x, pos.y, pos.z, dir.x, dir.y, dir.z, self.outerAngle, self.nearPlane, self.farPlane
+end
+
+
+---@param shader ShaderEffect
+---@param meshparts MeshPartConfig[]
+---@param target love.Texture
+---@param clear boolean
+function Spotlight:drawShadows(shader, meshparts, target, clear)
+    local frustum = self:getShadowFrustum()
+    canvasTable.depthstencil = target
 
     love.graphics.setCanvas(canvasTable)
-    love.graphics.clear()
+    if clear then
+        love.graphics.clear()
+    end
 
     shader:sendUniform("uViewProjMatrix", "column", self.viewProjMatrix)
-    frustum:updatePlanes(self.viewProjMatrix)
 
-    for i, config in ipairs(meshparts) do
-        if self:canMeshCastShadow(config) and frustum:testIntersection(config.meshPart.aabb, config.worldMatrix) then
-            shader:sendMeshConfigUniforms(config)
-            config.meshPart:draw()
-        end
-    end
+    self:drawShadowCasters(shader, meshparts, frustum)
 end
 
 
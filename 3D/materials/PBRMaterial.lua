@@ -111,5 +111,8 @@ end
 ---@type love.PixelFormat[]
 PBRMaterial.GBufferLayout = {"rgba16", "rgba8", "rg11b10f"}
 
+---@type boolean
+PBRMaterial.SupportsClusteredLighting = true
+
 
 return PBRMaterial
\ No newline at end of file
@@ -97,8 +97,9 @@ function Material:apply(shader)
 end
 
 
+--- Selects the shader variant used to render `light`, without sending its data
 ---@param light BaseLight
-function Material:setLight(light)
+function Material:setLightDefines(light)
     if light.shadowMap then
         self.shader:undefine("MATERIAL_DISABLE_SHADOWS")
     else
@@ -106,15 +107,22 @@ function Material:setLight(light)
     end
 
     self.shader:define("CURRENT_LIGHT_TYPE", light.typeDefinition)
+end
+
+
+---@param light BaseLight
+function Material:setLight(light)
+    self:setLightDefines(light)
     light:sendLightData(self.shader, "u_light")
 end
 
 
----@param pass "forward"|"gbuffer"|"lightpass"|"depth"|"shadowmapping"
+---@param pass "forward"|"clustered"|"gbuffer"|"lightpass"|"depth"|"shadowmapping"
 ---@return BaseMaterial
 function Material:setRenderPass(pass)
     local def =
         pass == "forward"       and "RENDER_PASS_FORWARD"            or
+        pass == "clustered"     and "RENDER_PASS_FORWARD_CLUSTERED"  or
         pass == "gbuffer"       and "RENDER_PASS_DEFERRED"           or
         pass == "lightpass"     and "RENDER_PASS_DEFERRED_LIGHTPASS" or
         pass == "depth"         and "RENDER_PASS_DEPTH_PREPASS"      or
@@ -122,7 +130,7 @@ function Material:setRenderPass(pass)
 
     self.shader:define("CURRENT_RENDER_PASS", def)
 
-    if pass == "depth" then
+    if pass == "depth" or pass == "clustered" then
         self.shader:undefine("CURRENT_LIGHT_TYPE")
     end
 
@@ -133,5 +141,9 @@ end
 ---@type love.PixelFormat[]
 Material.GBufferLayout = {}
 
+--- Whether the material shader implements `MATERIAL_CLUSTERED_LIGHT_PASS`
+---@type boolean
+Material.SupportsClusteredLighting = false
+
 
 return Material
\ No newline at end of file
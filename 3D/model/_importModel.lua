@@ -0,0 +1,9 @@
+local ModelCache = require "engine.3D.model.modelCache"
+
+-- Decoder of the "model" content type hint, runs in the content loading threads
+---@param filepath string
+---@param args table
+---@return table
+return function(filepath, args)
+    return ModelCache.Import(filepath, args[1])
+end
@@ -0,0 +1,18 @@
+local PackedSkeleton = require "engine.3D.model.animation.packedSkeleton"
+local ffi            = require "ffi"
+
+
+-- Evaluates poses of a packed skeleton. Job data: the packed skeleton, the time of each pose (doubles),
+-- and the output poses (`PackedSkeleton.GetPoseSize(args.maxBones)` bytes each)
+---@type JobKernel
+return function(first, last, data, args)
+    local times = ffi.cast("const double*", data[2]:getFFIPointer())
+    local poses = ffi.cast("uint8_t*", data[3]:getFFIPointer())
+    local poseSize = PackedSkeleton.GetPoseSize(args.maxBones)
+    local scalingOffset = args.maxBones * 2 * ffi.sizeof("Quaternion")
+
+    for i=first, last do
+        local pose = poses + i * poseSize
+        PackedSkeleton.EvaluateDQS(data[1], times[i], ffi.cast("Quaternion*", pose), ffi.cast("Vector3*", pose + scalingOffset))
+    end
+end
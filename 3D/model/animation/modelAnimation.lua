@@ -1,8 +1,11 @@
 local Matrix4 = require "engine.math.matrix4"
+local Matrix4Array = require "engine.math.matrix4Array"
 local AnimationNode = require "engine.3D.model.animation.modelAnimationNode"
 local Animator = require "engine.3D.model.animation.modelAnimator"
 local Object   = require "engine.3rdparty.classic.classic"
 local Quaternion = require "engine.math.quaternion"
+local Vector3 = require "engine.math.vector3"
+local ffi = require "ffi"
 
 
 --- @class ModelAnimation: Object
@@ -12,6 +15,7 @@ local Quaternion = require "engine.math.quaternion"
 --- @field public duration number
 --- @field public fps integer
 --- @field public animNodes table<string, ModelAnimationNode>
+--- @field public nodeCount integer
 --- @field public time number
 --- @field public isPlaying boolean
 ---
@@ -25,13 +29,36 @@ function Anim:new(model, animData)
     self.duration = animData.duration
     self.fps = animData.fps
     self.animNodes = {}
+    self.nodeCount = 0
 
     for name, animNodeData in pairs(animData.nodes) do
-        self.animNodes[name] = AnimationNode(animNodeData)
+        self.animNodes[name] = AnimationNode(animNodeData, self.nodeCount)
+        self.nodeCount = self.nodeCount + 1
     end
 end
 
 
+--- Creates a list of key cursors for sampling this animation, see `ModelAnimationNode:sample`
+---@return ffi.cdata*
+function Anim:createCursors()
+    return ffi.new("int32_t[?]", math.max(self.nodeCount * AnimationNode.CURSORS_PER_NODE, 1))
+end
+
+
+--- Replaces the keys of all nodes with evenly spaced ones, so they can be found in constant time
+---@param sampleRate number: Number of keys per second
+---@return self
+function Anim:resample(sampleRate)
+    local step = (self.fps > 0 and self.fps or 1) / sampleRate
+
+    for name, animNode in pairs(self.animNodes) do
+        animNode:resample(step, self.duration)
+    end
+
+    return self
+end
+
+
 ---@param armature ModelArmature
 ---@param modelOriginalGlobalMatrix Matrix4
 ---@return ModelAnimator
@@ -40,58 +67,87 @@ function Anim:getNewAnimator(armature, modelOriginalGlobalMatrix)
 end
 
 
---- @param time number
---- @param dqList Quaternion[]
---- @param scaleLists Vector3[]
---- @param bone ModelBone
---- @param parentTransform Matrix4
-function Anim:updateBonesDQS(time, dqList, scaleLists, bone, parentTransform)
-    local transform = bone.localMatrix
-    local animNode = self.animNodes[bone.name]
-
-    if animNode then
-        local position, rotation, scale = animNode:getInterpolated(time)
-        transform = Matrix4.CreateTransformationMatrix(rotation, scale, position)
-    end
-
-    local globalTransform = transform * parentTransform
-    local finalBoneTransform = bone.offset * globalTransform
-    local translation, scale, rotation = finalBoneTransform:decompose()
-    local id = bone.id+1
+local samplePosition = Vector3()
+local sampleRotation = Quaternion()
+local sampleScale = Vector3()
+local sampleTransform = Matrix4()
+local finalTransform = Matrix4()
+local globalTransforms = Matrix4Array(64)
 
-    dqList[id*2-1] = rotation
-    dqList[id*2]   = Quaternion.CreateDualQuaternionTranslation(rotation, translation)
-    scaleLists[id] = scale
 
-    for i, child in ipairs(bone.children) do
-        ---@cast child ModelBone
-        self:updateBonesDQS(time, dqList, scaleLists, child, globalTransform)
+-- Calculates the global transform of every bone of the armature, in `armature.sortedBones` order
+---@param anim ModelAnimation
+---@param time number
+---@param armature ModelArmature
+---@param rootTransform Matrix4
+---@param cursors ffi.cdata*?
+---@return ffi.cdata*: Global transforms (0-based)
+local function updateGlobalTransforms(anim, time, armature, rootTransform, cursors)
+    local bones, parents = armature.sortedBones, armature.parentIndices
+    local animNodes = anim.animNodes
+
+    globalTransforms:resize(#bones)
+    local globals = globalTransforms.data
+
+    for i, bone in ipairs(bones) do
+        local transform = bone.localMatrix
+        local animNode = animNodes[bone.name]
+        local parent = parents[i]
+
+        if animNode then
+            local position, rotation, scale = animNode:sample(time, cursors, samplePosition, sampleRotation, sampleScale)
+            transform = Matrix4.CreateTransformationMatrixInto(sampleTransform, rotation, scale, position)
+        end
+
+        Matrix4.MultiplyInto(globals[i-1], transform, parent > 0 and globals[parent-1] or rootTransform)
     end
+
+    return globals
 end
 
 
+--- Evaluates the skeleton for dual quaternion skinning. Bones are processed in a single pass
+--- using `armature.sortedBones`, and the results are written directly into the output arrays.
 --- @param time number
---- @param matrixList Matrix4
---- @param bone ModelBone
---- @param parentTransform Matrix4
-function Anim:updateBonesLBS(time, matrixList, bone, parentTransform)
-    local transform = bone.localMatrix
-    local animNode = self.animNodes[bone.name]
-
-    if animNode then
-        local position, rotation, scale = animNode:getInterpolated(time)
-        transform = Matrix4.CreateTransformationMatrix(rotation, scale, position)
+--- @param armature ModelArmature
+--- @param rootTransform Matrix4
+--- @param cursors ffi.cdata*?: Key cursors created with `createCursors`
+--- @param outQuaternions QuaternionArray: Where to store the dual quaternions (two per bone, indexed by bone id)
+--- @param outScaling Vector3Array: Where to store the scaling (one per bone, indexed by bone id)
+function Anim:updatePoseDQS(time, armature, rootTransform, cursors, outQuaternions, outScaling)
+    local globals = updateGlobalTransforms(self, time, armature, rootTransform, cursors)
+    local quats, scales = outQuaternions.data, outScaling.data
+    local maxId = outScaling.length
+
+    for i, bone in ipairs(armature.sortedBones) do
+        local id = bone.id
+
+        if id < maxId then
+            Matrix4.MultiplyInto(finalTransform, bone.offset, globals[i-1])
+
+            local translation, scale, rotation = Matrix4.DecomposeInto(finalTransform, samplePosition, scales[id], quats[id*2])
+            Quaternion.CreateDualQuaternionTranslationInto(quats[id*2+1], rotation, translation)
+        end
     end
+end
 
-    local globalTransform = transform * parentTransform
-
-    if bone then
-        matrixList[bone.id+1] = bone.offset * globalTransform
-    end
 
-    for i, child in ipairs(bone.children) do
-        ---@cast child ModelBone
-        self:updateBonesLBS(time, matrixList, child, globalTransform)
+--- Evaluates the skeleton for linear blend skinning. Bones are processed in a single pass
+--- using `armature.sortedBones`, and the results are written directly into the output array.
+--- @param time number
+--- @param armature ModelArmature
+--- @param rootTransform Matrix4
+--- @param cursors ffi.cdata*?: Key cursors created with `createCursors`
+--- @param outMatrices Matrix4Array: Where to store the bone matrices (indexed by bone id)
+function Anim:updatePoseLBS(time, armature, rootTransform, cursors, outMatrices)
+    local globals = updateGlobalTransforms(self, time, armature, rootTransform, cursors)
+    local matrices = outMatrices.data
+    local maxId = outMatrices.length
+
+    for i, bone in ipairs(armature.sortedBones) do
+        if bone.id < maxId then
+            Matrix4.MultiplyInto(matrices[bone.id], bone.offset, globals[i-1])
+        end
     end
 end
 
@@ -0,0 +1,465 @@
+local Animator       = require "engine.3D.model.animation.modelAnimator"
+local PackedSkeleton = require "engine.3D.model.animation.packedSkeleton"
+local Job            = require "engine.misc.job"
+local Object         = require "engine.3rdparty.classic.classic"
+local Vector3        = require "engine.math.vector3"
+local ffi            = require "ffi"
+local floor, huge, tan = math.floor, math.huge, math.tan
+
+
+---@alias AnimationLodLevel {distance: number, screenSize: number, interval: integer}
+---@alias AnimationManagerStats {evaluated: integer, reused: integer, skipped: integer, frozen: integer, cachedPoses: integer}
+---@alias AnimationPoseBatch {data: love.ByteData[], args: {maxBones: integer}, capacity: integer, count: integer, poses: AnimationPoseEntry[], times: number[], job: Job?}
+
+---@class AnimationPoseEntry
+---@field boneQuaternions QuaternionArray
+---@field boneScaling Vector3Array
+---@field users integer
+---@field key table?
+---@field sample integer
+
+---@class AnimatorRecord
+---@field animator ModelAnimator
+---@field position Vector3
+---@field radius number
+---@field isVisible boolean
+---@field interval integer
+---@field phase integer
+---@field pose AnimationPoseEntry?
+---@field ownQuaternions QuaternionArray
+---@field ownScaling Vector3Array
+
+
+---
+--- Updates a group of animators, sharing work between instances of the same model.
+---
+--- Playback time is quantized to `sampleRate`, so animators playing the same animation on the same
+--- armature at the same sample share a single pose, which is only evaluated once. Animators that are
+--- far away from the camera (or small on the screen) are updated every few frames, and animators
+--- that are not visible are frozen until they become visible again.
+---
+--- Managed animators don't own their pose buffers anymore, `boneQuaternions` and `boneScaling`
+--- point to the shared pose and must be treated as read-only.
+---
+--- When an update needs at least `minJobPoses` new poses, they are evaluated in the job threads
+--- (see `PackedSkeleton`). Job poses don't use key cursors, so resampled animations work best with them.
+--- `update` only schedules the jobs, so call it early in the frame. Until the jobs are done, animators keep
+--- their previous pose. `ShaderEffect:sendMeshConfigUniforms` waits for them (see `ModelAnimator:waitForPose`),
+--- call `waitForPoses` before reading `boneQuaternions` or `boneScaling` anywhere else.
+---
+--- @class ModelAnimationManager: Object
+---
+--- @field public sampleRate number: Pose samples per second. Lower values increase sharing
+--- @field public lodMetric "distance"|"screenSize"
+--- @field public lodLevels AnimationLodLevel[]: Sorted from the highest to the lowest detail
+--- @field public minJobPoses number: New poses needed in an update to evaluate them in the job threads. `math.huge` disables jobs
+--- @field public stats AnimationManagerStats: Counters of the last update
+--- @field private _records table<ModelAnimator, AnimatorRecord>
+--- @field private _poses table<ModelAnimation, table<ModelArmature, table<integer, AnimationPoseEntry>>>
+--- @field private _freePoses AnimationPoseEntry[]
+--- @field private _skeletons table<ModelAnimation, table<ModelArmature, love.ByteData>>: Packed skeletons for the jobs
+--- @field private _pendingAnimators ModelAnimator[]
+--- @field private _pendingPoses AnimationPoseEntry[]
+--- @field private _pendingTimes number[]
+--- @field private _pendingCount integer
+--- @field private _changedAnimators ModelAnimator[]: Animators that get a new pose once the pending poses are evaluated
+--- @field private _batches table<love.ByteData, AnimationPoseBatch>: Job buffers of each packed skeleton, reused between updates
+--- @field private _scheduledBatches AnimationPoseBatch[]
+--- @field private _frame integer
+--- @field private _nextPhase integer
+---
+--- @overload fun(sampleRate: number?): ModelAnimationManager
+local Manager = Object:extend("ModelAnimationManager")
+
+
+function Manager:new(sampleRate)
+    self.sampleRate = sampleRate or 30
+    self.lodMetric = "distance"
+    self.lodLevels = {
+        {distance = 20,   screenSize = 200, interval = 1},
+        {distance = 50,   screenSize = 80,  interval = 2},
+        {distance = huge, screenSize = 0,   interval = 4},
+    }
+    self.minJobPoses = 16
+
+    self.stats = {
+        evaluated = 0,   -- Poses evaluated in the last update
+        reused = 0,      -- Animators that used a pose evaluated by another animator
+        skipped = 0,     -- Animators that kept their last pose because of LOD
+        frozen = 0,      -- Animators that weren't visible
+        cachedPoses = 0, -- Poses currently in use
+    }
+
+    self._records = {}
+    self._poses = {}
+    self._freePoses = {}
+    self._skeletons = setmetatable({}, {__mode = "k"})
+    self._pendingAnimators = {}
+    self._pendingPoses = {}
+    self._pendingTimes = {}
+    self._pendingCount = 0
+    self._changedAnimators = {}
+    self._batches = setmetatable({}, {__mode = "k"})
+    self._scheduledBatches = {}
+    self._frame = 0
+    self._nextPhase = 0
+end
+
+
+--- Adds an animator to this manager. Its pose will be updated by `ModelAnimationManager:update`
+---@param animator ModelAnimator
+---@param position Vector3?: World position used for LOD, see `setInstanceState`
+---@param radius number?: Bounding radius used for screen size LOD
+function Manager:addAnimator(animator, position, radius)
+    assert(not self._records[animator], "Animator is already in this manager")
+
+    self._records[animator] = {
+        animator = animator,
+        position = position and position:clone() or Vector3(0),
+        radius = radius or 1,
+        isVisible = true,
+        interval = 1,
+        phase = self._nextPhase,
+        pose = nil,
+        ownQuaternions = animator.boneQuaternions,
+        ownScaling = animator.boneScaling,
+    }
+    animator.manager = self
+
+    -- Spread LOD updates over different frames
+    self._nextPhase = (self._nextPhase + 1) % 64
+end
+
+
+--- Removes an animator from this manager, giving back its own pose buffers
+---@param animator ModelAnimator
+function Manager:removeAnimator(animator)
+    local record = self._records[animator]
+
+    if record then
+        -- Its pose could still be waiting for a job
+        self:waitForPoses()
+        self:_releasePose(record.pose)
+
+        animator.boneQuaternions = record.ownQuaternions
+        animator.boneScaling = record.ownScaling
+        animator.manager = nil
+        self._records[animator] = nil
+    end
+end
+
+
+--- Updates the LOD information of an animator instance
+---@param animator ModelAnimator
+---@param position Vector3: World position of the instance
+---@param isVisible boolean: Invisible animators are not updated
+function Manager:setInstanceState(animator, position, isVisible)
+    local record = assert(self._records[animator], "Animator is not in this manager")
+
+    record.position.x, record.position.y, record.position.z = position.x, position.y, position.z
+    record.isVisible = isVisible
+end
+
+
+---@private
+---@param record AnimatorRecord
+---@param camera Camera3D?
+---@return integer
+function Manager:_getUpdateInterval(record, camera)
+    if not camera then
+        return 1
+    end
+
+    local pos, camPos = record.position, camera.position
+    local dx, dy, dz = pos.x - camPos.x, pos.y - camPos.y, pos.z - camPos.z
+    local distance = math.sqrt(dx*dx + dy*dy + dz*dz)
+
+    if self.lodMetric == "screenSize" then
+        -- Approximate projected diameter in pixels
+        local size = record.radius * camera.screenSize.height / (tan(camera.fov * 0.5) * math.max(distance, 0.0001))
+
+        for i, level in ipairs(self.lodLevels) do
+            if size >= level.screenSize then
+                return level.interval
+            end
+        end
+    else
+        for i, level in ipairs(self.lodLevels) do
+            if distance <= level.distance then
+                return level.interval
+            end
+        end
+    end
+
+    return self.lodLevels[#self.lodLevels].interval
+end
+
+
+---@private
+---@param pose AnimationPoseEntry?
+function Manager:_releasePose(pose)
+    if pose then
+        pose.users = pose.users - 1
+
+        if pose.users == 0 then
+            pose.key[pose.sample] = nil
+            pose.key = nil
+            table.insert(self._freePoses, pose)
+            self.stats.cachedPoses = self.stats.cachedPoses - 1
+        end
+    end
+end
+
+
+---@private
+---@param animator ModelAnimator
+---@param sample integer
+---@return AnimationPoseEntry, boolean: The pose and whether it was just created
+function Manager:_acquirePose(animator, sample)
+    local byArmature = self._poses[animator.animation]
+    if not byArmature then
+        byArmature = setmetatable({}, {__mode = "k"})
+        self._poses[animator.animation] = byArmature
+    end
+
+    local bySample = byArmature[animator.armature]
+    if not bySample then
+        bySample = {}
+        byArmature[animator.armature] = bySample
+    end
+
+    local pose = bySample[sample]
+    if pose then
+        pose.users = pose.users + 1
+        return pose, false
+    end
+
+    pose = table.remove(self._freePoses)
+    if not pose or pose.boneScaling.length ~= animator.maxBones then
+        local quaternions, scaling = Animator.CreatePoseBuffers(animator.maxBones)
+        pose = {boneQuaternions = quaternions, boneScaling = scaling}
+    end
+
+    pose.users = 1
+    pose.key = bySample
+    pose.sample = sample
+    bySample[sample] = pose
+    self.stats.cachedPoses = self.stats.cachedPoses + 1
+
+    return pose, true
+end
+
+
+--- Advances all animators and updates their poses. Poses evaluated in the job threads are only ready after `waitForPoses`
+---@param dt number
+---@param camera Camera3D?: Used for LOD. If not set all animators are updated every frame
+function Manager:update(dt, camera)
+    local stats = self.stats
+    local step = 1 / self.sampleRate
+
+    -- Entries of the last update can't be recycled while their jobs are running
+    self:waitForPoses()
+
+    stats.evaluated, stats.reused, stats.skipped, stats.frozen = 0, 0, 0, 0
+    self._frame = self._frame + 1
+
+    for animator, record in pairs(self._records) do
+        animator:advance(dt)
+
+        if not record.isVisible and record.pose then
+            stats.frozen = stats.frozen + 1
+        else
+            record.interval = self:_getUpdateInterval(record, camera)
+
+            if record.pose and (self._frame + record.phase) % record.interval ~= 0 then
+                stats.skipped = stats.skipped + 1
+            else
+                -- Quantize time to the nearest sample (time is in animation ticks)
+                local tickStep = step * (animator.fps > 0 and animator.fps or 1)
+                local sample = floor(animator.time / tickStep + 0.5)
+
+                if not record.pose or record.pose.sample ~= sample then
+                    local oldPose = record.pose
+                    local pose, isNew = self:_acquirePose(animator, sample)
+
+                    -- Release after acquiring, so a pose isn't recycled just to be recreated
+                    self:_releasePose(oldPose)
+                    record.pose = pose
+
+                    if isNew then
+                        local count = self._pendingCount + 1
+                        self._pendingAnimators[count] = animator
+                        self._pendingPoses[count] = pose
+                        self._pendingTimes[count] = sample * tickStep
+                        self._pendingCount = count
+                        stats.evaluated = stats.evaluated + 1
+                    else
+                        stats.reused = stats.reused + 1
+                    end
+
+                    table.insert(self._changedAnimators, animator)
+                else
+                    stats.reused = stats.reused + 1
+                end
+            end
+        end
+    end
+
+    self:_evaluatePendingPoses()
+
+    if #self._scheduledBatches == 0 then
+        self:_applyPoses()
+    end
+end
+
+
+-- Points the changed animators to their new poses, once they're evaluated
+---@private
+function Manager:_applyPoses()
+    local changed = self._changedAnimators
+
+    for i=1, #changed do
+        local animator = changed[i]
+        local pose = self._records[animator].pose
+
+        animator.boneQuaternions = pose.boneQuaternions
+        animator.boneScaling = pose.boneScaling
+        changed[i] = nil
+    end
+end
+
+
+--- Waits for the poses scheduled by the last `update` and gives them to their animators.
+--- Does nothing if no jobs are running
+function Manager:waitForPoses()
+    local scheduled = self._scheduledBatches
+
+    if #scheduled == 0 then
+        return
+    end
+
+    for i=1, #scheduled do
+        local batch = scheduled[i]
+        batch.job:wait()
+
+        local maxBones = batch.args.maxBones
+        local poseSize = PackedSkeleton.GetPoseSize(maxBones)
+        local quaternionSize = maxBones * 2 * ffi.sizeof("Quaternion")
+        local pointer = ffi.cast("uint8_t*", batch.data[3]:getFFIPointer())
+
+        for j=1, batch.count do
+            local entry = batch.poses[j]
+            local pose = pointer + (j-1) * poseSize
+
+            ffi.copy(entry.boneQuaternions.data, pose, quaternionSize)
+            ffi.copy(entry.boneScaling.data, pose + quaternionSize, poseSize - quaternionSize)
+            Animator.MarkPoseChanged(entry.boneQuaternions)
+            batch.poses[j] = nil
+        end
+
+        batch.job = nil
+        batch.count = 0
+        scheduled[i] = nil
+    end
+
+    self:_applyPoses()
+end
+
+
+---@private
+---@param animator ModelAnimator
+---@return love.ByteData
+function Manager:_getPackedSkeleton(animator)
+    local byArmature = self._skeletons[animator.animation]
+    if not byArmature then
+        byArmature = setmetatable({}, {__mode = "k"})
+        self._skeletons[animator.animation] = byArmature
+    end
+
+    local skeleton = byArmature[animator.armature]
+    if not skeleton then
+        skeleton = PackedSkeleton.Pack(animator.animation, animator.armature, animator.armatureToModelMatrix, animator.maxBones)
+        byArmature[animator.armature] = skeleton
+    end
+
+    return skeleton
+end
+
+
+---@private
+---@param skeleton love.ByteData
+---@param maxBones integer
+---@return AnimationPoseBatch
+function Manager:_getBatch(skeleton, maxBones)
+    local batch = self._batches[skeleton]
+    if not batch then
+        batch = {data = {skeleton}, args = {maxBones = maxBones}, capacity = 0, count = 0, poses = {}, times = {}, job = nil}
+        self._batches[skeleton] = batch
+    end
+
+    return batch
+end
+
+
+---@private
+---@param batch AnimationPoseBatch
+function Manager:_scheduleBatch(batch)
+    local count = batch.count
+
+    if count > batch.capacity then
+        -- Grow geometrically, so the buffers are only reallocated a few times
+        local capacity = math.max(count, batch.capacity * 2)
+
+        batch.data[2] = love.data.newByteData(capacity * 8)
+        batch.data[3] = love.data.newByteData(capacity * PackedSkeleton.GetPoseSize(batch.args.maxBones))
+        batch.capacity = capacity
+    end
+
+    local times, pointer = batch.times, ffi.cast("double*", batch.data[2]:getFFIPointer())
+    for i=1, count do
+        pointer[i-1] = times[i]
+        times[i] = nil
+    end
+
+    batch.job = Job("engine.3D.model.animation._poseJob", count, batch.data, batch.args):schedule()
+end
+
+
+---@private
+function Manager:_evaluatePendingPoses()
+    local count = self._pendingCount
+    local animators, poses, times = self._pendingAnimators, self._pendingPoses, self._pendingTimes
+
+    if count < self.minJobPoses then
+        for i=1, count do
+            animators[i]:updatePose(times[i], poses[i].boneQuaternions, poses[i].boneScaling)
+        end
+    else
+        -- One job per skeleton, all of them running at the same time
+        local scheduled = self._scheduledBatches
+
+        for i=1, count do
+            local animator = animators[i]
+            local batch = self:_getBatch(self:_getPackedSkeleton(animator), animator.maxBones)
+
+            if batch.count == 0 then
+                table.insert(scheduled, batch)
+            end
+
+            batch.count = batch.count + 1
+            batch.poses[batch.count] = poses[i]
+            batch.times[batch.count] = times[i]
+        end
+
+        for _, batch in ipairs(scheduled) do
+            self:_scheduleBatch(batch)
+        end
+    end
+
+    for i=1, count do
+        animators[i], poses[i], times[i] = nil, nil, nil
+    end
+    self._pendingCount = 0
+end
+
+return Manager
@@ -1,50 +1,80 @@
 local Vector3    = require "engine.math.vector3"
 local Quaternion = require "engine.math.quaternion"
+local Track      = require "engine.3D.model.animation.modelAnimationTrack"
 local Object     = require "engine.3rdparty.classic.classic"
 
 
 --- @class ModelAnimationNode: Object
 ---
 --- @field public name string
---- @field private _positionKeys {time: number, value: Vector3}[]
---- @field private _rotationKeys {time: number, value: Quaternion}[]
---- @field private _scaleKeys {time: number, value: Vector3}[]
+--- @field public index integer: Slot of this node inside the animator cursor lists (0-based)
+--- @field private _positionTrack ModelAnimationTrack
+--- @field private _rotationTrack ModelAnimationTrack
+--- @field private _scaleTrack ModelAnimationTrack
+---
+--- @overload fun(animNodeData: table, index: integer): ModelAnimationNode
 local AnimNode = Object:extend("ModelAnimationNode")
 
+AnimNode.CURSORS_PER_NODE = 3
+
 
-function AnimNode:new(animNodeData)
+function AnimNode:new(animNodeData, index)
     self.name = animNodeData.name
-    self._positionKeys = animNodeData.positionKeys
-    self._rotationKeys = animNodeData.rotationKeys
-    self._scaleKeys = animNodeData.scaleKeys
+    self.index = index or 0
+    self._positionTrack = Track(animNodeData.positionKeys, false)
+    self._rotationTrack = Track(animNodeData.rotationKeys, true)
+    self._scaleTrack = Track(animNodeData.scaleKeys, false)
 end
 
 
-local function findInterpolationKeys(keyList, time)
-    for i, nextKey in ipairs(keyList) do
-        if time < nextKey.time then
-            local prevKey = keyList[i-1] or nextKey
+--- Interpolates the node transformation at `time` into existing objects.
+---
+--- `cursors` keeps the last keys used by each track, so playback doesn't need to search the keys
+--- from the start every time. It's updated in place and should be unique for each animator.
+---@param time number
+---@param cursors ffi.cdata*?: Integer array with `CURSORS_PER_NODE` slots for each node of the animation
+---@param outPosition Vector3
+---@param outRotation Quaternion
+---@param outScale Vector3
+---@return Vector3, Quaternion, Vector3
+function AnimNode:sample(time, cursors, outPosition, outRotation, outScale)
+    if cursors then
+        local slot = self.index * AnimNode.CURSORS_PER_NODE
+        local _
 
-            return prevKey.value, nextKey.value, (time - prevKey.time) / (nextKey.time - prevKey.time)
-        end
+        _, cursors[slot]   = self._positionTrack:sample(time, cursors[slot],   outPosition)
+        _, cursors[slot+1] = self._rotationTrack:sample(time, cursors[slot+1], outRotation)
+        _, cursors[slot+2] = self._scaleTrack:sample(time, cursors[slot+2],    outScale)
+    else
+        self._positionTrack:sample(time, nil, outPosition)
+        self._rotationTrack:sample(time, nil, outRotation)
+        self._scaleTrack:sample(time, nil, outScale)
     end
-    return keyList[1].value, keyList[1].value, 0
+
+    return outPosition, outRotation, outScale
 end
 
 
 ---@param time number
+---@param cursors ffi.cdata*?
 ---@return Vector3
 ---@return Quaternion
 ---@return Vector3
-function AnimNode:getInterpolated(time)
-    local prevPos, nextPos, posProgress = findInterpolationKeys(self._positionKeys, time)
-    local prevRot, nextRot, rotProgress = findInterpolationKeys(self._rotationKeys, time)
-    local prevScale, nextScale, scaleProgress = findInterpolationKeys(self._scaleKeys, time)
-
-    return
-        Vector3.Lerp(prevPos, nextPos, posProgress),
-        Quaternion.Slerp(prevRot, nextRot, rotProgress),
-        Vector3.Lerp(prevScale, nextScale, scaleProgress)
+function AnimNode:getInterpolated(time, cursors)
+    return self:sample(time, cursors, Vector3(), Quaternion(), Vector3())
+end
+
+
+--- Replaces the keys of this node with evenly spaced ones. See `ModelAnimationTrack:resample`
+---@param step number: Time between keys
+---@param duration number: The length of the animation
+---@return self
+function AnimNode:resample(step, duration)
+    self._positionTrack:resample(step, duration)
+    self._rotationTrack:resample(step, duration)
+    self._scaleTrack:resample(step, duration)
+
+    return self
 end
 
-return AnimNode
\ No newline at end of file
+return AnimNode
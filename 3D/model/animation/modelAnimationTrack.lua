@@ -0,0 +1,198 @@
+local Vector3         = require "engine.math.vector3"
+local Quaternion      = require "engine.math.quaternion"
+local Vector3Array    = require "engine.math.vector3Array"
+local QuaternionArray = require "engine.math.quaternionArray"
+local Object          = require "engine.3rdparty.classic.classic"
+local ffi             = require "ffi"
+local floor, ceil     = math.floor, math.ceil
+
+
+--- Keys already packed as the arrays of a track: `times` holds doubles, `values` holds `Vector3` or `Quaternion` structs
+--- @alias CompiledAnimationKeys {count: integer, times: love.Data, values: love.Data}
+
+
+---
+--- A list of keyframes compiled into flat arrays, one for the key times and one for the packed values.
+---
+--- Keys are found with a cursor (the index of the last key used) that is checked first and then
+--- advanced incrementally, so sampling a track that is played forward is O(1). A binary search is
+--- only used when the cursor is too far from the requested time (e.g after seeking).
+--- Resampled tracks have evenly spaced keys, so the key index is calculated directly.
+---
+--- @class ModelAnimationTrack: Object
+---
+--- @field public count integer: Number of keys
+--- @field public times ffi.cdata*: Time of each key (0-based)
+--- @field public values Vector3Array|QuaternionArray: Value of each key
+--- @field public isRotation boolean: Whether this track stores quaternions, which are interpolated with slerp
+--- @field public step number?: Time between keys, only set if this track was resampled
+--- @field private _timesData love.Data?: Keeps the memory of `times` alive for compiled keys
+---
+--- @overload fun(keys: {time: number, value: Vector3|Quaternion}[]|CompiledAnimationKeys, isRotation: boolean): ModelAnimationTrack
+local Track = Object:extend("ModelAnimationTrack")
+
+
+function Track:new(keys, isRotation)
+    if keys.times then
+        self:_loadCompiled(keys, isRotation)
+        return
+    end
+
+    local count = #keys
+
+    self.count = count
+    self.isRotation = isRotation
+    self.times = ffi.new("double[?]", math.max(count, 1))
+    self.values = isRotation and QuaternionArray(count) or Vector3Array(count)
+    self.step = nil
+
+    for i, key in ipairs(keys) do
+        self.times[i-1] = key.time
+        self.values:push(key.value)
+    end
+
+    if count == 0 then
+        self.values:push(isRotation and Quaternion.Identity() or Vector3(0))
+        self.count = 1
+    end
+end
+
+
+---@private
+---@param keys CompiledAnimationKeys
+---@param isRotation boolean
+function Track:_loadCompiled(keys, isRotation)
+    local count = keys.count
+
+    if count == 0 then
+        Track.new(self, {}, isRotation)
+        return
+    end
+
+    -- The arrays use the data directly, without copying
+    self.count = count
+    self.isRotation = isRotation
+    self.times = ffi.cast("double*", keys.times:getFFIPointer())
+    self.values = isRotation and QuaternionArray(count, keys.values) or Vector3Array(count, keys.values)
+    self.values.length = count
+    self.step = nil
+    self._timesData = keys.times
+end
+
+
+--- Finds the key before `time`. Times outside the track range are clamped to the first/last key.
+--- @param time number: The time to search
+--- @param cursor integer?: Key index returned by a previous search, used as a starting point
+--- @return integer: The index of the key before `time` (0-based)
+--- @return number: Interpolation progress between this key and the next one (0-1)
+function Track:findKey(time, cursor)
+    local times, last = self.times, self.count-1
+
+    if time <= times[0] or last == 0 then
+        return 0, 0
+    end
+    if time >= times[last] then
+        return last, 0
+    end
+
+    local index
+
+    if self.step then
+        index = floor((time - times[0]) / self.step)
+
+        if index >= last then
+            index = last - 1
+        end
+    else
+        index = cursor or 0
+
+        if index >= last or time < times[index] then
+            index = nil
+        elseif time >= times[index+1] then
+            -- Most of the time playback only moves to the next key
+            index = index + 1
+
+            if index >= last or time >= times[index+1] then
+                index = nil
+            end
+        end
+
+        if not index then
+            local low, high = 0, last-1
+
+            while low < high do
+                local mid = floor((low + high + 1) / 2)
+
+                if times[mid] <= time then
+                    low = mid
+                else
+                    high = mid - 1
+                end
+            end
+
+            index = low
+        end
+    end
+
+    return index, (time - times[index]) / (times[index+1] - times[index])
+end
+
+
+--- Interpolates the track value at `time` and stores it into `out`
+--- @param time number: The time to sample
+--- @param cursor integer?: Key index returned by a previous sample, used as a starting point
+--- @param out Vector3|Quaternion: Where to store the result
+--- @return Vector3|Quaternion: `out`
+--- @return integer: The new cursor
+function Track:sample(time, cursor, out)
+    local index, progress = self:findKey(time, cursor)
+    local values = self.values.data
+    local nextIndex = index < self.count-1 and index+1 or index
+
+    if self.isRotation then
+        Quaternion.SlerpInto(out, values[index], values[nextIndex], progress)
+    else
+        Vector3.LerpInto(out, values[index], values[nextIndex], progress)
+    end
+
+    return out, index
+end
+
+
+--- Replaces the keys of this track with evenly spaced ones, so keys can be found in constant time.
+--- Keys between the original ones are interpolated, so the result can lose some detail with low rates.
+--- @param step number: Time between keys
+--- @param duration number: The length of the animation
+--- @return self
+function Track:resample(step, duration)
+    assert(step > 0, "Resampling step must be greater than zero")
+
+    if self.count == 1 then
+        return self
+    end
+
+    local count = ceil(duration / step) + 1
+    local times = ffi.new("double[?]", count)
+    local values = self.isRotation and QuaternionArray(count) or Vector3Array(count)
+    local value = self.isRotation and Quaternion() or Vector3()
+    local cursor = 0
+
+    values:resize(count)
+
+    for i=0, count-1 do
+        times[i] = i * step
+        local _, newCursor = self:sample(times[i], cursor, value)
+        values.data[i] = value
+        cursor = newCursor
+    end
+
+    self.times = times
+    self.values = values
+    self.count = count
+    self.step = step
+
+    return self
+end
+
+
+return Track
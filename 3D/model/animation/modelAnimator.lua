@@ -1,9 +1,9 @@
-local Vector3    = require "engine.math.vector3"
-local Quaternion = require "engine.math.quaternion"
-local Object     = require "engine.3rdparty.classic.classic"
-local newtable   = require "table.new"
-
-local MAX_BONES = 20
+local Vector3         = require "engine.math.vector3"
+local Quaternion      = require "engine.math.quaternion"
+local Vector3Array    = require "engine.math.vector3Array"
+local QuaternionArray = require "engine.math.quaternionArray"
+local Object          = require "engine.3rdparty.classic.classic"
+local ffi             = require "ffi"
 
 
 --- @class ModelAnimator: Object
@@ -12,16 +12,24 @@ local MAX_BONES = 20
 --- @field public isPlaying boolean
 --- @field public duration number
 --- @field public fps integer
---- @field public finalQuaternions Quaternion[]
---- @field public finalScaling Vector3[]
+--- @field public maxBones integer
+--- @field public boneQuaternions QuaternionArray: Dual quaternion of each bone (real and dual parts), backed by a ByteData that can be sent to shaders
+--- @field public boneScaling Vector3Array: Scaling of each bone, backed by a ByteData that can be sent to shaders
+--- @field public manager ModelAnimationManager?: Manager that updates the pose of this animator, if any
 ---
 --- @field private animation ModelAnimation
 --- @field private armature ModelArmature
 --- @field private armatureToModelMatrix Matrix4
+--- @field private cursors ffi.cdata*
 ---
 --- @overload fun(animation: ModelAnimation, armature: ModelArmature, modelOriginalGlobalMatrix: Matrix4): ModelAnimator
 local Animator = Object:extend("ModelAnimator")
 
+-- Must match MAX_BONE_COUNT in the shaders (see [engine/shaders/default.glsl]).
+-- Armatures with more bones use shaders compiled with BONE_TEXTURE, which allow up to MAX_TEXTURE_BONES
+Animator.MAX_BONES = 64
+Animator.MAX_TEXTURE_BONES = 1024
+
 
 function Animator:new(animation, armature, modelOriginalGlobalMatrix)
     self.time = 0
@@ -32,29 +40,48 @@ function Animator:new(animation, armature, modelOriginalGlobalMatrix)
     self.animation = animation
     self.armature = armature
     self.armatureToModelMatrix = armature:getGlobalMatrix() * modelOriginalGlobalMatrix.inverse
+    self.cursors = animation:createCursors()
 
-    self.finalQuaternions = newtable(MAX_BONES*2, 0)
-    self.finalScaling = newtable(MAX_BONES, 0)
-
-    for i=1, MAX_BONES do
-        self.finalQuaternions[i*2-1] = Quaternion.Identity()
-        self.finalQuaternions[i*2]   = Quaternion()
-        self.finalScaling[i]         = Vector3(1)
-    end
+    self.maxBones = Animator.GetMaxBones(armature)
+    self.boneQuaternions, self.boneScaling = Animator.CreatePoseBuffers(self.maxBones)
+    self.manager = nil
 end
 
 
-function Animator:update(dt)
+--- Advances the playback time without updating the pose
+---@param dt number
+function Animator:advance(dt)
     if self.isPlaying then
         self.time = (self.time + self.fps * dt) % self.duration
     end
+end
 
-    for name, bone in pairs(self.armature.rootBones) do
-        self.animation:updateBonesDQS(self.time, self.finalQuaternions, self.finalScaling, bone, self.armatureToModelMatrix)
+
+--- Evaluates the skeleton pose at `time`
+---@param time number?: Defaults to the current playback time
+---@param outQuaternions QuaternionArray?: Defaults to `boneQuaternions`
+---@param outScaling Vector3Array?: Defaults to `boneScaling`
+function Animator:updatePose(time, outQuaternions, outScaling)
+    outQuaternions = outQuaternions or self.boneQuaternions
+    self.animation:updatePoseDQS(time or self.time, self.armature, self.armatureToModelMatrix, self.cursors, outQuaternions, outScaling or self.boneScaling)
+    Animator.MarkPoseChanged(outQuaternions)
+end
+
+
+--- Waits until the pose is ready, if its manager is evaluating it in the job threads
+function Animator:waitForPose()
+    if self.manager then
+        self.manager:waitForPoses()
     end
 end
 
 
+function Animator:update(dt)
+    self:advance(dt)
+    self:updatePose()
+end
+
+
 function Animator:stop()
     self.isPlaying = false
     self.time = 0
@@ -71,4 +98,98 @@ function Animator:pause()
 end
 
 
+--- Gets the size of the pose buffers needed by an armature: `MAX_BONES`, or enough for all its bones
+--- (up to `MAX_TEXTURE_BONES`) if it has more
+---@param armature ModelArmature
+---@return integer
+function Animator.GetMaxBones(armature)
+    local maxBones = Animator.MAX_BONES
+
+    for i, bone in ipairs(armature.sortedBones) do
+        maxBones = math.max(maxBones, bone.id + 1)
+    end
+
+    return math.min(maxBones, Animator.MAX_TEXTURE_BONES)
+end
+
+
+--- Creates buffers that can store the pose of a skeleton, initialized with the bind pose
+---@param maxBones integer
+---@return QuaternionArray: Dual quaternions
+---@return Vector3Array: Scaling
+function Animator.CreatePoseBuffers(maxBones)
+    local quaternions = QuaternionArray(maxBones*2, love.data.newByteData(ffi.sizeof("Quaternion") * maxBones*2))
+    local scaling = Vector3Array(maxBones, love.data.newByteData(ffi.sizeof("Vector3") * maxBones))
+
+    quaternions:resize(maxBones*2)
+    scaling:resize(maxBones)
+
+    for i=1, maxBones do
+        quaternions:set(i*2-1, Quaternion.Identity())
+        scaling:set(i, Vector3(1))
+    end
+
+    return quaternions, scaling
+end
+
+
+local boneTextures = setmetatable({}, {__mode = "k"})
+
+--- Marks a pose buffer as changed, so its bone texture is uploaded again by the next `GetBoneTexture`.
+--- `updatePose` and `ModelAnimationManager` already do it, call it after writing a pose any other way
+---@param quaternions QuaternionArray: Dual quaternions of the pose
+function Animator.MarkPoseChanged(quaternions)
+    local entry = boneTextures[quaternions]
+
+    if entry then
+        entry.isDirty = true
+    end
+end
+
+
+--- Gets a float texture with a pose, for shaders compiled with BONE_TEXTURE. Each bone takes 3 texels:
+--- the real and dual parts of its dual quaternion, and its scale. The texture is cached per pose buffer,
+--- and only uploaded again when the pose changed (see `MarkPoseChanged`).
+---@param quaternions QuaternionArray: Dual quaternions
+---@param scaling Vector3Array: Scaling
+---@return love.Image
+function Animator.GetBoneTexture(quaternions, scaling)
+    local boneCount = scaling.length
+    local entry = boneTextures[quaternions]
+
+    if not entry or entry.boneCount ~= boneCount then
+        local imageData = love.image.newImageData(boneCount*3, 1, "rgba32f")
+
+        entry = {
+            boneCount = boneCount,
+            imageData = imageData,
+            pixels = ffi.cast("float*", imageData:getFFIPointer()),
+            image = love.graphics.newImage(imageData),
+            isDirty = true,
+        }
+        entry.image:setFilter("nearest", "nearest")
+        boneTextures[quaternions] = entry
+    end
+
+    if not entry.isDirty then
+        return entry.image
+    end
+
+    local pixels, quats, scales = entry.pixels, quaternions.data, scaling.data
+
+    for i=0, boneCount-1 do
+        local p = i*12
+        local scale = scales[i]
+
+        ffi.copy(pixels + p, quats + i*2, 32)
+        pixels[p+8], pixels[p+9], pixels[p+10], pixels[p+11] = scale.x, scale.y, scale.z, 1
+    end
+
+    entry.image:replacePixels(entry.imageData)
+    entry.isDirty = false
+
+    return entry.image
+end
+
+
 return Animator
\ No newline at end of file
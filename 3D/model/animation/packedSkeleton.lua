@@ -0,0 +1,232 @@
+local Matrix4      = require "engine.math.matrix4"
+local Matrix4Array = require "engine.math.matrix4Array"
+local Quaternion   = require "engine.math.quaternion"
+local Vector3      = require "engine.math.vector3"
+local Track        = require "engine.3D.model.animation.modelAnimationTrack"
+local ffi          = require "ffi"
+
+require "love.data"
+
+
+ffi.cdef [[
+    typedef struct {
+        int32_t boneCount, trackCount, maxBones, valuesOffset;
+        Matrix4 rootTransform;
+    } packed_skeleton_header;
+
+    typedef struct {
+        Matrix4 localMatrix;
+        Matrix4 offset;
+        int32_t parent, id;
+        int32_t track, _padding; // First of the position, rotation and scale tracks, -1 if the bone isn't animated
+    } packed_skeleton_bone;
+
+    typedef struct {
+        double step; // 0 if the track wasn't resampled
+        int32_t count, isRotation;
+        int32_t timesOffset, valuesOffset;
+    } packed_skeleton_track;
+]]
+
+local HEADER_SIZE = ffi.sizeof("packed_skeleton_header")
+local BONE_SIZE = ffi.sizeof("packed_skeleton_bone")
+local TRACK_SIZE = ffi.sizeof("packed_skeleton_track")
+
+-- Skeletons already unpacked by this Lua state
+local unpacked = setmetatable({}, {__mode = "k"}) ---@type table<love.Data, table>
+
+
+---
+--- An animation and the armature it plays on, packed into a single `ByteData` so poses can be evaluated
+--- in the job threads, which can't see the `ModelAnimation` and `ModelArmature` objects.
+---
+--- Layout: header, bones (in `sortedBones` order), tracks, key times (doubles), key values (`Vector3` or `Quaternion`).
+--- Bone local matrices are copied when packing, so changes made to them afterwards are ignored.
+---
+local PackedSkeleton = {}
+
+
+---@param offset integer
+---@return integer
+local function align(offset)
+    return math.ceil(offset / 8) * 8
+end
+
+
+--- Packs an animation and an armature
+---@param animation ModelAnimation
+---@param armature ModelArmature
+---@param rootTransform Matrix4
+---@param maxBones integer: Size of the output pose buffers, bones with greater ids are ignored
+---@return love.ByteData
+function PackedSkeleton.Pack(animation, armature, rootTransform, maxBones)
+    local bones = armature.sortedBones
+    local tracks = {} ---@type ModelAnimationTrack[]
+    local timeCount, valuesSize = 0, 0
+
+    for _, bone in ipairs(bones) do
+        local animNode = animation.animNodes[bone.name]
+
+        if animNode then
+            for _, track in ipairs({animNode._positionTrack, animNode._rotationTrack, animNode._scaleTrack}) do
+                tracks[#tracks+1] = track
+                timeCount = timeCount + track.count
+                valuesSize = valuesSize + track.count * ffi.sizeof(track.isRotation and "Quaternion" or "Vector3")
+            end
+        end
+    end
+
+    local timesOffset = align(HEADER_SIZE + BONE_SIZE * #bones + TRACK_SIZE * #tracks)
+    local valuesOffset = timesOffset + timeCount * 8
+    local data = love.data.newByteData(valuesOffset + math.max(valuesSize, 1))
+    local pointer = ffi.cast("uint8_t*", data:getFFIPointer())
+
+    local header = ffi.cast("packed_skeleton_header*", pointer)
+    local packedBones = ffi.cast("packed_skeleton_bone*", pointer + HEADER_SIZE)
+    local packedTracks = ffi.cast("packed_skeleton_track*", pointer + HEADER_SIZE + BONE_SIZE * #bones)
+    local times = ffi.cast("double*", pointer + timesOffset)
+
+    header.boneCount = #bones
+    header.trackCount = #tracks
+    header.maxBones = maxBones
+    header.valuesOffset = valuesOffset
+    header.rootTransform = rootTransform
+
+    local trackIndex = 0
+
+    for i, bone in ipairs(bones) do
+        local packed = packedBones[i-1]
+
+        packed.localMatrix = bone.localMatrix
+        packed.offset = bone.offset
+        packed.parent = armature.parentIndices[i]
+        packed.id = bone.id
+        packed.track = animation.animNodes[bone.name] and trackIndex or -1
+
+        if packed.track >= 0 then
+            trackIndex = trackIndex + 3
+        end
+    end
+
+    local timeOffset, valueOffset = 0, 0
+
+    for t, track in ipairs(tracks) do
+        local packed = packedTracks[t-1]
+        local valueSize = track.count * ffi.sizeof(track.isRotation and "Quaternion" or "Vector3")
+
+        packed.step = track.step or 0
+        packed.count = track.count
+        packed.isRotation = track.isRotation and 1 or 0
+        packed.timesOffset = timeOffset
+        packed.valuesOffset = valueOffset
+
+        ffi.copy(times + timeOffset, track.times, track.count * 8)
+        ffi.copy(pointer + valuesOffset + valueOffset, track.values.data, valueSize)
+
+        timeOffset = timeOffset + track.count
+        valueOffset = valueOffset + valueSize
+    end
+
+    return data
+end
+
+
+---@param data love.Data
+---@return table
+local function unpackSkeleton(data)
+    local pointer = ffi.cast("uint8_t*", data:getFFIPointer())
+    local header = ffi.cast("packed_skeleton_header*", pointer)
+    local bones = ffi.cast("packed_skeleton_bone*", pointer + HEADER_SIZE)
+    local packedTracks = ffi.cast("packed_skeleton_track*", pointer + HEADER_SIZE + BONE_SIZE * header.boneCount)
+    local times = ffi.cast("double*", pointer + align(HEADER_SIZE + BONE_SIZE * header.boneCount + TRACK_SIZE * header.trackCount))
+    local tracks = {}
+
+    -- Tracks that read the packed keys, without copying them
+    for t=0, header.trackCount-1 do
+        local packed = packedTracks[t]
+        local values = pointer + header.valuesOffset + packed.valuesOffset
+
+        tracks[t] = setmetatable({
+            count = packed.count,
+            isRotation = packed.isRotation == 1,
+            times = times + packed.timesOffset,
+            values = {data = ffi.cast(packed.isRotation == 1 and "Quaternion*" or "Vector3*", values)},
+            step = packed.step > 0 and packed.step or nil,
+        }, Track)
+    end
+
+    local skeleton = {header = header, bones = bones, tracks = tracks, data = data}
+    unpacked[data] = skeleton
+
+    return skeleton
+end
+
+
+local samplePosition = Vector3()
+local sampleRotation = Quaternion()
+local sampleScale = Vector3()
+local sampleTransform = Matrix4()
+local finalTransform = Matrix4()
+local globalTransforms = Matrix4Array(64)
+
+
+--- Evaluates the skeleton for dual quaternion skinning, like `ModelAnimation:updatePoseDQS`.
+--- Bones without an id in the skeleton keep the bind pose.
+---@param data love.Data: Packed skeleton
+---@param time number
+---@param outQuaternions ffi.cdata*: `Quaternion*` with 2 elements per bone
+---@param outScaling ffi.cdata*: `Vector3*` with 1 element per bone
+function PackedSkeleton.EvaluateDQS(data, time, outQuaternions, outScaling)
+    local skeleton = unpacked[data] or unpackSkeleton(data)
+    local header, bones, tracks = skeleton.header, skeleton.bones, skeleton.tracks
+    local boneCount, maxBones = header.boneCount, header.maxBones
+
+    for id=0, maxBones-1 do
+        local real, dual, scale = outQuaternions[id*2], outQuaternions[id*2+1], outScaling[id]
+
+        real.x, real.y, real.z, real.w = 0, 0, 0, 1
+        dual.x, dual.y, dual.z, dual.w = 0, 0, 0, 0
+        scale.x, scale.y, scale.z = 1, 1, 1
+    end
+
+    globalTransforms:resize(boneCount)
+    local globals = globalTransforms.data
+
+    for i=0, boneCount-1 do
+        local bone = bones[i]
+        local transform = bone.localMatrix
+
+        if bone.track >= 0 then
+            tracks[bone.track]:sample(time, nil, samplePosition)
+            tracks[bone.track+1]:sample(time, nil, sampleRotation)
+            tracks[bone.track+2]:sample(time, nil, sampleScale)
+
+            transform = Matrix4.CreateTransformationMatrixInto(sampleTransform, sampleRotation, sampleScale, samplePosition)
+        end
+
+        Matrix4.MultiplyInto(globals[i], transform, bone.parent > 0 and globals[bone.parent-1] or header.rootTransform)
+    end
+
+    for i=0, boneCount-1 do
+        local bone = bones[i]
+        local id = bone.id
+
+        if id < maxBones then
+            Matrix4.MultiplyInto(finalTransform, bone.offset, globals[i])
+
+            local translation, scale, rotation = Matrix4.DecomposeInto(finalTransform, samplePosition, outScaling[id], outQuaternions[id*2])
+            Quaternion.CreateDualQuaternionTranslationInto(outQuaternions[id*2+1], rotation, translation)
+        end
+    end
+end
+
+
+--- Size in bytes of the pose of a skeleton evaluated by `EvaluateDQS` (dual quaternions followed by scaling)
+---@param maxBones integer
+---@return integer
+function PackedSkeleton.GetPoseSize(maxBones)
+    return maxBones * (2 * ffi.sizeof("Quaternion") + ffi.sizeof("Vector3"))
+end
+
+
+return PackedSkeleton
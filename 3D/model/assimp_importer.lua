@@ -1,11 +1,20 @@
-local Matrix4     = require "engine.math.matrix4"
-local Vector3     = require "engine.math.vector3"
-local Vector2     = require "engine.math.vector2"
-local Quaternion  = require "engine.math.quaternion"
-local BoundingBox = require "engine.math.boundingBox"
-local bit         = require "bit"
-local ffi         = require "ffi"
-local newtable    = require "table.new"
+local MeshSimplifier = require "engine.3D.model.meshSimplifier"
+local TriangleBVH    = require "engine.math.triangleBVH"
+local bit            = require "bit"
+local ffi            = require "ffi"
+local newtable       = require "table.new"
+
+require "love.data"
+require "engine.3D.model.vertexFormat" -- For the vertex C type
+
+
+-- The importer can run in the content loading threads, so the scene it returns only has plain
+-- tables (matrices are 16 numbers in `Matrix4` constructor order, vectors are {x, y, z}),
+-- and the mesh data is already packed in `ByteData`, ready to be uploaded.
+
+local VERTEX_SIZE = ffi.sizeof("struct vertex")
+local COMPACT_VERTEX_SIZE = ffi.sizeof("struct compact_vertex")
+local NO_BONE = 255
 
 
 local ENABLE_LOGGING = false
@@ -127,26 +136,158 @@ local function readString(aiString)
 end
 
 local function readMatrix4x4(mat)
-    return Matrix4(
+    return {
         mat.a1, mat.b1, mat.c1, mat.d1,
         mat.a2, mat.b2, mat.c2, mat.d2,
         mat.a3, mat.b3, mat.c3, mat.d3,
         mat.a4, mat.b4, mat.c4, mat.d4
-    )
+    }
 end
 
+local IDENTITY_MATRIX = {
+    1, 0, 0, 0,
+    0, 1, 0, 0,
+    0, 0, 1, 0,
+    0, 0, 0, 1
+}
+
 local function readVector3(aiVec)
-    return Vector3(aiVec.x, aiVec.y, aiVec.z)
+    return {aiVec.x, aiVec.y, aiVec.z}
 end
 
 local function readVector2(aiVec)
-    return Vector2(aiVec.x, aiVec.y)
+    return {aiVec.x, aiVec.y}
 end
 
 local function readColor3(aiColor)
     return {aiColor.r, aiColor.g, aiColor.b}
 end
 
+-- Packs animation keys in the format used by `ModelAnimationTrack`, see `CompiledAnimationKeys`
+local function readAnimationKeys(aiKeys, count, isRotation)
+    local stride = isRotation and 4 or 3
+    local times = love.data.newByteData(math.max(count, 1) * ffi.sizeof("double"))
+    local values = love.data.newByteData(math.max(count, 1) * stride * ffi.sizeof("float"))
+    local timesPointer = ffi.cast("double*", times:getFFIPointer())
+    local valuesPointer = ffi.cast("float*", values:getFFIPointer())
+
+    for k=0, count-1 do
+        local key = aiKeys[k]
+        local offset = k * stride
+
+        timesPointer[k] = key.mTime
+        valuesPointer[offset], valuesPointer[offset+1], valuesPointer[offset+2] = key.mValue.x, key.mValue.y, key.mValue.z
+
+        if isRotation then
+            valuesPointer[offset+3] = key.mValue.w
+        end
+    end
+
+    return {count = count, times = times, values = values}
+end
+
+-- Octahedral encoding of a direction, in the [0, 1] range (same as `EncodeOctahedron` in `incl_utils.glsl`)
+local function encodeOctahedron(x, y, z)
+    local length = math.abs(x) + math.abs(y) + math.abs(z)
+    if length == 0 then
+        return 0.5, 0.5
+    end
+
+    x, y, z = x / length, y / length, z / length
+
+    if z < 0 then
+        x, y =
+            (1 - math.abs(y)) * (x >= 0 and 1 or -1),
+            (1 - math.abs(x)) * (y >= 0 and 1 or -1)
+    end
+
+    return x * 0.5 + 0.5, y * 0.5 + 0.5
+end
+
+-- Gets the `offset` and `scale` that map the [0, 1] range to the range of `min` and `max`,
+-- and the factor that maps that range back to unorm16 values
+local function getQuantizationRange(min, max)
+    local scale = max - min
+    return min, scale, scale > 0 and 65535 / scale or 0
+end
+
+-- Converts float vertices to the compact layout, see `vertexFormat.lua`.
+-- Returns `nil` if the mesh uses bone IDs that don't fit in a byte
+---@return love.ByteData?, MeshPartQuantization?
+local function packVertices(pointer, vertexCount)
+    local data = love.data.newByteData(math.max(vertexCount, 1) * COMPACT_VERTEX_SIZE)
+    local compactPointer = ffi.cast("struct compact_vertex*", data:getFFIPointer())
+    local floor, huge = math.floor, math.huge
+
+    -- Bounds of the positions and UVs
+    local minX, minY, minZ, minU, minV = huge, huge, huge, huge, huge
+    local maxX, maxY, maxZ, maxU, maxV = -huge, -huge, -huge, -huge, -huge
+
+    for v=0, vertexCount-1 do
+        local position, uv = pointer[v].position, pointer[v].uv
+
+        minX, maxX = math.min(minX, position.x), math.max(maxX, position.x)
+        minY, maxY = math.min(minY, position.y), math.max(maxY, position.y)
+        minZ, maxZ = math.min(minZ, position.z), math.max(maxZ, position.z)
+        minU, maxU = math.min(minU, uv.x), math.max(maxU, uv.x)
+        minV, maxV = math.min(minV, uv.y), math.max(maxV, uv.y)
+    end
+
+    if vertexCount == 0 then
+        minX, minY, minZ, minU, minV, maxX, maxY, maxZ, maxU, maxV = 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    end
+
+    local offsetX, scaleX, factorX = getQuantizationRange(minX, maxX)
+    local offsetY, scaleY, factorY = getQuantizationRange(minY, maxY)
+    local offsetZ, scaleZ, factorZ = getQuantizationRange(minZ, maxZ)
+    local offsetU, scaleU, factorU = getQuantizationRange(minU, maxU)
+    local offsetV, scaleV, factorV = getQuantizationRange(minV, maxV)
+
+    for v=0, vertexCount-1 do
+        local vertex, compact = pointer[v], compactPointer[v]
+        local position, uv = vertex.position, vertex.uv
+
+        compact.position[0] = floor((position.x - offsetX) * factorX + 0.5)
+        compact.position[1] = floor((position.y - offsetY) * factorY + 0.5)
+        compact.position[2] = floor((position.z - offsetZ) * factorZ + 0.5)
+        compact.position[3] = 65535
+        compact.uv[0] = floor((uv.x - offsetU) * factorU + 0.5)
+        compact.uv[1] = floor((uv.y - offsetV) * factorV + 0.5)
+
+        local nx, ny = encodeOctahedron(vertex.normal.x, vertex.normal.y, vertex.normal.z)
+        local tx, ty = encodeOctahedron(vertex.tangent.x, vertex.tangent.y, vertex.tangent.z)
+        compact.normalTangent[0], compact.normalTangent[1] = floor(nx * 65535 + 0.5), floor(ny * 65535 + 0.5)
+        compact.normalTangent[2], compact.normalTangent[3] = floor(tx * 65535 + 0.5), floor(ty * 65535 + 0.5)
+
+        -- Weights are rounded down, the remainder goes to the heaviest one so they still add up to 1
+        local total, heaviest = 0, 0
+        for i=0, 3 do
+            local id = vertex.boneIds[i]
+            if id >= NO_BONE then
+                return nil
+            end
+
+            compact.boneIds[i] = id < 0 and NO_BONE or id
+            compact.weights[i] = floor(vertex.weights[i] * 255)
+            total = total + compact.weights[i]
+
+            if vertex.weights[i] > vertex.weights[heaviest] then
+                heaviest = i
+            end
+        end
+
+        if total > 0 then
+            compact.weights[heaviest] = compact.weights[heaviest] + 255 - total
+        end
+    end
+
+    return data, {
+        positionScale = {scaleX, scaleY, scaleZ},
+        positionOffset = {offsetX, offsetY, offsetZ},
+        texCoordsTransform = {scaleU, scaleV, offsetU, offsetV},
+    }
+end
+
 local function getMaterialTexture(aiMat, basePath, aiTextureType)
     local path            = ffi.new("struct aiString[1]")
     local textureMapping  = ffi.new("enum aiTextureMapping[1]")
@@ -186,7 +327,7 @@ end
 
 
 
-local function importer(path, triangulate, flipUVs, removeUnusedMaterials, optimizeGraph)
+local function importer(path, triangulate, flipUVs, removeUnusedMaterials, optimizeGraph, compactVertices, lodRatios, buildTriangleBVH)
     if ENABLE_LOGGING then
         Assimp.aiEnableVerboseLogging(true)
         Assimp.aiAttachLogStream(aiLogStream)
@@ -236,7 +377,10 @@ local function importer(path, triangulate, flipUVs, removeUnusedMaterials, optim
         meshParts  = newtable(aiScene.mNumMeshes, 0),
         lights     = newtable(0, aiScene.mNumLights),
         cameras    = newtable(0, aiScene.mNumCameras),
-        armatures  = newtable(0, aiScene.mNumSkeletons)
+        armatures  = newtable(0, aiScene.mNumSkeletons),
+
+        -- Vertex memory of all mesh parts, and how much the compact layout saved
+        vertexMemory = {bytes = 0, saved = 0}
     }
 
 
@@ -331,40 +475,74 @@ local function importer(path, triangulate, flipUVs, removeUnusedMaterials, optim
     -- Get mesh parts and bones
     for m=1, aiScene.mNumMeshes do
         local aiMesh = aiScene.mMeshes[m-1]
+        local vertexCount = aiMesh.mNumVertices
+        local vertices = love.data.newByteData(VERTEX_SIZE * vertexCount)
+        local indexType = vertexCount > 0xFFFF and "uint32" or "uint16"
+        local indexCount = 0
+
+        for f=1, aiMesh.mNumFaces do
+            indexCount = indexCount + aiMesh.mFaces[f-1].mNumIndices
+        end
+
+        local indices = love.data.newByteData(math.max(indexCount, 1) * (indexType == "uint32" and 4 or 2))
         local part = {
             name     = readString(aiMesh.mName),
             material = getMaterialValue(aiScene.mMaterials[aiMesh.mMaterialIndex], "?mat.name", "string"),
-            indices  = newtable(aiMesh.mNumFaces*3, 0),
-            aabb     = BoundingBox(readVector3(aiMesh.mAABB.mMin), readVector3(aiMesh.mAABB.mMax)),
-
-            positions  = newtable(aiMesh.mNumVertices, 0),
-            normals    = newtable(aiMesh.mNumVertices, 0),
-            tangents   = newtable(aiMesh.mNumVertices, 0),
-            uvs        = newtable(aiMesh.mNumVertices, 0),
-            boneIds    = newtable(aiMesh.mNumVertices, 0),
-            weights    = newtable(aiMesh.mNumVertices, 0),
+            aabb     = {min = readVector3(aiMesh.mAABB.mMin), max = readVector3(aiMesh.mAABB.mMax)},
+
+            vertexCount = vertexCount,
+            vertices    = vertices,
+            indexCount  = indexCount,
+            indexType   = indexType,
+            indices     = indices,
+
+            vertexFormat = "standard",
+            quantization = nil,
+            lods         = nil,
+            triangleBVH  = nil,
         }
         scene.meshParts[m] = part
 
-        -- Vertices
-        for v=1, aiMesh.mNumVertices do
-            local vi = v-1
+        -- Vertices are copied straight from the assimp arrays
+        local pointer = ffi.cast("struct vertex*", vertices:getFFIPointer())
+        local aiPositions, aiNormals, aiTangents, aiUVs = aiMesh.mVertices, aiMesh.mNormals, aiMesh.mTangents, aiMesh.mTextureCoords[0]
+
+        for v=0, vertexCount-1 do
+            local vertex = pointer[v]
+            local position = aiPositions[v]
+
+            vertex.position.x, vertex.position.y, vertex.position.z = position.x, position.y, position.z
+
+            if aiNormals ~= nil then
+                local normal = aiNormals[v]
+                vertex.normal.x, vertex.normal.y, vertex.normal.z = normal.x, normal.y, normal.z
+            end
+
+            if aiTangents ~= nil then
+                local tangent = aiTangents[v]
+                vertex.tangent.x, vertex.tangent.y, vertex.tangent.z = tangent.x, tangent.y, tangent.z
+            end
+
+            if aiUVs ~= nil then
+                local uv = aiUVs[v]
+                vertex.uv.x, vertex.uv.y = uv.x, uv.y
+            end
 
-            part.positions[v]  = readVector3(aiMesh.mVertices[vi])
-            part.normals[v]    = aiMesh.mNormals          ~= nil and readVector3(aiMesh.mNormals[vi])          or Vector3()
-            part.tangents[v]   = aiMesh.mTangents         ~= nil and readVector3(aiMesh.mTangents[vi])         or Vector3()
-            part.uvs[v]        = aiMesh.mTextureCoords[0] ~= nil and readVector2(aiMesh.mTextureCoords[0][vi]) or Vector2()
-            part.boneIds[v]   = {-1,-1,-1,-1}
-            part.weights[v]   = {0,0,0,0}
+            for i=0, 3 do
+                vertex.boneIds[i] = -1
+                vertex.weights[i] = 0
+            end
         end
 
-        -- Indices
-        local ii = 1
+        -- Indices (0-based)
+        local indexPointer = ffi.cast(indexType == "uint32" and "uint32_t*" or "uint16_t*", indices:getFFIPointer())
+        local ii = 0
+
         for f=1, aiMesh.mNumFaces do
             local aiFace = aiMesh.mFaces[f-1]
 
             for i=1, aiFace.mNumIndices do
-                part.indices[ii] = aiFace.mIndices[i-1]+1
+                indexPointer[ii] = aiFace.mIndices[i-1]
                 ii = ii+1
             end
         end
@@ -392,17 +570,44 @@ local function importer(path, triangulate, flipUVs, removeUnusedMaterials, optim
             -- Assign bone weights to vertices
             for w=1, aiBone.mNumWeights do
                 local aiWeight = aiBone.mWeights[w-1]
-                local vert = aiWeight.mVertexId+1
+                local vertex = pointer[aiWeight.mVertexId]
 
-                for i=1, 4 do
-                    if part.boneIds[vert][i] == -1 then
-                        part.boneIds[vert][i] = bone.id
-                        part.weights[vert][i] = aiWeight.mWeight
+                for i=0, 3 do
+                    if vertex.boneIds[i] == -1 then
+                        vertex.boneIds[i] = bone.id
+                        vertex.weights[i] = aiWeight.mWeight
                         break
                     end
                 end
             end
         end
+
+        -- Ray query acceleration, from the full detail triangles
+        if buildTriangleBVH and indexCount > 0 and indexCount == aiMesh.mNumFaces * 3 then
+            part.triangleBVH = TriangleBVH.Build(pointer, VERTEX_SIZE, indexPointer, indexCount)
+        end
+
+        -- Levels of detail, they are appended to the index buffer and share the same vertices
+        if lodRatios and lodRatios[1] and indexCount > 0 and indexCount == aiMesh.mNumFaces * 3 then
+            part.indices, part.lods = MeshSimplifier.GenerateLods(pointer, vertexCount, indices, indexCount, indexType, lodRatios)
+            indices:release()
+        end
+
+        -- Quantize vertices
+        local compactData, quantization = nil, nil
+        if compactVertices then
+            compactData, quantization = packVertices(pointer, vertexCount)
+        end
+
+        if compactData then
+            part.vertices = compactData
+            part.vertexFormat = "compact"
+            part.quantization = quantization
+            scene.vertexMemory.saved = scene.vertexMemory.saved + vertices:getSize() - compactData:getSize()
+            vertices:release()
+        end
+
+        scene.vertexMemory.bytes = scene.vertexMemory.bytes + part.vertices:getSize()
     end
 
 
@@ -429,7 +634,7 @@ local function importer(path, triangulate, flipUVs, removeUnusedMaterials, optim
         if armature and armature[parentNode.name] and not armature[node.name] then
             armature[node.name] = {
                 id = armatureBoneIDs[armatureName],
-                offset = Matrix4.Identity()
+                offset = IDENTITY_MATRIX
             }
             armatureBoneIDs[armatureName] = armatureBoneIDs[armatureName] + 1
         end
@@ -460,26 +665,11 @@ local function importer(path, triangulate, flipUVs, removeUnusedMaterials, optim
             local aiNodeAnim = aiAnim.mChannels[n-1]
             local animNode = {
                 name         = readString(aiNodeAnim.mNodeName),
-                positionKeys = newtable(aiNodeAnim.mNumPositionKeys, 0),
-                scaleKeys    = newtable(aiNodeAnim.mNumScalingKeys,  0),
-                rotationKeys = newtable(aiNodeAnim.mNumRotationKeys, 0),
+                positionKeys = readAnimationKeys(aiNodeAnim.mPositionKeys, aiNodeAnim.mNumPositionKeys, false),
+                scaleKeys    = readAnimationKeys(aiNodeAnim.mScalingKeys,  aiNodeAnim.mNumScalingKeys,  false),
+                rotationKeys = readAnimationKeys(aiNodeAnim.mRotationKeys, aiNodeAnim.mNumRotationKeys, true),
             }
 
-            for k=1, aiNodeAnim.mNumPositionKeys do
-                local aiKey = aiNodeAnim.mPositionKeys[k-1]
-                animNode.positionKeys[k] = {time = aiKey.mTime, value = readVector3(aiKey.mValue)}
-            end
-
-            for k=1, aiNodeAnim.mNumRotationKeys do
-                local aiKey = aiNodeAnim.mRotationKeys[k-1]
-                animNode.rotationKeys[k] = {time = aiKey.mTime, value = Quaternion(aiKey.mValue.x, aiKey.mValue.y, aiKey.mValue.z, aiKey.mValue.w)}
-            end
-
-            for k=1, aiNodeAnim.mNumScalingKeys do
-                local aiKey = aiNodeAnim.mScalingKeys[k-1]
-                animNode.scaleKeys[k] = {time = aiKey.mTime, value = readVector3(aiKey.mValue)}
-            end
-
             animation.nodes[animNode.name] = animNode
         end
 
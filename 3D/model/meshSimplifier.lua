@@ -0,0 +1,365 @@
+local PriorityQueue = require "engine.collections.priorityQueue"
+local ffi           = require "ffi"
+local newtable      = require "table.new"
+
+require "love.data"
+require "engine.3D.model.vertexFormat" -- For the vertex C type
+
+local floor, sqrt, huge = math.floor, math.sqrt, math.huge
+
+
+-- Collapses can't rotate a triangle normal by more than ~78 degrees
+local MIN_NORMAL_DOT = 0.2
+
+
+---
+--- Generates levels of detail of triangle meshes, using quadric error metrics with half edge collapses.
+---
+--- Vertices are never moved or created, each level is just a new index buffer over the same vertices,
+--- so all levels can share a single vertex buffer. Vertices on open edges are never removed, which also
+--- keeps UV and normal seams (where the importer splits vertices) intact.
+---
+--- Doesn't depend on `love.graphics`, so it can run in the content loading threads.
+---
+local MeshSimplifier = {}
+
+
+-- Adds the quadric of a plane to the quadric of a vertex
+---@param q ffi.cdata*
+---@param o integer: Offset of the vertex quadric
+local function addPlaneQuadric(q, o, a, b, c, d, weight)
+    q[o  ] = q[o  ] + a*a*weight
+    q[o+1] = q[o+1] + a*b*weight
+    q[o+2] = q[o+2] + a*c*weight
+    q[o+3] = q[o+3] + a*d*weight
+    q[o+4] = q[o+4] + b*b*weight
+    q[o+5] = q[o+5] + b*c*weight
+    q[o+6] = q[o+6] + b*d*weight
+    q[o+7] = q[o+7] + c*c*weight
+    q[o+8] = q[o+8] + c*d*weight
+    q[o+9] = q[o+9] + d*d*weight
+end
+
+-- Squared distance of a point to the planes of a quadric
+local function evaluateQuadric(q, o, x, y, z)
+    return
+        q[o  ]*x*x + 2*q[o+1]*x*y + 2*q[o+2]*x*z + 2*q[o+3]*x +
+        q[o+4]*y*y + 2*q[o+5]*y*z + 2*q[o+6]*y +
+        q[o+7]*z*z + 2*q[o+8]*z +
+        q[o+9]
+end
+
+local function triangleNormal(p1, p2, p3)
+    local ax, ay, az = p2.x - p1.x, p2.y - p1.y, p2.z - p1.z
+    local bx, by, bz = p3.x - p1.x, p3.y - p1.y, p3.z - p1.z
+
+    return ay*bz - az*by, az*bx - ax*bz, ax*by - ay*bx
+end
+
+
+
+--- Simplifies a mesh to each of the `ratios` of its triangle count. Returns a new index buffer with the original
+--- indices followed by the indices of each level, and the `{start, count}` range of each level in it (1-based,
+--- like `Mesh:setDrawRange`). Levels that couldn't be simplified further than the previous one are skipped.
+---@param vertices ffi.cdata*: `struct vertex*`
+---@param vertexCount integer
+---@param indices love.ByteData: Triangle list, 0-based
+---@param indexCount integer
+---@param indexType love.IndexDataType
+---@param ratios number[]: Target fraction of the original triangles of each level, in decreasing order
+---@return love.ByteData indices, integer[][] ranges
+function MeshSimplifier.GenerateLods(vertices, vertexCount, indices, indexCount, indexType, ratios)
+    local indexCType = indexType == "uint32" and "uint32_t*" or "uint16_t*"
+    local indexPointer = ffi.cast(indexCType, indices:getFFIPointer())
+    local triangleCount = floor(indexCount / 3)
+
+    local triangles = ffi.new("int32_t[?]", triangleCount * 3)
+    local removed = ffi.new("bool[?]", triangleCount)
+    local quadrics = ffi.new("double[?]", vertexCount * 10)
+    local locked = ffi.new("bool[?]", vertexCount)
+    local targets = ffi.new("int32_t[?]", vertexCount)
+    local marks = ffi.new("int32_t[?]", vertexCount)
+    local vertexTriangles = newtable(vertexCount, 0) ---@type integer[][]
+    local mark = 0
+
+    for v=0, vertexCount-1 do
+        vertexTriangles[v] = {}
+    end
+
+    -- Triangles, plane quadrics and open edges
+    local edgeUses = {}
+
+    for t=0, triangleCount-1 do
+        local i1, i2, i3 = indexPointer[t*3], indexPointer[t*3+1], indexPointer[t*3+2]
+        triangles[t*3], triangles[t*3+1], triangles[t*3+2] = i1, i2, i3
+
+        local list = vertexTriangles[i1]; list[#list+1] = t
+        list = vertexTriangles[i2]; list[#list+1] = t
+        list = vertexTriangles[i3]; list[#list+1] = t
+
+        local p1 = vertices[i1].position
+        local nx, ny, nz = triangleNormal(p1, vertices[i2].position, vertices[i3].position)
+        local length = sqrt(nx*nx + ny*ny + nz*nz)
+
+        if length > 0 then
+            nx, ny, nz = nx / length, ny / length, nz / length
+            local d = -(nx*p1.x + ny*p1.y + nz*p1.z)
+
+            -- Weighted by area, so small triangles don't dominate the error
+            addPlaneQuadric(quadrics, i1*10, nx, ny, nz, d, length * 0.5)
+            addPlaneQuadric(quadrics, i2*10, nx, ny, nz, d, length * 0.5)
+            addPlaneQuadric(quadrics, i3*10, nx, ny, nz, d, length * 0.5)
+        end
+
+        for e=0, 2 do
+            local a, b = triangles[t*3+e], triangles[t*3+(e+1)%3]
+            local key = a < b and a * vertexCount + b or b * vertexCount + a
+            edgeUses[key] = (edgeUses[key] or 0) + 1
+        end
+    end
+
+    -- Vertices on open or non-manifold edges stay in place
+    for key, uses in pairs(edgeUses) do
+        if uses ~= 2 then
+            locked[key % vertexCount] = true
+            locked[floor(key / vertexCount)] = true
+        end
+    end
+    edgeUses = nil
+
+
+    -- Checks if collapsing `u` into `v` keeps the mesh manifold and doesn't flip triangles
+    local function isCollapseValid(u, v)
+        local shared = 0
+        local pv = vertices[v].position
+
+        mark = mark + 1
+
+        for _, t in ipairs(vertexTriangles[u]) do
+            if not removed[t] then
+                local o = t*3
+                local i1, i2, i3 = triangles[o], triangles[o+1], triangles[o+2]
+
+                if i1 == v or i2 == v or i3 == v then
+                    shared = shared + 1
+                else
+                    local p1, p2, p3 = vertices[i1].position, vertices[i2].position, vertices[i3].position
+                    local ox, oy, oz = triangleNormal(p1, p2, p3)
+
+                    if i1 == u then p1 = pv elseif i2 == u then p2 = pv else p3 = pv end
+                    local nx, ny, nz = triangleNormal(p1, p2, p3)
+
+                    local dot = ox*nx + oy*ny + oz*nz
+                    if dot <= MIN_NORMAL_DOT * sqrt((ox*ox + oy*oy + oz*oz) * (nx*nx + ny*ny + nz*nz)) then
+                        return false
+                    end
+                end
+
+                marks[i1], marks[i2], marks[i3] = mark, mark, mark
+            end
+        end
+
+        -- Link condition: the only vertices connected to both must be the ones opposite to the collapsed edge
+        local common = 0
+        local uMark = mark
+        mark = mark + 1
+
+        for _, t in ipairs(vertexTriangles[v]) do
+            if not removed[t] then
+                for c=t*3, t*3+2 do
+                    local w = triangles[c]
+
+                    if w ~= u and w ~= v and marks[w] == uMark then
+                        common = common + 1
+                        marks[w] = mark
+                    end
+                end
+            end
+        end
+
+        return common <= shared
+    end
+
+
+    -- Finds the cheapest collapse of a vertex. Checking if collapses are valid is expensive and most of them are,
+    -- so usually that's only done for the cheapest one when it's about to be collapsed
+    local function findCollapse(u, checkValidity)
+        if locked[u] then
+            return nil
+        end
+
+        local q = u*10
+        local bestTarget, bestCost = nil, huge
+
+        -- Unlocked vertices have a closed fan, so each neighbor comes right after `u` in exactly one triangle
+        for _, t in ipairs(vertexTriangles[u]) do
+            if not removed[t] then
+                local o = t*3
+                local v =
+                    triangles[o  ] == u and triangles[o+1] or
+                    triangles[o+1] == u and triangles[o+2] or
+                    triangles[o]
+
+                if v ~= u then
+                    local p = vertices[v].position
+                    local cost = evaluateQuadric(quadrics, q, p.x, p.y, p.z)
+
+                    if cost < bestCost and (not checkValidity or isCollapseValid(u, v)) then
+                        bestTarget, bestCost = v, cost
+                    end
+                end
+            end
+        end
+
+        return bestTarget, bestCost
+    end
+
+
+    local queue = PriorityQueue(vertexCount)
+
+    local function updateVertex(u, checkValidity)
+        local v, cost = findCollapse(u, checkValidity)
+
+        if v then
+            targets[u] = v
+            queue:push(-cost, u)
+        elseif queue:contains(u) then
+            queue:remove(u)
+        end
+    end
+
+    for u=0, vertexCount-1 do
+        updateVertex(u)
+    end
+
+
+    local function collapse(u, v)
+        local uList, vList = vertexTriangles[u], vertexTriangles[v]
+        local aliveRemoved = 0
+
+        for _, t in ipairs(uList) do
+            if not removed[t] then
+                local o = t*3
+
+                if triangles[o] == v or triangles[o+1] == v or triangles[o+2] == v then
+                    removed[t] = true
+                    aliveRemoved = aliveRemoved + 1
+                else
+                    for c=o, o+2 do
+                        if triangles[c] == u then
+                            triangles[c] = v
+                        end
+                    end
+
+                    vList[#vList+1] = t
+                end
+            end
+        end
+
+        for i=0, 9 do
+            quadrics[v*10+i] = quadrics[v*10+i] + quadrics[u*10+i]
+        end
+
+        -- Drop removed triangles from the list of the target
+        local count = 0
+        for i, t in ipairs(vList) do
+            if not removed[t] then
+                count = count + 1
+                vList[count] = t
+            end
+        end
+        for i=#vList, count+1, -1 do
+            vList[i] = nil
+        end
+
+        vertexTriangles[u] = {}
+        return aliveRemoved
+    end
+
+
+    -- Collapse the cheapest edges, taking a snapshot of the index buffer at each target ratio
+    local aliveCount = triangleCount
+    local levels = {} ---@type {count: integer, indices: ffi.cdata*}[]
+    local neighbors = {}
+    local lastCount = triangleCount
+
+    for _, ratio in ipairs(ratios) do
+        local targetCount = floor(triangleCount * ratio)
+
+        while aliveCount > targetCount and queue:getLength() > 0 do
+            local _, u = queue:pop()
+            local v = targets[u]
+
+            if isCollapseValid(u, v) then
+                aliveCount = aliveCount - collapse(u, v)
+
+                -- Collapse costs and validity only change around the target vertex
+                mark = mark + 1
+                local neighborCount = 0
+
+                for _, t in ipairs(vertexTriangles[v]) do
+                    for c=t*3, t*3+2 do
+                        local w = triangles[c]
+
+                        if marks[w] ~= mark then
+                            marks[w] = mark
+                            neighborCount = neighborCount + 1
+                            neighbors[neighborCount] = w
+                        end
+                    end
+                end
+
+                for i=1, neighborCount do
+                    updateVertex(neighbors[i])
+                end
+            else
+                updateVertex(u, true)
+            end
+        end
+
+        if aliveCount >= lastCount then
+            break
+        end
+
+        local level = {count = aliveCount * 3, indices = ffi.new("int32_t[?]", aliveCount * 3)}
+        local i = 0
+
+        for t=0, triangleCount-1 do
+            if not removed[t] then
+                level.indices[i], level.indices[i+1], level.indices[i+2] = triangles[t*3], triangles[t*3+1], triangles[t*3+2]
+                i = i + 3
+            end
+        end
+
+        levels[#levels+1] = level
+        lastCount = aliveCount
+    end
+
+
+    -- Original indices go first, followed by each level
+    local totalCount = indexCount
+    for _, level in ipairs(levels) do
+        totalCount = totalCount + level.count
+    end
+
+    local result = love.data.newByteData(math.max(totalCount, 1) * ffi.sizeof(indexCType:sub(1, -2)))
+    local resultPointer = ffi.cast(indexCType, result:getFFIPointer())
+    local ranges = {{1, indexCount}}
+    local offset = indexCount
+
+    ffi.copy(resultPointer, indexPointer, indexCount * ffi.sizeof(indexCType:sub(1, -2)))
+
+    for _, level in ipairs(levels) do
+        for i=0, level.count-1 do
+            resultPointer[offset + i] = level.indices[i]
+        end
+
+        ranges[#ranges+1] = {offset + 1, level.count}
+        offset = offset + level.count
+    end
+
+    return result, ranges
+end
+
+
+return MeshSimplifier
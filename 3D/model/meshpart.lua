@@ -1,75 +1,208 @@
-local Object  = require "engine.3rdparty.classic.classic"
-local ffi     = require "ffi"
-
-local vertexFormat = {
-    {"VertexPosition", "float", 3},
-    {"VertexTexCoords", "float", 2},
-    {"VertexNormal", "float", 3},
-    {"VertexTangent", "float", 3},
-    {"VertexBoneIDs", "float", 4},
-    {"VertexWeights", "float", 4}
+local BoundingBox  = require "engine.math.boundingBox"
+local Vector3      = require "engine.math.vector3"
+local Object       = require "engine.3rdparty.classic.classic"
+local vertexFormats = require "engine.3D.model.vertexFormat"
+local TriangleBVH  = require "engine.math.triangleBVH"
+local ffi          = require "ffi"
+
+require "engine.math.matrix4" -- For the Matrix4 C type
+
+-- Rows of the world matrix of each instance, see `GetWorldMatrix` in `incl_commonBuffers.glsl`
+local instanceFormat = {
+    {"InstanceTransform1", "float", 4},
+    {"InstanceTransform2", "float", 4},
+    {"InstanceTransform3", "float", 4},
+    {"InstanceTransform4", "float", 4},
 }
 
-ffi.cdef [[
-    struct vertex {
-        Vector3 position;
-        Vector2 uv;
-        Vector3 normal;
-        Vector3 tangent;
-        float boneIds[4];
-        float weights[4];
-    }
-]]
+-- Sent to the shaders when drawing meshes with the standard layout
+local noQuantization = {}
+
+local quantizationUniforms = {
+    uVertexPositionScale = "positionScale",
+    uVertexPositionOffset = "positionOffset",
+    uVertexTexCoordsTransform = "texCoordsTransform",
+}
+
+-- Last quantization sent to each shader, so it's only sent again when the mesh part layout changes
+local shaderQuantization = setmetatable({}, {__mode = "k"}) ---@type table<love.Shader, MeshPartQuantization>
+
+local instanceCapacity = 0
+local instanceBuffer = nil ---@type love.Mesh
+local instanceData = nil ---@type love.ByteData
+local instancePointer = nil ---@type ffi.cdata*
+
+--- @alias MeshPartQuantization {positionScale: number[], positionOffset: number[], texCoordsTransform: number[]}: How compact vertices map to the mesh bounds, see `vertexFormat.lua`
+--- @alias MeshPartData {name: string, material: string, aabb: {min: number[], max: number[]}, vertexCount: integer, vertices: love.ByteData, indexCount: integer, indexType: love.IndexDataType, indices: love.ByteData, vertexFormat: "standard"|"compact", quantization: MeshPartQuantization?, lods: integer[][]?, triangleBVH: TriangleBVHData?}
 
---- @alias VertexWeightArray table<integer, number>
 
+--- @alias MeshPartStats {triangles: integer, trianglesSaved: integer}
 
 --- @class MeshPart: Object
 --- @field buffer love.Mesh
 --- @field material BaseMaterial
 --- @field aabb BoundingBox
 --- @field model Model
+--- @field lods integer[][]?: `{start, count}` index range of each level of detail, the first one is the full mesh
+--- @field lodCount integer
+--- @field quantization MeshPartQuantization?: Only with the compact vertex layout
+--- @field private _instanceBuffer love.Mesh?
+--- @field private _triangleCount integer
+--- @field private _lod integer: Level of detail selected by the current draw range
+--- @field private _triangleBVH TriangleBVH?
 ---
---- @overload fun(part: unknown, model: Model): MeshPart
+--- @overload fun(part: MeshPartData, model: Model): MeshPart
 local Meshpart = Object:extend("MeshPart")
 
+--- Counters shared by all mesh parts, see `MeshPart.ResetStats`
+---@type MeshPartStats
+Meshpart.stats = {
+    triangles = 0,      -- Triangles drawn, including every instance
+    trianglesSaved = 0, -- Triangles skipped by drawing lower levels of detail
+}
+
 
 function Meshpart:new(meshPartData, model)
-    self.buffer = love.graphics.newMesh(vertexFormat, #meshPartData.positions, "triangles", "static")
+    local aabb = meshPartData.aabb
+
+    -- The vertex and index data is already packed by the importer, so it's uploaded as is.
+    -- Both vertex layouts work with the same shaders, see `vertexFormat.lua`
+    self.buffer = love.graphics.newMesh(vertexFormats[meshPartData.vertexFormat], meshPartData.vertices, "triangles", "static")
     self.material = model.materials[meshPartData.material]
     self.model = model
-    self.aabb = meshPartData.aabb
+    self.aabb = BoundingBox(Vector3(unpack(aabb.min)), Vector3(unpack(aabb.max)))
+    self.lods = meshPartData.lods
+    self.lodCount = self.lods and #self.lods or 1
+    self.quantization = meshPartData.quantization
+    self._triangleCount = math.floor((meshPartData.indexCount > 0 and meshPartData.indexCount or meshPartData.vertexCount) / 3)
+    self._lod = 1
+    self._triangleBVH = meshPartData.triangleBVH and TriangleBVH(meshPartData.triangleBVH)
+
+    -- Levels of detail are stored after the full mesh in the index buffer, the draw range selects one of them
+    if meshPartData.indexCount > 0 then
+        self.buffer:setVertexMap(meshPartData.indices, meshPartData.indexType)
+    end
 
-    self:__loadVertices(meshPartData)
+    if self.lods then
+        self.buffer:setDrawRange(self.lods[1][1], self.lods[1][2])
+    end
 end
 
 
---- @private
---- @param meshPartData table
-function Meshpart:__loadVertices(meshPartData)
-    -- Vertices
-    local vertices = love.data.newByteData(ffi.sizeof("struct vertex") * #meshPartData.positions)
-    local pointer = ffi.cast("struct vertex*", vertices:getFFIPointer())
+--- Selects a level of detail and updates the stats
+---@private
+---@param lod integer?
+---@param instances integer
+function Meshpart:_prepareDraw(lod, instances)
+    local stats = Meshpart.stats
+    local lods = self.lods
 
-    for i=1, #meshPartData.positions do
-        local index = i-1
+    if not lods then
+        stats.triangles = stats.triangles + self._triangleCount * instances
+        return
+    end
+
+    lod = math.min(lod or 1, self.lodCount)
+
+    if lod ~= self._lod then
+        self.buffer:setDrawRange(lods[lod][1], lods[lod][2])
+        self._lod = lod
+    end
+
+    local triangles = lods[lod][2] / 3
+    stats.triangles = stats.triangles + triangles * instances
+    stats.trianglesSaved = stats.trianglesSaved + (self._triangleCount - triangles) * instances
+end
+
+
+--- Sends the bounds used to decode compact vertices to the current shader. Meshes drawn with the
+--- same shaders outside of `MeshPart` must use the standard layout.
+---@private
+function Meshpart:_sendQuantization()
+    local shader = love.graphics.getShader()
+    local quantization = self.quantization or noQuantization
 
-        pointer[index].position  = meshPartData.positions[i]
-        pointer[index].uv        = meshPartData.uvs[i]
-        pointer[index].normal    = meshPartData.normals[i]
-        pointer[index].tangent   = meshPartData.tangents[i]
-        pointer[index].boneIds   = meshPartData.boneIds[i]
-        pointer[index].weights   = meshPartData.weights[i]
+    if not shader or shaderQuantization[shader] == quantization or not shader:hasUniform("uCompactVertices") then
+        return
     end
 
-    self.buffer:setVertices(vertices)
-    self.buffer:setVertexMap(meshPartData.indices)
+    shaderQuantization[shader] = quantization
+    shader:send("uCompactVertices", self.quantization ~= nil)
+
+    -- Unused uniforms are removed by the shader compiler (e.g. UVs in depth passes)
+    if self.quantization then
+        for uniform, key in pairs(quantizationUniforms) do
+            if shader:hasUniform(uniform) then
+                shader:send(uniform, quantization[key])
+            end
+        end
+    end
 end
 
 
-function Meshpart:draw()
+---@param lod integer?: Level of detail, the full mesh by default
+function Meshpart:draw(lod)
+    self:_prepareDraw(lod, 1)
+    self:_sendQuantization()
     love.graphics.draw(self.buffer)
 end
 
 
+--- Draws this mesh part once for each world matrix with a single draw call.
+--- The shader must be compiled with `MESH_INSTANCING` defined.
+---@param matrices Matrix4[]
+---@param count integer?
+---@param lod integer?: Level of detail, the full mesh by default
+function Meshpart:drawInstanced(matrices, count, lod)
+    count = count or #matrices
+    self:_prepareDraw(lod, count)
+    self:_sendQuantization()
+
+    if count > instanceCapacity then
+        instanceCapacity = math.max(count, instanceCapacity * 2, 64)
+        instanceBuffer = love.graphics.newMesh(instanceFormat, instanceCapacity, nil, "dynamic")
+        instanceData = love.data.newByteData(ffi.sizeof("Matrix4") * instanceCapacity)
+        instancePointer = ffi.cast("Matrix4*", instanceData:getFFIPointer())
+    end
+
+    if self._instanceBuffer ~= instanceBuffer then
+        for i, attr in ipairs(instanceFormat) do
+            self.buffer:attachAttribute(attr[1], instanceBuffer, "perinstance")
+        end
+
+        self._instanceBuffer = instanceBuffer
+    end
+
+    for i=1, count do
+        instancePointer[i-1] = matrices[i]
+    end
+
+    instanceBuffer:setVertices(instanceData, 1, count)
+    love.graphics.drawInstanced(self.buffer, count)
+end
+
+
+--- Gets the triangle tree used for ray queries, see `Inter3d.ray_mesh`. It's built by the importer
+--- when the model is loaded with `triangleBVH` enabled, otherwise it's built from the mesh on the first call.
+---@return TriangleBVH
+function Meshpart:getTriangleBVH()
+    if not self._triangleBVH then
+        local lod = self._lod
+        self:_prepareDraw(1, 0) -- Only the full detail mesh
+
+        self._triangleBVH = TriangleBVH.FromMesh(self.buffer, self.quantization)
+        self:_prepareDraw(lod, 0)
+    end
+
+    return self._triangleBVH
+end
+
+
+--- Resets `MeshPart.stats`, usually once per frame
+function Meshpart.ResetStats()
+    Meshpart.stats.triangles = 0
+    Meshpart.stats.trianglesSaved = 0
+end
+
+
 return Meshpart
\ No newline at end of file
@@ -7,10 +7,17 @@ local ArmatureNode   = require "engine.3D.model.modelArmature"
 local BoneNode       = require "engine.3D.model.modelBone"
 local ModelAnimation = require "engine.3D.model.animation.modelAnimation"
 local ContentLoader  = require "engine.resourceHandling.contentLoader"
+local ContentPromise = require "engine.resourceHandling.contentPromise"
+local ModelCache     = require "engine.3D.model.modelCache"
+local Matrix4        = require "engine.math.matrix4"
 local Object         = require "engine.3rdparty.classic.classic"
 
 
---- @alias ModelLoadingOptions {materials: table<string, BaseMaterial>, contentLoader: ContentLoader, triangulate: boolean, flipUVs: boolean, removeUnusedMaterials: boolean, optimizeGraph: boolean}
+-- Options of the models being loaded by `Model.LoadAsync`
+local asyncLoads = setmetatable({}, {__mode = "k"}) ---@type table<ContentPromise, {file: string, opts: ModelLoadingOptions}>
+
+
+--- @alias ModelLoadingOptions {materials: table<string, BaseMaterial>, contentLoader: ContentLoader, triangulate: boolean, flipUVs: boolean, removeUnusedMaterials: boolean, optimizeGraph: boolean, cache: boolean?, compactVertices: boolean?, lodRatios: number[]?, triangleBVH: boolean?}
 --- @alias BoneInfo {id: integer, offset: Matrix4}
 
 --- @class Model: Object
@@ -25,12 +32,13 @@ local Object         = require "engine.3rdparty.classic.classic"
 --- @field armatures table<string, ModelArmature>
 --- @field contentLoader ContentLoader
 --- @field opts ModelLoadingOptions
+--- @field vertexMemory {bytes: integer, saved: integer}: Vertex buffer size, and how much `compactVertices` saved
 ---
---- @overload fun(file: string, opts: ModelLoadingOptions): Model
+--- @overload fun(file: string, opts: ModelLoadingOptions, modelData: table?): Model
 local Model = Object:extend("Model")
 
 
-function Model:new(file, opts)
+function Model:new(file, opts, modelData)
     self.nodes = {}
     self.meshes = {}
     self.meshParts = {}
@@ -43,9 +51,9 @@ function Model:new(file, opts)
     self.opts = opts
 
 
-    -- Read model data
-    local importer = require "engine.3D.model.assimp_importer"
-    local modelData = importer(file, opts.triangulate, opts.flipUVs, opts.removeUnusedMaterials, opts.optimizeGraph)
+    -- Read model data, unless it was already imported by a content loading thread
+    modelData = modelData or ModelCache.Import(file, opts)
+    self.vertexMemory = modelData.vertexMemory
 
 
     -- Load materials
@@ -77,6 +85,32 @@ end
 
 
 
+--- Imports a model in the content loading threads. The promise content is the loaded `Model`,
+--- only the GPU buffers and materials are created on the main thread.
+--- @param file string
+--- @param opts ModelLoadingOptions
+--- @param priority ContentPriority?
+--- @return ContentPromise
+function Model.LoadAsync(file, opts, priority)
+    local importOptions = {
+        triangulate = opts.triangulate,
+        flipUVs = opts.flipUVs,
+        removeUnusedMaterials = opts.removeUnusedMaterials,
+        optimizeGraph = opts.optimizeGraph,
+        cache = opts.cache,
+        compactVertices = opts.compactVertices,
+        lodRatios = opts.lodRatios,
+        triangleBVH = opts.triangleBVH,
+    }
+
+    local promise = ContentPromise(file, "model", importOptions)
+    asyncLoads[promise] = {file = file, opts = opts}
+
+    return promise:loadAsync(priority)
+end
+
+
+
 --- @private
 --- @param nodeData table
 --- @param modelData table
@@ -84,7 +118,7 @@ end
 function Model:__loadNode(nodeData, modelData)
     local node = nil
     local nodeName = nodeData.name
-    local nodeTransform = nodeData.transform
+    local nodeTransform = Matrix4(unpack(nodeData.transform))
 
     if nodeData.meshParts then
         local parts = {}
@@ -131,6 +165,10 @@ function Model:__loadNode(nodeData, modelData)
         end
     end
 
+    if modelData.armatures[nodeName] then
+        node:sortBones()
+    end
+
     return node
 end
 
@@ -142,7 +180,7 @@ end
 --- @return ModelBone
 function Model:__loadBone(nodeData, modelData, armatureNode)
     local boneData = modelData.armatures[armatureNode.name][nodeData.name]
-    local bone = BoneNode(self, nodeData.name, nodeData.transform, boneData.offset, boneData.id)
+    local bone = BoneNode(self, nodeData.name, Matrix4(unpack(nodeData.transform)), Matrix4(unpack(boneData.offset)), boneData.id)
 
     armatureNode.bones[nodeData.name] = bone
 
@@ -155,4 +193,10 @@ function Model:__loadBone(nodeData, modelData, armatureNode)
 end
 
 
+ContentPromise.RegisterHint("model", "engine.3D.model._importModel", function(modelData, args, promise)
+    local load = asyncLoads[promise]
+    return Model(load.file, load.opts, modelData)
+end)
+
+
 return Model
\ No newline at end of file
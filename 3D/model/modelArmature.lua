@@ -4,6 +4,8 @@ local ModelNode = require "engine.3D.model.modelNode"
 ---
 ---@field public bones table<string, ModelBone>
 ---@field public rootBones table<string, ModelBone>
+---@field public sortedBones ModelBone[]: All bones sorted so parents always come before their children
+---@field public parentIndices integer[]: Index of the parent of each bone in `sortedBones`, or 0 for root bones
 ---
 ---@overload fun(model: Model, name: string, localMatrix: Matrix4): ModelArmature
 local ModelArmature = ModelNode:extend("ModelArmature")
@@ -13,6 +15,37 @@ function ModelArmature:new(model, name, localMatrix)
 
     self.bones = {}
     self.rootBones = {}
+    self.sortedBones = {}
+    self.parentIndices = {}
 end
 
-return ModelArmature
\ No newline at end of file
+
+--- Flattens the bone hierarchy into `sortedBones` and `parentIndices`, so the skeleton can be
+--- evaluated with a single loop instead of recursion. Must be called after the bone hierarchy changes.
+---@return self
+function ModelArmature:sortBones()
+    local sorted, parents = {}, {}
+
+    for name, bone in pairs(self.rootBones) do
+        table.insert(sorted, bone)
+        table.insert(parents, 0)
+    end
+
+    -- Breadth-first, so every bone is added after its parent
+    local i = 1
+    while i <= #sorted do
+        for c, child in ipairs(sorted[i].children) do
+            table.insert(sorted, child)
+            table.insert(parents, i)
+        end
+
+        i = i + 1
+    end
+
+    self.sortedBones = sorted
+    self.parentIndices = parents
+
+    return self
+end
+
+return ModelArmature
@@ -0,0 +1,333 @@
+local ffi = require "ffi"
+
+require "love.data"
+require "love.filesystem"
+
+
+local MAGIC = "KMDL"
+local FORMAT_VERSION = 5
+local CACHE_FOLDER = "modelcache"
+
+-- Value tags of the scene description
+local TAG_FALSE, TAG_TRUE, TAG_NUMBER, TAG_STRING, TAG_TABLE, TAG_BLOB = 0, 1, 2, 3, 4, 5
+
+local BLOB_ALIGNMENT = 8
+
+local doubleBuffer = ffi.new("double[1]")
+local uintBuffer = ffi.new("uint32_t[1]")
+
+
+---
+--- Binary cache of imported models, so they can be loaded without assimp.
+---
+--- A cache file stores the output of the importer: the data blobs (vertices, indices, animation keys)
+--- are written as they are in memory, and the rest of the scene is stored in a small tagged description.
+--- When reading, each blob becomes a `DataView` of the file data, so they are handed to `love.graphics.newMesh`
+--- and `ModelAnimationTrack` without being copied.
+---
+--- File layout (little endian):
+--- ```
+--- "KMDL" | u32 version | u32 description size | description | u32 blob count | (u32 size, padding, bytes)...
+--- ```
+--- The bytes of each blob start at a multiple of 8, so they can be read as doubles.
+--- Cache files are named after a hash of the source file contents, the import options and the format version,
+--- so changing any of them makes the model be imported again.
+---
+--- Works in the content loading threads too.
+---
+local ModelCache = {}
+
+
+------------------------
+----- Serialization ----
+------------------------
+
+local function packUint(value)
+    uintBuffer[0] = value
+    return ffi.string(uintBuffer, 4)
+end
+
+local function packNumber(value)
+    doubleBuffer[0] = value
+    return ffi.string(doubleBuffer, 8)
+end
+
+local function alignBlob(offset)
+    return math.ceil(offset / BLOB_ALIGNMENT) * BLOB_ALIGNMENT
+end
+
+local function isData(value)
+    return type(value) == "userdata" and value.typeOf and value:typeOf("Data")
+end
+
+
+local function writeValue(value, out, blobs)
+    local valueType = type(value)
+
+    if valueType == "boolean" then
+        out[#out+1] = string.char(value and TAG_TRUE or TAG_FALSE)
+
+    elseif valueType == "number" then
+        out[#out+1] = string.char(TAG_NUMBER)..packNumber(value)
+
+    elseif valueType == "string" then
+        out[#out+1] = string.char(TAG_STRING)..packUint(#value)..value
+
+    elseif isData(value) then
+        blobs[#blobs+1] = value
+        out[#out+1] = string.char(TAG_BLOB)..packUint(#blobs-1)
+
+    elseif valueType == "table" then
+        local count = 0
+        for _ in pairs(value) do
+            count = count + 1
+        end
+
+        out[#out+1] = string.char(TAG_TABLE)..packUint(count)
+
+        for k, v in pairs(value) do
+            writeValue(k, out, blobs)
+            writeValue(v, out, blobs)
+        end
+    else
+        error("Can't store values of type '"..valueType.."' in the model cache")
+    end
+end
+
+
+-- Values are only read if they fit before `limit`, so damaged files can't read outside of the file data
+---@param pointer ffi.cdata*
+---@param offset integer
+---@param limit integer: End of the description
+---@param blobs love.Data[]
+---@return any value, integer? offset: `offset` is `nil` if the description is damaged
+local function readValue(pointer, offset, limit, blobs)
+    if offset >= limit then
+        return nil, nil
+    end
+
+    local tag = pointer[offset]
+    offset = offset + 1
+
+    if tag == TAG_FALSE or tag == TAG_TRUE then
+        return tag == TAG_TRUE, offset
+    end
+
+    if tag == TAG_NUMBER then
+        if offset + 8 > limit then
+            return nil, nil
+        end
+
+        ffi.copy(doubleBuffer, pointer + offset, 8)
+        return doubleBuffer[0], offset + 8
+    end
+
+    if offset + 4 > limit then
+        return nil, nil
+    end
+
+    ffi.copy(uintBuffer, pointer + offset, 4)
+    local size = uintBuffer[0]
+    offset = offset + 4
+
+    if tag == TAG_STRING then
+        if offset + size > limit then
+            return nil, nil
+        end
+
+        return ffi.string(pointer + offset, size), offset + size
+    end
+
+    if tag == TAG_BLOB then
+        return blobs[size+1], blobs[size+1] and offset
+    end
+
+    -- Each entry takes at least 2 bytes
+    if tag ~= TAG_TABLE or offset + size * 2 > limit then
+        return nil, nil
+    end
+
+    local result = {}
+
+    for i=1, size do
+        local key, value
+        key, offset = readValue(pointer, offset, limit, blobs)
+
+        if offset == nil or key == nil or key ~= key then
+            return nil, nil
+        end
+
+        value, offset = readValue(pointer, offset, limit, blobs)
+
+        if offset == nil then
+            return nil, nil
+        end
+
+        result[key] = value
+    end
+
+    return result, offset
+end
+
+
+
+--- Gets the cache file path of a model. Returns `nil` if the source file doesn't exist
+---@param file string: Path of the source model
+---@param opts table: Import options, see `ModelLoadingOptions`
+---@return string?
+function ModelCache.GetPath(file, opts)
+    local source = love.filesystem.read("data", file)
+    if not source then
+        return nil
+    end
+
+    local key = table.concat({
+        love.data.hash("sha1", source),
+        tostring(opts.triangulate or false),
+        tostring(opts.flipUVs or false),
+        tostring(opts.removeUnusedMaterials or false),
+        tostring(opts.optimizeGraph or false),
+        tostring(opts.compactVertices or false),
+        table.concat(opts.lodRatios or {}, ","),
+        tostring(opts.triangleBVH or false),
+        FORMAT_VERSION
+    }, "|")
+
+    return CACHE_FOLDER.."/"..love.data.encode("string", "hex", love.data.hash("sha1", key))..".kmdl"
+end
+
+
+--- Writes an imported scene to a cache file
+---@param path string
+---@param scene table: Output of the importer
+function ModelCache.Write(path, scene)
+    local blobs = {} ---@type love.Data[]
+    local description = {}
+
+    writeValue(scene, description, blobs)
+    description = table.concat(description)
+
+    local header = MAGIC..packUint(FORMAT_VERSION)..packUint(#description)..description..packUint(#blobs)
+    local size = #header
+
+    for _, blob in ipairs(blobs) do
+        size = alignBlob(size + 4) + blob:getSize()
+    end
+
+    local data = love.data.newByteData(size)
+    local pointer = ffi.cast("uint8_t*", data:getFFIPointer())
+    local offset = #header
+
+    ffi.copy(pointer, header, #header)
+
+    for _, blob in ipairs(blobs) do
+        local start = alignBlob(offset + 4)
+
+        uintBuffer[0] = blob:getSize()
+        ffi.copy(pointer + offset, uintBuffer, 4)
+        ffi.copy(pointer + start, blob:getFFIPointer(), blob:getSize())
+        offset = start + blob:getSize()
+    end
+
+    love.filesystem.createDirectory(CACHE_FOLDER)
+    assert(love.filesystem.write(path, data))
+end
+
+
+--- Reads a cache file. Returns `nil` if the file doesn't exist, has a different format version or is damaged
+---@param path string
+---@return table?: The imported scene
+function ModelCache.Read(path)
+    if not love.filesystem.getInfo(path, "file") then
+        return nil
+    end
+
+    local data = love.filesystem.read("data", path) --[[@as love.FileData?]]
+    if not data or data:getSize() < 16 then
+        return nil
+    end
+
+    local pointer = ffi.cast("const uint8_t*", data:getFFIPointer())
+    local fileSize = data:getSize()
+
+    ffi.copy(uintBuffer, pointer + 4, 4)
+    if ffi.string(pointer, 4) ~= MAGIC or uintBuffer[0] ~= FORMAT_VERSION then
+        return nil
+    end
+
+    ffi.copy(uintBuffer, pointer + 8, 4)
+    local descriptionStart = 12
+    local descriptionEnd = descriptionStart + uintBuffer[0]
+
+    if descriptionEnd + 4 > fileSize then
+        return nil
+    end
+
+    -- Blobs go first, so the description can reference them
+    ffi.copy(uintBuffer, pointer + descriptionEnd, 4)
+    local blobCount = uintBuffer[0]
+    local blobs = {}
+    local offset = descriptionEnd + 4
+
+    -- Each blob takes at least its 4 byte size
+    if offset + blobCount * 4 > fileSize then
+        return nil
+    end
+
+    for i=1, blobCount do
+        local start = alignBlob(offset + 4)
+
+        ffi.copy(uintBuffer, pointer + offset, 4)
+        if start + uintBuffer[0] > fileSize then
+            return nil
+        end
+
+        blobs[i] = love.data.newDataView(data, start, uintBuffer[0])
+        offset = start + uintBuffer[0]
+    end
+
+    local scene, descriptionOffset = readValue(pointer, descriptionStart, descriptionEnd, blobs)
+
+    if descriptionOffset ~= descriptionEnd or type(scene) ~= "table" then
+        return nil
+    end
+
+    return scene
+end
+
+
+--- Imports a model, using the cached version if there's one. The result is cached if it wasn't.
+--- Assimp is only loaded if the model needs to be imported.
+---@param file string
+---@param opts table: Import options, see `ModelLoadingOptions`
+---@return table: The imported scene
+function ModelCache.Import(file, opts)
+    local path = opts.cache ~= false and ModelCache.GetPath(file, opts)
+    local scene = path and ModelCache.Read(path)
+
+    if not scene then
+        local importer = require "engine.3D.model.assimp_importer"
+        scene = importer(file, opts.triangulate, opts.flipUVs, opts.removeUnusedMaterials, opts.optimizeGraph, opts.compactVertices, opts.lodRatios, opts.triangleBVH)
+
+        if path then
+            ModelCache.Write(path, scene)
+        end
+    end
+
+    return scene
+end
+
+
+--- Imports and caches a model ahead of time, so the game never needs to import it.
+--- The cache files are written to the save directory, ship them in the `modelcache` folder of the game.
+---@param file string
+---@param opts table: Import options, see `ModelLoadingOptions`
+function ModelCache.Bake(file, opts)
+    local path = assert(ModelCache.GetPath(file, opts), "Model not found: "..file)
+    local importer = require "engine.3D.model.assimp_importer"
+
+    ModelCache.Write(path, importer(file, opts.triangulate, opts.flipUVs, opts.removeUnusedMaterials, opts.optimizeGraph, opts.compactVertices, opts.lodRatios, opts.triangleBVH))
+end
+
+
+return ModelCache
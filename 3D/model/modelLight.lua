@@ -1,4 +1,5 @@
 local ModelNode = require "engine.3D.model.modelNode"
+local Vector2   = require "engine.math.vector2"
 
 --- @class ModelLight: ModelNode
 ---
@@ -37,7 +38,7 @@ function Camera:new(model, name, localMatrix, aiLightData)
     self.innerCone = aiLightData.innerCone
     self.outerCone = aiLightData.outerCone
 
-    self.areaLightSize = aiLightData.size
+    self.areaLightSize = Vector2(aiLightData.size[1], aiLightData.size[2])
 end
 
 
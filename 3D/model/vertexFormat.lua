@@ -0,0 +1,55 @@
+local ffi = require "ffi"
+
+require "engine.math.vector3" -- For the Vector3 C type
+require "engine.math.vector2" -- For the Vector2 C type
+
+
+-- Layouts of the vertices of model meshes. They don't depend on `love.graphics`,
+-- so vertex data can be built in the content loading threads.
+--
+-- `compact_vertex` is the quantized layout (28 bytes instead of 76):
+-- * position: unorm16, relative to the bounds of the mesh part (w is always 1)
+-- * uv: unorm16, relative to the UV bounds of the mesh part
+-- * normalTangent: unorm16 octahedral encoding, normal in xy and tangent in zw
+-- * boneIds: bone index, 255 means no bone
+-- * weights: unorm8, always adding up to 255
+--
+-- The bounds are stored in `MeshPartQuantization`, and sent by `MeshPart` as uniforms.
+-- See `incl_meshSkinning.glsl` for the decoding.
+ffi.cdef [[
+    struct vertex {
+        Vector3 position;
+        Vector2 uv;
+        Vector3 normal;
+        Vector3 tangent;
+        float boneIds[4];
+        float weights[4];
+    };
+
+    struct compact_vertex {
+        uint16_t position[4];
+        uint16_t uv[2];
+        uint16_t normalTangent[4];
+        uint8_t boneIds[4];
+        uint8_t weights[4];
+    };
+]]
+
+return {
+    standard = {
+        {"VertexPosition", "float", 3},
+        {"VertexTexCoords", "float", 2},
+        {"VertexNormal", "float", 3},
+        {"VertexTangent", "float", 3},
+        {"VertexBoneIDs", "float", 4},
+        {"VertexWeights", "float", 4}
+    },
+
+    compact = {
+        {"VertexPosition", "unorm16", 4},
+        {"VertexTexCoords", "unorm16", 2},
+        {"VertexPackedNormalTangent", "unorm16", 4},
+        {"VertexPackedBoneIDs", "byte", 4},
+        {"VertexPackedWeights", "byte", 4}
+    }
+}
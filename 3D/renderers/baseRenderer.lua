@@ -1,15 +1,21 @@
-local Lume         = require "engine.3rdparty.lume"
-local Matrix4      = require "engine.math.matrix4"
-local Stack        = require "engine.collections.stack"
-local ShaderEffect = require "engine.misc.shaderEffect"
-local CubemapUtils = require "engine.misc.cubemapUtils"
-local Object       = require "engine.3rdparty.classic.classic"
-local tableclear   = require "table.clear"
+local Lume          = require "engine.3rdparty.lume"
+local Matrix4       = require "engine.math.matrix4"
+local Vector3       = require "engine.math.vector3"
+local BVH           = require "engine.math.boundingVolumeHierarchy"
+local CameraFrustum = require "engine.misc.cameraFrustum"
+local RenderQueue   = require "engine.3D.renderers.renderQueue"
+local Stack         = require "engine.collections.stack"
+local ShaderEffect  = require "engine.misc.shaderEffect"
+local CubemapUtils  = require "engine.misc.cubemapUtils"
+local MeshPart      = require "engine.3D.model.meshpart"
+local FrameArena    = require "engine.misc.frameArena"
+local Object        = require "engine.3rdparty.classic.classic"
+local tableclear    = require "table.clear"
 
 local skyboxShader = ShaderEffect("engine/shaders/3D/skybox.glsl")
 local configPool = Stack()
 
---- @alias MeshPartConfig {meshPart: MeshPart, material: BaseMaterial, castShadows: boolean, ignoreLighting: boolean, static: boolean, worldMatrix: Matrix4, animator: ModelAnimator?}
+--- @alias MeshPartConfig {meshPart: MeshPart, material: BaseMaterial, castShadows: boolean, ignoreLighting: boolean, static: boolean, worldMatrix: Matrix4, animator: ModelAnimator?, lights: BaseLight[]?, lod: integer, shadowLod: integer}
 
 --- @class BaseRenderer: Object
 ---
@@ -19,7 +25,26 @@ local configPool = Stack()
 --- @field public skyBoxTexture love.Texture
 --- @field public postProcessingEffects BasePostProcessingEffect[]
 --- @field public lights BaseLight[]
+--- @field public visibleMeshParts MeshPartConfig[]: Mesh parts inside the camera frustum, updated once per frame before `renderMeshes`
+--- @field public frustum CameraFrustum
+--- @field public renderQueue RenderQueue: Used by the renderers to sort draw calls, also has the draw counters of the last frame
+--- @field public shadowUpdateBudget integer: Maximum number of shadow maps updated per frame, the ones that waited the longest go first
+--- @field public shadowUpdates integer: Shadow maps updated in the last frame
+--- @field public lodScreenSizes number[]: Screen size (fraction of the screen height) below which each level of detail after the first one is used
+--- @field public lodBias number: Multiplies the screen size of mesh parts when selecting their level of detail, lower values use simpler meshes
+--- @field public shadowLodBias number: Same as `lodBias`, for shadow maps. Cached shadow maps keep the levels they were rendered with
 --- @field protected meshParts Stack
+--- @field private _staticConfigs MeshPartConfig[]
+--- @field private _dynamicConfigs MeshPartConfig[]
+--- @field private _pendingConfigs MeshPartConfig[]
+--- @field private _staticTree BoundingVolumeHierarchy
+--- @field private _dynamicTree BoundingVolumeHierarchy
+--- @field private _isStaticTreeDirty boolean
+--- @field private _isDynamicTreeDirty boolean
+--- @field private _lightCasters table<BaseLight, MeshPartConfig[]>
+--- @field private _frame integer
+--- @field private _movedStaticConfigs table<MeshPartConfig, boolean>
+--- @field private _pendingShadowLights BaseLight[]
 ---
 --- @overload fun(screenSize: Vector2): BaseRenderer
 local Renderer = Object:extend("BaseRenderer")
@@ -30,6 +55,27 @@ function Renderer:new(screensize)
     self.meshParts = Stack()
     self.lights = {}
 
+    self.visibleMeshParts = {}
+    self.frustum = CameraFrustum()
+    self.renderQueue = RenderQueue()
+    self.shadowUpdateBudget = 8
+    self.shadowUpdates = 0
+    self.lodScreenSizes = {0.25, 0.1, 0.04}
+    self.lodBias = 1
+    self.shadowLodBias = 0.5
+
+    self._staticConfigs = {}
+    self._dynamicConfigs = {}
+    self._pendingConfigs = {}
+    self._staticTree = BVH()
+    self._dynamicTree = BVH()
+    self._isStaticTreeDirty = false
+    self._isDynamicTreeDirty = false
+    self._lightCasters = setmetatable({}, {__mode = "k"})
+    self._frame = 0
+    self._movedStaticConfigs = setmetatable({}, {__mode = "k"})
+    self._pendingShadowLights = {}
+
     self.skyBoxTexture = nil
 
     self.resultCanvas = love.graphics.newCanvas(screensize.width, screensize.height, {format = "rg11b10f"})
@@ -48,15 +94,55 @@ function Renderer:pushMeshPart(meshPart)
     config.static = false
     config.worldMatrix = Matrix4.Identity()
     config.animator = nil
+    config.lod = 1
+    config.shadowLod = 1
 
     self.meshParts:push(config)
+    table.insert(self._pendingConfigs, config)
     return config
 end
 
 
+---@private
+---@param config MeshPartConfig
+function Renderer:_removeFromSpatialIndex(config)
+    -- Shadow caches that used this mesh part must be updated
+    if config._isInStaticTree then
+        self._movedStaticConfigs[config] = true
+    end
+
+    local list = config._isInStaticTree and self._staticConfigs or self._dynamicConfigs
+    local index = Lume.find(list, config)
+
+    if index then
+        table.remove(list, index)
+
+        if config._isInStaticTree then
+            self._isStaticTreeDirty = true
+        else
+            self._isDynamicTreeDirty = true
+        end
+    else
+        table.remove(self._pendingConfigs, Lume.find(self._pendingConfigs, config))
+    end
+
+    config._isInStaticTree = nil
+end
+
+
+--- Must be called after the `static` flag of a mesh part is changed, or after a static mesh part is moved.
+--- Static mesh parts are stored in a tree that is only rebuilt when needed, while dynamic ones are updated every frame.
+---@param config MeshPartConfig
+function Renderer:invalidateMeshPart(config)
+    self:_removeFromSpatialIndex(config)
+    table.insert(self._pendingConfigs, config)
+end
+
+
 ---@param config MeshPartConfig
 function Renderer:removeMeshPart(config)
     table.remove(self.meshParts, Lume.find(self.meshParts, config))
+    self:_removeFromSpatialIndex(config)
 
     config.animator = nil
     config.meshPart = nil
@@ -67,17 +153,289 @@ end
 
 
 function Renderer:clearMeshParts()
+    tableclear(self._staticConfigs)
+    tableclear(self._dynamicConfigs)
+    tableclear(self._pendingConfigs)
+    self._isStaticTreeDirty = true
+    self._isDynamicTreeDirty = true
+
+    for i, light in ipairs(self.lights) do
+        light:invalidateShadowCache()
+    end
+
     while self.meshParts:peek() do
         local config = self.meshParts:pop()
         config.animator = nil
         config.meshPart = nil
         config.material = nil
         config.worldMatrix = nil
+        config._isInStaticTree = nil
         configPool:push(config)
     end
 end
 
 
+local aabbMin, aabbMax = Vector3(), Vector3()
+
+-- Stores the world space bounds of a list of mesh parts in a tree
+---@param tree BoundingVolumeHierarchy
+---@param configs MeshPartConfig[]
+local function updateTreeBounds(tree, configs)
+    tree:setItemCount(#configs)
+
+    for i, config in ipairs(configs) do
+        local min, max = config.meshPart.aabb:getMinMaxTransformedInto(config.worldMatrix, aabbMin, aabbMax)
+        tree:setItemBounds(i, min.x, min.y, min.z, max.x, max.y, max.z)
+    end
+end
+
+
+--- Updates `visibleMeshParts` with the mesh parts inside the camera frustum. This is done
+--- once per frame by `render`, so all passes can share the same list.
+---@param camera Camera3D
+function Renderer:updateVisibleMeshParts(camera)
+    -- Sort new mesh parts into the static or dynamic tree
+    for i, config in ipairs(self._pendingConfigs) do
+        if config.static then
+            table.insert(self._staticConfigs, config)
+            self._isStaticTreeDirty = true
+        else
+            table.insert(self._dynamicConfigs, config)
+            self._isDynamicTreeDirty = true
+        end
+
+        config._isInStaticTree = config.static
+    end
+    tableclear(self._pendingConfigs)
+
+    if self._isStaticTreeDirty then
+        updateTreeBounds(self._staticTree, self._staticConfigs)
+        self._staticTree:build()
+        self._isStaticTreeDirty = false
+    end
+
+    -- Dynamic mesh parts can move freely, so their bounds are updated every frame
+    updateTreeBounds(self._dynamicTree, self._dynamicConfigs)
+
+    if self._isDynamicTreeDirty then
+        self._dynamicTree:build()
+        self._isDynamicTreeDirty = false
+    else
+        self._dynamicTree:refit()
+    end
+
+    local visible = self.visibleMeshParts
+    local oldCount = #visible
+
+    self.frustum:updatePlanes(camera.viewProjectionMatrix)
+
+    local count = self._staticTree:queryFrustum(self.frustum, self._staticConfigs, visible, 0)
+    count = self._dynamicTree:queryFrustum(self.frustum, self._dynamicConfigs, visible, count)
+
+    for i=count+1, oldCount do
+        visible[i] = nil
+    end
+end
+
+
+-- Gets the first level of detail whose screen size threshold is above `screenSize`
+---@param screenSize number
+---@param thresholds number[]
+---@param lodCount integer
+---@return integer
+local function selectLod(screenSize, thresholds, lodCount)
+    local lod = 1
+
+    while lod < lodCount and thresholds[lod] and screenSize < thresholds[lod] do
+        lod = lod + 1
+    end
+
+    return lod
+end
+
+
+-- Screen size of the bounding sphere of a mesh part, computed once per frame
+---@param config MeshPartConfig
+---@param camera Camera3D
+---@param scale number: Screen size of a sphere with radius 1 (at distance 1 with perspective cameras)
+---@param frame integer
+---@return number
+local function getScreenSize(config, camera, scale, frame)
+    if config._screenSizeFrame == frame then
+        return config._screenSize
+    end
+
+    local min, max = config.meshPart.aabb:getMinMaxTransformedInto(config.worldMatrix, aabbMin, aabbMax)
+    local rx, ry, rz = (max.x - min.x) * 0.5, (max.y - min.y) * 0.5, (max.z - min.z) * 0.5
+    local radius = math.sqrt(rx*rx + ry*ry + rz*rz)
+    local screenSize = radius * scale
+
+    if camera.type == "perspective" then
+        local position = camera.position
+        local dx, dy, dz = min.x + rx - position.x, min.y + ry - position.y, min.z + rz - position.z
+        local distance = math.sqrt(dx*dx + dy*dy + dz*dz)
+
+        screenSize = distance > radius and screenSize / distance or math.huge
+    end
+
+    config._screenSize, config._screenSizeFrame = screenSize, frame
+    return screenSize
+end
+
+
+--- Selects the level of detail of the visible mesh parts (`config.lod`) and of the shadow casters of each
+--- light (`config.shadowLod`), based on how much of the screen their bounding sphere covers. Other mesh parts
+--- keep their last levels, since they aren't drawn. Must be called after `assignLights`.
+---@param camera Camera3D
+function Renderer:updateLods(camera)
+    local thresholds, lodBias, shadowLodBias = self.lodScreenSizes, self.lodBias, self.shadowLodBias
+    local scale = camera.type == "perspective" and 1 / math.tan(camera.fov * 0.5) or 2 / camera.screenSize.height
+    local frame = self._frame
+
+    for i, config in ipairs(self.visibleMeshParts) do
+        local lodCount = config.meshPart.lodCount
+        config.lod = lodCount > 1 and selectLod(getScreenSize(config, camera, scale, frame) * lodBias, thresholds, lodCount) or 1
+    end
+
+    for l, light in ipairs(self.lights) do
+        local casters = light.enabled and light.castShadows and self._lightCasters[light]
+
+        if casters then
+            for i, config in ipairs(casters) do
+                local lodCount = config.meshPart.lodCount
+                config.shadowLod = lodCount > 1 and selectLod(getScreenSize(config, camera, scale, frame) * shadowLodBias, thresholds, lodCount) or 1
+            end
+        end
+    end
+end
+
+
+local queryResult = {}
+
+-- Appends `light` to the light list of all visible mesh parts in `configs`
+---@param light BaseLight
+---@param configs MeshPartConfig[]
+---@param count integer
+---@param frame integer
+local function addLightToMeshes(light, configs, count, frame)
+    for i=1, count do
+        local config = configs[i]
+
+        if config._visibleFrame == frame then
+            table.insert(config.lights, light)
+        end
+    end
+end
+
+
+-- Stores the mesh parts of `configs` that can cast shadows into `casters`
+---@param configs MeshPartConfig[]
+---@param count integer
+---@param casters MeshPartConfig[]
+local function setShadowCasters(configs, count, casters)
+    tableclear(casters)
+
+    for i=1, count do
+        if configs[i].castShadows then
+            table.insert(casters, configs[i])
+        end
+    end
+end
+
+
+--- Finds which lights affect each visible mesh part (stored in `config.lights`), and which mesh
+--- parts can cast shadows for each light, using the light bounding volumes. Must be called after
+--- `updateVisibleMeshParts`.
+function Renderer:assignLights()
+    local frame = self._frame + 1
+    self._frame = frame
+
+    for i, config in ipairs(self.visibleMeshParts) do
+        config._visibleFrame = frame
+        config.lights = config.lights or {}
+        tableclear(config.lights)
+    end
+
+    local staticTree, staticConfigs = self._staticTree, self._staticConfigs
+    local dynamicTree, dynamicConfigs = self._dynamicTree, self._dynamicConfigs
+
+    for l, light in ipairs(self.lights) do
+        if not light.enabled then goto continue end
+
+        local x, y, z, radius = light:getBoundingSphere()
+        local count = 0
+
+        -- Lighting
+        if x then
+            count = staticTree:querySphere(x, y, z, radius, staticConfigs, queryResult, 0)
+            count = dynamicTree:querySphere(x, y, z, radius, dynamicConfigs, queryResult, count)
+            addLightToMeshes(light, queryResult, count, frame)
+        else
+            for i, config in ipairs(self.visibleMeshParts) do
+                table.insert(config.lights, light)
+            end
+        end
+
+        -- Shadow casters
+        if light.castShadows then
+            local casters = self._lightCasters[light] or {}
+            local frustum = light:getShadowFrustum()
+            self._lightCasters[light] = casters
+
+            if frustum then
+                count = staticTree:queryFrustum(frustum, staticConfigs, queryResult, 0)
+                count = dynamicTree:queryFrustum(frustum, dynamicConfigs, queryResult, count)
+                setShadowCasters(queryResult, count, casters)
+            elseif x then
+                setShadowCasters(queryResult, count, casters)
+            else
+                setShadowCasters(self.meshParts, #self.meshParts, casters)
+            end
+        end
+
+        ::continue::
+    end
+
+    tableclear(queryResult)
+end
+
+
+local function compareShadowPriority(a, b)
+    return a.framesSinceShadowUpdate > b.framesSinceShadowUpdate
+end
+
+
+--- Updates the shadow maps that changed, up to `shadowUpdateBudget` per frame. Lights over the
+--- budget keep their last shadow map and get priority on the next frames. Must be called after `assignLights`.
+function Renderer:updateShadowMaps()
+    local pending = self._pendingShadowLights
+    local moved = self._movedStaticConfigs
+
+    for i, light in ipairs(self.lights) do
+        if light.enabled and light:needsShadowUpdate(self._lightCasters[light] or self.meshParts, moved) then
+            light.framesSinceShadowUpdate = light.framesSinceShadowUpdate + 1
+            table.insert(pending, light)
+        end
+    end
+
+    -- Already tested against the casters of every light
+    tableclear(moved)
+
+    if #pending > self.shadowUpdateBudget then
+        table.sort(pending, compareShadowPriority)
+    end
+
+    local count = math.min(#pending, self.shadowUpdateBudget)
+    for i=1, count do
+        local light = pending[i]
+        light:generateShadowMap(self._lightCasters[light] or self.meshParts)
+    end
+
+    self.shadowUpdates = count
+    tableclear(pending)
+end
+
+
 ---@param ... BaseLight
 function Renderer:addLights(...)
     Lume.push(self.lights, ...)
@@ -124,21 +482,30 @@ function Renderer:_renderSkyBox(camera)
     love.graphics.setDepthMode("lequal", false)
 
     skyboxShader:use()
-    skyboxShader:sendUniform("u_viewProj", "column", view:multiply(camera.perspectiveMatrix))
+    skyboxShader:sendUniform("u_viewProj", "column", Matrix4.MultiplyInto(Matrix4.Temp(), view, camera.perspectiveMatrix))
     skyboxShader:sendUniform("u_skyTex", self.skyBoxTexture)
 
     love.graphics.draw(CubemapUtils.cubeMesh)
 end
 
 
+--- Renders a frame. This also recycles the temporaries of the frame arena (see `FrameArena.reset`),
+--- so temporaries created before this call must not be used after it.
 ---@param camera Camera3D
 ---@return love.Canvas
 function Renderer:render(camera)
+    FrameArena.reset()
     love.graphics.push("all")
 
-    for i, light in ipairs(self.lights) do
-        light:generateShadowMap(self.meshParts)
-    end
+    self.renderQueue:resetStats()
+    ShaderEffect.ResetStats()
+    MeshPart.ResetStats()
+
+    self:updateVisibleMeshParts(camera)
+    self:assignLights()
+    self:updateLods(camera)
+
+    self:updateShadowMaps()
 
     self:renderMeshes(camera)
 
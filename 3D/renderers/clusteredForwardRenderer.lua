@@ -0,0 +1,164 @@
+local ForwardRenderer  = require "engine.3D.renderers.forwardRenderer"
+local LightClusterGrid = require "engine.3D.renderers.lightClusterGrid"
+local BaseLight        = require "engine.3D.lights.baseLight"
+local ffi              = require "ffi"
+local tableclear       = require "table.clear"
+local lg               = love.graphics
+
+
+---@param width integer
+---@param height integer
+---@param format love.PixelFormat
+---@return love.ImageData, love.Image
+local function newDataTexture(width, height, format)
+    local data = love.image.newImageData(width, height, format)
+    local texture = lg.newImage(data)
+    texture:setFilter("nearest", "nearest")
+    texture:setWrap("clamp")
+
+    return data, texture
+end
+
+
+---
+--- Forward renderer that shades all shadowless point and spot lights in a single pass.
+---
+--- Lights are binned into a grid of view frustum clusters on the CPU (see `LightClusterGrid`), and the
+--- light data and per cluster light lists are uploaded to float textures every frame. Materials that
+--- support it (`SupportsClusteredLighting`) then loop over the lights of the fragment cluster.
+---
+--- Lights with shadows, directional lights, and materials without a clustered path still use the
+--- additive multi-pass lighting of `ForwardRenderer`.
+---
+--- @class ClusteredForwardRenderer: ForwardRenderer
+---
+--- @field public clusterGrid LightClusterGrid
+--- @field private _lightData love.ImageData
+--- @field private _lightTexture love.Image
+--- @field private _clusterData love.ImageData
+--- @field private _clusterTexture love.Image
+--- @field private _indexData love.ImageData
+--- @field private _indexTexture love.Image
+--- @field private _clusteredLights BaseLight[]
+--- @field private _isClustered table<BaseLight, boolean>
+--- @field private _gridSize number[]: Reused `uClusterGridSize` value
+--- @field private _depthParams number[]: Reused `uClusterDepthParams` value, updated with the camera planes
+--- @field private _sendClusterUniforms fun(shader: ShaderEffect)
+---
+--- @overload fun(screenSize: Vector2, clusterGrid: LightClusterGrid?): ClusteredForwardRenderer
+local ClusteredForwardRenderer = ForwardRenderer:extend("ClusteredForwardRenderer")
+
+
+function ClusteredForwardRenderer:new(screensize, clusterGrid)
+    ForwardRenderer.new(self, screensize)
+
+    local grid = clusterGrid or LightClusterGrid()
+    self.clusterGrid = grid
+
+    self._lightData, self._lightTexture = newDataTexture(LightClusterGrid.LIGHT_TEXELS, grid.maxLights, "rgba32f")
+    self._clusterData, self._clusterTexture = newDataTexture(grid.sizeX * grid.sizeY, grid.sizeZ, "rg32f")
+    self._indexData, self._indexTexture = newDataTexture(LightClusterGrid.INDEX_TEXTURE_WIDTH, grid.indexCapacity / LightClusterGrid.INDEX_TEXTURE_WIDTH, "r32f")
+
+    self._clusteredLights = {}
+    self._isClustered = {}
+    self._gridSize = {grid.sizeX, grid.sizeY, grid.sizeZ}
+    self._depthParams = {0, 0}
+
+    -- Called by the render queue once per shader variant
+    self._sendClusterUniforms = function(shader)
+        shader:trySendUniform("uClusterLights", self._lightTexture)
+        shader:trySendUniform("uClusterGrid", self._clusterTexture)
+        shader:trySendUniform("uClusterIndices", self._indexTexture)
+        shader:trySendUniform("uClusterGridSize", self._gridSize)
+        shader:trySendUniform("uClusterDepthParams", self._depthParams)
+    end
+end
+
+
+---@param light BaseLight
+---@return boolean
+function ClusteredForwardRenderer:canClusterLight(light)
+    local lightType = light.typeDefinition
+    return light.enabled and not light.shadowMap and (lightType == BaseLight.LIGHT_TYPE_POINT or lightType == BaseLight.LIGHT_TYPE_SPOT)
+end
+
+
+--- Bins the clustered lights and uploads the result
+---@private
+---@param camera Camera3D
+function ClusteredForwardRenderer:_updateClusters(camera)
+    local lights, isClustered = self._clusteredLights, self._isClustered
+    local grid = self.clusterGrid
+
+    tableclear(lights)
+    tableclear(isClustered)
+
+    for i, light in ipairs(self.lights) do
+        if self:canClusterLight(light) then
+            table.insert(lights, light)
+            isClustered[light] = true
+        end
+    end
+
+    grid:build(lights, camera.viewMatrix, camera.projectionMatrix, camera.nearPlane, camera.farPlane)
+    self._depthParams[1], self._depthParams[2] = grid.depthScale, grid.depthBias
+
+    -- Only the used part of the buffers is copied, the rest of the textures is never read
+    ffi.copy(self._lightData:getFFIPointer(), grid.lightData, grid.lightCount * LightClusterGrid.LIGHT_TEXELS * 16)
+    ffi.copy(self._clusterData:getFFIPointer(), grid.clusterData, grid.clusterCount * 8)
+    ffi.copy(self._indexData:getFFIPointer(), grid.indices, grid.indexCount * 4)
+
+    self._lightTexture:replacePixels(self._lightData)
+    self._clusterTexture:replacePixels(self._clusterData)
+    self._indexTexture:replacePixels(self._indexData)
+end
+
+
+---@param camera Camera3D
+function ClusteredForwardRenderer:renderMeshes(camera)
+    -- The grid is built from a perspective frustum
+    if camera.type ~= "perspective" then
+        ForwardRenderer.renderMeshes(self, camera)
+        return
+    end
+
+    self:_updateClusters(camera)
+
+    lg.setCanvas({self.resultCanvas, depthstencil = self.depthCanvas})
+    lg.clear()
+
+    self:renderDepthPrePass(camera)
+
+
+    ---------------
+    -- Rendering --
+    ---------------
+
+    lg.setDepthMode("lequal", false)
+    lg.setMeshCullMode("back")
+    lg.setBlendMode("add", "alphamultiply")
+
+    local grid = self.clusterGrid
+    local queue = self.renderQueue:begin(camera)
+
+    for c, config in ipairs(self.visibleMeshParts) do
+        if config.material.SupportsClusteredLighting then
+            if grid.lightCount > 0 then
+                queue:push("clustered", config)
+            end
+
+            self:queueLightPasses(config, self._isClustered)
+        else
+            self:queueLightPasses(config)
+        end
+    end
+
+    queue:submit(self, camera, self._sendClusterUniforms)
+
+
+    lg.setShader()
+    lg.setBlendMode("alpha", "alphamultiply")
+end
+
+
+return ClusteredForwardRenderer
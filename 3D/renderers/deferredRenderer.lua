@@ -1,7 +1,6 @@
 local BaseRederer   = require "engine.3D.renderers.baseRenderer"
 local Matrix4       = require "engine.math.matrix4"
 local Vector3       = require "engine.math.vector3"
-local CameraFrustum = require "engine.misc.cameraFrustum"
 local Utils         = require "engine.misc.utils"
 local Vector2       = require "engine.math.vector2"
 local lg            = love.graphics
@@ -10,7 +9,7 @@ local lg            = love.graphics
 local sphereVolume = Utils.newSphereMesh(Vector3(1), 32, 32)
 local coneVolume = Utils.newConeMesh(Vector3(1), 32)
 local squareVolume = Utils.newSquareMesh(Vector2(1))
-local frustum = CameraFrustum()
+local upVector = Vector3(0, 1, 0)
 
 ---@alias GBuffer {uniform: string, buffer: love.Canvas}[]
 
@@ -48,22 +47,14 @@ function DeferredRenderer:renderMeshes(camera)
     lg.setBlendMode("replace", "premultiplied")
     lg.setMeshCullMode("back")
 
-    frustum:updatePlanes(camera.viewProjectionMatrix)
-    self.lightPassMaterial:setRenderPass("gbuffer")
-    self.lightPassMaterial.shader:sendCommonUniforms()
-    self.lightPassMaterial.shader:sendRendererUniforms(self)
-    self.lightPassMaterial.shader:sendCameraUniforms(camera)
-    self.lightPassMaterial.shader:use()
+    local queue = self.renderQueue:begin(camera)
 
-    for i, config in ipairs(self.meshParts) do
-        if frustum:testIntersection(config.meshPart.aabb, config.worldMatrix) then
-            self.lightPassMaterial.shader:sendMeshConfigUniforms(config)
-
-            config.material:apply(self.lightPassMaterial.shader)
-            config.meshPart:draw()
-        end
+    for i, config in ipairs(self.visibleMeshParts) do
+        queue:push("gbuffer", config, nil, self.lightPassMaterial)
     end
 
+    queue:submit(self, camera)
+
 
     ----------------
     -- Light pass --
@@ -83,12 +74,16 @@ function DeferredRenderer:renderMeshes(camera)
         local volumeMesh = nil
 
         if Utils.isType(light, "PointLight") then ---@cast light PointLight
-            volumeMatrix = Matrix4.CreateScale(Vector3(light.farPlane)):multiply(Matrix4.CreateTranslation(light.position)):multiply(camera.viewProjectionMatrix)
+            local r, pos = light.farPlane, light.position
+            volumeMatrix = Matrix4.Temp(r,0,0,0, 0,r,0,0, 0,0,r,0, pos.x,pos.y,pos.z,1)
+            Matrix4.MultiplyInto(volumeMatrix, volumeMatrix, camera.viewProjectionMatrix)
             volumeMesh = sphereVolume
 
         elseif Utils.isType(light, "SpotLight") then ---@cast light SpotLight
             local coneSize = light.farPlane * math.cos(light.outerAngle)
-            volumeMatrix = Matrix4.CreateScale(Vector3(coneSize, coneSize, light.farPlane)):multiply(Matrix4.CreateWorld(light.position, light.direction, Vector3(0,1,0))):multiply(camera.viewProjectionMatrix)
+            volumeMatrix = Matrix4.Temp(coneSize,0,0,0, 0,coneSize,0,0, 0,0,light.farPlane,0, 0,0,0,1)
+            Matrix4.MultiplyInto(volumeMatrix, volumeMatrix, Matrix4.CreateWorld(light.position, light.direction, upVector))
+            Matrix4.MultiplyInto(volumeMatrix, volumeMatrix, camera.viewProjectionMatrix)
             volumeMesh = coneVolume
         else
             volumeMatrix = Matrix4.CreateOrthographicOffCenter(0, 1, 1, 0, 0, 1)
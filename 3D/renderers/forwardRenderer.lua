@@ -1,9 +1,6 @@
 local BaseRederer   = require "engine.3D.renderers.baseRenderer"
-local CameraFrustum = require "engine.misc.cameraFrustum"
 local lg            = love.graphics
 
-local frustum = CameraFrustum()
-
 --- @class ForwardRenderer: BaseRenderer
 ---
 --- @overload fun(screenSize: Vector2): ForwardRenderer
@@ -19,8 +16,33 @@ function ForwardRenderer:renderMeshes(camera)
     lg.setCanvas({self.resultCanvas, depthstencil = self.depthCanvas})
     lg.clear()
 
-    frustum:updatePlanes(camera.viewProjectionMatrix)
+    self:renderDepthPrePass(camera)
+
+
+    ---------------
+    -- Rendering --
+    ---------------
+
+    lg.setDepthMode("lequal", false)
+    lg.setMeshCullMode("back")
+    lg.setBlendMode("add", "alphamultiply")
+
+    local queue = self.renderQueue:begin(camera)
 
+    for c, config in ipairs(self.visibleMeshParts) do
+        self:queueLightPasses(config)
+    end
+
+    queue:submit(self, camera)
+
+
+    lg.setShader()
+    lg.setBlendMode("alpha", "alphamultiply")
+end
+
+
+---@param camera Camera3D
+function ForwardRenderer:renderDepthPrePass(camera)
     --------------------
     -- Depth pre-pass --
     --------------------
@@ -34,61 +56,26 @@ function ForwardRenderer:renderMeshes(camera)
     lg.setMeshCullMode("back")
     lg.setBlendMode("replace")
 
-    for i, config in ipairs(self.meshParts) do
-        if frustum:testIntersection(config.meshPart.aabb, config.worldMatrix) then
-            config.material:setRenderPass("depth")
-
-            config.material.shader:use()
-            config.material.shader:sendMeshConfigUniforms(config)
-            config.material.shader:sendCommonUniforms()
-            config.material.shader:sendRendererUniforms(self)
-            config.material.shader:sendCameraUniforms(camera)
+    local queue = self.renderQueue:begin(camera)
 
-            config.material:apply()
-            lg.draw(config.meshPart.buffer)
-        end
+    for i, config in ipairs(self.visibleMeshParts) do
+        queue:push("depth", config)
     end
 
+    queue:submit(self, camera)
+end
 
-    ---------------
-    -- Rendering --
-    ---------------
-
-    lg.setDepthMode("lequal", false)
-    lg.setMeshCullMode("back")
-    lg.setBlendMode("add", "alphamultiply")
-
-    for c, config in ipairs(self.meshParts) do
-        local material = config.material
-        local shader = material.shader
-
-        if frustum:testIntersection(config.meshPart.aabb, config.worldMatrix) then
-            material:setRenderPass("forward")
-
-            for l, light in ipairs(self.lights) do
-                if not light.enabled then goto continue end
-
-                material:setLight(light)
-
-                shader:use()
-                shader:sendCommonUniforms()
-                shader:sendRendererUniforms(self) --! Sending this amount of data every single pass isn't really a good idea, gonna fix it later 
-                shader:sendCameraUniforms(camera)
-                shader:sendMeshConfigUniforms(config)
-
-
-                material:apply()
-                config.meshPart:draw()
 
-                ::continue::
-            end
+--- Adds one additive pass for each light affecting a mesh part to the render queue
+---@param config MeshPartConfig
+---@param skipLights table<BaseLight, boolean>?: Lights that were already rendered in some other way
+function ForwardRenderer:queueLightPasses(config, skipLights)
+    -- Only lights that can reach this mesh (see `BaseRenderer:assignLights`)
+    for l, light in ipairs(config.lights) do
+        if not (skipLights and skipLights[light]) then
+            self.renderQueue:push("forward", config, light)
         end
     end
-
-
-    lg.setShader()
-    lg.setBlendMode("alpha", "alphamultiply")
 end
 
-
 return ForwardRenderer
\ No newline at end of file
@@ -0,0 +1,286 @@
+local Object = require "engine.3rdparty.classic.classic"
+local ffi    = require "ffi"
+local floor, min, max, log, sqrt, cos = math.floor, math.min, math.max, math.log, math.sqrt, math.cos
+
+
+-- Same values as `BaseLight.LIGHT_TYPE_*`, not required here so the grid can be used without LÖVE
+local LIGHT_TYPE_SPOT  = 2
+local LIGHT_TYPE_POINT = 3
+
+
+---@class ClusterableLight
+---@field typeDefinition integer
+---@field position Vector3
+---@field direction Vector3?
+---@field color number[]
+---@field constant number
+---@field linear number
+---@field quadratic number
+---@field innerAngle number?
+---@field outerAngle number?
+---@field getBoundingSphere fun(self): number, number, number, number
+
+---@alias LightClusterGridStats {lights: integer, culledLights: integer, indices: integer, overflows: integer}
+
+
+---
+--- Bins point and spot lights into a grid of view frustum clusters (froxels).
+---
+--- The view frustum is split into `sizeX` * `sizeY` screen tiles and `sizeZ` exponential depth slices.
+--- Every light is tested against the clusters touched by its bounding sphere, and the result is a
+--- compact list of light indices for each cluster, so the shader only loops over the lights that can
+--- actually reach the fragment.
+---
+--- This class only fills FFI buffers and doesn't use LÖVE, the renderer is responsible for uploading
+--- them to textures:
+--- - `lightData`: `LIGHT_TEXELS` RGBA texels per light (see `incl_lights.glsl`)
+--- - `clusterData`: RG texels with the offset and count of each cluster inside `indices`, indexed by `x + y*sizeX + z*sizeX*sizeY`
+--- - `indices`: R texels with the light indices, `INDEX_TEXTURE_WIDTH` per row
+---
+--- @class LightClusterGrid: Object
+---
+--- @field public sizeX integer
+--- @field public sizeY integer
+--- @field public sizeZ integer
+--- @field public clusterCount integer
+--- @field public maxLights integer
+--- @field public maxLightsPerCluster integer
+--- @field public indexCapacity integer
+--- @field public lightCount integer
+--- @field public indexCount integer
+--- @field public depthScale number: Used to calculate the depth slice: `floor(log(depth) * depthScale + depthBias)`
+--- @field public depthBias number
+--- @field public lightData ffi.cdata*
+--- @field public clusterData ffi.cdata*
+--- @field public indices ffi.cdata*
+--- @field public stats LightClusterGridStats
+--- @field private _counts ffi.cdata*
+--- @field private _clusterLights ffi.cdata*
+---
+--- @overload fun(sizeX: integer?, sizeY: integer?, sizeZ: integer?, maxLights: integer?, maxLightsPerCluster: integer?): LightClusterGrid
+local Grid = Object:extend("LightClusterGrid")
+
+Grid.LIGHT_TEXELS = 4
+Grid.INDEX_TEXTURE_WIDTH = 1024
+
+
+function Grid:new(sizeX, sizeY, sizeZ, maxLights, maxLightsPerCluster)
+    self.sizeX = sizeX or 16
+    self.sizeY = sizeY or 9
+    self.sizeZ = sizeZ or 24
+    self.clusterCount = self.sizeX * self.sizeY * self.sizeZ
+    self.maxLights = maxLights or 1024
+    self.maxLightsPerCluster = maxLightsPerCluster or 64
+
+    -- Most clusters are empty or only have a few lights, so the compact list is way smaller than the worst case
+    local width = Grid.INDEX_TEXTURE_WIDTH
+    self.indexCapacity = math.ceil(self.clusterCount * 16 / width) * width
+
+    self.lightCount = 0
+    self.indexCount = 0
+    self.depthScale = 0
+    self.depthBias = 0
+
+    self.lightData = ffi.new("float[?]", self.maxLights * Grid.LIGHT_TEXELS * 4)
+    self.clusterData = ffi.new("float[?]", self.clusterCount * 2)
+    self.indices = ffi.new("float[?]", self.indexCapacity)
+
+    self._counts = ffi.new("int32_t[?]", self.clusterCount)
+    self._clusterLights = ffi.new("int32_t[?]", self.clusterCount * self.maxLightsPerCluster)
+
+    self.stats = {
+        lights = 0,       -- Lights stored in the grid
+        culledLights = 0, -- Lights outside the view frustum depth range
+        indices = 0,      -- Used light indices
+        overflows = 0,    -- Light indices dropped because a cluster (or the index list) was full
+    }
+end
+
+
+---@private
+---@param light ClusterableLight
+---@param index integer
+---@param radius number
+function Grid:_packLight(light, index, radius)
+    local data = self.lightData
+    local i = index * Grid.LIGHT_TEXELS * 4
+    local pos, color = light.position, light.color
+    local isSpot = light.typeDefinition == LIGHT_TYPE_SPOT
+
+    data[i],    data[i+1],  data[i+2],  data[i+3]  = pos.x, pos.y, pos.z, radius
+    data[i+4],  data[i+5],  data[i+6],  data[i+7]  = color[1], color[2], color[3], light.typeDefinition
+    data[i+12], data[i+13], data[i+14], data[i+15] = light.constant, light.linear, light.quadratic, isSpot and cos(light.outerAngle) or -1
+
+    if isSpot then
+        local dir = light.direction
+        data[i+8], data[i+9], data[i+10], data[i+11] = dir.x, dir.y, dir.z, cos(light.innerAngle)
+    else
+        data[i+8], data[i+9], data[i+10], data[i+11] = 0, 0, 0, 1
+    end
+end
+
+
+--- Gets the depth slice that contains a view space depth
+---@param depth number: Positive distance from the camera plane
+---@return integer
+function Grid:getDepthSlice(depth)
+    return min(max(floor(log(depth) * self.depthScale + self.depthBias), 0), self.sizeZ-1)
+end
+
+
+--- Gets the index of a cluster in `clusterData`
+---@param x integer
+---@param y integer
+---@param z integer
+---@return integer
+function Grid:getClusterIndex(x, y, z)
+    return x + (y + z * self.sizeY) * self.sizeX
+end
+
+
+--- Gets the light indices of a cluster
+---@param x integer
+---@param y integer
+---@param z integer
+---@return integer[]
+function Grid:getClusterLights(x, y, z)
+    local cluster = self:getClusterIndex(x, y, z)
+    local offset, count = self.clusterData[cluster*2], self.clusterData[cluster*2+1]
+    local result = {}
+
+    for i=0, count-1 do
+        result[i+1] = self.indices[offset+i]
+    end
+
+    return result
+end
+
+
+--- Bins `lights` into the clusters of a perspective view
+---@param lights ClusterableLight[]: Point and spot lights
+---@param viewMatrix Matrix4
+---@param projMatrix Matrix4: Perspective projection
+---@param near number
+---@param far number
+---@return self
+function Grid:build(lights, viewMatrix, projMatrix, near, far)
+    local sizeX, sizeY, sizeZ = self.sizeX, self.sizeY, self.sizeZ
+    local maxPerCluster = self.maxLightsPerCluster
+    local counts, clusterLights = self._counts, self._clusterLights
+    local stats = self.stats
+    local v, p11, p22 = viewMatrix, projMatrix.m11, projMatrix.m22
+
+    -- Exponential slices: slice = log(depth / near) / log(far / near) * sizeZ
+    local depthScale = sizeZ / log(far / near)
+    local depthBias = -log(near) * depthScale
+    self.depthScale, self.depthBias = depthScale, depthBias
+
+    ffi.fill(counts, ffi.sizeof("int32_t") * self.clusterCount)
+    stats.culledLights, stats.overflows = 0, 0
+
+    local lightCount = 0
+
+    for l, light in ipairs(lights) do
+        if lightCount >= self.maxLights then
+            stats.overflows = stats.overflows + 1
+            goto continue
+        end
+
+        local wx, wy, wz, radius = light:getBoundingSphere()
+
+        -- To view space (the camera looks towards -Z)
+        local cx = wx * v.m11 + wy * v.m21 + wz * v.m31 + v.m41
+        local cy = wx * v.m12 + wy * v.m22 + wz * v.m32 + v.m42
+        local depth = -(wx * v.m13 + wy * v.m23 + wz * v.m33 + v.m43)
+
+        if depth + radius < near or depth - radius > far then
+            stats.culledLights = stats.culledLights + 1
+            goto continue
+        end
+
+        local index = lightCount
+        local radius2 = radius * radius
+        lightCount = lightCount + 1
+        self:_packLight(light, index, radius)
+
+        local firstSlice = self:getDepthSlice(max(depth - radius, near))
+        local lastSlice = self:getDepthSlice(min(depth + radius, far))
+
+        for z=firstSlice, lastSlice do
+            -- Part of the sphere inside this slice
+            local sliceNear = max(near * (far / near) ^ (z / sizeZ), depth - radius, near)
+            local sliceFar = min(near * (far / near) ^ ((z+1) / sizeZ), depth + radius, far)
+            local dz = depth < sliceNear and sliceNear - depth or (depth > sliceFar and depth - sliceFar or 0)
+            local r = sqrt(max(radius2 - dz*dz, 0))
+
+            -- Project the box around the sphere cross section, the nearest depth gives the widest bounds
+            local minX, maxX, minY, maxY = cx - r, cx + r, cy - r, cy + r
+            minX = minX * p11 / (minX < 0 and sliceNear or sliceFar)
+            maxX = maxX * p11 / (maxX > 0 and sliceNear or sliceFar)
+            minY = minY * p22 / (minY < 0 and sliceNear or sliceFar)
+            maxY = maxY * p22 / (maxY > 0 and sliceNear or sliceFar)
+
+            if maxX < -1 or minX > 1 or maxY < -1 or minY > 1 then
+                goto nextSlice
+            end
+
+            local firstX = max(floor((minX * 0.5 + 0.5) * sizeX), 0)
+            local lastX = min(floor((maxX * 0.5 + 0.5) * sizeX), sizeX-1)
+            local firstY = max(floor((minY * 0.5 + 0.5) * sizeY), 0)
+            local lastY = min(floor((maxY * 0.5 + 0.5) * sizeY), sizeY-1)
+
+            for y=firstY, lastY do
+                local cluster = firstX + (y + z * sizeY) * sizeX
+
+                for x=firstX, lastX do
+                    local count = counts[cluster]
+
+                    if count < maxPerCluster then
+                        clusterLights[cluster * maxPerCluster + count] = index
+                        counts[cluster] = count + 1
+                    else
+                        stats.overflows = stats.overflows + 1
+                    end
+
+                    cluster = cluster + 1
+                end
+            end
+
+            ::nextSlice::
+        end
+
+        ::continue::
+    end
+
+    -- Compact the per cluster lists into a single one
+    local clusterData, indices = self.clusterData, self.indices
+    local capacity = self.indexCapacity
+    local offset = 0
+
+    for c=0, self.clusterCount-1 do
+        local count = min(counts[c], capacity - offset)
+        local first = c * maxPerCluster
+
+        if count < counts[c] then
+            stats.overflows = stats.overflows + counts[c] - count
+        end
+
+        clusterData[c*2], clusterData[c*2+1] = offset, count
+
+        for i=0, count-1 do
+            indices[offset+i] = clusterLights[first+i]
+        end
+
+        offset = offset + count
+    end
+
+    self.lightCount = lightCount
+    self.indexCount = offset
+    stats.lights = lightCount
+    stats.indices = offset
+
+    return self
+end
+
+
+return Grid
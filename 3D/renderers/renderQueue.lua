@@ -0,0 +1,421 @@
+local Object     = require "engine.3rdparty.classic.classic"
+local ffi        = require "ffi"
+local bit        = require "bit"
+local tableclear = require "table.clear"
+local band, bor, lshift, rshift = bit.band, bit.bor, bit.lshift, bit.rshift
+local floor, min, sqrt = math.floor, math.min, math.sqrt
+
+
+---@alias RenderPassName "forward"|"clustered"|"gbuffer"|"lightpass"|"depth"|"shadowmapping"
+---@alias RenderQueueStats {draws: integer, instances: integer, shaderSwitches: integer, materialSwitches: integer, lightSwitches: integer}
+
+---@class RenderQueueEntry
+---@field pass RenderPassName
+---@field config MeshPartConfig
+---@field material BaseMaterial: Material whose attributes are applied
+---@field shaderMaterial BaseMaterial: Material whose shader is used
+---@field light BaseLight?
+---@field variant love.Shader: Shader variant selected by the pass, light and animation defines
+---@field isInstanced boolean
+---@field lod integer
+
+
+local DEPTH_BITS = 20
+local MAX_DEPTH = lshift(1, DEPTH_BITS) - 1
+
+local PASS_IDS = {
+    depth = 0,
+    gbuffer = 1,
+    clustered = 2,
+    forward = 3,
+    lightpass = 4,
+    shadowmapping = 5,
+}
+
+
+---
+--- Sorts draw calls to minimize state changes.
+---
+--- Every draw gets a 64 bit sort key (stored as two 32 bit halves) built from, in order of priority:
+--- - pass (4 bits), shader variant (10 bits), light (8 bits), material (10 bits)
+--- - mesh part (10 bits), level of detail (2 bits), distance to the camera (20 bits, front to back)
+---
+--- Keys are radix sorted, and `submit` only switches shaders, sends light data and applies materials
+--- when they actually change. Per shader uniforms (common, renderer and camera) are sent once per
+--- shader variant instead of once per draw.
+---
+--- With `useInstancing` enabled, shaders are compiled with `MESH_INSTANCING` and consecutive draws
+--- of the same mesh part with the same state are merged into a single instanced draw. Animated
+--- meshes are never merged, since they need their own bone uniforms.
+---
+--- Ids are only used for sorting, so ids wrapping around when there are too many objects only
+--- makes batching worse, it doesn't break anything.
+---
+--- @class RenderQueue: Object
+---
+--- @field public useInstancing boolean
+--- @field public stats RenderQueueStats: Counters since the last `resetStats`
+--- @field public count integer
+--- @field private _entries RenderQueueEntry[]
+--- @field private _keysHigh ffi.cdata*
+--- @field private _keysLow ffi.cdata*
+--- @field private _order ffi.cdata*
+--- @field private _swap ffi.cdata*
+--- @field private _capacity integer
+--- @field private _ids table<any, integer>
+--- @field private _nextIds integer[]
+--- @field private _cameraX number
+--- @field private _cameraY number
+--- @field private _cameraZ number
+--- @field private _depthScale number
+--- @field private _preparedShaders table<love.Shader, boolean>
+--- @field private _usedShaders table<ShaderEffect, boolean>
+--- @field private _batch Matrix4[]
+---
+--- @overload fun(): RenderQueue
+local RenderQueue = Object:extend("RenderQueue")
+
+
+function RenderQueue:new()
+    self.count = 0
+    self.useInstancing = true
+    self.stats = {
+        draws = 0,            -- Draw calls submitted
+        instances = 0,        -- Meshes drawn, including every instance of instanced draws
+        shaderSwitches = 0,   -- Times a different shader variant was bound
+        materialSwitches = 0, -- Times a material was applied
+        lightSwitches = 0,    -- Times light data was sent
+    }
+
+    self._entries = {}
+    self._capacity = 0
+    self._ids = setmetatable({}, {__mode = "k"})
+    self._nextIds = {0, 0, 0, 0}
+    self._cameraX, self._cameraY, self._cameraZ = 0, 0, 0
+    self._depthScale = 0
+    self._preparedShaders = {}
+    self._usedShaders = {}
+    self._batch = {}
+
+    self:_reserve(256)
+end
+
+
+---@private
+---@param capacity integer
+function RenderQueue:_reserve(capacity)
+    if capacity <= self._capacity then
+        return
+    end
+
+    local keysHigh = ffi.new("uint32_t[?]", capacity)
+    local keysLow = ffi.new("uint32_t[?]", capacity)
+
+    if self._keysHigh then
+        ffi.copy(keysHigh, self._keysHigh, self.count * 4)
+        ffi.copy(keysLow, self._keysLow, self.count * 4)
+    end
+
+    self._keysHigh, self._keysLow = keysHigh, keysLow
+    self._order = ffi.new("int32_t[?]", capacity)
+    self._swap = ffi.new("int32_t[?]", capacity)
+    self._capacity = capacity
+end
+
+
+-- Gets a small id for an object, `category` selects an independent counter
+---@private
+---@param object any
+---@param category integer
+---@param mask integer
+---@return integer
+function RenderQueue:_getId(object, category, mask)
+    if not object then
+        return 0
+    end
+
+    local id = self._ids[object]
+
+    if not id then
+        id = self._nextIds[category] + 1
+        self._nextIds[category] = id
+        self._ids[object] = id
+    end
+
+    return band(id, mask)
+end
+
+
+--- Removes all entries and sets the camera used to sort by depth
+---@param camera Camera3D
+---@return self
+function RenderQueue:begin(camera)
+    local pos = camera.position
+
+    self.count = 0
+    self._cameraX, self._cameraY, self._cameraZ = pos.x, pos.y, pos.z
+    self._depthScale = MAX_DEPTH / camera.farPlane
+
+    return self
+end
+
+
+--- Adds a draw call to the queue
+---@param pass RenderPassName
+---@param config MeshPartConfig
+---@param light BaseLight?: Light rendered by this draw, if any
+---@param shaderMaterial BaseMaterial?: Material whose shader is used, `config.material` by default
+function RenderQueue:push(pass, config, light, shaderMaterial)
+    shaderMaterial = shaderMaterial or config.material
+
+    local shader = shaderMaterial.shader
+    local isInstanced = self.useInstancing
+
+    -- Select the variant now, so the key knows which shader will be used
+    shaderMaterial:setRenderPass(pass)
+    if light then
+        shaderMaterial:setLightDefines(light)
+    end
+
+    if isInstanced then
+        shader:define("MESH_INSTANCING")
+    else
+        shader:undefine("MESH_INSTANCING")
+    end
+    shader:setAnimationDefines(config.animator)
+
+    local index = self.count
+    local variant = shader.shader
+    self._usedShaders[shader] = true
+
+    if index >= self._capacity then
+        self:_reserve(self._capacity * 2)
+    end
+
+    local entry = self._entries[index+1]
+    if not entry then
+        entry = {}
+        self._entries[index+1] = entry
+    end
+
+    entry.pass = pass
+    entry.config = config
+    entry.material = config.material
+    entry.shaderMaterial = shaderMaterial
+    entry.light = light
+    entry.variant = variant
+    entry.isInstanced = isInstanced
+    entry.lod = (pass == "shadowmapping" and config.shadowLod or config.lod) or 1
+
+    local world = config.worldMatrix
+    local dx, dy, dz = world.m41 - self._cameraX, world.m42 - self._cameraY, world.m43 - self._cameraZ
+    local depth = min(floor(sqrt(dx*dx + dy*dy + dz*dz) * self._depthScale), MAX_DEPTH)
+
+    self._keysHigh[index] = bor(
+        lshift(PASS_IDS[pass] or 15, 28),
+        lshift(self:_getId(variant, 1, 0x3FF), 18),
+        lshift(self:_getId(light, 2, 0xFF), 10),
+        self:_getId(config.material, 3, 0x3FF)
+    )
+    self._keysLow[index] = bor(
+        lshift(self:_getId(config.meshPart, 4, 0x3FF), DEPTH_BITS + 2),
+        lshift(min(entry.lod - 1, 3), DEPTH_BITS),
+        depth
+    )
+
+    self.count = index + 1
+end
+
+
+local counts = ffi.new("int32_t[256]")
+
+-- One LSD radix sort pass over 8 bits of the keys. Returns false if all keys had the same digit
+---@param keys ffi.cdata*
+---@param shift integer
+---@param src ffi.cdata*
+---@param dst ffi.cdata*
+---@param count integer
+---@return boolean
+local function radixPass(keys, shift, src, dst, count)
+    ffi.fill(counts, ffi.sizeof(counts))
+
+    for i=0, count-1 do
+        local digit = band(rshift(keys[src[i]], shift), 0xFF)
+        counts[digit] = counts[digit] + 1
+    end
+
+    if counts[band(rshift(keys[src[0]], shift), 0xFF)] == count then
+        return false
+    end
+
+    local offset = 0
+    for d=0, 255 do
+        local c = counts[d]
+        counts[d] = offset
+        offset = offset + c
+    end
+
+    for i=0, count-1 do
+        local index = src[i]
+        local digit = band(rshift(keys[index], shift), 0xFF)
+        dst[counts[digit]] = index
+        counts[digit] = counts[digit] + 1
+    end
+
+    return true
+end
+
+
+--- Sorts the entries by their keys
+function RenderQueue:sort()
+    local count = self.count
+    local order, swap = self._order, self._swap
+
+    for i=0, count-1 do
+        order[i] = i
+    end
+
+    if count < 2 then
+        return
+    end
+
+    -- Least significant half first
+    for k=1, 2 do
+        local keys = k == 1 and self._keysLow or self._keysHigh
+
+        for shift=0, 24, 8 do
+            if radixPass(keys, shift, order, swap, count) then
+                order, swap = swap, order
+            end
+        end
+    end
+
+    self._order, self._swap = order, swap
+end
+
+
+--- Sorts and draws all entries
+---@param renderer BaseRenderer
+---@param camera Camera3D
+---@param onShaderChange fun(shader: ShaderEffect)?: Called once for each shader variant, to send extra uniforms
+function RenderQueue:submit(renderer, camera, onShaderChange)
+    self:sort()
+
+    local stats = self.stats
+    local entries, order, count = self._entries, self._order, self.count
+    local prepared, batch = self._preparedShaders, self._batch
+    local currentVariant, currentLight, currentMaterial = nil, nil, nil
+
+    tableclear(prepared)
+
+    local i = 0
+    while i < count do
+        local entry = entries[order[i]+1]
+        local shaderMaterial = entry.shaderMaterial
+        local shader = shaderMaterial.shader
+        local light = entry.light
+        local config = entry.config
+
+        if entry.variant ~= currentVariant then
+            shaderMaterial:setRenderPass(entry.pass)
+            if light then
+                shaderMaterial:setLightDefines(light)
+            end
+            if entry.isInstanced then
+                shader:define("MESH_INSTANCING")
+            else
+                shader:undefine("MESH_INSTANCING")
+            end
+            shader:setAnimationDefines(config.animator)
+
+            shader:use()
+
+            if not prepared[entry.variant] then
+                shader:sendCommonUniforms()
+                shader:sendRendererUniforms(renderer)
+                shader:sendCameraUniforms(camera)
+
+                if onShaderChange then
+                    onShaderChange(shader)
+                end
+
+                prepared[entry.variant] = true
+            end
+
+            currentVariant = entry.variant
+            currentLight, currentMaterial = nil, nil
+            stats.shaderSwitches = stats.shaderSwitches + 1
+        end
+
+        if light and light ~= currentLight then
+            light:sendLightData(shader, "u_light")
+            currentLight = light
+            stats.lightSwitches = stats.lightSwitches + 1
+        end
+
+        if entry.material ~= currentMaterial then
+            entry.material:apply(shader)
+            currentMaterial = entry.material
+            stats.materialSwitches = stats.materialSwitches + 1
+        end
+
+        shader:sendMeshConfigUniforms(config)
+
+        if entry.isInstanced then
+            local meshPart = config.meshPart
+            local instances = 1
+            batch[1] = config.worldMatrix
+
+            -- Merge the following draws of the same mesh part, they are next to each other after sorting
+            if not config.animator then
+                while i + instances < count do
+                    local nextEntry = entries[order[i + instances]+1]
+                    local nextConfig = nextEntry.config
+
+                    if nextEntry.variant ~= currentVariant or nextEntry.material ~= currentMaterial or nextEntry.light ~= light
+                    or nextConfig.meshPart ~= meshPart or nextEntry.lod ~= entry.lod or nextConfig.animator then
+                        break
+                    end
+
+                    instances = instances + 1
+                    batch[instances] = nextConfig.worldMatrix
+                end
+            end
+
+            meshPart:drawInstanced(batch, instances, entry.lod)
+            stats.instances = stats.instances + instances
+            i = i + instances
+        else
+            config.meshPart:draw(entry.lod)
+            stats.instances = stats.instances + 1
+            i = i + 1
+        end
+
+        stats.draws = stats.draws + 1
+    end
+
+    -- Don't keep references to objects that could be removed
+    for e=1, count do
+        local entry = entries[e]
+        entry.config, entry.material, entry.shaderMaterial, entry.light, entry.variant = nil, nil, nil, nil, nil
+    end
+    tableclear(batch)
+
+    -- Other code may use the same shaders to draw meshes without instancing
+    for shader in pairs(self._usedShaders) do
+        shader:undefine("MESH_INSTANCING")
+        shader:setAnimationDefines(nil)
+    end
+    tableclear(self._usedShaders)
+
+    self.count = 0
+end
+
+
+function RenderQueue:resetStats()
+    local stats = self.stats
+    stats.draws, stats.instances, stats.shaderSwitches, stats.materialSwitches, stats.lightSwitches = 0, 0, 0, 0, 0
+end
+
+
+return RenderQueue
@@ -0,0 +1,17 @@
+local Grid      = require "engine.AI.pathfinding.pathfindingGrid"
+local FlowField = require "engine.AI.pathfinding.flowField"
+
+
+-- Builds a whole flow field. Job data: grid types, costs and walkable cells, then the field integration and directions.
+-- See `FlowField:buildAsync`
+---@type JobKernel
+return function(first, last, data, args)
+    local grid = Grid.FromData(args.width, args.height, args.minCost, data[1], data[2], data[3])
+    local field = FlowField(grid, args.diagonalMovement, data[4], data[5])
+
+    for _, cell in ipairs(args.goals) do
+        field:_addGoalCell(cell)
+    end
+
+    field:build()
+end
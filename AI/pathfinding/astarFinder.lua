@@ -1,72 +1,489 @@
-local bit           = require "bit"
+local Vector2       = require "engine.math.vector2"
 local PriorityQueue = require "engine.collections.priorityQueue"
-local Lume          = require "engine.3rdparty.lume"
 local Object        = require "engine.3rdparty.classic.classic"
-local Finder        = Object:extend("Finder")
+local ffi           = require "ffi"
+local tableclear    = require "table.clear"
+local abs, min, max, floor, sqrt = math.abs, math.min, math.max, math.floor, math.sqrt
 
-local function hash(vec)
-    return bit.bxor(vec.x * 397, vec.y)
+local SQRT2 = sqrt(2)
+
+---@alias DiagonalMovement
+---|"never"               # Only orthogonal moves
+---|"always"              # Diagonal moves can pass between two walls
+---|"ifAtMostOneObstacle" # Diagonal moves can cut the corner of a single wall
+---|"onlyWhenNoObstacles" # Diagonal moves can't cut corners
+
+local DIAGONAL_MODES = {never = 0, always = 1, ifAtMostOneObstacle = 2, onlyWhenNoObstacles = 3}
+
+-- The 4 orthogonal directions come first
+local DIR_X = {1, 0, -1,  0, 1, -1, -1,  1}
+local DIR_Y = {0, 1,  0, -1, 1,  1, -1, -1}
+
+
+-- Grid used by the current search, stored as upvalues so the jump functions stay cheap
+local gridWidth, gridHeight, gridWalkable = 0, 0, nil
+
+local function isWalkable(x, y)
+    return x >= 0 and y >= 0 and x < gridWidth and y < gridHeight and gridWalkable[x + y * gridWidth] == 1
+end
+
+local function sign(v)
+    return v > 0 and 1 or (v < 0 and -1 or 0)
 end
 
-local function manhattan(a, b)
-    return math.abs(a.x - b.x) + math.abs(a.y - b.y)
+
+--- Jumps horizontally or vertically, returns the index of the next jump point or -1
+---@param x integer
+---@param y integer
+---@param dx integer
+---@param dy integer
+---@param goalX integer
+---@param goalY integer
+---@return integer
+local function jumpStraight(x, y, dx, dy, goalX, goalY)
+    while true do
+        x, y = x + dx, y + dy
+
+        if not isWalkable(x, y) then
+            return -1
+        end
+
+        if x == goalX and y == goalY then
+            return x + y * gridWidth
+        end
+
+        -- Forced neighbors: a side cell that was blocked behind us is open now
+        if dx ~= 0 then
+            if (isWalkable(x, y-1) and not isWalkable(x-dx, y-1)) or (isWalkable(x, y+1) and not isWalkable(x-dx, y+1)) then
+                return x + y * gridWidth
+            end
+        else
+            if (isWalkable(x-1, y) and not isWalkable(x-1, y-dy)) or (isWalkable(x+1, y) and not isWalkable(x+1, y-dy)) then
+                return x + y * gridWidth
+            end
+        end
+    end
 end
 
-local function euclidean(a, b)
-    return math.sqrt((a.x - b.x)^2 + (a.y - b.y)^2)
+
+--- Jumps diagonally, returns the index of the next jump point or -1
+---@param x integer
+---@param y integer
+---@param dx integer
+---@param dy integer
+---@param goalX integer
+---@param goalY integer
+---@return integer
+local function jumpDiagonal(x, y, dx, dy, goalX, goalY)
+    while true do
+        x, y = x + dx, y + dy
+
+        if not isWalkable(x, y) then
+            return -1
+        end
+
+        if x == goalX and y == goalY then
+            return x + y * gridWidth
+        end
+
+        if jumpStraight(x, y, dx, 0, goalX, goalY) >= 0 or jumpStraight(x, y, 0, dy, goalX, goalY) >= 0 then
+            return x + y * gridWidth
+        end
+
+        -- No corner cutting
+        if not (isWalkable(x+dx, y) and isWalkable(x, y+dy)) then
+            return -1
+        end
+    end
 end
 
-function Finder:new()
+
+local neighborsX, neighborsY = {}, {}
+
+---@param count integer
+---@param x integer
+---@param y integer
+---@return integer
+local function addNeighbor(count, x, y)
+    count = count + 1
+    neighborsX[count], neighborsY[count] = x, y
+    return count
 end
 
-function Finder:findPath(grid, from, to)
-    local frontier = PriorityQueue()
-    local fromHash = hash(from)
-    local toHash = hash(to)
+
+--- Stores the neighbors of a cell that must be explored by jump point search in `neighborsX` and `neighborsY`
+---@param x integer
+---@param y integer
+---@param parentIndex integer: -1 for the start cell
+---@return integer
+local function findJumpNeighbors(x, y, parentIndex)
+    local count = 0
+
+    if parentIndex < 0 then
+        for d=1, 8 do
+            local dx, dy = DIR_X[d], DIR_Y[d]
+
+            if isWalkable(x+dx, y+dy) and (d <= 4 or (isWalkable(x+dx, y) and isWalkable(x, y+dy))) then
+                count = addNeighbor(count, x+dx, y+dy)
+            end
+        end
+
+        return count
+    end
+
+    local px, py = parentIndex % gridWidth, floor(parentIndex / gridWidth)
+    local dx, dy = sign(x - px), sign(y - py)
+
+    if dx ~= 0 and dy ~= 0 then
+        local isVerticalWalkable = isWalkable(x, y+dy)
+        local isHorizontalWalkable = isWalkable(x+dx, y)
+
+        if isVerticalWalkable then
+            count = addNeighbor(count, x, y+dy)
+        end
+        if isHorizontalWalkable then
+            count = addNeighbor(count, x+dx, y)
+        end
+        if isVerticalWalkable and isHorizontalWalkable and isWalkable(x+dx, y+dy) then
+            count = addNeighbor(count, x+dx, y+dy)
+        end
+    elseif dx ~= 0 then
+        local isNextWalkable = isWalkable(x+dx, y)
+        local isTopWalkable = isWalkable(x, y+1)
+        local isBottomWalkable = isWalkable(x, y-1)
+
+        if isNextWalkable then
+            count = addNeighbor(count, x+dx, y)
+
+            if isTopWalkable and isWalkable(x+dx, y+1) then
+                count = addNeighbor(count, x+dx, y+1)
+            end
+            if isBottomWalkable and isWalkable(x+dx, y-1) then
+                count = addNeighbor(count, x+dx, y-1)
+            end
+        end
+        if isTopWalkable then
+            count = addNeighbor(count, x, y+1)
+        end
+        if isBottomWalkable then
+            count = addNeighbor(count, x, y-1)
+        end
+    else
+        local isNextWalkable = isWalkable(x, y+dy)
+        local isRightWalkable = isWalkable(x+1, y)
+        local isLeftWalkable = isWalkable(x-1, y)
+
+        if isNextWalkable then
+            count = addNeighbor(count, x, y+dy)
+
+            if isRightWalkable and isWalkable(x+1, y+dy) then
+                count = addNeighbor(count, x+1, y+dy)
+            end
+            if isLeftWalkable and isWalkable(x-1, y+dy) then
+                count = addNeighbor(count, x-1, y+dy)
+            end
+        end
+        if isRightWalkable then
+            count = addNeighbor(count, x+1, y)
+        end
+        if isLeftWalkable then
+            count = addNeighbor(count, x-1, y)
+        end
+    end
+
+    return count
+end
+
+
+
+---
+--- A* pathfinder over a `Grid`.
+---
+--- Cells are identified by their integer index, and all per cell search data lives in FFI arrays
+--- that are reused between searches, so a search doesn't allocate anything after the first one
+--- (except for the vectors returned by `findPath`).
+---
+--- With `useJumpPoints` enabled, jump point search is used instead, which skips most of the cells
+--- of open areas. It requires a grid where all walkable cells have the same cost and the
+--- `"onlyWhenNoObstacles"` diagonal movement.
+---
+--- @class Finder: Object
+---
+--- @field public diagonalMovement DiagonalMovement
+--- @field public useJumpPoints boolean
+--- @field public trackSearched boolean: Stores the opened cells in `searched`, for debugging
+--- @field public searched Vector2[]
+--- @field public expandedNodes integer: Cells expanded by the last search
+--- @field private _capacity integer
+--- @field private _searchId integer
+--- @field private _g ffi.cdata*
+--- @field private _parent ffi.cdata*
+--- @field private _opened ffi.cdata*
+--- @field private _closed ffi.cdata*
+--- @field private _open PriorityQueue
+--- @field private _pathIndices integer[]
+--- @field private _uniformGrid Grid?: Last grid checked to have uniform costs for jump point search
+--- @field private _uniformGridVersion integer
+---
+--- @overload fun(diagonalMovement: DiagonalMovement?, useJumpPoints: boolean?): Finder
+local Finder = Object:extend("Finder")
+
+Finder.DIAGONAL_MODES = DIAGONAL_MODES
+
+
+function Finder:new(diagonalMovement, useJumpPoints)
+    self.diagonalMovement = diagonalMovement or "never"
+    self.useJumpPoints = useJumpPoints or false
+    self.trackSearched = false
     self.searched = {}
+    self.expandedNodes = 0
 
-    local came_from = {[fromHash] = from}
-    local total_cost = {[fromHash] = 0}
+    self._capacity = 0
+    self._searchId = 0
+    self._pathIndices = {}
+    self._uniformGrid = nil
+    self._uniformGridVersion = -1
+end
+
+
+---@private
+---@param count integer
+function Finder:_reserve(count)
+    if count <= self._capacity then
+        return
+    end
+
+    self._g = ffi.new("double[?]", count)
+    self._parent = ffi.new("int32_t[?]", count)
+    self._opened = ffi.new("uint32_t[?]", count)
+    self._closed = ffi.new("uint32_t[?]", count)
+    self._capacity = count
+    self._searchId = 0
+    self._open = PriorityQueue(count)
+end
+
+
+---@private
+---@return integer
+function Finder:_nextSearchId()
+    if self._searchId == 0xFFFFFFFF then
+        ffi.fill(self._opened, self._capacity * ffi.sizeof("uint32_t"))
+        ffi.fill(self._closed, self._capacity * ffi.sizeof("uint32_t"))
+        self._searchId = 0
+    end
+
+    self._searchId = self._searchId + 1
+    return self._searchId
+end
+
+
+--- Finds a path between two cells using cell indices (see `Grid:getIndex`)
+---@param grid Grid
+---@param start integer
+---@param goal integer
+---@param out integer[]: Receives the cell indices of the path, from `start` to `goal`
+---@param maxExpanded integer?: Gives up after expanding this many cells
+---@return integer?: Number of cells in the path, `nil` if there's no path (or it wasn't found within `maxExpanded`)
+function Finder:findPathIndices(grid, start, goal, out, maxExpanded)
+    local mode = assert(DIAGONAL_MODES[self.diagonalMovement], "Invalid diagonal movement")
+    local useJumpPoints = self.useJumpPoints
+    assert(not useJumpPoints or mode == DIAGONAL_MODES.onlyWhenNoObstacles, "Jump point search requires \"onlyWhenNoObstacles\" diagonal movement")
+
+    -- Checking the costs is O(cells), so it's only done again when the grid changes
+    if useJumpPoints and (self._uniformGrid ~= grid or self._uniformGridVersion ~= grid.version) then
+        assert(grid:hasUniformCost(), "Jump point search requires all walkable cells to have the same cost")
+        self._uniformGrid, self._uniformGridVersion = grid, grid.version
+    end
+
+    self:_reserve(grid.cellCount)
+
+    local searchId = self:_nextSearchId()
+    local width, height = grid.width, grid.height
+    local walkable, costs = grid.walkable, grid.costs
+    local g, parent, opened, closed = self._g, self._parent, self._opened, self._closed
+    local open = self._open
+    local directionCount = mode == DIAGONAL_MODES.never and 4 or 8
+    local tracking = self.trackSearched
+    local expanded = 0
 
-    frontier:push(0, from)
+    gridWidth, gridHeight, gridWalkable = width, height, walkable
+    self.expandedNodes = 0
+
+    if tracking then
+        tableclear(self.searched)
+    end
+
+    if walkable[goal] == 0 then
+        return nil
+    end
+
+    -- Slightly overestimating breaks ties between cells with the same cost in favor of the ones
+    -- closer to the goal, which avoids exploring whole open areas. The path cost is at most
+    -- `1 + 1 / (width + height)` times the optimal one.
+    local goalX, goalY = goal % width, floor(goal / width)
+    local unit = grid.minCost * (1 + 1 / (width + height))
+
+    local function heuristic(index)
+        local dx, dy = abs(index % width - goalX), abs(floor(index / width) - goalY)
+
+        if directionCount == 4 then
+            return (dx + dy) * unit
+        end
+        return (max(dx, dy) + (SQRT2 - 1) * min(dx, dy)) * unit
+    end
+
+    -- Priorities are negated, since the queue pops the highest one first
+    g[start], parent[start], opened[start] = 0, -1, searchId
+    open:clear()
+    open:push(-heuristic(start), start)
+    local found = false
+
+    while open:getLength() > 0 do
+        local _, node = open:pop()
+
+        closed[node] = searchId
+
+        if node == goal then
+            found = true
+            break
+        end
 
-    while frontier:getLength() > 0 do
-        local _, currPos = frontier:pop() --- @cast currPos Vector2
-        local currHash = hash(currPos)
+        expanded = expanded + 1
 
-        if currPos == to then
+        if maxExpanded and expanded > maxExpanded then
             break
         end
 
-        for i, nextPos in ipairs(grid:getNeighbors(currPos)) do --- @cast nextPos Vector2
-            local nextType, nextCost = grid:getCell(nextPos)
-            local newCost = total_cost[currHash] + nextCost
-            local nextHash = hash(nextPos)
+        local x, y = node % width, floor(node / width)
+        local nodeG = g[node]
 
-            if not total_cost[nextHash] or newCost < total_cost[nextHash] then
-                total_cost[nextHash] = newCost
-                came_from[nextHash] = currPos
+        if useJumpPoints then
+            for n=1, findJumpNeighbors(x, y, parent[node]) do
+                local dx, dy = neighborsX[n] - x, neighborsY[n] - y
+                local jumpPoint
 
-                frontier:push(-newCost - manhattan(to, nextPos), nextPos)
+                if dx ~= 0 and dy ~= 0 then
+                    jumpPoint = jumpDiagonal(x, y, dx, dy, goalX, goalY)
+                else
+                    jumpPoint = jumpStraight(x, y, dx, dy, goalX, goalY)
+                end
 
-                Lume.push(self.searched, nextPos)
+                if jumpPoint >= 0 and closed[jumpPoint] ~= searchId then
+                    local adx, ady = abs(jumpPoint % width - x), abs(floor(jumpPoint / width) - y)
+                    local newG = nodeG + (max(adx, ady) + (SQRT2 - 1) * min(adx, ady)) * costs[jumpPoint]
+
+                    if opened[jumpPoint] ~= searchId or newG < g[jumpPoint] then
+                        g[jumpPoint], parent[jumpPoint], opened[jumpPoint] = newG, node, searchId
+                        open:push(-(newG + heuristic(jumpPoint)), jumpPoint)
+
+                        if tracking then
+                            table.insert(self.searched, Vector2(grid:getCoord(jumpPoint)))
+                        end
+                    end
+                end
+            end
+        else
+            for d=1, directionCount do
+                local dx, dy = DIR_X[d], DIR_Y[d]
+                local nx, ny = x + dx, y + dy
+                local next = nx + ny * width
+
+                if nx >= 0 and ny >= 0 and nx < width and ny < height and walkable[next] == 1 and closed[next] ~= searchId then
+                    local stepCost = costs[next]
+                    local canMove = true
+
+                    if d > 4 then
+                        -- Both cells are inside the grid, since the diagonal one is
+                        local openSides = walkable[nx + y * width] + walkable[x + ny * width]
+
+                        canMove = mode == DIAGONAL_MODES.always
+                            or (mode == DIAGONAL_MODES.ifAtMostOneObstacle and openSides >= 1)
+                            or openSides == 2
+                        stepCost = stepCost * SQRT2
+                    end
+
+                    local newG = nodeG + stepCost
+
+                    if canMove and (opened[next] ~= searchId or newG < g[next]) then
+                        g[next], parent[next], opened[next] = newG, node, searchId
+                        open:push(-(newG + heuristic(next)), next)
+
+                        if tracking then
+                            table.insert(self.searched, Vector2(nx, ny))
+                        end
+                    end
+                end
             end
         end
     end
 
-    if not came_from[toHash] then
+    self.expandedNodes = expanded
+
+    if not found then
         return nil
     end
 
-    local path = {came_from[toHash], to}
+    -- Walk back from the goal, filling the straight lines between jump points
+    local length = 0
+    local node = goal
+
+    while node >= 0 do
+        local previous = parent[node]
+
+        length = length + 1
+        out[length] = node
+
+        if useJumpPoints and previous >= 0 then
+            local x, y = node % width, floor(node / width)
+            local px, py = previous % width, floor(previous / width)
+            local sx, sy = sign(px - x), sign(py - y)
 
-    repeat
-        local cell = came_from[hash(path[1])]
+            x, y = x + sx, y + sy
+            while x ~= px or y ~= py do
+                length = length + 1
+                out[length] = x + y * width
+                x, y = x + sx, y + sy
+            end
+        end
+
+        node = previous
+    end
 
-        table.insert(path, 1, cell)
-    until cell == from
+    for i=#out, length+1, -1 do
+        out[i] = nil
+    end
+
+    for i=1, floor(length / 2) do
+        out[i], out[length-i+1] = out[length-i+1], out[i]
+    end
+
+    return length
+end
+
+
+--- Finds a path between two cells
+---@param grid Grid
+---@param from Vector2
+---@param to Vector2
+---@return Vector2[]?: The cells of the path, including `from` and `to`. `nil` if there's no path
+function Finder:findPath(grid, from, to)
+    if not grid:isInside(from.x, from.y) or not grid:isInside(to.x, to.y) then
+        return nil
+    end
+
+    local indices = self._pathIndices
+    local length = self:findPathIndices(grid, grid:getIndex(from.x, from.y), grid:getIndex(to.x, to.y), indices)
+
+    if not length then
+        return nil
+    end
+
+    local path = {}
+    for i=1, length do
+        path[i] = Vector2(grid:getCoord(indices[i]))
+    end
 
     return path
 end
 
-return Finder
\ No newline at end of file
+return Finder
@@ -0,0 +1,515 @@
+local Finder      = require "engine.AI.pathfinding.astarFinder"
+local BucketQueue = require "engine.collections.bucketQueue"
+local Job         = require "engine.misc.job"
+local Object      = require "engine.3rdparty.classic.classic"
+local ffi         = require "ffi"
+local tableclear  = require "table.clear"
+local floor, max, sqrt, huge = math.floor, math.max, math.sqrt, math.huge
+
+require "love.data"
+
+local SQRT2 = sqrt(2)
+local DIAGONAL_MODES = Finder.DIAGONAL_MODES
+
+-- Direction 0 means "no direction" (goals and unreachable cells)
+local DIR_X = {[0] = 0, 1, 0, -1,  0, 1, -1, -1,  1}
+local DIR_Y = {[0] = 0, 0, 1,  0, -1, 1,  1, -1, -1}
+local OPPOSITE = {3, 4, 1, 2, 7, 8, 5, 6}
+
+local sharedFields = setmetatable({}, {__mode = "k"}) ---@type table<Grid, table<string, FlowField>>
+
+
+---@alias FlowFieldStats {processedCells: integer, resetCells: integer}
+
+
+---
+--- Flow field over a `Grid`, for any number of agents going to the same goals.
+---
+--- The integration field (cost to reach the nearest goal from each cell) is computed with Dijkstra's
+--- algorithm, using a bucket queue: buckets are as wide as the cheapest step, so cells in the same
+--- bucket can't improve each other and the result is exact. If a cell change lowers `grid.minCost`,
+--- the queue is recreated with narrower buckets by the next `update` or `invalidateCell`. Every cell also stores the direction
+--- to its next cell on the way to the goal, which agents can sample in constant time.
+---
+--- The field can be built in slices over multiple frames (`update`), and is repaired incrementally
+--- when cells change (`invalidateCell`): only the cells whose route went through the changed cell
+--- are computed again. Whole fields can also be built in the job threads (`buildAsync`), so multiple
+--- fields are built in parallel.
+---
+--- @class FlowField: Object
+---
+--- @field public grid Grid
+--- @field public diagonalMovement DiagonalMovement
+--- @field public integration ffi.cdata*: Cost to reach a goal from each cell, `math.huge` if unreachable
+--- @field public directions ffi.cdata*: Direction index of each cell, see `getDirection`
+--- @field public integrationData love.Data: Memory of `integration`, shared with the job threads
+--- @field public directionsData love.Data: Memory of `directions`
+--- @field public stats FlowFieldStats
+--- @field private _goals integer[]
+--- @field private _isGoal table<integer, boolean>
+--- @field private _queue BucketQueue
+--- @field private _resetCells integer[]
+--- @field private _isReset table<integer, boolean>
+--- @field private _refs integer: Users of a shared field
+--- @field private _sharedKey string?
+--- @field private _job Job?: Build running in the job threads
+---
+--- @overload fun(grid: Grid, diagonalMovement: DiagonalMovement?, integrationData: love.Data?, directionsData: love.Data?): FlowField
+local FlowField = Object:extend("FlowField")
+
+
+function FlowField:new(grid, diagonalMovement, integrationData, directionsData)
+    local count = grid.cellCount
+
+    self.grid = grid
+    self.diagonalMovement = diagonalMovement or "onlyWhenNoObstacles"
+    self.integrationData = integrationData or love.data.newByteData(math.max(count, 1) * 4)
+    self.directionsData = directionsData or love.data.newByteData(math.max(count, 1))
+    self.integration = ffi.cast("float*", self.integrationData:getFFIPointer())
+    self.directions = ffi.cast("uint8_t*", self.directionsData:getFFIPointer())
+
+    self.stats = {
+        processedCells = 0, -- Cells taken from the queue since the last reset
+        resetCells = 0,     -- Cells invalidated by the last `invalidateCell`
+    }
+
+    self._goals = {}
+    self._isGoal = {}
+    self._resetCells = {}
+    self._isReset = {}
+    self._refs = 0
+
+    self:_initQueue()
+    self:_resetField()
+end
+
+
+---@private
+function FlowField:_initQueue()
+    local grid = self.grid
+    local maxCost = 0
+
+    for i=0, grid.cellCount-1 do
+        if grid.walkable[i] == 1 then
+            maxCost = max(maxCost, grid.costs[i])
+        end
+    end
+
+    assert(grid.minCost > 0, "Flow fields need positive cell costs")
+
+    -- Enough buckets to hold everything a single step can push
+    self._queue = BucketQueue(grid.cellCount, grid.minCost, maxCost * SQRT2)
+end
+
+
+--- Recreates the queue if `grid.minCost` dropped below its bucket width, which would make the order inexact
+---@private
+function FlowField:_checkQueue()
+    local old = self._queue
+
+    if self.grid.minCost >= old.bucketWidth then
+        return
+    end
+
+    self:_initQueue()
+
+    while old:getLength() > 0 do
+        self:_push(old:pop())
+    end
+end
+
+
+---@private
+function FlowField:_resetField()
+    local count = self.grid.cellCount
+
+    for i=0, count-1 do
+        self.integration[i] = huge
+    end
+
+    ffi.fill(self.directions, count)
+    self._queue:clear()
+    self.stats.processedCells = 0
+end
+
+
+---@private
+---@param cell integer
+function FlowField:_push(cell)
+    self._queue:push(cell, self.integration[cell])
+end
+
+
+-----------
+-- Field --
+-----------
+
+--- Cost of moving from `cell` to its neighbor in `direction`, `nil` if the move isn't allowed
+---@private
+---@param cell integer
+---@param direction integer
+---@param mode integer
+---@return number?
+function FlowField:_getStepCost(cell, direction, mode)
+    local grid = self.grid
+    local width = grid.width
+    local x, y = cell % width, floor(cell / width)
+    local nx, ny = x + DIR_X[direction], y + DIR_Y[direction]
+
+    if nx < 0 or ny < 0 or nx >= width or ny >= grid.height then
+        return nil
+    end
+
+    local next = nx + ny * width
+    if grid.walkable[next] == 0 then
+        return nil
+    end
+
+    if direction > 4 then
+        local openSides = grid.walkable[nx + y * width] + grid.walkable[x + ny * width]
+
+        if mode == DIAGONAL_MODES.never
+        or (mode == DIAGONAL_MODES.ifAtMostOneObstacle and openSides < 1)
+        or (mode == DIAGONAL_MODES.onlyWhenNoObstacles and openSides < 2) then
+            return nil
+        end
+
+        return grid.costs[next] * SQRT2
+    end
+
+    return grid.costs[next]
+end
+
+
+--- Sets a single goal cell and restarts the field. Call `update` or `build` afterwards
+---@param x integer
+---@param y integer
+---@return self
+function FlowField:setGoal(x, y)
+    self:clearGoals()
+    return self:addGoal(x, y)
+end
+
+
+--- Adds a goal cell, agents go to the nearest one
+---@param x integer
+---@param y integer
+---@return self
+function FlowField:addGoal(x, y)
+    return self:_addGoalCell(self.grid:getIndex(x, y))
+end
+
+
+---@package
+---@param cell integer
+---@return self
+function FlowField:_addGoalCell(cell)
+    if not self._isGoal[cell] then
+        table.insert(self._goals, cell)
+        self._isGoal[cell] = true
+
+        if self.grid.walkable[cell] == 1 then
+            self.integration[cell] = 0
+            self.directions[cell] = 0
+            self:_push(cell)
+        end
+    end
+
+    return self
+end
+
+
+---@return self
+function FlowField:clearGoals()
+    tableclear(self._goals)
+    tableclear(self._isGoal)
+    self:_resetField()
+
+    return self
+end
+
+
+--- Processes up to `maxCells` cells of the queue, so the field can be built over multiple frames.
+--- Cells that weren't reached yet have no direction.
+---@param maxCells integer?: Unlimited by default
+---@return boolean: Whether the field is complete
+function FlowField:update(maxCells)
+    local grid = self.grid
+    local width, height = grid.width, grid.height
+    local walkable, costs = grid.walkable, grid.costs
+    local integration, directions = self.integration, self.directions
+    local mode = DIAGONAL_MODES[self.diagonalMovement]
+    local directionCount = mode == DIAGONAL_MODES.never and 4 or 8
+    local processed = 0
+
+    self:_checkQueue()
+    local queue = self._queue
+
+    maxCells = maxCells or huge
+
+    while processed < maxCells and queue:getLength() > 0 do
+        local cell = queue:pop()
+
+        processed = processed + 1
+
+        local x, y = cell % width, floor(cell / width)
+        local cellValue = integration[cell]
+        local cellCost = costs[cell]
+
+        -- Agents move from the neighbors to this cell, so every step costs the same as entering it
+        for d=1, directionCount do
+            local nx, ny = x + DIR_X[d], y + DIR_Y[d]
+            local neighbor = nx + ny * width
+
+            if nx >= 0 and ny >= 0 and nx < width and ny < height and walkable[neighbor] == 1 then
+                local stepCost = cellCost
+                local canMove = true
+
+                if d > 4 then
+                    local openSides = walkable[nx + y * width] + walkable[x + ny * width]
+
+                    canMove = mode == DIAGONAL_MODES.always
+                        or (mode == DIAGONAL_MODES.ifAtMostOneObstacle and openSides >= 1)
+                        or openSides == 2
+                    stepCost = stepCost * SQRT2
+                end
+
+                if canMove and cellValue + stepCost < integration[neighbor] then
+                    integration[neighbor] = cellValue + stepCost
+                    directions[neighbor] = OPPOSITE[d]
+                    self:_push(neighbor)
+                end
+            end
+        end
+    end
+
+    self.stats.processedCells = self.stats.processedCells + processed
+    return self._queue:getLength() == 0
+end
+
+
+--- Computes the whole field
+---@return self
+function FlowField:build()
+    self:update()
+    return self
+end
+
+
+---@return boolean
+function FlowField:isComplete()
+    if self._job and not self._job:isDone() then
+        return false
+    end
+
+    return self._queue:getLength() == 0
+end
+
+
+--- Builds the whole field in the job threads. The field must not be used until the returned job is done
+--- (see `Job:wait`, or check `isComplete`). Processed cells are not counted in `stats`.
+---@return Job
+function FlowField:buildAsync()
+    local grid = self.grid
+
+    -- The worker starts again from the goals
+    self:_resetField()
+
+    self._job = Job("engine.AI.pathfinding._flowFieldJob", 1, {
+        grid.typesData, grid.costsData, grid.walkableData, self.integrationData, self.directionsData
+    }, {
+        width = grid.width,
+        height = grid.height,
+        minCost = grid.minCost,
+        diagonalMovement = self.diagonalMovement,
+        goals = self._goals,
+    }):schedule()
+
+    local job = self._job
+    job.onCompleteEvent:addCallback(function()
+        self._job = nil
+    end)
+
+    return job
+end
+
+
+--- Repairs the field after a cell changed its type or cost. The repair is done by the next `update`
+---@param x integer
+---@param y integer
+function FlowField:invalidateCell(x, y)
+    local grid = self.grid
+    local width = grid.width
+    local cell = grid:getIndex(x, y)
+    local integration, directions = self.integration, self.directions
+    local mode = DIAGONAL_MODES[self.diagonalMovement]
+    local directionCount = mode == DIAGONAL_MODES.never and 4 or 8
+    local reset, isReset = self._resetCells, self._isReset
+
+    self:_checkQueue()
+
+    -- The cost of entering this cell changed, so everything that flows through it is outdated.
+    -- It may also block (or unblock) diagonal moves that pass by its corners
+    local first = #reset + 1
+    local x, y = cell % width, floor(cell / width)
+    table.insert(reset, cell)
+    isReset[cell] = true
+
+    for d=5, 8 do
+        local nx, ny = x + DIR_X[d], y + DIR_Y[d]
+
+        for side=1, 2 do
+            local sx, sy = side == 1 and nx or x, side == 1 and y or ny
+
+            if grid:isInside(sx, sy) then
+                local neighbor = sx + sy * width
+                local direction = directions[neighbor]
+
+                -- The diagonal from (sx, sy) to (nx, ny) or (x, y) passes by this cell
+                if direction > 4 and not isReset[neighbor]
+                and (sx + DIR_X[direction] == (side == 1 and x or nx)) and (sy + DIR_Y[direction] == (side == 1 and ny or y)) then
+                    table.insert(reset, neighbor)
+                    isReset[neighbor] = true
+                end
+            end
+        end
+    end
+
+    local i = first
+    while i <= #reset do
+        local current = reset[i]
+
+        for d=1, 8 do
+            local nx, ny = current % width + DIR_X[d], floor(current / width) + DIR_Y[d]
+
+            if nx >= 0 and ny >= 0 and nx < width and ny < grid.height then
+                local neighbor = nx + ny * width
+
+                if not isReset[neighbor] and directions[neighbor] == OPPOSITE[d] then
+                    table.insert(reset, neighbor)
+                    isReset[neighbor] = true
+                end
+            end
+        end
+
+        i = i + 1
+    end
+
+    for r=first, #reset do
+        local current = reset[r]
+        integration[current] = huge
+        directions[current] = 0
+
+        self._queue:remove(current)
+    end
+
+    -- Seed the reset cells from their valid neighbors
+    for r=first, #reset do
+        local current = reset[r]
+
+        if grid.walkable[current] == 1 then
+            if self._isGoal[current] then
+                integration[current] = 0
+                self:_push(current)
+            else
+                for d=1, directionCount do
+                    local stepCost = self:_getStepCost(current, d, mode)
+
+                    if stepCost then
+                        local neighbor = current + DIR_X[d] + DIR_Y[d] * width
+
+                        if not isReset[neighbor] and integration[neighbor] + stepCost < integration[current] then
+                            integration[current] = integration[neighbor] + stepCost
+                            directions[current] = d
+                        end
+                    end
+                end
+
+                if integration[current] < huge then
+                    self:_push(current)
+                end
+            end
+        end
+    end
+
+    -- The changed cell may have become cheaper or opened new diagonals, which can improve its surroundings
+    for d=0, 8 do
+        local nx, ny = x + DIR_X[d], y + DIR_Y[d]
+
+        if grid:isInside(nx, ny) then
+            local neighbor = nx + ny * width
+
+            if integration[neighbor] < huge and not self._queue:contains(neighbor) then
+                self:_push(neighbor)
+            end
+        end
+    end
+
+    self.stats.resetCells = #reset - first + 1
+
+    for r=first, #reset do
+        isReset[reset[r]] = nil
+        reset[r] = nil
+    end
+end
+
+
+--- Gets the direction an agent on a cell should move to. Returns 0, 0 on goals and unreachable cells
+---@param x integer
+---@param y integer
+---@return integer dx, integer dy
+function FlowField:getDirection(x, y)
+    local direction = self.directions[x + y * self.grid.width]
+    return DIR_X[direction], DIR_Y[direction]
+end
+
+
+--- Gets the cost to reach the nearest goal from a cell
+---@param x integer
+---@param y integer
+---@return number
+function FlowField:getDistance(x, y)
+    return self.integration[x + y * self.grid.width]
+end
+
+
+--- Gets a field shared by all users of the same grid and goal, built on the first use.
+--- `FlowField.Release` must be called by each user when done.
+---@param grid Grid
+---@param x integer
+---@param y integer
+---@param diagonalMovement DiagonalMovement?
+---@return FlowField
+function FlowField.Acquire(grid, x, y, diagonalMovement)
+    local fields = sharedFields[grid]
+    if not fields then
+        fields = {}
+        sharedFields[grid] = fields
+    end
+
+    local key = x..","..y..","..(diagonalMovement or "")
+    local field = fields[key]
+
+    if not field then
+        field = FlowField(grid, diagonalMovement):setGoal(x, y):build()
+        field._sharedKey = key
+        fields[key] = field
+    end
+
+    field._refs = field._refs + 1
+    return field
+end
+
+
+---@param field FlowField
+function FlowField.Release(field)
+    field._refs = field._refs - 1
+
+    if field._refs <= 0 and field._sharedKey then
+        sharedFields[field.grid][field._sharedKey] = nil
+        field._sharedKey = nil
+    end
+end
+
+
+return FlowField
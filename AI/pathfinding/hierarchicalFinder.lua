@@ -0,0 +1,865 @@
+local Finder        = require "engine.AI.pathfinding.astarFinder"
+local PriorityQueue = require "engine.collections.priorityQueue"
+local Vector2       = require "engine.math.vector2"
+local Object        = require "engine.3rdparty.classic.classic"
+local ffi           = require "ffi"
+local tableclear    = require "table.clear"
+local abs, min, max, floor, sqrt, huge = math.abs, math.min, math.max, math.floor, math.sqrt, math.huge
+
+local SQRT2 = sqrt(2)
+local DIAGONAL_MODES = Finder.DIAGONAL_MODES
+
+-- Border openings at least this wide get an entrance at each end instead of a single one in the middle
+local MAX_ENTRANCE_WIDTH = 6
+
+local DIR_X = {1, 0, -1,  0, 1, -1, -1,  1}
+local DIR_Y = {0, 1,  0, -1, 1,  1, -1, -1}
+
+
+---@alias HierarchicalFinderStats {abstractNodes: integer, expandedNodes: integer, cacheHits: integer, cacheMisses: integer, directQueries: integer, rebuiltClusters: integer}
+
+
+---
+--- Hierarchical pathfinder (HPA*) over a `Grid`.
+---
+--- The grid is split into square clusters. Every opening in the border between two clusters gets
+--- one or two entrances, each one made of a pair of abstract nodes (one cell on each side). Paths
+--- between the nodes of the same cluster are precomputed, so a query only needs to search the small
+--- abstract graph, and then refine the segments between consecutive nodes inside a single cluster.
+---
+--- Paths through the abstract graph are not optimal: they must go through the entrances, which can make
+--- a short path several times longer. So `findPathIndices` first runs a direct A* (see `Finder`), limited
+--- to `directSearchLimit` expanded cells, when the start and goal are in the same or neighboring clusters.
+--- Longer paths cost a few percent more than the optimal ones on average, but can be up to about twice as
+--- long when the entrances force a detour.
+---
+--- `findAbstractPath` and `refineSegment` can be used to only refine the part of a path that is needed,
+--- e.g. the next few segments an agent will walk.
+---
+--- The abstract path between two clusters is cached, so other queries between the same clusters
+--- only need to connect their start and goal cells to it.
+---
+--- After changing cells of the grid, `invalidateCell` must be called. Only the clusters touching
+--- the changed cells are rebuilt, on the next query.
+---
+--- @class HierarchicalFinder: Object
+---
+--- @field public grid Grid
+--- @field public clusterSize integer
+--- @field public clustersX integer
+--- @field public clustersY integer
+--- @field public clusterCount integer
+--- @field public diagonalMovement DiagonalMovement
+--- @field public cacheSize integer: Maximum number of cached cluster to cluster paths
+--- @field public directSearchLimit integer: Cells the direct search of short queries can expand before using the abstract graph
+--- @field public stats HierarchicalFinderStats
+--- @field private _nodeCell integer[]
+--- @field private _nodeCluster integer[]
+--- @field private _nodeRefs integer[]
+--- @field private _intraTo integer[][]
+--- @field private _intraCost number[][]
+--- @field private _interTo integer[][]
+--- @field private _interCost number[][]
+--- @field private _freeNodes integer[]
+--- @field private _nodeCount integer
+--- @field private _cellNode table<integer, integer>
+--- @field private _clusterNodes table<integer, boolean>[]
+--- @field private _verticalEntrances integer[][]: Node pairs on the border to the right of each cluster
+--- @field private _horizontalEntrances integer[][]: Node pairs on the border below each cluster
+--- @field private _dirtyClusters table<integer, boolean>
+--- @field private _localDist ffi.cdata*
+--- @field private _localParent ffi.cdata*
+--- @field private _localSeen ffi.cdata*
+--- @field private _localClosed ffi.cdata*
+--- @field private _localSearchId integer
+--- @field private _queue PriorityQueue
+--- @field private _cache table<integer, integer[]>
+--- @field private _cacheStamps table<integer, integer>
+--- @field private _cacheCount integer
+--- @field private _cacheClock integer
+--- @field private _searchId integer
+--- @field private _g table<integer, number>
+--- @field private _parent table<integer, integer>
+--- @field private _seen table<integer, integer>
+--- @field private _closed table<integer, integer>
+--- @field private _startDist table<integer, number>: Distance from the start cell to the nodes of its cluster
+--- @field private _goalDist table<integer, number>: Distance from the nodes of the goal cluster to the goal cell
+--- @field private _directFinder Finder
+---
+--- @overload fun(grid: Grid, clusterSize: integer?, diagonalMovement: DiagonalMovement?): HierarchicalFinder
+local HierarchicalFinder = Object:extend("HierarchicalFinder")
+
+
+function HierarchicalFinder:new(grid, clusterSize, diagonalMovement)
+    self.grid = grid
+    self.clusterSize = clusterSize or 16
+    self.clustersX = math.ceil(grid.width / self.clusterSize)
+    self.clustersY = math.ceil(grid.height / self.clusterSize)
+    self.clusterCount = self.clustersX * self.clustersY
+    self.diagonalMovement = diagonalMovement or "never"
+    self.cacheSize = 256
+    self.directSearchLimit = 9 * self.clusterSize * self.clusterSize
+
+    self.stats = {
+        abstractNodes = 0,   -- Nodes in the abstract graph
+        expandedNodes = 0,   -- Abstract nodes expanded by the last query
+        cacheHits = 0,       -- Queries that reused a cached abstract path
+        cacheMisses = 0,     -- Queries that searched the abstract graph
+        directQueries = 0,   -- Queries answered by the direct search
+        rebuiltClusters = 0, -- Clusters rebuilt by the last update
+    }
+
+    self._nodeCell = {}
+    self._nodeCluster = {}
+    self._nodeRefs = {}
+    self._intraTo = {}
+    self._intraCost = {}
+    self._interTo = {}
+    self._interCost = {}
+    self._freeNodes = {}
+    self._nodeCount = 0
+    self._cellNode = {}
+    self._clusterNodes = {}
+    self._verticalEntrances = {}
+    self._horizontalEntrances = {}
+    self._dirtyClusters = {}
+
+    for c=0, self.clusterCount-1 do
+        self._clusterNodes[c] = {}
+        self._verticalEntrances[c] = {}
+        self._horizontalEntrances[c] = {}
+        self._dirtyClusters[c] = true
+    end
+
+    local localCount = self.clusterSize * self.clusterSize
+    self._localDist = ffi.new("double[?]", localCount)
+    self._localParent = ffi.new("int32_t[?]", localCount)
+    self._localSeen = ffi.new("uint32_t[?]", localCount)
+    self._localClosed = ffi.new("uint32_t[?]", localCount)
+    self._localSearchId = 0
+    self._queue = PriorityQueue(grid.cellCount + 1) -- Holds cells and node ids
+
+    self._searchId = 0
+    self._g = {}
+    self._parent = {}
+    self._seen = {}
+    self._closed = {}
+    self._startDist = {}
+    self._goalDist = {}
+    self._waypoints = {}
+    self._pathIndices = {}
+    self._affectedClusters = {}
+    self._rebuiltBorders = {}
+
+    self._cache = {}
+    self._cacheStamps = {}
+    self._cacheCount = 0
+    self._cacheClock = 0
+    self._directFinder = Finder(self.diagonalMovement)
+end
+
+
+---@param cell integer
+---@return integer
+function HierarchicalFinder:getCellCluster(cell)
+    local width, size = self.grid.width, self.clusterSize
+    return floor((cell % width) / size) + floor(floor(cell / width) / size) * self.clustersX
+end
+
+
+--- Marks the cluster of a cell to be rebuilt. Must be called after changing the type or cost of a cell
+---@param x integer
+---@param y integer
+function HierarchicalFinder:invalidateCell(x, y)
+    self._dirtyClusters[self:getCellCluster(self.grid:getIndex(x, y))] = true
+end
+
+
+---------------------
+-- Abstract graph --
+---------------------
+
+---@private
+---@param cell integer
+---@return integer
+function HierarchicalFinder:_acquireNode(cell)
+    local id = self._cellNode[cell]
+
+    if id then
+        self._nodeRefs[id] = self._nodeRefs[id] + 1
+        return id
+    end
+
+    id = table.remove(self._freeNodes)
+    if not id then
+        self._nodeCount = self._nodeCount + 1
+        id = self._nodeCount
+
+        self._intraTo[id], self._intraCost[id] = {}, {}
+        self._interTo[id], self._interCost[id] = {}, {}
+    end
+
+    local cluster = self:getCellCluster(cell)
+
+    self._nodeCell[id] = cell
+    self._nodeCluster[id] = cluster
+    self._nodeRefs[id] = 1
+    self._cellNode[cell] = id
+    self._clusterNodes[cluster][id] = true
+    self.stats.abstractNodes = self.stats.abstractNodes + 1
+
+    return id
+end
+
+
+---@private
+---@param id integer
+function HierarchicalFinder:_releaseNode(id)
+    local refs = self._nodeRefs[id] - 1
+    self._nodeRefs[id] = refs
+
+    if refs == 0 then
+        self._cellNode[self._nodeCell[id]] = nil
+        self._clusterNodes[self._nodeCluster[id]][id] = nil
+
+        tableclear(self._intraTo[id])
+        tableclear(self._intraCost[id])
+        tableclear(self._interTo[id])
+        tableclear(self._interCost[id])
+
+        table.insert(self._freeNodes, id)
+        self.stats.abstractNodes = self.stats.abstractNodes - 1
+    end
+end
+
+
+---@param edgesTo integer[]
+---@param edgesCost number[]
+---@param to integer
+local function removeEdge(edgesTo, edgesCost, to)
+    for i, other in ipairs(edgesTo) do
+        if other == to then
+            table.remove(edgesTo, i)
+            table.remove(edgesCost, i)
+            return
+        end
+    end
+end
+
+
+--- Finds the entrances of the border to the right of (or below) a cluster
+---@private
+---@param cluster integer
+---@param isVertical boolean
+function HierarchicalFinder:_buildBorder(cluster, isVertical)
+    local entrances = isVertical and self._verticalEntrances[cluster] or self._horizontalEntrances[cluster]
+    local interTo, interCost = self._interTo, self._interCost
+
+    for i=1, #entrances, 2 do
+        local a, b = entrances[i], entrances[i+1]
+
+        removeEdge(interTo[a], interCost[a], b)
+        removeEdge(interTo[b], interCost[b], a)
+        self:_releaseNode(a)
+        self:_releaseNode(b)
+    end
+    tableclear(entrances)
+
+    local grid, size = self.grid, self.clusterSize
+    local cx, cy = cluster % self.clustersX, floor(cluster / self.clustersX)
+
+    if (isVertical and cx+1 >= self.clustersX) or (not isVertical and cy+1 >= self.clustersY) then
+        return
+    end
+
+    -- Cells along the border, and the offset to the cell on the other side
+    local first, step, across, length
+
+    if isVertical then
+        first = grid:getIndex((cx+1) * size - 1, cy * size)
+        step, across = grid.width, 1
+        length = min(size, grid.height - cy * size)
+    else
+        first = grid:getIndex(cx * size, (cy+1) * size - 1)
+        step, across = 1, grid.width
+        length = min(size, grid.width - cx * size)
+    end
+
+    local walkable, costs = grid.walkable, grid.costs
+    local segmentStart = nil
+
+    for i=0, length do
+        local cell = first + i * step
+        local isOpen = i < length and walkable[cell] == 1 and walkable[cell + across] == 1
+
+        if isOpen and not segmentStart then
+            segmentStart = i
+        elseif not isOpen and segmentStart then
+            local segmentEnd = i - 1
+            local positions = segmentEnd - segmentStart + 1 < MAX_ENTRANCE_WIDTH
+                and {floor((segmentStart + segmentEnd) / 2)}
+                or  {segmentStart, segmentEnd}
+
+            for p, position in ipairs(positions) do
+                local cellA = first + position * step
+                local cellB = cellA + across
+                local a, b = self:_acquireNode(cellA), self:_acquireNode(cellB)
+
+                table.insert(interTo[a], b)
+                table.insert(interCost[a], costs[cellB])
+                table.insert(interTo[b], a)
+                table.insert(interCost[b], costs[cellA])
+
+                table.insert(entrances, a)
+                table.insert(entrances, b)
+            end
+
+            segmentStart = nil
+        end
+    end
+end
+
+
+--- Precomputes the paths between all nodes of a cluster
+---@private
+---@param cluster integer
+function HierarchicalFinder:_buildClusterEdges(cluster)
+    local nodes = self._clusterNodes[cluster]
+    local intraTo, intraCost, nodeCell = self._intraTo, self._intraCost, self._nodeCell
+
+    for id in pairs(nodes) do
+        tableclear(intraTo[id])
+        tableclear(intraCost[id])
+    end
+
+    for id in pairs(nodes) do
+        self:_searchCluster(cluster, nodeCell[id], false)
+
+        for other in pairs(nodes) do
+            if other ~= id then
+                local distance = self:_getLocalDistance(nodeCell[other])
+
+                if distance < huge then
+                    table.insert(intraTo[id], other)
+                    table.insert(intraCost[id], distance)
+                end
+            end
+        end
+    end
+end
+
+
+---@private
+---@param entry integer[]
+---@param affected table<integer, boolean>
+---@return boolean
+function HierarchicalFinder:_cacheEntryTouches(entry, affected)
+    for i, id in ipairs(entry) do
+        if affected[self._nodeCluster[id]] then
+            return true
+        end
+    end
+
+    return false
+end
+
+
+--- Rebuilds all clusters marked by `invalidateCell`. This is done automatically before each query
+function HierarchicalFinder:update()
+    local dirty = self._dirtyClusters
+
+    if next(dirty) == nil then
+        return
+    end
+
+    local clustersX, clusterCount = self.clustersX, self.clusterCount
+    local affected, rebuiltBorders = self._affectedClusters, self._rebuiltBorders
+
+    -- Neighbors share border nodes with the dirty clusters, so their paths must be updated too
+    for c in pairs(dirty) do
+        local cx = c % clustersX
+
+        affected[c] = true
+        if cx > 0 then affected[c-1] = true end
+        if cx+1 < clustersX then affected[c+1] = true end
+        if c - clustersX >= 0 then affected[c-clustersX] = true end
+        if c + clustersX < clusterCount then affected[c+clustersX] = true end
+    end
+
+    -- Cached paths reference nodes that may be removed, so drop them before rebuilding
+    for key, entry in pairs(self._cache) do
+        if self:_cacheEntryTouches(entry, affected) then
+            self._cache[key] = nil
+            self._cacheStamps[key] = nil
+            self._cacheCount = self._cacheCount - 1
+        end
+    end
+
+    for c in pairs(dirty) do
+        local cx = c % clustersX
+
+        -- Vertical borders use positive keys and horizontal ones negative keys
+        local borders = {c+1, -(c+1), cx > 0 and c or nil, c - clustersX >= 0 and -(c - clustersX + 1) or nil}
+
+        for b=1, 4 do
+            local border = borders[b]
+
+            if border and not rebuiltBorders[border] then
+                self:_buildBorder(abs(border) - 1, border > 0)
+                rebuiltBorders[border] = true
+            end
+        end
+    end
+
+    local rebuilt = 0
+    for c in pairs(affected) do
+        self:_buildClusterEdges(c)
+        rebuilt = rebuilt + 1
+    end
+
+    self.stats.rebuiltClusters = rebuilt
+
+    tableclear(dirty)
+    tableclear(affected)
+    tableclear(rebuiltBorders)
+end
+
+
+------------------
+-- Local search --
+------------------
+
+--- Uniform cost search restricted to a cluster
+---@private
+---@param cluster integer
+---@param start integer: Cell index
+---@param isReverse boolean: Follows moves backwards, so distances are *to* `start` instead of from it
+---@param target integer?: Stops the search once this cell is reached
+---@return boolean: Whether `target` was reached
+function HierarchicalFinder:_searchCluster(cluster, start, isReverse, target)
+    local grid, size = self.grid, self.clusterSize
+    local width = grid.width
+    local x0, y0 = (cluster % self.clustersX) * size, floor(cluster / self.clustersX) * size
+    local x1, y1 = min(x0 + size, width) - 1, min(y0 + size, grid.height) - 1
+    local walkable, costs = grid.walkable, grid.costs
+    local dist, parent, seen, closed = self._localDist, self._localParent, self._localSeen, self._localClosed
+    local mode = DIAGONAL_MODES[self.diagonalMovement]
+    local directionCount = mode == DIAGONAL_MODES.never and 4 or 8
+    local queue = self._queue
+
+    self._localSearchId = self._localSearchId + 1
+    local id = self._localSearchId
+
+    local startLocal = (start % width - x0) + (floor(start / width) - y0) * size
+    dist[startLocal], parent[startLocal], seen[startLocal] = 0, -1, id
+
+    queue:clear()
+    queue:push(0, start)
+
+    while queue:getLength() > 0 do
+        local _, cell = queue:pop()
+        local x, y = cell % width, floor(cell / width)
+        local cellLocal = (x - x0) + (y - y0) * size
+
+        if closed[cellLocal] ~= id then
+            closed[cellLocal] = id
+
+            if cell == target then
+                return true
+            end
+
+            local cellDist = dist[cellLocal]
+
+            for d=1, directionCount do
+                local nx, ny = x + DIR_X[d], y + DIR_Y[d]
+                local next = nx + ny * width
+
+                if nx >= x0 and ny >= y0 and nx <= x1 and ny <= y1 and walkable[next] == 1 then
+                    local nextLocal = (nx - x0) + (ny - y0) * size
+                    local stepCost = isReverse and costs[cell] or costs[next]
+                    local canMove = closed[nextLocal] ~= id
+
+                    if d > 4 then
+                        local openSides = walkable[nx + y * width] + walkable[x + ny * width]
+
+                        canMove = canMove and (mode == DIAGONAL_MODES.always
+                            or (mode == DIAGONAL_MODES.ifAtMostOneObstacle and openSides >= 1)
+                            or openSides == 2)
+                        stepCost = stepCost * SQRT2
+                    end
+
+                    local newDist = cellDist + stepCost
+
+                    if canMove and (seen[nextLocal] ~= id or newDist < dist[nextLocal]) then
+                        dist[nextLocal], parent[nextLocal], seen[nextLocal] = newDist, cell, id
+                        queue:push(-newDist, next)
+                    end
+                end
+            end
+        end
+    end
+
+    return false
+end
+
+
+--- Distance found by the last `_searchCluster` call, `math.huge` if the cell wasn't reached
+---@private
+---@param cell integer
+---@return number
+function HierarchicalFinder:_getLocalDistance(cell)
+    local width, size = self.grid.width, self.clusterSize
+    local cellLocal = (cell % width) % size + (floor(cell / width) % size) * size
+
+    if self._localClosed[cellLocal] ~= self._localSearchId then
+        return huge
+    end
+
+    return self._localDist[cellLocal]
+end
+
+
+--- Stores the distances of the last `_searchCluster` call to the nodes of a cluster
+---@private
+---@param cluster integer
+---@param out table<integer, number>
+function HierarchicalFinder:_getNodeDistances(cluster, out)
+    tableclear(out)
+
+    for id in pairs(self._clusterNodes[cluster]) do
+        local distance = self:_getLocalDistance(self._nodeCell[id])
+
+        if distance < huge then
+            out[id] = distance
+        end
+    end
+end
+
+
+-------------
+-- Queries --
+-------------
+
+---@private
+---@param key integer
+---@param entry integer[]
+function HierarchicalFinder:_storeCache(key, entry)
+    if not self._cache[key] then
+        self._cacheCount = self._cacheCount + 1
+    end
+
+    self._cacheClock = self._cacheClock + 1
+    self._cache[key] = entry
+    self._cacheStamps[key] = self._cacheClock
+
+    -- Drop the least recently used path
+    if self._cacheCount > self.cacheSize then
+        local oldestKey, oldestStamp = nil, huge
+
+        for k, stamp in pairs(self._cacheStamps) do
+            if stamp < oldestStamp then
+                oldestKey, oldestStamp = k, stamp
+            end
+        end
+
+        self._cache[oldestKey] = nil
+        self._cacheStamps[oldestKey] = nil
+        self._cacheCount = self._cacheCount - 1
+    end
+end
+
+
+--- A* over the abstract graph, from the nodes reachable from the start cell to the goal cell
+---@private
+---@param goal integer
+---@param out integer[]: Receives the abstract nodes of the path
+---@return integer?: Number of nodes
+function HierarchicalFinder:_searchAbstract(goal, out)
+    local g, parent, seen, closed = self._g, self._parent, self._seen, self._closed
+    local intraTo, intraCost, interTo, interCost = self._intraTo, self._intraCost, self._interTo, self._interCost
+    local nodeCell, startDist, goalDist = self._nodeCell, self._startDist, self._goalDist
+    local width, queue = self.grid.width, self._queue
+    local isOrthogonal = DIAGONAL_MODES[self.diagonalMovement] == DIAGONAL_MODES.never
+    local unit = self.grid.minCost
+    local goalX, goalY = goal % width, floor(goal / width)
+
+    local function heuristic(id)
+        local cell = nodeCell[id]
+        local dx, dy = abs(cell % width - goalX), abs(floor(cell / width) - goalY)
+
+        if isOrthogonal then
+            return (dx + dy) * unit
+        end
+        return (max(dx, dy) + (SQRT2 - 1) * min(dx, dy)) * unit
+    end
+
+    self._searchId = self._searchId + 1
+    local searchId = self._searchId
+
+    queue:clear()
+
+    for id, distance in pairs(startDist) do
+        g[id], parent[id], seen[id] = distance, 0, searchId
+        queue:push(-(distance + heuristic(id)), id)
+    end
+
+    local bestCost, bestNode = huge, nil
+    local expanded = 0
+
+    while queue:getLength() > 0 do
+        local priority, id = queue:pop()
+
+        -- The goal can't be reached with a lower cost anymore
+        if -priority >= bestCost then
+            break
+        end
+
+        if closed[id] ~= searchId then
+            closed[id] = searchId
+            expanded = expanded + 1
+
+            local nodeG = g[id]
+            local toGoal = goalDist[id]
+
+            if toGoal and nodeG + toGoal < bestCost then
+                bestCost, bestNode = nodeG + toGoal, id
+            end
+
+            for e=1, 2 do
+                local edgesTo = e == 1 and intraTo[id] or interTo[id]
+                local edgesCost = e == 1 and intraCost[id] or interCost[id]
+
+                for i, other in ipairs(edgesTo) do
+                    local newG = nodeG + edgesCost[i]
+
+                    if closed[other] ~= searchId and (seen[other] ~= searchId or newG < g[other]) then
+                        g[other], parent[other], seen[other] = newG, id, searchId
+                        queue:push(-(newG + heuristic(other)), other)
+                    end
+                end
+            end
+        end
+    end
+
+    self.stats.expandedNodes = expanded
+
+    if not bestNode then
+        return nil
+    end
+
+    local length = 0
+    local id = bestNode
+
+    while id ~= 0 do
+        length = length + 1
+        out[length] = id
+        id = parent[id]
+    end
+
+    for i=#out, length+1, -1 do
+        out[i] = nil
+    end
+
+    for i=1, floor(length / 2) do
+        out[i], out[length-i+1] = out[length-i+1], out[i]
+    end
+
+    return length
+end
+
+
+--- Finds the waypoints of a path: the start cell, the abstract nodes to go through and the goal cell.
+--- Consecutive waypoints are either in the same cluster or next to each other, see `refineSegment`.
+---@param start integer: Cell index
+---@param goal integer: Cell index
+---@param out integer[]: Receives the cell indices of the waypoints
+---@return integer?: Number of waypoints, `nil` if there's no path
+function HierarchicalFinder:findAbstractPath(start, goal, out)
+    self:update()
+
+    local walkable = self.grid.walkable
+
+    if walkable[start] == 0 or walkable[goal] == 0 then
+        return nil
+    end
+
+    local startCluster, goalCluster = self:getCellCluster(start), self:getCellCluster(goal)
+
+    -- The path may still leave the cluster if there's no way inside it
+    if startCluster == goalCluster and self:_searchCluster(startCluster, start, false, goal) then
+        local length = start == goal and 1 or 2
+        out[1], out[2] = start, goal
+
+        for i=#out, length+1, -1 do
+            out[i] = nil
+        end
+
+        return length
+    end
+
+    self:_searchCluster(startCluster, start, false)
+    self:_getNodeDistances(startCluster, self._startDist)
+
+    self:_searchCluster(goalCluster, goal, true)
+    self:_getNodeDistances(goalCluster, self._goalDist)
+
+    local key = startCluster * self.clusterCount + goalCluster
+    local nodes = self._cache[key]
+
+    if nodes and self._startDist[nodes[1]] and self._goalDist[nodes[#nodes]] then
+        self.stats.cacheHits = self.stats.cacheHits + 1
+        self._cacheClock = self._cacheClock + 1
+        self._cacheStamps[key] = self._cacheClock
+    else
+        nodes = {}
+
+        if not self:_searchAbstract(goal, nodes) then
+            return nil
+        end
+
+        self.stats.cacheMisses = self.stats.cacheMisses + 1
+        self:_storeCache(key, nodes)
+    end
+
+    -- Start and goal cells can be nodes themselves
+    local length = 1
+    out[1] = start
+
+    for i, id in ipairs(nodes) do
+        local cell = self._nodeCell[id]
+
+        if cell ~= out[length] then
+            length = length + 1
+            out[length] = cell
+        end
+    end
+
+    if goal ~= out[length] then
+        length = length + 1
+        out[length] = goal
+    end
+
+    for i=#out, length+1, -1 do
+        out[i] = nil
+    end
+
+    return length
+end
+
+
+--- Appends the cells between two consecutive waypoints of `findAbstractPath` to `out`, including
+--- `to` but not `from`
+---@param from integer
+---@param to integer
+---@param out integer[]
+---@param length integer: Number of cells already in `out`
+---@return integer: The new length of `out`
+function HierarchicalFinder:refineSegment(from, to, out, length)
+    local cluster = self:getCellCluster(from)
+
+    -- Entrance nodes of different clusters are next to each other
+    if cluster ~= self:getCellCluster(to) then
+        out[length+1] = to
+        return length + 1
+    end
+
+    if from == to or not self:_searchCluster(cluster, from, false, to) then
+        return length
+    end
+
+    local width, size = self.grid.width, self.clusterSize
+    local parent = self._localParent
+    local first = length + 1
+    local cell = to
+
+    while cell ~= from do
+        length = length + 1
+        out[length] = cell
+        cell = parent[(cell % width) % size + (floor(cell / width) % size) * size]
+    end
+
+    for i=0, floor((length - first + 1) / 2) - 1 do
+        out[first+i], out[length-i] = out[length-i], out[first+i]
+    end
+
+    return length
+end
+
+
+--- Finds a path between two cells using cell indices (see `Grid:getIndex`)
+---@param start integer
+---@param goal integer
+---@param out integer[]: Receives the cell indices of the path, from `start` to `goal`
+---@return integer?: Number of cells in the path, `nil` if there's no path
+function HierarchicalFinder:findPathIndices(start, goal, out)
+    local walkable, clustersX = self.grid.walkable, self.clustersX
+
+    if walkable[start] == 0 or walkable[goal] == 0 then
+        return nil
+    end
+
+    local startCluster, goalCluster = self:getCellCluster(start), self:getCellCluster(goal)
+
+    -- Short paths are found directly, going through the entrances could make them much longer
+    if abs(startCluster % clustersX - goalCluster % clustersX) <= 1 and abs(floor(startCluster / clustersX) - floor(goalCluster / clustersX)) <= 1 then
+        local finder = self._directFinder
+        finder.diagonalMovement = self.diagonalMovement
+
+        local length = finder:findPathIndices(self.grid, start, goal, out, self.directSearchLimit)
+
+        if length then
+            self.stats.directQueries = self.stats.directQueries + 1
+            return length
+        end
+    end
+
+    local waypoints = self._waypoints
+    local count = self:findAbstractPath(start, goal, waypoints)
+
+    if not count then
+        return nil
+    end
+
+    local length = 1
+    out[1] = start
+
+    for i=2, count do
+        length = self:refineSegment(waypoints[i-1], waypoints[i], out, length)
+    end
+
+    for i=#out, length+1, -1 do
+        out[i] = nil
+    end
+
+    return length
+end
+
+
+--- Finds a path between two cells
+---@param from Vector2
+---@param to Vector2
+---@return Vector2[]?: The cells of the path, including `from` and `to`. `nil` if there's no path
+function HierarchicalFinder:findPath(from, to)
+    local grid = self.grid
+
+    if not grid:isInside(from.x, from.y) or not grid:isInside(to.x, to.y) then
+        return nil
+    end
+
+    local indices = self._pathIndices
+    local length = self:findPathIndices(grid:getIndex(from.x, from.y), grid:getIndex(to.x, to.y), indices)
+
+    if not length then
+        return nil
+    end
+
+    local path = {}
+    for i=1, length do
+        path[i] = Vector2(grid:getCoord(indices[i]))
+    end
+
+    return path
+end
+
+
+return HierarchicalFinder
@@ -1,56 +1,238 @@
 local Vector2 = require "engine.math.vector2"
-local Lume    = require "engine.3rdparty.lume"
 local Object  = require "engine.3rdparty.classic.classic"
-local Grid    = Object:extend("Grid")
+local ffi     = require "ffi"
 
-local function getCoord(i, size)
-    return
-        ((i-1) % size.width),
-        math.floor((i-1) / size.width)
-end
+require "love.data"
+
+
+---
+--- Grid of cells used for pathfinding. Cell types and costs are stored in FFI arrays indexed by
+--- `x + y * width` (zero based), so finders can work with plain integers instead of vectors.
+---
+--- Cells with the `"wall"` type are not walkable. Type names are mapped to small integer ids,
+--- so a grid supports up to 256 different types.
+---
+--- @class Grid: Object
+---
+--- @field public size Vector2
+--- @field public width integer
+--- @field public height integer
+--- @field public cellCount integer
+--- @field public types ffi.cdata*: Type id of each cell
+--- @field public costs ffi.cdata*: Cost to enter each cell
+--- @field public walkable ffi.cdata*: 1 if the cell can be entered, 0 otherwise
+--- @field public minCost number: Lower bound of the cost of walkable cells, used by heuristics
+--- @field public version integer: Incremented every time a cell changes
+--- @field public typesData love.ByteData: Memory of `types`, can be shared with the job threads
+--- @field public costsData love.ByteData: Memory of `costs`
+--- @field public walkableData love.ByteData: Memory of `walkable`
+--- @field private _typeNames string[]
+--- @field private _typeIds table<string, integer>
+---
+--- @overload fun(size: Vector2, callback: fun(x: integer, y: integer): string, number): Grid
+local Grid = Object:extend("Grid")
+
+Grid.WALL = "wall"
 
-local function getIndex(x, y, size)
-    return (x+1) + y * size.width
-end
 
 function Grid:new(size, callback)
+    local count = size.width * size.height
+
     self.size = size
-    self.map = {}
-    self.cost = {}
+    self.width = size.width
+    self.height = size.height
+    self.cellCount = count
 
-    for i=1, size.width * size.height do
-        local x, y = getCoord(i, size)
-        local type, cost = callback(x, y)
+    self:_setData(love.data.newByteData(math.max(count, 1)), love.data.newByteData(math.max(count, 1) * 4), love.data.newByteData(math.max(count, 1)))
+    self.minCost = math.huge
+    self.version = 0
 
-        self.map[i] = type
-        self.cost[i] = cost
+    self._typeNames = {}
+    self._typeIds = {}
+
+    for i=0, count-1 do
+        local x, y = self:getCoord(i)
+        self:_setCell(i, callback(x, y))
     end
 end
 
-function Grid:getCell(pos)
-    if pos >= self.size or pos < Vector2(0) then
+
+---@private
+---@param typesData love.Data
+---@param costsData love.Data
+---@param walkableData love.Data
+function Grid:_setData(typesData, costsData, walkableData)
+    self.typesData = typesData
+    self.costsData = costsData
+    self.walkableData = walkableData
+
+    self.types = ffi.cast("uint8_t*", typesData:getFFIPointer())
+    self.costs = ffi.cast("float*", costsData:getFFIPointer())
+    self.walkable = ffi.cast("uint8_t*", walkableData:getFFIPointer())
+end
+
+
+---@private
+---@param name string
+---@return integer
+function Grid:_getTypeId(name)
+    local id = self._typeIds[name]
+
+    if not id then
+        id = #self._typeNames
+        assert(id < 256, "Too many cell types")
+
+        self._typeNames[id+1] = name
+        self._typeIds[name] = id
+    end
+
+    return id
+end
+
+
+---@private
+---@param index integer
+---@param type string
+---@param cost number
+function Grid:_setCell(index, type, cost)
+    local isWalkable = type ~= Grid.WALL
+
+    self.types[index] = self:_getTypeId(type)
+    self.costs[index] = cost
+    self.walkable[index] = isWalkable and 1 or 0
+
+    if isWalkable and cost < self.minCost then
+        self.minCost = cost
+    end
+end
+
+
+---@param x integer
+---@param y integer
+---@return integer
+function Grid:getIndex(x, y)
+    return x + y * self.width
+end
+
+
+---@param index integer
+---@return integer x, integer y
+function Grid:getCoord(index)
+    return index % self.width, math.floor(index / self.width)
+end
+
+
+---@param x integer
+---@param y integer
+---@return boolean
+function Grid:isInside(x, y)
+    return x >= 0 and y >= 0 and x < self.width and y < self.height
+end
+
+
+---@param x integer
+---@param y integer
+---@return boolean
+function Grid:isWalkableAt(x, y)
+    return self:isInside(x, y) and self.walkable[x + y * self.width] == 1
+end
+
+
+---@param x integer
+---@param y integer
+---@return string? type, number cost
+function Grid:getCellAt(x, y)
+    if not self:isInside(x, y) then
         return nil, 0
     end
 
-    local i = getIndex(pos.x, pos.y, self.size)
-    return self.map[i], self.cost[i]
+    local i = x + y * self.width
+    return self._typeNames[self.types[i]+1], self.costs[i]
+end
+
+
+---@param pos Vector2
+---@return string? type, number cost
+function Grid:getCell(pos)
+    return self:getCellAt(pos.x, pos.y)
+end
+
+
+--- Changes a cell. Note that `minCost` is never raised, so it can get lower than the actual minimum
+---@param x integer
+---@param y integer
+---@param type string
+---@param cost number
+function Grid:setCell(x, y, type, cost)
+    assert(self:isInside(x, y), "Cell is outside the grid")
+
+    self:_setCell(x + y * self.width, type, cost)
+    self.version = self.version + 1
+end
+
+
+--- Returns `true` if all walkable cells have the same cost
+---@return boolean
+function Grid:hasUniformCost()
+    local walkable, costs = self.walkable, self.costs
+    local cost = nil
+
+    for i=0, self.cellCount-1 do
+        if walkable[i] == 1 then
+            cost = cost or costs[i]
+
+            if costs[i] ~= cost then
+                return false
+            end
+        end
+    end
+
+    return true
 end
 
 
-local sides = {Vector2(1,0), Vector2(0,1), Vector2(-1,0), Vector2(0,-1)}
+--- Creates a grid over the data of another grid, e.g in a job thread. Type names are not available
+---@param width integer
+---@param height integer
+---@param minCost number
+---@param typesData love.Data
+---@param costsData love.Data
+---@param walkableData love.Data
+---@return Grid
+function Grid.FromData(width, height, minCost, typesData, costsData, walkableData)
+    local grid = setmetatable({}, Grid)
+
+    grid.size = Vector2(width, height)
+    grid.width = width
+    grid.height = height
+    grid.cellCount = width * height
+    grid.minCost = minCost
+    grid.version = 0
+    grid._typeNames = {}
+    grid._typeIds = {}
+    grid:_setData(typesData, costsData, walkableData)
+
+    return grid
+end
+
+
+local sides = {{1,0}, {0,1}, {-1,0}, {0,-1}}
+
+--- Gets the walkable orthogonal neighbors of a cell
+---@param pos Vector2
+---@return Vector2[]
 function Grid:getNeighbors(pos)
     local neighbors = {}
 
     for i=1, 4 do
-        local ngPos = pos + sides[i]
-        local ngType, ngcost = self:getCell(ngPos)
+        local x, y = pos.x + sides[i][1], pos.y + sides[i][2]
 
-        if ngType and ngType ~= "wall" then
-            Lume.push(neighbors, ngPos)
+        if self:isWalkableAt(x, y) then
+            table.insert(neighbors, Vector2(x, y))
         end
     end
 
     return neighbors
 end
 
-return Grid
\ No newline at end of file
+return Grid
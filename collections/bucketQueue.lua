@@ -0,0 +1,294 @@
+local Object = require "engine.3rdparty.classic.classic"
+local ffi    = require "ffi"
+local floor, min, huge = math.floor, math.min, math.huge
+
+
+---
+--- A queue of integer items (from 0 to `capacity - 1`) sorted by the lowest key, using buckets instead of a heap.
+--- Pushing and popping items are `O(1)` on average, which makes it faster than `PriorityQueue` for Dijkstra-like
+--- searches where keys are integer costs or costs with a known minimum step.
+---
+--- Each bucket holds the keys in a range of `bucketWidth`, and items in the same bucket are popped in any order.
+--- With integer keys and a `bucketWidth` of 1, or with `bucketWidth` set to the cheapest step of a search, the
+--- order is exact. The buckets are circular, covering `maxStep` past the current key, so keys further ahead are
+--- kept in an overflow list until the queue reaches them. Keys can also be pushed behind the current key, but
+--- that takes `O(n)`.
+---
+--- Like `PriorityQueue`, an item can only be in the queue once: pushing it again changes its key.
+---
+--- @class BucketQueue
+---
+--- @field public capacity integer
+--- @field public bucketWidth number
+--- @field public bucketCount integer: Circular buckets, plus an overflow list for keys too far ahead
+--- @field public keys ffi.cdata*
+--- @field private _head ffi.cdata*
+--- @field private _next ffi.cdata*
+--- @field private _prev ffi.cdata*
+--- @field private _slot ffi.cdata*: Bucket slot of each item, -1 if not in the queue
+--- @field private _currentKey integer: Key of the bucket being popped
+--- @field private _length integer
+--- @field private _overflowLength integer
+---
+--- @overload fun(capacity: integer, bucketWidth: number?, maxStep: number?): BucketQueue
+local BucketQueue = Object:extend("BucketQueue")
+
+function BucketQueue:new(capacity, bucketWidth, maxStep)
+    self.capacity = capacity
+    self.bucketWidth = bucketWidth or 1
+    self.bucketCount = floor((maxStep or 64) / self.bucketWidth) + 2
+
+    self.keys = ffi.new("double[?]", capacity)
+    self._head = ffi.new("int32_t[?]", self.bucketCount + 1)
+    self._next = ffi.new("int32_t[?]", capacity)
+    self._prev = ffi.new("int32_t[?]", capacity)
+    self._slot = ffi.new("int32_t[?]", capacity)
+
+    ffi.fill(self._head, (self.bucketCount + 1) * ffi.sizeof("int32_t"), 0xFF)
+    ffi.fill(self._slot, capacity * ffi.sizeof("int32_t"), 0xFF)
+
+    self._currentKey = 0
+    self._length = 0
+    self._overflowLength = 0
+end
+
+
+---@private
+---@param item integer
+---@param slot integer
+function BucketQueue:_link(item, slot)
+    local head = self._head[slot]
+
+    self._prev[item] = -1
+    self._next[item] = head
+    if head >= 0 then
+        self._prev[head] = item
+    end
+
+    self._head[slot] = item
+    self._slot[item] = slot
+    self._length = self._length + 1
+
+    if slot == self.bucketCount then
+        self._overflowLength = self._overflowLength + 1
+    end
+end
+
+
+---@private
+---@param item integer
+function BucketQueue:_unlink(item)
+    local slot = self._slot[item]
+    local prev, next = self._prev[item], self._next[item]
+
+    if prev >= 0 then
+        self._next[prev] = next
+    else
+        self._head[slot] = next
+    end
+    if next >= 0 then
+        self._prev[next] = prev
+    end
+
+    if slot == self.bucketCount then
+        self._overflowLength = self._overflowLength - 1
+    end
+
+    self._slot[item] = -1
+    self._length = self._length - 1
+end
+
+
+---@private
+---@param item integer
+function BucketQueue:_linkByKey(item)
+    local key = floor(self.keys[item] / self.bucketWidth)
+
+    if key >= self._currentKey + self.bucketCount then
+        self:_link(item, self.bucketCount)
+    else
+        self:_link(item, key % self.bucketCount)
+    end
+end
+
+
+--- Moves the overflow items that fit in the buckets
+---@private
+function BucketQueue:_refill()
+    local limit = self._currentKey + self.bucketCount
+    local item = self._head[self.bucketCount]
+
+    while item >= 0 do
+        local next = self._next[item]
+
+        if floor(self.keys[item] / self.bucketWidth) < limit then
+            self:_unlink(item)
+            self:_linkByKey(item)
+        end
+
+        item = next
+    end
+end
+
+
+--- Moves the buckets to start at `key`, only needed when a key is pushed behind the current one
+---@private
+---@param key integer
+function BucketQueue:_rebase(key)
+    local overflow = self.bucketCount
+
+    for slot=0, overflow-1 do
+        while self._head[slot] >= 0 do
+            local item = self._head[slot]
+            self:_unlink(item)
+            self:_link(item, overflow)
+        end
+    end
+
+    self._currentKey = key
+    self:_refill()
+end
+
+
+--- Advances to the first bucket with items
+---@private
+---@return integer: Slot of the bucket
+function BucketQueue:_advance()
+    local bucketCount = self.bucketCount
+
+    -- Everything left is too far ahead, jump to the smallest key
+    if self._length == self._overflowLength then
+        local minKey = huge
+        local item = self._head[bucketCount]
+
+        while item >= 0 do
+            minKey = min(minKey, floor(self.keys[item] / self.bucketWidth))
+            item = self._next[item]
+        end
+
+        self._currentKey = minKey
+        self:_refill()
+    end
+
+    while true do
+        local slot = self._currentKey % bucketCount
+
+        if self._head[slot] >= 0 then
+            return slot
+        end
+
+        self._currentKey = self._currentKey + 1
+
+        -- A new bucket entered the window
+        if self._overflowLength > 0 then
+            self:_refill()
+        end
+    end
+end
+
+
+--- Pushes an item to the queue. If the item is already in the queue, its key is changed instead
+--- @param item integer: Item to be pushed
+--- @param key number: Item key, items with lower keys are popped first
+function BucketQueue:push(item, key)
+    if self._slot[item] >= 0 then
+        self:_unlink(item)
+    end
+
+    local bucket = floor(key / self.bucketWidth)
+    self.keys[item] = key
+
+    if self._length == 0 then
+        self._currentKey = bucket
+    elseif bucket < self._currentKey then
+        self:_rebase(bucket)
+    end
+
+    self:_linkByKey(item)
+end
+
+
+--- Removes an item with the lowest key and returns it
+--- @return integer: The popped item
+--- @return number: Item key
+function BucketQueue:pop()
+    assert(self._length > 0, "Queue is empty")
+
+    local item = self._head[self:_advance()]
+    self:_unlink(item)
+
+    return item, self.keys[item]
+end
+
+
+--- Returns an item with the lowest key without removing it
+--- @return integer?: The item
+--- @return number?: Item key
+function BucketQueue:peek()
+    if self._length == 0 then
+        return nil, nil
+    end
+
+    local item = self._head[self:_advance()]
+    return item, self.keys[item]
+end
+
+
+--- Removes the specified item from the queue
+--- @param item integer: Item to be removed
+--- @return boolean: Whether the item was in the queue
+function BucketQueue:remove(item)
+    if self._slot[item] < 0 then
+        return false
+    end
+
+    self:_unlink(item)
+    return true
+end
+
+
+--- Checks if the specified item is in the queue
+--- @param item integer: The item to check
+--- @return boolean
+function BucketQueue:contains(item)
+    return self._slot[item] >= 0
+end
+
+
+--- Gets the key of the specified item
+--- @param item integer: Item in the queue
+--- @return number?: Item key, `nil` if the item is not in the queue
+function BucketQueue:getKey(item)
+    if self._slot[item] >= 0 then
+        return self.keys[item]
+    end
+    return nil
+end
+
+
+--- Remove all items from the queue
+function BucketQueue:clear()
+    for slot=0, self.bucketCount do
+        local item = self._head[slot]
+
+        while item >= 0 do
+            self._slot[item] = -1
+            item = self._next[item]
+        end
+
+        self._head[slot] = -1
+    end
+
+    self._currentKey = 0
+    self._length = 0
+    self._overflowLength = 0
+end
+
+
+--- Get the number of items in this queue
+--- @return number: The number of items
+function BucketQueue:getLength()
+    return self._length
+end
+
+return BucketQueue
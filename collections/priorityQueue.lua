@@ -1,72 +1,120 @@
-local Object = require "engine.3rdparty.classic.classic"
+local Object     = require "engine.3rdparty.classic.classic"
+local ffi        = require "ffi"
+local tableclear = require "table.clear"
 -- Priority queue using binary heap: https://www.geeksforgeeks.org/priority-queue-using-binary-heap/
 
 local floor = math.floor
-local function parent(index)
-    return floor((index - 1) / 2)
-end
-
-local function leftChild(index)
-    return (2 * index) + 1
-end
-
-local function rightChild(index)
-    return (2 * index) + 2
-end
 
 
 ---
 --- A queue that's sorted based on the specified priority of each element. Based on binary heap algorithm.
 ---
+--- The queue keeps track of the position of each item, so an item can only be in the queue once: pushing
+--- it again changes its priority instead. This allows changing priorities and removing items in `O(log n)`.
+---
+--- When created with a `capacity`, the queue works in numeric mode: items must be integers from 0 to `capacity - 1`,
+--- and everything is stored in FFI arrays, which is faster and doesn't create garbage. Useful for graph searches.
+---
 --- @class PriorityQueue
 ---
---- @operator call: PriorityQueue
+--- @field public items table|ffi.cdata*
+--- @field public priorities table|ffi.cdata*
+--- @field public positions table|ffi.cdata*: Heap index of each item (`nil` or -1 if not in the queue)
+--- @field public pointer integer: Heap index of the last item
+--- @field public capacity integer?
+---
+--- @overload fun(capacity: integer?): PriorityQueue
 local PriorityQueue = Object:extend("PriorityQueue")
 
-function PriorityQueue:new()
-    self.items = {}
-    self.priorities = {}
+function PriorityQueue:new(capacity)
+    self.capacity = capacity
 
-    self.pointer = -1
-end
+    if capacity then
+        self.items = ffi.new("int32_t[?]", capacity)
+        self.priorities = ffi.new("double[?]", capacity)
+        self.positions = ffi.new("int32_t[?]", capacity)
 
-function PriorityQueue:__swap(index1, index2)
-    local priorities = self.priorities
-    local items = self.items
+        ffi.fill(self.positions, capacity * ffi.sizeof("int32_t"), 0xFF)
+    else
+        self.items = {}
+        self.priorities = {}
+        self.positions = {}
+    end
 
-    local tempPriority, tempItem = priorities[index1], items[index1]
-    priorities[index1], items[index1] = priorities[index2], items[index2]
-    priorities[index2], items[index2] = tempPriority, tempItem
+    self.pointer = -1
 end
 
-function PriorityQueue:__shiftUp(index)
-    local priorities = self.priorities
 
-    while (index > 0 and priorities[parent(index)] < priorities[index]) do
-        self:__swap(parent(index), index)
+---@private
+---@param index integer
+function PriorityQueue:_siftUp(index)
+    local priorities, items, positions = self.priorities, self.items, self.positions
+    local priority, item = priorities[index], items[index]
+
+    while index > 0 do
+        local parent = floor((index - 1) / 2)
+        if priorities[parent] >= priority then
+            break
+        end
 
-        index = parent(index)
+        priorities[index], items[index] = priorities[parent], items[parent]
+        positions[items[index]] = index
+        index = parent
     end
+
+    priorities[index], items[index] = priority, item
+    positions[item] = index
 end
 
-function PriorityQueue:__shiftDown(index)
-    local priorities = self.priorities
-    local max = index
 
-    local left = leftChild(index)
-    if left <= self.pointer and priorities[left] > priorities[max] then
-        max = left
+---@private
+---@param index integer
+function PriorityQueue:_siftDown(index)
+    local priorities, items, positions = self.priorities, self.items, self.positions
+    local priority, item = priorities[index], items[index]
+    local last = self.pointer
+
+    while true do
+        local child = index * 2 + 1
+        if child > last then
+            break
+        end
+
+        if child < last and priorities[child+1] > priorities[child] then
+            child = child + 1
+        end
+        if priorities[child] <= priority then
+            break
+        end
+
+        priorities[index], items[index] = priorities[child], items[child]
+        positions[items[index]] = index
+        index = child
     end
 
-    local right = rightChild(index)
-    if right <= self.pointer and priorities[right] > priorities[max] then
-        max = right
-    end
+    priorities[index], items[index] = priority, item
+    positions[item] = index
+end
+
 
-    if index ~= max then
-        self:__swap(max, index)
-        self:__shiftDown(max)
+--- Removes the last item of the heap
+---@private
+---@return number: Item priority
+---@return any: The removed item
+function PriorityQueue:_removeLast()
+    local last = self.pointer
+    local priority, item = self.priorities[last], self.items[last]
+
+    if self.capacity then
+        self.positions[item] = -1
+    else
+        self.priorities[last] = nil
+        self.items[last] = nil -- Free item in case it's a reference type
+        self.positions[item] = nil
     end
+
+    self.pointer = last - 1
+    return priority, item
 end
 
 
@@ -74,21 +122,32 @@ end
 --- @return number: Item priority
 --- @return any: The highest priotity item
 function PriorityQueue:peek()
+    if self.pointer < 0 then
+        return nil, nil
+    end
+
     return self.priorities[0], self.items[0]
 end
 
 
 
---- Pushes an item to the queue
---- @param priority integer: Item priority
+--- Pushes an item to the queue. If the item is already in the queue, its priority is changed instead
+--- @param priority number: Item priority
 --- @param item any: Item to be pushed
 function PriorityQueue:push(priority, item)
+    local index = self.positions[item]
+
+    if index and index >= 0 then
+        self:changePriority(index, priority)
+        return
+    end
+
     self.pointer = self.pointer + 1
 
     self.priorities[self.pointer] = priority
     self.items[self.pointer] = item
 
-    self:__shiftUp(self.pointer)
+    self:_siftUp(self.pointer)
 end
 
 
@@ -97,19 +156,11 @@ end
 --- @return any: The popped item
 function PriorityQueue:pop()
     assert(self.pointer > -1, "Queue is empty")
-
-    local priority, item = self:peek()
-    self:__swap(0, self.pointer)
-
-    self.priorities[self.pointer] = nil -- Free item in case it's a reference type
-    self.pointer = self.pointer - 1
-
-    self:__shiftDown(0)
-    return priority, item
+    return self:removeAt(0)
 end
 
 
---- Changes priority of the specified item
+--- Changes priority of the item at the specified heap index
 --- @param index number: Index of item
 --- @param priority number: Priority to be set
 function PriorityQueue:changePriority(index, priority)
@@ -117,27 +168,102 @@ function PriorityQueue:changePriority(index, priority)
     self.priorities[index] = priority
 
     if (priority > oldPriority) then
-        self:__shiftUp(index)
+        self:_siftUp(index)
     else
-        self:__shiftDown(index)
+        self:_siftDown(index)
     end
 end
 
 
+--- Changes priority of the specified item. When using negated costs as priorities (like in graph searches),
+--- this is the "decrease key" operation.
+--- @param item any: Item in the queue
+--- @param priority number: Priority to be set
+function PriorityQueue:setPriority(item, priority)
+    local index = self.positions[item]
+    assert(index and index >= 0, "Item is not in the queue")
+
+    self:changePriority(index, priority)
+end
+
+
+--- Gets the priority of the specified item
+--- @param item any: Item in the queue
+--- @return number?: Item priority, `nil` if the item is not in the queue
+function PriorityQueue:getPriority(item)
+    local index = self.positions[item]
+
+    if index and index >= 0 then
+        return self.priorities[index]
+    end
+    return nil
+end
+
+
+--- Checks if the specified item is in the queue
+--- @param item any: The item to check
+--- @return boolean
+function PriorityQueue:contains(item)
+    local index = self.positions[item]
+    return index ~= nil and index >= 0
+end
+
+
 --- Removes the specified item and returns it
+--- @param item any: Item to be removed
+--- @return number?: Item priority, `nil` if the item is not in the queue
+--- @return any: The removed item
+function PriorityQueue:remove(item)
+    local index = self.positions[item]
+
+    if index and index >= 0 then
+        return self:removeAt(index)
+    end
+    return nil, nil
+end
+
+
+--- Removes the item at the specified heap index and returns it
 --- @param index number: Index of item
 --- @return number: Item priority
 --- @return any: The removed item
-function PriorityQueue:remove(index)
-    self:changePriority(index, self.priorities[0] + 1)
-    return self:pop()
+function PriorityQueue:removeAt(index)
+    local last = self.pointer
+
+    if index == last then
+        return self:_removeLast()
+    end
+
+    local priorities, items = self.priorities, self.items
+    local priority, item = priorities[index], items[index]
+
+    -- Fill the gap with the last item
+    priorities[index], priorities[last] = priorities[last], priority
+    items[index], items[last] = items[last], item
+    self:_removeLast()
+
+    if index > 0 and priorities[index] > priorities[floor((index - 1) / 2)] then
+        self:_siftUp(index)
+    else
+        self:_siftDown(index)
+    end
+
+    return priority, item
 end
 
 
 --- Remove all items from the queue
 function PriorityQueue:clear()
-    self.items = {}
-    self.priorities = {}
+    if self.capacity then
+        for i=0, self.pointer do
+            self.positions[self.items[i]] = -1
+        end
+    else
+        tableclear(self.items)
+        tableclear(self.priorities)
+        tableclear(self.positions)
+    end
+
     self.pointer = -1
 end
 
@@ -161,10 +287,9 @@ end
 
 local function iter(this, i)
     i = i+1
-    local priority, item = this:getItem(i)
 
-    if item then
-        return i, priority, item
+    if i <= this.pointer then
+        return i, this:getItem(i)
     end
 end
 
@@ -181,4 +306,4 @@ function PriorityQueue:iterate()
     return iter, self, -1
 end
 
-return PriorityQueue
\ No newline at end of file
+return PriorityQueue
@@ -0,0 +1,179 @@
+local Object = require "engine.3rdparty.classic.classic"
+local ffi    = require "ffi"
+
+
+---
+--- Storage of all the entities of an `ArchetypeWorld` that have the same set of components.
+---
+--- Each component has a column, with one row per entity. Rows are 1-based and kept packed: removing an entity
+--- moves the last one into its row. Components without a schema are stored in a plain Lua array, components
+--- with a schema (see `ArchetypeWorld:defineComponent`) are stored as one FFI array per field, so a system
+--- reads them as `column.x[row]`.
+---
+--- @class Archetype: Object
+---
+--- @field public signature string: Sorted component names, separated by commas
+--- @field public componentNames string[]
+--- @field public columns table<string, table>
+--- @field public entities integer[]: Entity id of each row
+--- @field public count integer
+--- @field public capacity integer
+--- @field package schemas table<string, ComponentSchema>
+--- @field package addEdges table<string, Archetype>: Archetype with one more component, filled as entities move
+--- @field package removeEdges table<string, Archetype>: Archetype with one less component
+---
+--- @overload fun(componentNames: string[], schemas: table<string, ComponentSchema>): Archetype
+local Archetype = Object:extend("Archetype")
+
+
+--- @alias ComponentSchema {name: string, ctype: string}[]
+
+
+function Archetype:new(componentNames, schemas)
+    self.signature = table.concat(componentNames, ",")
+    self.componentNames = componentNames
+    self.columns = {}
+    self.entities = {}
+    self.count = 0
+    self.capacity = 0
+    self.schemas = {}
+    self.addEdges = {}
+    self.removeEdges = {}
+
+    for _, name in ipairs(componentNames) do
+        self.schemas[name] = schemas[name]
+        self.columns[name] = {}
+    end
+
+    self:_grow(16)
+end
+
+
+---@private
+---@param capacity integer
+function Archetype:_grow(capacity)
+    for name, schema in pairs(self.schemas) do
+        local column = self.columns[name]
+
+        for _, field in ipairs(schema) do
+            local old = column[field.name]
+            local new = ffi.new(field.ctype.."[?]", capacity + 1)
+
+            if old then
+                ffi.copy(new, old, (self.count + 1) * ffi.sizeof(field.ctype))
+            end
+
+            column[field.name] = new
+        end
+    end
+
+    self.capacity = capacity
+end
+
+
+--- Checks if the entities of this archetype have a component
+---@param name string
+---@return boolean
+function Archetype:has(name)
+    return self.columns[name] ~= nil
+end
+
+
+--- Adds a row for an entity. Its components are left with whatever was in that row before.
+---@param entity integer
+---@return integer row
+function Archetype:push(entity)
+    if self.count >= self.capacity then
+        self:_grow(self.capacity * 2)
+    end
+
+    self.count = self.count + 1
+    self.entities[self.count] = entity
+
+    return self.count
+end
+
+
+--- Stores a component of the entity in a row. Fields missing from `value` are set to 0, a `nil` value of a component
+--- without schema is stored as `true` (a tag).
+---@param name string
+---@param row integer
+---@param value any
+function Archetype:write(name, row, value)
+    local column = self.columns[name]
+    local schema = self.schemas[name]
+
+    if schema then
+        for _, field in ipairs(schema) do
+            column[field.name][row] = value and value[field.name] or 0
+        end
+    else
+        column[row] = value == nil or value
+    end
+end
+
+
+--- Removes a row, moving the last row into it
+---@param row integer
+---@return integer? moved: Entity that now is in `row`, if any
+function Archetype:remove(row)
+    local last = self.count
+    local moved = nil
+
+    if row ~= last then
+        self:_copyRow(self, last, row)
+        moved = self.entities[last]
+        self.entities[row] = moved
+    end
+
+    -- Lua columns would keep the values alive otherwise
+    for _, name in ipairs(self.componentNames) do
+        if not self.schemas[name] then
+            self.columns[name][last] = nil
+        end
+    end
+
+    self.entities[last] = nil
+    self.count = last - 1
+
+    return moved
+end
+
+
+--- Moves an entity to another archetype, keeping the components both have
+---@param row integer
+---@param target Archetype
+---@return integer newRow, integer? moved: Entity that now is in `row` of this archetype, if any
+function Archetype:moveTo(row, target)
+    local newRow = target:push(self.entities[row])
+
+    target:_copyRow(self, row, newRow)
+    return newRow, self:remove(row)
+end
+
+
+---@private
+---@param source Archetype
+---@param sourceRow integer
+---@param row integer
+function Archetype:_copyRow(source, sourceRow, row)
+    for _, name in ipairs(self.componentNames) do
+        local sourceColumn = source.columns[name]
+
+        if sourceColumn then
+            local column = self.columns[name]
+            local schema = self.schemas[name]
+
+            if schema then
+                for _, field in ipairs(schema) do
+                    column[field.name][row] = sourceColumn[field.name][sourceRow]
+                end
+            else
+                column[row] = sourceColumn[sourceRow]
+            end
+        end
+    end
+end
+
+
+return Archetype
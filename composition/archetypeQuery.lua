@@ -0,0 +1,84 @@
+local Object = require "engine.3rdparty.classic.classic"
+
+
+---
+--- The archetypes of an `ArchetypeWorld` that have a set of components. Queries are cached by the world and
+--- updated when new archetypes are created, so iterating never checks entities that don't match.
+---
+--- @class ArchetypeQuery: Object
+---
+--- @field public componentNames string[]
+--- @field public archetypes Archetype[]: Matching archetypes, including empty ones
+--- @field private _world ArchetypeWorld
+---
+--- @overload fun(world: ArchetypeWorld, componentNames: string[]): ArchetypeQuery
+local ArchetypeQuery = Object:extend("ArchetypeQuery")
+
+
+function ArchetypeQuery:new(world, componentNames)
+    self.componentNames = componentNames
+    self.archetypes = {}
+    self._world = world
+end
+
+
+--- Checks if an archetype has all the components of this query
+---@param archetype Archetype
+---@return boolean
+function ArchetypeQuery:matches(archetype)
+    for _, name in ipairs(self.componentNames) do
+        if not archetype:has(name) then
+            return false
+        end
+    end
+
+    return true
+end
+
+
+---@param archetypes Archetype[]
+---@param func fun(archetype: Archetype, count: integer, ...)
+---@param ... any
+local function visitArchetypes(archetypes, func, ...)
+    for i=1, #archetypes do
+        local archetype = archetypes[i]
+
+        if archetype.count > 0 then
+            func(archetype, archetype.count, ...)
+        end
+    end
+end
+
+
+--- Calls `func(archetype, count, ...)` for each matching archetype with entities. Structural changes made
+--- by `func` (spawning, despawning, adding or removing components) are applied after all archetypes are visited.
+--- If `func` raises an error, the world is unlocked before the error is raised again.
+---@param func fun(archetype: Archetype, count: integer, ...)
+---@param ... any
+function ArchetypeQuery:each(func, ...)
+    local world = self._world
+
+    world:lock()
+    local success, err = pcall(visitArchetypes, self.archetypes, func, ...)
+    world:unlock()
+
+    if not success then
+        error(err, 0)
+    end
+end
+
+
+--- Number of entities matching this query
+---@return integer
+function ArchetypeQuery:getCount()
+    local count = 0
+
+    for _, archetype in ipairs(self.archetypes) do
+        count = count + archetype.count
+    end
+
+    return count
+end
+
+
+return ArchetypeQuery
@@ -0,0 +1,427 @@
+local Archetype      = require "engine.composition.archetype"
+local ArchetypeQuery = require "engine.composition.archetypeQuery"
+local Object         = require "engine.3rdparty.classic.classic"
+
+
+---
+--- Entity storage grouped by archetype, for large amounts of simple entities (particles, projectiles, crowds...).
+--- Works alongside `Entity`/`Component`, which are still better for a few entities with complex behavior.
+---
+--- Entities are integer ids, and their components are stored in the columns of the `Archetype` of their component
+--- set. Systems iterate over whole archetypes through cached queries instead of checking each entity:
+--- ```lua
+--- world:defineComponent("Position", {x = "float", y = "float"})
+--- world:defineComponent("Velocity", {x = "float", y = "float"})
+---
+--- world:addSystem("update", {"Position", "Velocity"}, function(archetype, count, dt)
+---     local pos, vel = archetype.columns.Position, archetype.columns.Velocity
+---
+---     for i=1, count do
+---         pos.x[i] = pos.x[i] + vel.x[i] * dt
+---         pos.y[i] = pos.y[i] + vel.y[i] * dt
+---     end
+--- end)
+---
+--- world:spawn({Position = {x = 0, y = 0}, Velocity = {x = 1, y = 0}})
+--- world:emit("update", dt)
+--- ```
+---
+--- While systems are running the world is locked, and structural changes are applied once it's unlocked.
+--- Ids of despawned entities are reused.
+---
+--- @class ArchetypeWorld: Object
+---
+--- @field public archetypes table<string, Archetype>: Archetypes by signature
+--- @field public schemas table<string, ComponentSchema>
+--- @field private _root Archetype: Archetype without components
+--- @field private _entityArchetype table<integer, Archetype>
+--- @field private _entityRow table<integer, integer>
+--- @field private _freeIds integer[]
+--- @field private _nextId integer
+--- @field private _queries table<string, ArchetypeQuery>
+--- @field private _systems table<string, {query: ArchetypeQuery, func: function}[]>
+--- @field private _lockDepth integer
+--- @field private _pending table[]: Structural changes made while locked
+---
+--- @overload fun(): ArchetypeWorld
+local ArchetypeWorld = Object:extend("ArchetypeWorld")
+
+
+function ArchetypeWorld:new()
+    self.archetypes = {}
+    self.schemas = {}
+    self._entityArchetype = {}
+    self._entityRow = {}
+    self._freeIds = {}
+    self._nextId = 1
+    self._queries = {}
+    self._systems = {}
+    self._lockDepth = 0
+    self._pending = {}
+
+    self._root = self:_getArchetype({})
+end
+
+
+--- Defines a component made of plain numbers, stored as FFI arrays (one per field) instead of Lua tables.
+--- Must be called before the component is used.
+---@param name string
+---@param fields table<string, string>: C type of each field, e.g. `{x = "float", y = "float"}`
+function ArchetypeWorld:defineComponent(name, fields)
+    assert(not self.schemas[name], "Component "..name.." is already defined")
+
+    local schema = {}
+    for field, ctype in pairs(fields) do
+        schema[#schema+1] = {name = field, ctype = ctype}
+    end
+    table.sort(schema, function(a, b) return a.name < b.name end)
+
+    self.schemas[name] = schema
+end
+
+
+---@private
+---@param componentNames string[]: Sorted
+---@return Archetype
+function ArchetypeWorld:_getArchetype(componentNames)
+    local signature = table.concat(componentNames, ",")
+    local archetype = self.archetypes[signature]
+
+    if not archetype then
+        archetype = Archetype(componentNames, self.schemas)
+        self.archetypes[signature] = archetype
+
+        for _, query in pairs(self._queries) do
+            if query:matches(archetype) then
+                query.archetypes[#query.archetypes+1] = archetype
+            end
+        end
+    end
+
+    return archetype
+end
+
+
+---@private
+---@param archetype Archetype
+---@param name string
+---@param add boolean
+---@return Archetype
+function ArchetypeWorld:_getNeighbor(archetype, name, add)
+    local edges = add and archetype.addEdges or archetype.removeEdges
+    local neighbor = edges[name]
+
+    if not neighbor then
+        local names = {}
+
+        for _, other in ipairs(archetype.componentNames) do
+            if other ~= name then
+                names[#names+1] = other
+            end
+        end
+
+        if add then
+            names[#names+1] = name
+            table.sort(names)
+        end
+
+        neighbor = self:_getArchetype(names)
+        edges[name] = neighbor
+    end
+
+    return neighbor
+end
+
+
+---@private
+---@param entity integer
+---@param target Archetype
+---@return integer row
+function ArchetypeWorld:_move(entity, target)
+    local row, moved = self._entityArchetype[entity]:moveTo(self._entityRow[entity], target)
+
+    if moved then
+        self._entityRow[moved] = self._entityRow[entity]
+    end
+
+    self._entityArchetype[entity] = target
+    self._entityRow[entity] = row
+    return row
+end
+
+
+---@private
+---@param entity integer
+---@param components table<string, any>
+function ArchetypeWorld:_place(entity, components)
+    local names = {}
+    for name in pairs(components) do
+        names[#names+1] = name
+    end
+    table.sort(names)
+
+    local archetype = self:_getArchetype(names)
+    local row = archetype:push(entity)
+
+    for name, value in pairs(components) do
+        archetype:write(name, row, value)
+    end
+
+    self._entityArchetype[entity] = archetype
+    self._entityRow[entity] = row
+end
+
+
+
+--- Creates an entity. If the world is locked, the entity only exists after it's unlocked.
+---@param components table<string, any>?: Initial components by name. Components with a schema take any value with the same fields
+---@return integer entity
+function ArchetypeWorld:spawn(components)
+    local entity = table.remove(self._freeIds)
+
+    if not entity then
+        entity = self._nextId
+        self._nextId = entity + 1
+    end
+
+    if self._lockDepth > 0 then
+        self._pending[#self._pending+1] = {"spawn", entity, components or {}}
+    else
+        self:_place(entity, components or {})
+    end
+
+    return entity
+end
+
+
+--- Removes an entity
+---@param entity integer
+function ArchetypeWorld:despawn(entity)
+    if self._lockDepth > 0 then
+        self._pending[#self._pending+1] = {"despawn", entity}
+        return
+    end
+
+    local archetype = assert(self._entityArchetype[entity], "Entity does not exist")
+    local moved = archetype:remove(self._entityRow[entity])
+
+    if moved then
+        self._entityRow[moved] = self._entityRow[entity]
+    end
+
+    self._entityArchetype[entity] = nil
+    self._entityRow[entity] = nil
+    self._freeIds[#self._freeIds+1] = entity
+end
+
+
+--- Adds a component to an entity, or replaces its value if the entity already has it
+---@param entity integer
+---@param name string
+---@param value any
+function ArchetypeWorld:addComponent(entity, name, value)
+    if self._lockDepth > 0 then
+        self._pending[#self._pending+1] = {"add", entity, name, value}
+        return
+    end
+
+    local archetype = assert(self._entityArchetype[entity], "Entity does not exist")
+    local row = self._entityRow[entity]
+
+    if not archetype:has(name) then
+        row = self:_move(entity, self:_getNeighbor(archetype, name, true))
+        archetype = self._entityArchetype[entity]
+    end
+
+    archetype:write(name, row, value)
+end
+
+
+--- Removes a component from an entity
+---@param entity integer
+---@param name string
+function ArchetypeWorld:removeComponent(entity, name)
+    if self._lockDepth > 0 then
+        self._pending[#self._pending+1] = {"remove", entity, name}
+        return
+    end
+
+    local archetype = assert(self._entityArchetype[entity], "Entity does not exist")
+    assert(archetype:has(name), "Entity does not have component "..name)
+
+    self:_move(entity, self:_getNeighbor(archetype, name, false))
+end
+
+
+--- Gets a component of an entity. For components with a schema, returns the column and the row of the entity instead,
+--- so the fields are read as `column.x[row]`.
+---@param entity integer
+---@param name string
+---@return any value, integer? row
+function ArchetypeWorld:getComponent(entity, name)
+    local archetype = self._entityArchetype[entity]
+    local column = archetype and archetype.columns[name]
+
+    if not column then
+        return nil
+    end
+
+    local row = self._entityRow[entity]
+
+    if archetype.schemas[name] then
+        return column, row
+    end
+
+    return column[row]
+end
+
+
+---@param entity integer
+---@param name string
+---@return boolean
+function ArchetypeWorld:hasComponent(entity, name)
+    local archetype = self._entityArchetype[entity]
+    return archetype ~= nil and archetype:has(name)
+end
+
+
+---@param entity integer
+---@return boolean
+function ArchetypeWorld:exists(entity)
+    return self._entityArchetype[entity] ~= nil
+end
+
+
+--- Gets the cached query of a set of components, creating it if needed
+---@param ... string: Component names
+---@return ArchetypeQuery
+function ArchetypeWorld:query(...)
+    local names = {...}
+    table.sort(names)
+
+    local key = table.concat(names, ",")
+    local query = self._queries[key]
+
+    if not query then
+        query = ArchetypeQuery(self, names)
+        self._queries[key] = query
+
+        for _, archetype in pairs(self.archetypes) do
+            if query:matches(archetype) then
+                query.archetypes[#query.archetypes+1] = archetype
+            end
+        end
+    end
+
+    return query
+end
+
+
+--- Registers a system, called by `emit(callback, ...)` for each archetype with all the components as
+--- `func(archetype, count, ...)`
+---@param callback string: e.g. "update", "draw"
+---@param componentNames string[]
+---@param func fun(archetype: Archetype, count: integer, ...)
+function ArchetypeWorld:addSystem(callback, componentNames, func)
+    local systems = self._systems[callback] or {}
+    self._systems[callback] = systems
+
+    systems[#systems+1] = {query = self:query(unpack(componentNames)), func = func}
+end
+
+
+---@param callback string
+---@param func function
+function ArchetypeWorld:removeSystem(callback, func)
+    local systems = self._systems[callback] or {}
+
+    for i, system in ipairs(systems) do
+        if system.func == func then
+            table.remove(systems, i)
+            return
+        end
+    end
+end
+
+
+---@param systems {query: ArchetypeQuery, func: function}[]
+---@param ... any
+local function runSystems(systems, ...)
+    for i=1, #systems do
+        local system = systems[i]
+        system.query:each(system.func, ...)
+    end
+end
+
+
+--- Runs the systems registered for a callback, in the order they were added.
+--- If a system raises an error, the world is unlocked before the error is raised again.
+---@param callback string
+---@param ... any
+function ArchetypeWorld:emit(callback, ...)
+    local systems = self._systems[callback]
+
+    if not systems then
+        return
+    end
+
+    self:lock()
+    local success, err = pcall(runSystems, systems, ...)
+    self:unlock()
+
+    if not success then
+        error(err, 0)
+    end
+end
+
+
+--- Defers structural changes until `unlock` is called the same number of times, so archetypes can be iterated safely
+function ArchetypeWorld:lock()
+    self._lockDepth = self._lockDepth + 1
+end
+
+
+--- Applies the structural changes made since the world was locked, once every `lock` has been undone
+function ArchetypeWorld:unlock()
+    self._lockDepth = self._lockDepth - 1
+
+    if self._lockDepth > 0 then
+        return
+    end
+
+    local pending = self._pending
+    self._pending = {}
+
+    for _, change in ipairs(pending) do
+        local kind, entity = change[1], change[2]
+
+        if kind == "spawn" then
+            self:_place(entity, change[3])
+        elseif kind == "despawn" then
+            self:despawn(entity)
+        elseif kind == "add" then
+            self:addComponent(entity, change[3], change[4])
+        else
+            self:removeComponent(entity, change[3])
+        end
+    end
+end
+
+
+--- Removes all entities. Archetypes, queries and systems are kept.
+function ArchetypeWorld:clear()
+    for _, archetype in pairs(self.archetypes) do
+        while archetype.count > 0 do
+            archetype:remove(archetype.count)
+        end
+    end
+
+    self._entityArchetype = {}
+    self._entityRow = {}
+    self._freeIds = {}
+    self._nextId = 1
+    self._pending = {}
+end
+
+
+return ArchetypeWorld
@@ -1,13 +1,136 @@
+local Component = require "engine.composition.component"
+
 local CM = {
     entities = {} ---@type table<Entity, boolean>
 }
 
 local waitingForRemove = {}
 
+-- Enabled components of the added entities that implement each callback, so a broadcast only calls those.
+-- Lists are kept up to date as components change. The callbacks of `Component` have their lists from the start,
+-- lists of other callbacks are created on their first broadcast. Components are appended when added, but removing
+-- one moves the last component of the list into its slot, so the call order is not guaranteed.
+local subscribers = {} ---@type table<string, (Component|false)[]>
+local subscriberSlots = {} ---@type table<string, table<Component, integer>>
+
+for funcname, value in pairs(Component) do
+    if type(value) == "function" and funcname ~= "new" and funcname:sub(1, 2) ~= "__" then
+        subscribers[funcname] = {}
+        subscriberSlots[funcname] = {}
+    end
+end
+
+-- Components removed during a broadcast leave a `false` in their slot, lists are compacted after it ends
+local broadcastDepth = 0
+local dirtyLists = {} ---@type table<string, boolean>
+
+
+---@param comp Component
+---@param funcname string
+---@return boolean
+local function implements(comp, funcname)
+    local func = comp[funcname]
+    return func ~= nil and func ~= Component[funcname]
+end
+
+
+local function compactLists()
+    for funcname in pairs(dirtyLists) do
+        local list, slots = subscribers[funcname], subscriberSlots[funcname]
+        local count = 0
+
+        for i=1, #list do
+            local comp = list[i]
+
+            if comp then
+                count = count + 1
+                list[count] = comp
+                slots[comp] = count
+            end
+        end
+
+        for i=#list, count+1, -1 do
+            list[i] = nil
+        end
+
+        dirtyLists[funcname] = nil
+    end
+end
+
+
+---@param funcname string
+---@return (Component|false)[]
+local function createList(funcname)
+    local list, slots = {}, {}
+
+    for entity in pairs(CM.entities) do
+        for _, comp in pairs(entity.components) do
+            if implements(comp, funcname) then
+                list[#list+1] = comp
+                slots[comp] = #list
+            end
+        end
+    end
+
+    subscribers[funcname] = list
+    subscriberSlots[funcname] = slots
+    return list
+end
+
+
+--- Starts sending broadcasts to a component. Called by `Entity` when its components change.
+---@package
+---@param comp Component
+function CM._subscribe(comp)
+    for funcname, list in pairs(subscribers) do
+        local slots = subscriberSlots[funcname]
+
+        if not slots[comp] and implements(comp, funcname) then
+            list[#list+1] = comp
+            slots[comp] = #list
+        end
+    end
+end
+
+
+--- Stops sending broadcasts to a component. Called by `Entity` when its components change.
+---@package
+---@param comp Component
+function CM._unsubscribe(comp)
+    for funcname, slots in pairs(subscriberSlots) do
+        local slot = slots[comp]
+
+        if slot then
+            local list = subscribers[funcname]
+            slots[comp] = nil
+
+            if broadcastDepth > 0 then
+                list[slot] = false
+                dirtyLists[funcname] = true
+            else
+                local last = list[#list]
+                list[slot] = last
+                list[#list] = nil
+
+                if last ~= comp then
+                    slots[last] = slot
+                end
+            end
+        end
+    end
+end
+
+
 local function removeWaitingEntities()
     for entity in pairs(waitingForRemove) do
         waitingForRemove[entity] = nil
         CM.entities[entity] = nil
+        entity._manager = nil
+
+        for _, comp in pairs(entity.components) do
+            CM._unsubscribe(comp)
+        end
+
         entity:broadcastToComponents("onEntityRemoved", entity)
     end
 end
@@ -17,6 +140,11 @@ end
 function CM.addEntity(entity)
     assert(not CM.entities[entity], "Entity already exists")
     CM.entities[entity] = true
+    entity._manager = CM
+
+    for _, comp in pairs(entity.components) do
+        CM._subscribe(comp)
+    end
 
     entity:broadcastToComponents("onEntityAdded", entity)
 end
@@ -39,11 +167,25 @@ end
 ---@param funcname string
 ---@param ... any
 function CM.broadcastToAllComponents(funcname, ...)
-    for entity in pairs(CM.entities) do
-        entity:broadcastToComponents(funcname, ...)
+    local list = subscribers[funcname] or createList(funcname)
+
+    broadcastDepth = broadcastDepth + 1
+
+    for i=1, #list do
+        local comp = list[i]
+
+        if comp then
+            comp[funcname](comp, ...)
+        end
+    end
+
+    broadcastDepth = broadcastDepth - 1
+
+    if broadcastDepth == 0 then
+        compactLists()
     end
 
     removeWaitingEntities()
 end
 
-return CM
\ No newline at end of file
+return CM
@@ -4,6 +4,7 @@ local Object = require "engine.3rdparty.classic.classic"
 ---
 ---@field public components table<string, Component>
 ---@field private _disabledComponents table<string, Component>
+---@field package _manager table?: The composition manager, while the entity is added to it
 ---
 ---@overload fun(): Entity
 local Entity = Object:extend("Entity")
@@ -26,6 +27,10 @@ function Entity:attachComponents(...)
 
         comp.entity = self
         comp:onAttach(self)
+
+        if self._manager then
+            self._manager._subscribe(comp)
+        end
     end
 
     return self
@@ -38,6 +43,11 @@ function Entity:detachComponent(compClassName)
     local comp = self.components[compClassName] or self._disabledComponents[compClassName]
 
     assert(comp, "Entity does not have component "..compClassName)
+
+    if self._manager then
+        self._manager._unsubscribe(comp)
+    end
+
     comp:onDetach(self)
     comp.entity = nil
 
@@ -51,7 +61,12 @@ function Entity:disableComponent(compClassName)
     local comp = self.components[compClassName]
     assert(comp, "Entity does not have component "..compClassName)
 
+    self.components[compClassName] = nil
     self._disabledComponents[compClassName] = comp
+
+    if self._manager then
+        self._manager._unsubscribe(comp)
+    end
     return self
 end
 
@@ -61,6 +76,11 @@ function Entity:enableComponent(compClassName)
     assert(comp, "Entity does not have component "..compClassName)
 
     self.components[compClassName] = comp
+    self._disabledComponents[compClassName] = nil
+
+    if self._manager then
+        self._manager._subscribe(comp)
+    end
     return self
 end
 
@@ -0,0 +1,103 @@
+-- Benchmark of `Finder` on 1024x1024 grids: A* with and without diagonal moves, and jump point search.
+-- Needs `love.data`, so require it from a LÖVE game (e.g. in `love.load`):
+--     require "engine.debug.benchmarks.astarFinder"
+--
+-- Prints, for each map and mode, the average time, expanded nodes and path length of the same random queries.
+-- Jump point search only runs on the map with uniform costs.
+
+local Grid    = require "engine.AI.pathfinding.pathfindingGrid"
+local Finder  = require "engine.AI.pathfinding.astarFinder"
+local Vector2 = require "engine.math.vector2"
+
+local SIZE = 1024
+local QUERIES = 40
+
+local modes = {
+    {name = "A* orthogonal", finder = Finder("never")},
+    {name = "A* diagonal",   finder = Finder("onlyWhenNoObstacles")},
+    {name = "JPS",           finder = Finder("onlyWhenNoObstacles", true), uniformOnly = true},
+}
+
+
+---@param withMud boolean: Adds areas that cost 4 times more to cross
+---@return Grid
+local function createMap(withMud)
+    local walls, mud = {}, {}
+
+    -- Random rectangular obstacles, and random mud patches
+    for r=1, 400 do
+        local x, y, w, h = math.random(0, SIZE-1), math.random(0, SIZE-1), math.random(2, 40), math.random(2, 40)
+        local cells = (withMud and r % 2 == 0) and mud or walls
+
+        for i=x, math.min(x+w, SIZE-1) do
+            for j=y, math.min(y+h, SIZE-1) do
+                cells[i + j*SIZE] = true
+            end
+        end
+    end
+
+    return Grid(Vector2(SIZE, SIZE), function(x, y)
+        local i = x + y*SIZE
+
+        if walls[i] then
+            return "wall", 1
+        end
+
+        return mud[i] and "mud" or "floor", mud[i] and 4 or 1
+    end)
+end
+
+
+---@param grid Grid
+---@return integer[][]: Pairs of cells connected by a path
+local function createQueries(grid)
+    local finder, path, queries = Finder("onlyWhenNoObstacles"), {}, {}
+
+    while #queries < QUERIES do
+        local start, goal = math.random(0, grid.cellCount-1), math.random(0, grid.cellCount-1)
+
+        if grid.walkable[start] == 1 and grid.walkable[goal] == 1 and finder:findPathIndices(grid, start, goal, path) then
+            table.insert(queries, {start, goal})
+        end
+    end
+
+    return queries
+end
+
+
+---@param name string
+---@param withMud boolean
+local function run(name, withMud)
+    math.randomseed(7)
+
+    local grid = createMap(withMud)
+    local queries = createQueries(grid)
+    local path = {}
+
+    print(("%s (%dx%d, %d queries)"):format(name, SIZE, SIZE, QUERIES))
+
+    for _, mode in ipairs(modes) do
+        if not (mode.uniformOnly and withMud) then
+            local finder = mode.finder
+            local expanded, length = 0, 0
+
+            -- Warm up (and let jump point search check the costs of the grid)
+            finder:findPathIndices(grid, queries[1][1], queries[1][2], path)
+
+            local start = os.clock()
+            for _, query in ipairs(queries) do
+                length = length + finder:findPathIndices(grid, query[1], query[2], path)
+                expanded = expanded + finder.expandedNodes
+            end
+            local elapsed = os.clock() - start
+
+            print(("  %-14s %8.2f ms per path, %8d expanded nodes, %6d cells"):format(
+                mode.name, elapsed * 1000 / QUERIES, expanded / QUERIES, length / QUERIES
+            ))
+        end
+    end
+end
+
+
+run("Obstacles", false)
+run("Obstacles and mud", true)
@@ -0,0 +1,93 @@
+-- Benchmark of a `FlowField` against one `Finder:findPath` call per agent, all going to the same goal.
+-- Needs `love.data` and the job threads, so require it from a LÖVE game (e.g. in `love.load`):
+--     require "engine.debug.benchmarks.flowField"
+--
+-- Prints, for each grid size: the time to build the whole field, the time for every agent to sample
+-- its direction, the time of the individual A* searches and the time to repair the field after a cell change.
+
+local Grid      = require "engine.AI.pathfinding.pathfindingGrid"
+local Finder    = require "engine.AI.pathfinding.astarFinder"
+local FlowField = require "engine.AI.pathfinding.flowField"
+local Vector2   = require "engine.math.vector2"
+
+local AGENT_COUNT = 500
+local REPAIRS = 20
+
+
+---@param size integer
+local function run(size)
+    math.randomseed(11)
+
+    -- Random rectangular obstacles
+    local walls = {}
+    for r=1, 400 * size / 1024 do
+        local x, y, w, h = math.random(0, size-1), math.random(0, size-1), math.random(2, 40), math.random(2, 40)
+
+        for i=x, math.min(x+w, size-1) do
+            for j=y, math.min(y+h, size-1) do
+                walls[i + j*size] = true
+            end
+        end
+    end
+
+    local grid = Grid(Vector2(size, size), function(x, y)
+        return walls[x + y*size] and "wall" or "floor", 1
+    end)
+
+    -- Goal in the biggest open area, so most cells can reach it
+    local goalX, goalY, reference
+    repeat
+        goalX, goalY = math.random(0, size-1), math.random(0, size-1)
+        reference = grid.walkable[goalX + goalY*size] == 1 and FlowField(grid):setGoal(goalX, goalY):build()
+    until reference and reference.stats.processedCells > grid.cellCount * 0.3
+
+    local agents = {}
+    while #agents < AGENT_COUNT do
+        local x, y = math.random(0, size-1), math.random(0, size-1)
+
+        if reference:getDistance(x, y) < math.huge then
+            table.insert(agents, Vector2(x, y))
+        end
+    end
+
+    -- Flow field
+    local start = os.clock()
+    local field = FlowField(grid):setGoal(goalX, goalY):build()
+    local buildTime = os.clock() - start
+    local reachable = field.stats.processedCells
+
+    start = os.clock()
+    for _, agent in ipairs(agents) do
+        field:getDirection(agent.x, agent.y)
+    end
+    local sampleTime = os.clock() - start
+
+    -- A*
+    local finder = Finder("onlyWhenNoObstacles")
+    local goal = Vector2(goalX, goalY)
+
+    start = os.clock()
+    for _, agent in ipairs(agents) do
+        finder:findPath(grid, agent, goal)
+    end
+    local pathTime = os.clock() - start
+
+    -- Incremental repair
+    start = os.clock()
+    for i=1, REPAIRS do
+        local x, y = math.random(0, size-1), math.random(0, size-1)
+
+        grid:setCell(x, y, "wall", 1)
+        field:invalidateCell(x, y)
+        field:update()
+    end
+    local repairTime = (os.clock() - start) / REPAIRS
+
+    print(("%dx%d, %d reachable cells"):format(size, size, reachable))
+    print(("  flow field: build %.1f ms, %d samples %.3f ms, repair %.2f ms per cell"):format(buildTime * 1000, AGENT_COUNT, sampleTime * 1000, repairTime * 1000))
+    print(("  A*: %d findPath calls %.1f ms"):format(AGENT_COUNT, pathTime * 1000))
+end
+
+
+run(256)
+run(512)
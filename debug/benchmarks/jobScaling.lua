@@ -0,0 +1,121 @@
+-- Scaling of the job system from 1 to N cores (the main thread plus 0 to N-1 workers).
+-- Needs `love.thread`, so require it from a LÖVE game (e.g. in `love.load`):
+--     require "engine.debug.benchmarks.jobScaling"
+--
+-- Prints, for each worker count, the time of two workloads and their speedup over the main thread alone:
+-- frustum culling of 1M boxes, and 4000 poses of a 64 bone skeleton (`ModelAnimationManager` jobs).
+
+local Job            = require "engine.misc.job"
+local PackedSkeleton = require "engine.3D.model.animation.packedSkeleton"
+local Armature       = require "engine.3D.model.modelArmature"
+local Bone           = require "engine.3D.model.modelBone"
+local Animation      = require "engine.3D.model.animation.modelAnimation"
+local Matrix4        = require "engine.math.matrix4"
+local Quaternion     = require "engine.math.quaternion"
+local Vector3        = require "engine.math.vector3"
+local ffi            = require "ffi"
+
+local BOX_COUNT = 1000000
+local POSE_COUNT = 4000
+local BONE_COUNT = 64
+local RUNS = 5
+
+
+-- Frustum culling data: random boxes, and the planes of a frustum around the origin
+math.randomseed(5)
+local boxes = love.data.newByteData(BOX_COUNT * 6 * 4)
+local visibility = love.data.newByteData(BOX_COUNT)
+local boxPointer = ffi.cast("float*", boxes:getFFIPointer())
+
+for i=0, BOX_COUNT-1 do
+    local x, y, z = math.random() * 200 - 100, math.random() * 200 - 100, math.random() * 200 - 100
+    local b = i*6
+
+    boxPointer[b], boxPointer[b+1], boxPointer[b+2] = x, y, z
+    boxPointer[b+3], boxPointer[b+4], boxPointer[b+5] = x + 1, y + 1, z + 1
+end
+
+local planes = {
+    1, 0, 0, 50,   -1, 0, 0, 50,
+    0, 1, 0, 50,   0, -1, 0, 50,
+    0, 0, 1, 50,   0, 0, -1, 50,
+}
+
+
+-- Pose data: a binary tree skeleton with an animation that moves every bone
+local armature = Armature(nil, "armature", Matrix4.Identity())
+local animationData = {name = "animation", duration = 100, fps = 30, nodes = {}}
+local bones = {}
+
+for i=0, BONE_COUNT-1 do
+    local localMatrix = Matrix4.CreateTransformationMatrix(Quaternion.CreateFromAxisAngle(Vector3(0, 0, 1), 0.1*i), Vector3(1), Vector3(0, 1, 0))
+    local bone = Bone(nil, "bone"..i, localMatrix, Matrix4.Identity(), i)
+    local node = {name = bone.name, positionKeys = {}, rotationKeys = {}, scaleKeys = {}}
+
+    bones[i] = bone
+    armature.bones[bone.name] = bone
+
+    if i == 0 then
+        armature.rootBones[bone.name] = bone
+    else
+        bones[math.floor((i-1) / 2)]:addChild(bone)
+    end
+
+    for t=0, 100, 5 do
+        table.insert(node.positionKeys, {time = t, value = Vector3(0, 1 + 0.01*t, 0)})
+        table.insert(node.rotationKeys, {time = t, value = Quaternion.CreateFromAxisAngle(Vector3(0, 0, 1), 0.01*t + 0.05*i)})
+        table.insert(node.scaleKeys, {time = t, value = Vector3(1)})
+    end
+
+    animationData.nodes[bone.name] = node
+end
+
+armature:sortBones()
+
+local animation = Animation(nil, animationData)
+local skeleton = PackedSkeleton.Pack(animation, armature, Matrix4.Identity(), BONE_COUNT)
+local times = love.data.newByteData(POSE_COUNT * 8)
+local poses = love.data.newByteData(POSE_COUNT * PackedSkeleton.GetPoseSize(BONE_COUNT))
+local timePointer = ffi.cast("double*", times:getFFIPointer())
+
+for i=0, POSE_COUNT-1 do
+    timePointer[i] = math.random() * 100
+end
+
+
+---@param create fun(): Job
+---@return number: Best time of `RUNS` runs
+local function measure(create)
+    local best = math.huge
+
+    for i=1, RUNS do
+        local start = love.timer.getTime()
+        create():schedule():wait()
+        best = math.min(best, love.timer.getTime() - start)
+    end
+
+    return best
+end
+
+
+local maxWorkers = math.max(love.system.getProcessorCount() - 1, 0)
+local baseCull, basePoses
+
+for workers=0, maxWorkers do
+    Job.SetWorkerCount(workers)
+
+    local cullTime = measure(function()
+        return Job("engine.misc._frustumCullJob", BOX_COUNT, {boxes, visibility}, {planes = planes})
+    end)
+    local poseTime = measure(function()
+        return Job("engine.3D.model.animation._poseJob", POSE_COUNT, {skeleton, times, poses}, {maxBones = BONE_COUNT})
+    end)
+
+    baseCull, basePoses = baseCull or cullTime, basePoses or poseTime
+
+    print(("%d cores: culling %.2f ms (%.2fx), poses %.2f ms (%.2fx)"):format(
+        workers + 1, cullTime * 1000, baseCull / cullTime, poseTime * 1000, basePoses / poseTime
+    ))
+end
+
+Job.SetWorkerCount(maxWorkers)
@@ -0,0 +1,113 @@
+-- Benchmark and sanity check of `LightClusterGrid` with 1000 point and spot lights.
+-- Doesn't need LÖVE, run it with LuaJIT from the folder that contains the engine:
+--     luajit engine/debug/benchmarks/lightClusterGrid.lua
+--
+-- Prints the build time, the memory allocated per build and the result of a brute-force
+-- check: random points inside the frustum must find every light that reaches them in their cluster.
+
+local Grid    = require "engine.3D.renderers.lightClusterGrid"
+local Matrix4 = require "engine.math.matrix4"
+local Vector3 = require "engine.math.vector3"
+
+local LIGHT_COUNT = 1000
+local BUILDS = 200
+local CHECKS = 100000
+local NEAR, FAR = 0.1, 100
+
+local position, forward, up = Vector3(1, 2, 3), Vector3(0.3, -0.1, -1):normalize(), Vector3(0, 1, 0)
+local view = Matrix4.CreateLookAtDirection(position, forward, up)
+local proj = Matrix4.CreatePerspectiveFOV(math.pi/3, 16/9, NEAR, FAR)
+
+
+local function getBoundingSphere(self)
+    return self.position.x, self.position.y, self.position.z, self.radius
+end
+
+math.randomseed(42)
+local lights = {}
+
+for i=1, LIGHT_COUNT do
+    local distance = math.random() * 60
+    local x = position.x + forward.x * distance + math.random() * 40 - 20
+    local y = position.y + forward.y * distance + math.random() * 24 - 12
+    local z = position.z + forward.z * distance + math.random() * 40 - 20
+
+    lights[i] = {
+        typeDefinition = i % 3 == 0 and 2 or 3,
+        position = Vector3(x, y, z),
+        direction = Vector3(0, 0, 1),
+        color = {1, 1, 1},
+        constant = 0, linear = 0, quadratic = 1,
+        innerAngle = 0.3, outerAngle = 0.5,
+        radius = 0.5 + math.random() * 4,
+        getBoundingSphere = getBoundingSphere,
+    }
+end
+
+local grid = Grid(16, 9, 24, 1024, 128)
+grid:build(lights, view, proj, NEAR, FAR)
+
+
+-- Timing
+collectgarbage()
+collectgarbage("stop")
+local memory = collectgarbage("count")
+local start = os.clock()
+
+for i=1, BUILDS do
+    grid:build(lights, view, proj, NEAR, FAR)
+end
+
+local elapsed = os.clock() - start
+local allocated = collectgarbage("count") - memory
+collectgarbage("restart")
+
+print(("lights: %d, in range: %d, indices: %d, overflows: %d"):format(LIGHT_COUNT, grid.stats.lights, grid.stats.indices, grid.stats.overflows))
+print(("build: %.3f ms, %.2f KB allocated per build"):format(elapsed / BUILDS * 1000, allocated / BUILDS))
+
+
+-- Brute-force check
+local function getCluster(x, y, z)
+    local v = view
+    local vx = x*v.m11 + y*v.m21 + z*v.m31 + v.m41
+    local vy = x*v.m12 + y*v.m22 + z*v.m32 + v.m42
+    local depth = -(x*v.m13 + y*v.m23 + z*v.m33 + v.m43)
+
+    if depth < NEAR or depth > FAR then return end
+
+    local nx, ny = vx * proj.m11 / depth, vy * proj.m22 / depth
+    if math.abs(nx) > 1 or math.abs(ny) > 1 then return end
+
+    return math.min(math.floor((nx*0.5 + 0.5) * grid.sizeX), grid.sizeX-1), math.min(math.floor((ny*0.5 + 0.5) * grid.sizeY), grid.sizeY-1), grid:getDepthSlice(depth)
+end
+
+local misses, overlaps = 0, 0
+local data = grid.lightData
+
+for n=1, CHECKS do
+    local distance = 0.2 + math.random() * 70
+    local x = position.x + forward.x * distance + math.random() * 60 - 30
+    local y = position.y + forward.y * distance + math.random() * 40 - 20
+    local z = position.z + forward.z * distance + math.random() * 60 - 30
+    local cx, cy, cz = getCluster(x, y, z)
+
+    if cx then
+        local inCluster = {}
+        for _, index in ipairs(grid:getClusterLights(cx, cy, cz)) do
+            inCluster[index] = true
+        end
+
+        -- The first texel of each light has its position and radius
+        for i=0, grid.lightCount-1 do
+            local b = i * Grid.LIGHT_TEXELS * 4
+            local dx, dy, dz, r = x - data[b], y - data[b+1], z - data[b+2], data[b+3]
+
+            if dx*dx + dy*dy + dz*dz <= r*r then
+                overlaps = overlaps + 1
+                if not inCluster[i] then misses = misses + 1 end
+            end
+        end
+    end
+end
+
+print(("brute-force check: %d point/light overlaps, %d missing from their cluster"):format(overlaps, misses))
@@ -0,0 +1,235 @@
+-- Benchmark of the priority queues: the previous heap, `PriorityQueue` (with table and FFI storage) and `BucketQueue`.
+-- Doesn't need LÖVE, run it with LuaJIT from the folder that contains the engine:
+--     luajit engine/debug/benchmarks/priorityQueue.lua
+--
+-- Prints the time of each queue for two workloads: pushing random integer keys and popping them all,
+-- and a Dijkstra search over a grid with random costs, like the ones `Finder` and `FlowField` run.
+
+local PriorityQueue = require "engine.collections.priorityQueue"
+local BucketQueue   = require "engine.collections.bucketQueue"
+local Object        = require "engine.3rdparty.classic.classic"
+local floor = math.floor
+
+local ITEM_COUNT = 200000
+local MAX_KEY = 100000
+local GRID_SIZE = 512
+local MAX_COST = 4
+local RUNS = 5
+
+
+-- Previous queue, kept here for comparison. It doesn't know where its items are, so searches push
+-- duplicates and skip the stale ones when they're popped
+local PreviousQueue = Object:extend("PreviousPriorityQueue")
+
+function PreviousQueue:new()
+    self.items = {}
+    self.priorities = {}
+    self.pointer = -1
+end
+
+function PreviousQueue:__swap(index1, index2)
+    local priorities, items = self.priorities, self.items
+
+    priorities[index1], priorities[index2] = priorities[index2], priorities[index1]
+    items[index1], items[index2] = items[index2], items[index1]
+end
+
+function PreviousQueue:__shiftUp(index)
+    local priorities = self.priorities
+
+    while index > 0 and priorities[floor((index - 1) / 2)] < priorities[index] do
+        self:__swap(floor((index - 1) / 2), index)
+        index = floor((index - 1) / 2)
+    end
+end
+
+function PreviousQueue:__shiftDown(index)
+    local priorities = self.priorities
+    local max = index
+    local left, right = 2 * index + 1, 2 * index + 2
+
+    if left <= self.pointer and priorities[left] > priorities[max] then
+        max = left
+    end
+    if right <= self.pointer and priorities[right] > priorities[max] then
+        max = right
+    end
+
+    if index ~= max then
+        self:__swap(max, index)
+        self:__shiftDown(max)
+    end
+end
+
+function PreviousQueue:push(priority, item)
+    self.pointer = self.pointer + 1
+    self.priorities[self.pointer] = priority
+    self.items[self.pointer] = item
+    self:__shiftUp(self.pointer)
+end
+
+function PreviousQueue:pop()
+    local priority, item = self.priorities[0], self.items[0]
+
+    self:__swap(0, self.pointer)
+    self.priorities[self.pointer] = nil
+    self.pointer = self.pointer - 1
+    self:__shiftDown(0)
+
+    return priority, item
+end
+
+function PreviousQueue:getLength()
+    return self.pointer + 1
+end
+
+function PreviousQueue:clear()
+    self.items = {}
+    self.priorities = {}
+    self.pointer = -1
+end
+
+
+-- Every queue is used through the same functions. Heaps pop the highest priority, so keys are negated
+local queues = {
+    {
+        name = "previous heap",
+        create = function() return PreviousQueue() end,
+        push = function(queue, item, key) queue:push(-key, item) end,
+        pop = function(queue) local priority, item = queue:pop() return item, -priority end,
+        allowsDuplicates = true,
+    },
+    {
+        name = "PriorityQueue",
+        create = function() return PriorityQueue() end,
+        push = function(queue, item, key) queue:push(-key, item) end,
+        pop = function(queue) local priority, item = queue:pop() return item, -priority end,
+    },
+    {
+        name = "PriorityQueue (FFI)",
+        create = function(capacity) return PriorityQueue(capacity) end,
+        push = function(queue, item, key) queue:push(-key, item) end,
+        pop = function(queue) local priority, item = queue:pop() return item, -priority end,
+    },
+    {
+        name = "BucketQueue",
+        create = function(capacity, maxStep) return BucketQueue(capacity, 1, maxStep) end,
+        push = function(queue, item, key) queue:push(item, key) end,
+        pop = function(queue) return queue:pop() end,
+    },
+}
+
+
+---@param func fun(): number
+---@return number time: Best of `RUNS`, in ms
+---@return number result
+local function measure(func)
+    local best, result = math.huge, nil
+
+    for i=1, RUNS do
+        collectgarbage()
+
+        local start = os.clock()
+        result = func()
+        best = math.min(best, os.clock() - start)
+    end
+
+    return best * 1000, result
+end
+
+
+-- Push/pop: random keys, pushed all at once and then popped in order
+math.randomseed(1)
+local keys = {}
+for i=0, ITEM_COUNT-1 do
+    keys[i] = math.random(0, MAX_KEY)
+end
+
+print(("push/pop %dk random keys"):format(ITEM_COUNT / 1000))
+
+for _, q in ipairs(queues) do
+    local queue = q.create(ITEM_COUNT, MAX_KEY)
+    local push, pop = q.push, q.pop
+
+    local time, checksum = measure(function()
+        local sum, last = 0, -1
+
+        for i=0, ITEM_COUNT-1 do
+            push(queue, i, keys[i])
+        end
+
+        for i=1, ITEM_COUNT do
+            local item, key = pop(queue)
+            assert(key >= last, "Keys popped out of order")
+            sum, last = sum + key, key
+        end
+
+        return sum
+    end)
+
+    print(("  %-20s %8.2f ms  (checksum %d)"):format(q.name, time, checksum))
+end
+
+
+-- Dijkstra over a grid from the center to every cell. Moving between two cells costs the sum of their
+-- costs, so cells are often reached again with a lower cost ("decrease key")
+local cellCount = GRID_SIZE * GRID_SIZE
+local costs = {}
+for i=0, cellCount-1 do
+    costs[i] = math.random(1, MAX_COST)
+end
+
+local dist, closed = {}, {}
+local DX, DY = {1, 0, -1, 0}, {0, 1, 0, -1}
+
+print(("Dijkstra on a %dx%d grid, steps cost from 2 to %d"):format(GRID_SIZE, GRID_SIZE, MAX_COST * 2))
+
+for _, q in ipairs(queues) do
+    local queue = q.create(cellCount, MAX_COST * 2)
+    local push, pop = q.push, q.pop
+    local pushes
+
+    local time, checksum = measure(function()
+        local start = floor(GRID_SIZE / 2) * (GRID_SIZE + 1)
+        local sum = 0
+        pushes = 0
+
+        for i=0, cellCount-1 do
+            dist[i], closed[i] = math.huge, false
+        end
+
+        dist[start] = 0
+        push(queue, start, 0)
+
+        while queue:getLength() > 0 do
+            local cell, d = pop(queue)
+
+            -- Only the previous heap can pop an outdated copy of a cell
+            if not closed[cell] then
+                closed[cell] = true
+                sum = sum + d
+
+                local x, y = cell % GRID_SIZE, floor(cell / GRID_SIZE)
+
+                for n=1, 4 do
+                    local nx, ny = x + DX[n], y + DY[n]
+
+                    if nx >= 0 and ny >= 0 and nx < GRID_SIZE and ny < GRID_SIZE then
+                        local next = nx + ny * GRID_SIZE
+                        local newDist = d + costs[cell] + costs[next]
+
+                        if not closed[next] and newDist < dist[next] then
+                            dist[next] = newDist
+                            push(queue, next, newDist)
+                            pushes = pushes + 1
+                        end
+                    end
+                end
+            end
+        end
+
+        return sum
+    end)
+
+    print(("  %-20s %8.2f ms  %7d pushes%s  (checksum %d)"):format(q.name, time, pushes, q.allowsDuplicates and " (with duplicates)" or "", checksum))
+end
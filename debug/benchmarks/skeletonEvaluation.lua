@@ -0,0 +1,136 @@
+-- Benchmark of the single pass skeleton evaluation (`ModelAnimation:updatePoseDQS`) against the previous
+-- recursive one, which walked `bone.children` and created new matrices, vectors and quaternions for every bone.
+-- Doesn't need LÖVE, run it with LuaJIT from the folder that contains the engine:
+--     luajit engine/debug/benchmarks/skeletonEvaluation.lua
+--
+-- Prints, for each bone count, the time and the memory allocated per pose with the recursive evaluation,
+-- and with the single pass one without and with key cursors (the way `ModelAnimator` plays animations).
+
+local Armature        = require "engine.3D.model.modelArmature"
+local Bone            = require "engine.3D.model.modelBone"
+local Animation       = require "engine.3D.model.animation.modelAnimation"
+local Matrix4         = require "engine.math.matrix4"
+local Quaternion      = require "engine.math.quaternion"
+local Vector3         = require "engine.math.vector3"
+local Vector3Array    = require "engine.math.vector3Array"
+local QuaternionArray = require "engine.math.quaternionArray"
+
+local BONE_COUNTS = {16, 64, 128, 256}
+local KEY_COUNT = 60
+local POSES = 2000
+
+
+-- Previous evaluation, kept here for comparison
+local function updateBonesDQS(animation, time, dqList, scaleList, bone, parentTransform)
+    local transform = bone.localMatrix
+    local animNode = animation.animNodes[bone.name]
+
+    if animNode then
+        local position, rotation, scale = animNode:getInterpolated(time)
+        transform = Matrix4.CreateTransformationMatrix(rotation, scale, position)
+    end
+
+    local globalTransform = transform * parentTransform
+    local finalBoneTransform = bone.offset * globalTransform
+    local translation, scale, rotation = finalBoneTransform:decompose()
+    local id = bone.id+1
+
+    dqList[id*2-1] = rotation
+    dqList[id*2]   = Quaternion.CreateDualQuaternionTranslation(rotation, translation)
+    scaleList[id] = scale
+
+    for i, child in ipairs(bone.children) do
+        updateBonesDQS(animation, time, dqList, scaleList, child, globalTransform)
+    end
+end
+
+
+--- Creates a skeleton shaped like a character rig: a spine, with limbs of 4 bones branching from it
+---@param boneCount integer
+---@return ModelAnimation, ModelArmature
+local function createSkeleton(boneCount)
+    local armature = Armature(nil, "armature", Matrix4.Identity())
+    local animationData = {name = "animation", duration = KEY_COUNT, fps = 30, nodes = {}}
+    local bones = {}
+
+    for i=0, boneCount-1 do
+        local offset = Matrix4.CreateTransformationMatrix(Quaternion.Identity(), Vector3(1), Vector3(0, -i * 0.1, 0))
+        local bone = Bone(nil, "bone"..i, Matrix4.Identity(), offset, i)
+        local node = {name = bone.name, positionKeys = {}, rotationKeys = {}, scaleKeys = {}}
+
+        bones[i] = bone
+        armature.bones[bone.name] = bone
+
+        if i == 0 then
+            armature.rootBones[bone.name] = bone
+        elseif i % 5 == 1 then
+            bones[math.max(i - 5, 0)]:addChild(bone)
+        else
+            bones[i-1]:addChild(bone)
+        end
+
+        for t=0, KEY_COUNT do
+            table.insert(node.positionKeys, {time = t, value = Vector3(0, 0.1, 0.01 * math.sin(t + i))})
+            table.insert(node.rotationKeys, {time = t, value = Quaternion.CreateFromAxisAngle(Vector3(1, 0, 0), 0.3 * math.sin(0.2*t + i))})
+            table.insert(node.scaleKeys, {time = t, value = Vector3(1)})
+        end
+
+        animationData.nodes[bone.name] = node
+    end
+
+    armature:sortBones()
+    return Animation(nil, animationData), armature
+end
+
+
+---@param func fun(time: number)
+---@return number time, number allocated: Per pose, in µs and KB
+local function measure(func)
+    -- Warm up, so the first bone count isn't measured while the JIT compiles the traces
+    for i=1, 200 do
+        func(i % KEY_COUNT)
+    end
+
+    collectgarbage()
+    collectgarbage("stop")
+
+    local memory = collectgarbage("count")
+    local start = os.clock()
+
+    -- Advances like a 60 fps playback, so key cursors only move forward
+    for i=1, POSES do
+        func((i * 0.5) % KEY_COUNT)
+    end
+
+    local time, allocated = (os.clock() - start) / POSES, (collectgarbage("count") - memory) / POSES
+    collectgarbage("restart")
+
+    return time * 1e6, allocated
+end
+
+
+for _, boneCount in ipairs(BONE_COUNTS) do
+    local animation, armature = createSkeleton(boneCount)
+    local root = Matrix4.Identity()
+    local rootBone = armature.sortedBones[1]
+    local cursors = animation:createCursors()
+    local dqList, scaleList = {}, {}
+    local quaternions, scaling = QuaternionArray(boneCount*2), Vector3Array(boneCount)
+
+    quaternions:resize(boneCount*2)
+    scaling:resize(boneCount)
+
+    local recursiveTime, recursiveMemory = measure(function(time)
+        updateBonesDQS(animation, time, dqList, scaleList, rootBone, root)
+    end)
+    local linearTime, linearMemory = measure(function(time)
+        animation:updatePoseDQS(time, armature, root, nil, quaternions, scaling)
+    end)
+    local cursorTime, cursorMemory = measure(function(time)
+        animation:updatePoseDQS(time, armature, root, cursors, quaternions, scaling)
+    end)
+
+    print(("%4d bones: recursive %7.1f µs %6.1f KB | single pass %6.1f µs %4.1f KB (%4.1fx) | with cursors %6.1f µs %4.1f KB (%4.1fx)"):format(
+        boneCount, recursiveTime, recursiveMemory, linearTime, linearMemory, recursiveTime / linearTime, cursorTime, cursorMemory, recursiveTime / cursorTime
+    ))
+end
@@ -0,0 +1,152 @@
+-- Benchmark of the batched `StructArray` kernels against the scalar math API (one object per value).
+-- Doesn't need LÖVE, run it with LuaJIT from the folder that contains the engine:
+--     luajit engine/debug/benchmarks/structArrays.lua
+--
+-- Prints, for each operation, the time and the memory allocated per run with tables of `Vector3`,
+-- `Matrix4` and `Quaternion` objects, and with `Vector3Array`, `Matrix4Array` and `QuaternionArray`.
+
+local Vector3         = require "engine.math.vector3"
+local Matrix4         = require "engine.math.matrix4"
+local Quaternion      = require "engine.math.quaternion"
+local Vector3Array    = require "engine.math.vector3Array"
+local Matrix4Array    = require "engine.math.matrix4Array"
+local QuaternionArray = require "engine.math.quaternionArray"
+
+local POINT_COUNT = 100000
+local MATRIX_COUNT = 10000
+local QUATERNION_COUNT = 50000
+local RUNS = 20
+
+
+math.randomseed(3)
+
+local function randomQuaternion()
+    return Quaternion.CreateFromAxisAngle(Vector3(math.random() - 0.5, math.random() - 0.5, math.random() - 0.5):normalize(), math.random() * 6)
+end
+
+local transform = Matrix4.CreateTransformationMatrix(randomQuaternion(), Vector3(2), Vector3(1, 2, 3))
+
+local points, pointArray, outArray = {}, Vector3Array(POINT_COUNT), Vector3Array(POINT_COUNT)
+for i=1, POINT_COUNT do
+    points[i] = Vector3(math.random() * 100, math.random() * 100, math.random() * 100)
+    pointArray:push(points[i])
+end
+
+local matrices1, matrices2, matrixArray1, matrixArray2, matrixOut = {}, {}, Matrix4Array(MATRIX_COUNT), Matrix4Array(MATRIX_COUNT), Matrix4Array(MATRIX_COUNT)
+for i=1, MATRIX_COUNT do
+    matrices1[i] = Matrix4.CreateTransformationMatrix(randomQuaternion(), Vector3(1), Vector3(i, 0, 0))
+    matrices2[i] = Matrix4.CreateTransformationMatrix(randomQuaternion(), Vector3(1), Vector3(0, i, 0))
+    matrixArray1:push(matrices1[i])
+    matrixArray2:push(matrices2[i])
+end
+
+local quaternions1, quaternions2, quaternionArray1, quaternionArray2, quaternionOut = {}, {}, QuaternionArray(QUATERNION_COUNT), QuaternionArray(QUATERNION_COUNT), QuaternionArray(QUATERNION_COUNT)
+for i=1, QUATERNION_COUNT do
+    quaternions1[i], quaternions2[i] = randomQuaternion(), randomQuaternion()
+    quaternionArray1:push(quaternions1[i])
+    quaternionArray2:push(quaternions2[i])
+end
+
+
+---@param func function
+---@return number time, number allocated: Per run, in ms and KB
+local function measure(func)
+    func()
+    collectgarbage()
+    collectgarbage("stop")
+
+    local memory = collectgarbage("count")
+    local start = os.clock()
+
+    for i=1, RUNS do
+        func()
+    end
+
+    local time, allocated = (os.clock() - start) / RUNS, (collectgarbage("count") - memory) / RUNS
+    collectgarbage("restart")
+
+    return time * 1000, allocated
+end
+
+
+---@param name string
+---@param scalar function
+---@param batched function
+local function compare(name, scalar, batched)
+    local scalarTime, scalarMemory = measure(scalar)
+    local batchedTime, batchedMemory = measure(batched)
+
+    print(("%-32s scalar %8.2f ms %9.1f KB | batched %7.2f ms %7.1f KB | %5.1fx"):format(
+        name, scalarTime, scalarMemory, batchedTime, batchedMemory, scalarTime / batchedTime
+    ))
+end
+
+
+local results = {}
+
+compare(("transform %dk points"):format(POINT_COUNT / 1000),
+    function()
+        for i=1, POINT_COUNT do
+            results[i] = points[i]:clone():transform(transform)
+        end
+    end,
+    function()
+        pointArray:transform(transform, outArray)
+    end
+)
+
+compare(("normalize %dk vectors"):format(POINT_COUNT / 1000),
+    function()
+        for i=1, POINT_COUNT do
+            results[i] = points[i].normalized
+        end
+    end,
+    function()
+        pointArray:normalize(outArray)
+    end
+)
+
+compare(("min/max of %dk points"):format(POINT_COUNT / 1000),
+    function()
+        local min, max = Vector3(math.huge), Vector3(-math.huge)
+        for i=1, POINT_COUNT do
+            min, max = Vector3.Min(min, points[i]), Vector3.Max(max, points[i])
+        end
+    end,
+    function()
+        pointArray:getMinMax()
+    end
+)
+
+compare(("multiply %dk matrices"):format(MATRIX_COUNT / 1000),
+    function()
+        for i=1, MATRIX_COUNT do
+            results[i] = matrices1[i] * matrices2[i]
+        end
+    end,
+    function()
+        Matrix4Array.Multiply(matrixArray1, matrixArray2, matrixOut)
+    end
+)
+
+compare(("slerp %dk quaternions"):format(QUATERNION_COUNT / 1000),
+    function()
+        for i=1, QUATERNION_COUNT do
+            results[i] = Quaternion.Slerp(quaternions1[i], quaternions2[i], 0.3)
+        end
+    end,
+    function()
+        QuaternionArray.Slerp(quaternionArray1, quaternionArray2, 0.3, quaternionOut)
+    end
+)
+
+compare(("lerp %dk quaternions"):format(QUATERNION_COUNT / 1000),
+    function()
+        for i=1, QUATERNION_COUNT do
+            results[i] = Quaternion.Lerp(quaternions1[i], quaternions2[i], 0.3)
+        end
+    end,
+    function()
+        QuaternionArray.Lerp(quaternionArray1, quaternionArray2, 0.3, quaternionOut)
+    end
+)
@@ -0,0 +1,195 @@
+-- Benchmark of `TriangleBVH` on a terrain of 100k triangles, against testing every triangle (what
+-- `Inter3d.ray_mesh` did before the tree).
+-- Needs `love.data`, so require it from a LÖVE game (e.g. in `love.load`):
+--     require "engine.debug.benchmarks.triangleBVH"
+--
+-- Prints the build time of the tree, and the time per ray of closest hit and any hit (line of sight) queries,
+-- one by one and with `raycastBatch`. Closest hits are checked against the brute force ones.
+
+local TriangleBVH = require "engine.math.triangleBVH"
+local ffi         = require "ffi"
+
+local QUADS = 224 -- 224x224 quads, 100352 triangles
+local RAY_COUNT = 20000
+local BRUTE_FORCE_RAY_COUNT = 200
+local RUNS = 5
+local EPSILON = 1e-9
+
+
+---@param x number
+---@param z number
+---@return number
+local function height(x, z)
+    return 8 * math.sin(x * 0.05) * math.cos(z * 0.07) + 2 * math.sin(x * 0.3 + z * 0.2)
+end
+
+
+-- Terrain: a grid of vertices (3 floats each) with two triangles per quad
+local vertexCount = (QUADS + 1) * (QUADS + 1)
+local indexCount = QUADS * QUADS * 6
+local vertices = ffi.new("float[?]", vertexCount * 3)
+local indices = ffi.new("uint32_t[?]", indexCount)
+
+for z=0, QUADS do
+    for x=0, QUADS do
+        local v = (x + z * (QUADS + 1)) * 3
+        vertices[v], vertices[v+1], vertices[v+2] = x, height(x, z), z
+    end
+end
+
+for z=0, QUADS-1 do
+    for x=0, QUADS-1 do
+        local i, v = (x + z * QUADS) * 6, x + z * (QUADS + 1)
+        indices[i], indices[i+1], indices[i+2] = v, v + QUADS + 1, v + 1
+        indices[i+3], indices[i+4], indices[i+5] = v + 1, v + QUADS + 1, v + QUADS + 2
+    end
+end
+
+
+-- Closest hit rays: from above the terrain, looking down at random angles. Any hit rays: segments between
+-- two points slightly above the terrain, most of them blocked by a hill
+math.randomseed(5)
+
+local rays = ffi.new("BVHRay[?]", RAY_COUNT)
+local segments = ffi.new("BVHRay[?]", RAY_COUNT)
+local hits = ffi.new("BVHRayHit[?]", RAY_COUNT)
+
+for i=0, RAY_COUNT-1 do
+    local ray = rays[i]
+    ray.ox, ray.oy, ray.oz = math.random() * QUADS, 20 + math.random() * 20, math.random() * QUADS
+    ray.dx, ray.dy, ray.dz = math.random() - 0.5, -1, math.random() - 0.5
+    ray.maxDistance = 0
+
+    local x1, z1, x2, z2 = math.random() * QUADS, math.random() * QUADS, math.random() * QUADS, math.random() * QUADS
+    local y1, y2 = height(x1, z1) + 2, height(x2, z2) + 2
+    local segment = segments[i]
+    segment.ox, segment.oy, segment.oz = x1, y1, z1
+    segment.dx, segment.dy, segment.dz = x2 - x1, y2 - y1, z2 - z1
+    segment.maxDistance = 1
+end
+
+
+-- Tests every triangle of the index buffer, with the same intersection as the tree
+local function bruteForceRaycast(ox, oy, oz, dx, dy, dz, maxDistance)
+    local best, bestTriangle = maxDistance, nil
+
+    for t=0, indexCount/3 - 1 do
+        local p1, p2, p3 = indices[t*3] * 3, indices[t*3+1] * 3, indices[t*3+2] * 3
+        local x1, y1, z1 = vertices[p1], vertices[p1+1], vertices[p1+2]
+        local e1x, e1y, e1z = vertices[p2] - x1, vertices[p2+1] - y1, vertices[p2+2] - z1
+        local e2x, e2y, e2z = vertices[p3] - x1, vertices[p3+1] - y1, vertices[p3+2] - z1
+
+        local hx, hy, hz = dy*e2z - dz*e2y, dz*e2x - dx*e2z, dx*e2y - dy*e2x
+        local a = e1x*hx + e1y*hy + e1z*hz
+
+        if a <= -EPSILON or a >= EPSILON then
+            local f = 1 / a
+            local sx, sy, sz = ox - x1, oy - y1, oz - z1
+            local u = f * (sx*hx + sy*hy + sz*hz)
+
+            if u >= 0 and u <= 1 then
+                local qx, qy, qz = sy*e1z - sz*e1y, sz*e1x - sx*e1z, sx*e1y - sy*e1x
+                local v = f * (dx*qx + dy*qy + dz*qz)
+
+                if v >= 0 and u + v <= 1 then
+                    local distance = f * (e2x*qx + e2y*qy + e2z*qz)
+
+                    if distance > EPSILON and distance < best then
+                        best, bestTriangle = distance, t
+                    end
+                end
+            end
+        end
+    end
+
+    return bestTriangle and best, bestTriangle
+end
+
+
+---@param func fun(): integer?
+---@return number time: Best of `RUNS`, in ms
+---@return integer? result
+local function measure(func)
+    local best, result = math.huge, nil
+
+    for i=1, RUNS do
+        collectgarbage()
+
+        local start = os.clock()
+        result = func()
+        best = math.min(best, os.clock() - start)
+    end
+
+    return best * 1000, result
+end
+
+
+local buildTime, tree = measure(function()
+    return TriangleBVH(TriangleBVH.Build(vertices, 12, indices, indexCount))
+end)
+
+print(("%d triangles: built in %.1f ms, %d nodes"):format(tree.triangleCount, buildTime, tree.nodeCount))
+
+
+local bruteForceTime, bruteForceHits = measure(function()
+    local count = 0
+
+    for i=0, BRUTE_FORCE_RAY_COUNT-1 do
+        local ray = rays[i]
+        local distance = bruteForceRaycast(ray.ox, ray.oy, ray.oz, ray.dx, ray.dy, ray.dz, math.huge)
+        local treeDistance = tree:raycast(ray.ox, ray.oy, ray.oz, ray.dx, ray.dy, ray.dz)
+
+        -- Rays through an edge can hit either triangle, so only the distances are compared
+        assert(distance == treeDistance, "The tree and the brute force disagree")
+        count = count + (distance and 1 or 0)
+    end
+
+    return count
+end)
+bruteForceTime = bruteForceTime / BRUTE_FORCE_RAY_COUNT * 1000
+
+print(("  %-32s %8.2f µs per ray  (%d/%d hits, same as the tree)"):format("brute force closest hit", bruteForceTime, bruteForceHits, BRUTE_FORCE_RAY_COUNT))
+
+
+---@param name string
+---@param queries ffi.cdata*
+---@param anyHit boolean
+local function run(name, queries, anyHit)
+    local singleTime, singleHits = measure(function()
+        local count = 0
+
+        for i=0, RAY_COUNT-1 do
+            local ray = queries[i]
+            local maxDistance = ray.maxDistance > 0 and ray.maxDistance or math.huge
+
+            if tree:raycast(ray.ox, ray.oy, ray.oz, ray.dx, ray.dy, ray.dz, maxDistance, anyHit) then
+                count = count + 1
+            end
+        end
+
+        return count
+    end)
+
+    local batchTime, batchHits = measure(function()
+        local count = 0
+        tree:raycastBatch(queries, hits, RAY_COUNT, anyHit)
+
+        for i=0, RAY_COUNT-1 do
+            count = count + (hits[i].triangle >= 0 and 1 or 0)
+        end
+
+        return count
+    end)
+
+    singleTime, batchTime = singleTime / RAY_COUNT * 1000, batchTime / RAY_COUNT * 1000
+
+    -- The brute force only finds closest hits, so any hit queries aren't compared with it
+    local speedup = anyHit and "" or (", %.0fx faster than brute force"):format(bruteForceTime / singleTime)
+
+    print(("  %-32s %8.2f µs per ray  (%d/%d hits%s)"):format(name, singleTime, singleHits, RAY_COUNT, speedup))
+    print(("  %-32s %8.2f µs per ray  (%d/%d hits)"):format(name.." (batch)", batchTime, batchHits, RAY_COUNT))
+end
+
+
+run("tree closest hit", rays, false)
+run("tree any hit (segments)", segments, true)
@@ -0,0 +1,92 @@
+-- Benchmark of a `VerletWorld` simulating a 250x200 cloth (50k particles, ~99.5k constraints).
+-- Doesn't need LÖVE, run it with LuaJIT from the folder that contains the engine:
+--     luajit engine/debug/benchmarks/verletCloth.lua
+--
+-- Prints the time per step with and without particle collisions, and the cost of reading
+-- every particle through `VerletBody` properties against the number accessors.
+
+local World   = require "engine.2D.verlet.verletWorld"
+local Body    = require "engine.2D.verlet.verletBody"
+local Vector2 = require "engine.math.vector2"
+
+local WIDTH, HEIGHT = 250, 200
+local SPACING = 4
+local STEPS = 30
+local READS = 10
+
+
+---@param collisions boolean
+---@return VerletWorld
+local function createCloth(collisions)
+    local world = World()
+    world.gravity = Vector2(0, 980)
+    world.particleCollisions = collisions
+
+    for y=0, HEIGHT-1 do
+        for x=0, WIDTH-1 do
+            local i = world:addParticle(x * SPACING, y * SPACING, 1, collisions and 1.5 or 0)
+
+            if y == 0 and x % 10 == 0 then
+                world:pin(i)
+            end
+            if x > 0 then
+                world:addConstraint(i-1, i, nil, 1, 3)
+            end
+            if y > 0 then
+                world:addConstraint(i-WIDTH, i, nil, 1, 3)
+            end
+        end
+    end
+
+    -- Slanted floor under the cloth
+    world:addSegment(0, HEIGHT * SPACING * 0.8, WIDTH * SPACING, HEIGHT * SPACING * 0.9)
+
+    return world
+end
+
+
+for _, collisions in ipairs({false, true}) do
+    local world = createCloth(collisions)
+    world:update(1/60)
+
+    local start = os.clock()
+    for i=1, STEPS do
+        world:step(1/60)
+    end
+    local elapsed = (os.clock() - start) / STEPS
+
+    print(("collisions %s: %d particles, %d constraints, %d substeps x %d iterations"):format(tostring(collisions), world.particleCount, world.constraintCount, world.substeps, world.iterations))
+    -- step doesn't reset the stats, they include the steps of the first update
+    local stats = world.stats
+    print(("  %.1f ms per step, %d particle contacts and %d pair tests per step"):format(elapsed * 1000, stats.particleContacts / stats.steps, stats.pairTests / stats.steps))
+end
+
+
+-- Handle access
+local world = World()
+local bodies = {}
+
+for i=1, WIDTH * HEIGHT do
+    bodies[i] = Body(world, Vector2(i % WIDTH, math.floor(i / WIDTH)), 1)
+end
+
+local sum = 0
+local start = os.clock()
+for n=1, READS do
+    for i=1, #bodies do
+        local position = bodies[i].position
+        sum = sum + position.x + position.y
+    end
+end
+local propertyTime = (os.clock() - start) / READS
+
+start = os.clock()
+for n=1, READS do
+    for i=1, #bodies do
+        local x, y = bodies[i]:getPosition()
+        sum = sum + x + y
+    end
+end
+local accessorTime = (os.clock() - start) / READS
+
+print(("reading %d body positions: %.2f ms with .position, %.2f ms with :getPosition()"):format(#bodies, propertyTime * 1000, accessorTime * 1000))
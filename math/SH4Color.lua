@@ -2,6 +2,7 @@ local Object = require "engine.3rdparty.classic.classic"
 local Vector3 = require "engine.math.vector3"
 local Vector2 = require "engine.math.vector2"
 local Utils   = require "engine.misc.utils"
+local SH9Color = require "engine.math.SH9Color"
 local sin, cos, sqrt = math.sin, math.cos, math.sqrt
 
 -- https://web.archive.org/web/20220127124628/https://orlandoaguilar.github.io/sh/spherical/harmonics/irradiance/map/2017/02/12/SphericalHarmonics.html
@@ -164,38 +165,7 @@ function SH.CreateFromCubeMap(cubeMapFaces)
 		}
 	end
 
-	local size = Vector2(cubeMapFaces[1]:getDimensions())
-    local weightSum = 0.0
-    local result = SH()
-
-	for y = 0, size.height-1 do
-		for x = 0, size.width-1 do
-			local uv = Vector2(x, y):add(0.5):divide(size):multiply(2):subtract(1)
-			local temp = 1.0 + uv.lengthSquared
-			local weight = 4.0 / (sqrt(temp) * temp)
-
-			for face = 1, 6 do
-                local sample = Vector3(cubeMapFaces[face]:getPixel(x, y))
-				local u, v = uv.u, -uv.v
-
-				local dir = (
-					face == 1 and Vector3( 1, v, u) or
-					face == 2 and Vector3(-1, v,-u) or
-					face == 3 and Vector3( u, 1, v) or
-					face == 4 and Vector3( u,-1,-v) or
-					face == 5 and Vector3( u, v,-1) or
-					face == 6 and Vector3(-u, v, 1)
-				)
-
-				local base = SH.ProjectDirection(dir:normalize()):multiply(sample * weight)
-				result:add(base)
-
-				weightSum = weightSum + weight
-			end
-		end
-	end
-
-    return result:multiply(4.0 * math.pi / weightSum)
+	return SH(unpack(SH9Color.ProjectCubeMap(cubeMapFaces, 4)))
 end
 
 return SH
\ No newline at end of file
@@ -2,6 +2,8 @@ local Object = require "engine.3rdparty.classic.classic"
 local Vector3 = require "engine.math.vector3"
 local Vector2 = require "engine.math.vector2"
 local Utils   = require "engine.misc.utils"
+local Job     = require "engine.misc.job"
+local ffi     = require "ffi"
 local sin, cos, sqrt = math.sin, math.cos, math.sqrt
 
 -- https://web.archive.org/web/20220127124628/https://orlandoaguilar.github.io/sh/spherical/harmonics/irradiance/map/2017/02/12/SphericalHarmonics.html
@@ -179,38 +181,47 @@ function SH.CreateFromCubeMap(cubeMapFaces)
 		}
 	end
 
-	local size = Vector2(cubeMapFaces[1]:getDimensions())
-    local weightSum = 0.0
-    local result = SH()
+	return SH(unpack(SH.ProjectCubeMap(cubeMapFaces, 9)))
+end
+
+
+--- Projects the faces of a cube map into the first `coefficientCount` spherical harmonics coefficients.
+--- The rows of the faces are split between the job threads.
+---@param cubeMapFaces love.ImageData[]
+---@param coefficientCount integer: 4 or 9
+---@return Vector3[]
+function SH.ProjectCubeMap(cubeMapFaces, coefficientCount)
+	local stride = coefficientCount * 3 + 1
+	local height = cubeMapFaces[1]:getHeight()
+	local chunkSize = math.max(math.ceil(height / ((Job.GetWorkerCount() + 1) * 4)), 1)
+	local sums = love.data.newByteData(math.ceil(height / chunkSize) * stride * ffi.sizeof("double"))
+
+	local data = {unpack(cubeMapFaces, 1, 6)}
+	data[7] = sums
 
-	for y = 0, size.height-1 do
-		for x = 0, size.width-1 do
-			local uv = Vector2(x, y):add(0.5):divide(size):multiply(2):subtract(1)
-			local temp = 1.0 + uv.lengthSquared
-			local weight = 4.0 / (sqrt(temp) * temp)
-
-			for face = 1, 6 do
-                local sample = Vector3(cubeMapFaces[face]:getPixel(x, y))
-				local u, v = uv.u, -uv.v
-
-				local dir = (
-					face == 1 and Vector3( 1, v, u) or
-					face == 2 and Vector3(-1, v,-u) or
-					face == 3 and Vector3( u, 1, v) or
-					face == 4 and Vector3( u,-1,-v) or
-					face == 5 and Vector3( u, v,-1) or
-					face == 6 and Vector3(-u, v, 1)
-				)
-
-				local base = SH.ProjectDirection(dir:normalize()):multiply(sample * weight)
-				result:add(base)
-
-				weightSum = weightSum + weight
-			end
+	local job = Job("engine.math._projectSHJob", height, data, {coefficients = coefficientCount}):schedule(chunkSize):wait()
+	local pointer = ffi.cast("const double*", sums:getFFIPointer())
+	local totals = {}
+
+	for i=0, stride-1 do
+		totals[i] = 0
+
+		for chunk=0, job.chunkCount-1 do
+			totals[i] = totals[i] + pointer[chunk * stride + i]
 		end
 	end
 
-    return result:multiply(4.0 * math.pi / weightSum)
+	sums:release()
+
+	local scale = 4.0 * math.pi / totals[stride-1]
+	local result = {}
+
+	for c=1, coefficientCount do
+		local o = (c-1) * 3
+		result[c] = Vector3(totals[o], totals[o+1], totals[o+2]):multiply(scale)
+	end
+
+	return result
 end
 
 return SH
\ No newline at end of file
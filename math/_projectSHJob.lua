@@ -0,0 +1,141 @@
+local ffi = require "ffi"
+local bit = require "bit"
+local band, rshift = bit.band, bit.rshift
+local sqrt, huge = math.sqrt, math.huge
+
+
+-- Unsigned float with a 5 bit exponent, as used by the rg11b10f format
+local function unpackSmallFloat(bits, mantissaBits)
+    local exponent = rshift(bits, mantissaBits)
+    local mantissa = band(bits, 2^mantissaBits - 1) / 2^mantissaBits
+
+    if exponent == 0 then
+        return mantissa * 2^-14
+    elseif exponent == 31 then
+        return mantissa == 0 and huge or 0
+    end
+
+    return (1 + mantissa) * 2^(exponent - 15)
+end
+
+local function unpackHalf(bits)
+    local value = unpackSmallFloat(band(bits, 0x7FFF), 10)
+    return band(bits, 0x8000) ~= 0 and -value or value
+end
+
+
+-- Reads a pixel as r, g, b. Common formats are read directly from memory
+---@param imageData love.ImageData
+---@return fun(x: integer, y: integer): number, number, number
+local function getPixelReader(imageData)
+    local format = imageData:getFormat()
+    local width = imageData:getWidth()
+    local pointer = imageData:getFFIPointer()
+
+    if format == "rgba8" then
+        local pixels = ffi.cast("const uint8_t*", pointer)
+
+        return function(x, y)
+            local i = (x + y * width) * 4
+            return pixels[i] / 255, pixels[i+1] / 255, pixels[i+2] / 255
+        end
+    elseif format == "rgba32f" then
+        local pixels = ffi.cast("const float*", pointer)
+
+        return function(x, y)
+            local i = (x + y * width) * 4
+            return pixels[i], pixels[i+1], pixels[i+2]
+        end
+    elseif format == "rgba16f" then
+        local pixels = ffi.cast("const uint16_t*", pointer)
+
+        return function(x, y)
+            local i = (x + y * width) * 4
+            return unpackHalf(pixels[i]), unpackHalf(pixels[i+1]), unpackHalf(pixels[i+2])
+        end
+    elseif format == "rg11b10f" then
+        local pixels = ffi.cast("const uint32_t*", pointer)
+
+        return function(x, y)
+            local value = pixels[x + y * width]
+            return unpackSmallFloat(band(value, 0x7FF), 6), unpackSmallFloat(band(rshift(value, 11), 0x7FF), 6), unpackSmallFloat(rshift(value, 22), 5)
+        end
+    end
+
+    return function(x, y)
+        local r, g, b = imageData:getPixel(x, y)
+        return r, g, b
+    end
+end
+
+
+-- Projects rows of the 6 faces of a cube map into spherical harmonics. Job data: the 6 faces (`ImageData`), then
+-- the output, where each chunk writes `args.coefficients * 3` sums (rgb of each coefficient) and the weight sum,
+-- as doubles. The chunks are added together by `SH9Color.ProjectCubeMap`
+---@type JobKernel
+return function(first, last, data, args, chunk)
+    local coefficients = args.coefficients
+    local stride = coefficients * 3 + 1
+    local out = ffi.cast("double*", data[7]:getFFIPointer()) + chunk * stride
+    local width, height = data[1]:getDimensions()
+    local readers = {}
+
+    for face=1, 6 do
+        readers[face] = getPixelReader(data[face])
+    end
+
+    for i=0, stride-1 do
+        out[i] = 0
+    end
+
+    local basis = {}
+
+    for y=first, last do
+        for x=0, width-1 do
+            local u = (x + 0.5) / width * 2 - 1
+            local v = -((y + 0.5) / height * 2 - 1)
+            local temp = 1 + u*u + v*v
+            local weight = 4 / (sqrt(temp) * temp)
+
+            for face=1, 6 do
+                local r, g, b = readers[face](x, y)
+                local dx, dy, dz
+
+                if     face == 1 then dx, dy, dz =  1, v, u
+                elseif face == 2 then dx, dy, dz = -1, v,-u
+                elseif face == 3 then dx, dy, dz =  u, 1, v
+                elseif face == 4 then dx, dy, dz =  u,-1,-v
+                elseif face == 5 then dx, dy, dz =  u, v,-1
+                else                  dx, dy, dz = -u, v, 1
+                end
+
+                local length = sqrt(dx*dx + dy*dy + dz*dz)
+                dx, dy, dz = dx / length, dy / length, dz / length
+
+                basis[1] = 0.282095
+                basis[2] = 0.488603 * dy
+                basis[3] = 0.488603 * dz
+                basis[4] = 0.488603 * dx
+
+                if coefficients > 4 then
+                    basis[5] = 1.092548 * dx * dy
+                    basis[6] = 1.092548 * dy * dz
+                    basis[7] = 0.315392 * (3 * dz * dz - 1)
+                    basis[8] = 1.092548 * dx * dz
+                    basis[9] = 0.546274 * (dx * dx - dy * dy)
+                end
+
+                for c=1, coefficients do
+                    local o = (c-1) * 3
+                    local w = basis[c] * weight
+
+                    out[o]   = out[o]   + r * w
+                    out[o+1] = out[o+1] + g * w
+                    out[o+2] = out[o+2] + b * w
+                end
+
+                out[stride-1] = out[stride-1] + weight
+            end
+        end
+    end
+end
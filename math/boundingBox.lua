@@ -1,5 +1,4 @@
 local CStruct = require "engine.misc.cstruct"
-local Matrix3 = require "engine.math.matrix3"
 local Vector3 = require "engine.math.vector3"
 local Inter3d = require "engine.math.intersection3d"
 
@@ -93,18 +92,33 @@ end
 ---@param mat Matrix4
 ---@return Vector3, Vector3
 function BoundingBox:getMinMaxTransformed(mat)
-    local trCenter = self.center:transform(mat)
+    return self:getMinMaxTransformedInto(mat, Vector3(), Vector3())
+end
+
 
+--- Same as `getMinMaxTransformed`, but stores the results in existing vectors instead of creating new ones
+---@param mat Matrix4
+---@param outMin Vector3
+---@param outMax Vector3
+---@return Vector3, Vector3
+function BoundingBox:getMinMaxTransformedInto(mat, outMin, outMax)
     local abs = math.abs
-    local absMat = Matrix3(
-        abs(mat.m11), abs(mat.m12), abs(mat.m13),
-        abs(mat.m21), abs(mat.m22), abs(mat.m23),
-        abs(mat.m31), abs(mat.m32), abs(mat.m33)
-    )
+    local min, max = self.min, self.max
+    local cx, cy, cz = (min.x + max.x) * 0.5, (min.y + max.y) * 0.5, (min.z + max.z) * 0.5
+    local ex, ey, ez = abs(max.x - min.x) * 0.5, abs(max.y - min.y) * 0.5, abs(max.z - min.z) * 0.5
+
+    local tcx = cx * mat.m11 + cy * mat.m21 + cz * mat.m31 + mat.m41
+    local tcy = cx * mat.m12 + cy * mat.m22 + cz * mat.m32 + mat.m42
+    local tcz = cx * mat.m13 + cy * mat.m23 + cz * mat.m33 + mat.m43
+
+    local tex = ex * abs(mat.m11) + ey * abs(mat.m21) + ez * abs(mat.m31)
+    local tey = ex * abs(mat.m12) + ey * abs(mat.m22) + ez * abs(mat.m32)
+    local tez = ex * abs(mat.m13) + ey * abs(mat.m23) + ez * abs(mat.m33)
 
-    local trSize = self.size:transform(absMat):multiply(0.5)
+    outMin.x, outMin.y, outMin.z = tcx - tex, tcy - tey, tcz - tez
+    outMax.x, outMax.y, outMax.z = tcx + tex, tcy + tey, tcz + tez
 
-    return trCenter - trSize, trCenter + trSize
+    return outMin, outMax
 end
 
 
@@ -0,0 +1,466 @@
+local Object = require "engine.3rdparty.classic.classic"
+local ffi    = require "ffi"
+local min, max, huge, floor = math.min, math.max, math.huge, math.floor
+
+
+ffi.cdef [[
+    typedef struct {
+        float minx, miny, minz;
+        float maxx, maxy, maxz;
+        int32_t first; // First child node (internal nodes) or first item (leaves)
+        int32_t count; // Number of items, 0 for internal nodes
+    } BVHNode;
+]]
+
+
+local MAX_LEAF_SIZE = 4
+
+
+---
+--- A bounding volume hierarchy of axis aligned boxes, stored in flat FFI arrays.
+---
+--- Items are referenced by their index (1-based) and their bounds are set with `setItemBounds`.
+--- The tree must be built with `build` after items are added or removed, and can be cheaply
+--- updated with `refit` when items only move (queries stay correct, but get slower if items
+--- move too far from where they were when the tree was built).
+---
+--- @class BoundingVolumeHierarchy: Object
+---
+--- @field public itemCount integer
+--- @field public nodeCount integer
+--- @field private _bounds ffi.cdata*: 6 floats per item (min xyz, max xyz)
+--- @field private _centers ffi.cdata*: 3 floats per item
+--- @field private _order ffi.cdata*: Item indices (0-based), sorted so every leaf references a contiguous range
+--- @field private _nodes ffi.cdata*
+--- @field private _capacity integer
+--- @field private _stack ffi.cdata*: Traversal stack
+--- @field private _collectStack ffi.cdata*: Traversal stack used when collecting whole subtrees
+---
+--- @overload fun(capacity: integer?): BoundingVolumeHierarchy
+local BVH = Object:extend("BoundingVolumeHierarchy")
+
+
+function BVH:new(capacity)
+    self.itemCount = 0
+    self.nodeCount = 0
+    self._capacity = 0
+
+    self:reserve(capacity or 64)
+end
+
+
+--- Makes sure the tree can store at least `capacity` items. Current item bounds are preserved.
+---@param capacity integer
+---@return self
+function BVH:reserve(capacity)
+    if capacity <= self._capacity then
+        return self
+    end
+
+    local bounds = ffi.new("float[?]", capacity * 6)
+    if self._bounds then
+        ffi.copy(bounds, self._bounds, ffi.sizeof("float") * self._capacity * 6)
+    end
+
+    self._bounds = bounds
+    self._centers = ffi.new("float[?]", capacity * 3)
+    self._order = ffi.new("int32_t[?]", capacity)
+    self._nodes = ffi.new("BVHNode[?]", capacity * 2)
+    self._stack = ffi.new("int32_t[?]", capacity * 2)
+    self._collectStack = ffi.new("int32_t[?]", capacity * 2)
+    self._capacity = capacity
+    self.nodeCount = 0
+
+    return self
+end
+
+
+--- Sets the number of items in the tree. Call `build` afterwards.
+---@param count integer
+---@return self
+function BVH:setItemCount(count)
+    if count > self._capacity then
+        self:reserve(max(count, self._capacity * 2))
+    end
+
+    self.itemCount = count
+    return self
+end
+
+
+---@param index integer: Item index (1-based)
+---@param minx number
+---@param miny number
+---@param minz number
+---@param maxx number
+---@param maxy number
+---@param maxz number
+function BVH:setItemBounds(index, minx, miny, minz, maxx, maxy, maxz)
+    local b = self._bounds
+    local i = (index-1) * 6
+
+    b[i], b[i+1], b[i+2], b[i+3], b[i+4], b[i+5] = minx, miny, minz, maxx, maxy, maxz
+end
+
+
+---@param index integer: Item index (1-based)
+---@return number minx, number miny, number minz, number maxx, number maxy, number maxz
+function BVH:getItemBounds(index)
+    local b = self._bounds
+    local i = (index-1) * 6
+
+    return b[i], b[i+1], b[i+2], b[i+3], b[i+4], b[i+5]
+end
+
+
+-- Recalculates the bounds of a node from its items
+local function fitLeaf(node, order, bounds)
+    local minx, miny, minz = huge, huge, huge
+    local maxx, maxy, maxz = -huge, -huge, -huge
+
+    for i=node.first, node.first + node.count - 1 do
+        local b = order[i] * 6
+        minx, miny, minz = min(minx, bounds[b]),   min(miny, bounds[b+1]), min(minz, bounds[b+2])
+        maxx, maxy, maxz = max(maxx, bounds[b+3]), max(maxy, bounds[b+4]), max(maxz, bounds[b+5])
+    end
+
+    node.minx, node.miny, node.minz = minx, miny, minz
+    node.maxx, node.maxy, node.maxz = maxx, maxy, maxz
+end
+
+
+-- Recalculates the bounds of an internal node from its children
+local function fitInternal(node, a, b)
+    node.minx, node.miny, node.minz = min(a.minx, b.minx), min(a.miny, b.miny), min(a.minz, b.minz)
+    node.maxx, node.maxy, node.maxz = max(a.maxx, b.maxx), max(a.maxy, b.maxy), max(a.maxz, b.maxz)
+end
+
+
+--- Builds the tree from scratch using the current item bounds
+---@return self
+function BVH:build()
+    local count = self.itemCount
+    local bounds, centers, order, nodes = self._bounds, self._centers, self._order, self._nodes
+
+    for i=0, count-1 do
+        local b = i * 6
+        centers[i*3]   = (bounds[b]   + bounds[b+3]) * 0.5
+        centers[i*3+1] = (bounds[b+1] + bounds[b+4]) * 0.5
+        centers[i*3+2] = (bounds[b+2] + bounds[b+5]) * 0.5
+        order[i] = i
+    end
+
+    self.nodeCount = 1
+    nodes[0].first = 0
+    nodes[0].count = count
+
+    if count == 0 then
+        fitLeaf(nodes[0], order, bounds)
+        return self
+    end
+
+    -- Nodes are split top-down, children are always stored after their parent
+    local stack, top = self._stack, 1
+    stack[0] = 0
+
+    while top > 0 do
+        top = top - 1
+        local node = nodes[stack[top]]
+        local first, itemCount = node.first, node.count
+
+        fitLeaf(node, order, bounds)
+
+        if itemCount > MAX_LEAF_SIZE then
+            -- Split at the middle of the largest axis of the item centers
+            local cminx, cminy, cminz = huge, huge, huge
+            local cmaxx, cmaxy, cmaxz = -huge, -huge, -huge
+
+            for i=first, first + itemCount - 1 do
+                local c = order[i] * 3
+                cminx, cminy, cminz = min(cminx, centers[c]), min(cminy, centers[c+1]), min(cminz, centers[c+2])
+                cmaxx, cmaxy, cmaxz = max(cmaxx, centers[c]), max(cmaxy, centers[c+1]), max(cmaxz, centers[c+2])
+            end
+
+            local axis, split = 0, (cminx + cmaxx) * 0.5
+            local extent = cmaxx - cminx
+
+            if cmaxy - cminy > extent then
+                axis, split, extent = 1, (cminy + cmaxy) * 0.5, cmaxy - cminy
+            end
+            if cmaxz - cminz > extent then
+                axis, split, extent = 2, (cminz + cmaxz) * 0.5, cmaxz - cminz
+            end
+
+            -- Partition items
+            local left, right = first, first + itemCount - 1
+
+            while left <= right do
+                if centers[order[left] * 3 + axis] < split then
+                    left = left + 1
+                else
+                    order[left], order[right] = order[right], order[left]
+                    right = right - 1
+                end
+            end
+
+            local leftCount = left - first
+
+            -- All centers are in the same place, split in half instead
+            if leftCount == 0 or leftCount == itemCount then
+                leftCount = floor(itemCount / 2)
+            end
+
+            local childIndex = self.nodeCount
+            local leftChild, rightChild = nodes[childIndex], nodes[childIndex+1]
+
+            leftChild.first, leftChild.count = first, leftCount
+            rightChild.first, rightChild.count = first + leftCount, itemCount - leftCount
+            node.first, node.count = childIndex, 0
+
+            self.nodeCount = self.nodeCount + 2
+            stack[top], stack[top+1] = childIndex, childIndex+1
+            top = top + 2
+        end
+    end
+
+    return self
+end
+
+
+--- Updates the node bounds using the current item bounds, without changing the tree structure
+---@return self
+function BVH:refit()
+    local nodes, order, bounds = self._nodes, self._order, self._bounds
+
+    -- Children are always stored after their parents, so a reverse loop processes them first
+    for i=self.nodeCount-1, 0, -1 do
+        local node = nodes[i]
+
+        if node.count > 0 or self.itemCount == 0 then
+            fitLeaf(node, order, bounds)
+        else
+            fitInternal(node, nodes[node.first], nodes[node.first+1])
+        end
+    end
+
+    return self
+end
+
+
+local planes = {}
+
+
+-- Appends all items under a node to `out`
+local function collectAll(self, nodeIndex, items, out, outCount)
+    local nodes, order = self._nodes, self._order
+    local stack, top = self._collectStack, 1
+    stack[0] = nodeIndex
+
+    while top > 0 do
+        top = top - 1
+        local node = nodes[stack[top]]
+
+        if node.count > 0 then
+            for i=node.first, node.first + node.count - 1 do
+                outCount = outCount + 1
+                out[outCount] = items and items[order[i]+1] or order[i]+1
+            end
+        else
+            stack[top], stack[top+1] = node.first, node.first+1
+            top = top + 2
+        end
+    end
+
+    return outCount
+end
+
+
+--- Finds all items that intersect a camera frustum
+---@param frustum CameraFrustum
+---@param items any[]?: If set, `out` receives `items[index]` instead of the item index
+---@param out any[]: Where to store the results
+---@param outCount integer?: Number of elements already in `out`. Defaults to 0
+---@return integer: The new number of elements in `out`
+function BVH:queryFrustum(frustum, items, out, outCount)
+    outCount = outCount or 0
+
+    if self.itemCount == 0 or self.nodeCount == 0 then
+        return outCount
+    end
+
+    local nodes, order, bounds = self._nodes, self._order, self._bounds
+    local stack, top = self._stack, 1
+    stack[0] = 0
+
+    planes[1], planes[2], planes[3] = frustum.topPlane, frustum.bottomPlane, frustum.leftPlane
+    planes[4], planes[5], planes[6] = frustum.rightPlane, frustum.farPlane, frustum.nearPlane
+
+    while top > 0 do
+        top = top - 1
+        local node = nodes[stack[top]]
+        local inside = true
+        local outside = false
+
+        for p=1, 6 do
+            local plane = planes[p]
+            local px, py, pz = plane.x, plane.y, plane.z
+
+            -- Farthest corner along the plane normal
+            local fx = px < 0 and node.minx or node.maxx
+            local fy = py < 0 and node.miny or node.maxy
+            local fz = pz < 0 and node.minz or node.maxz
+
+            if px*fx + py*fy + pz*fz + plane.w < 0 then
+                outside = true
+                break
+            end
+
+            -- Nearest corner along the plane normal
+            local nx = px < 0 and node.maxx or node.minx
+            local ny = py < 0 and node.maxy or node.miny
+            local nz = pz < 0 and node.maxz or node.minz
+
+            if px*nx + py*ny + pz*nz + plane.w < 0 then
+                inside = false
+            end
+        end
+
+        if not outside then
+            if inside then
+                outCount = collectAll(self, stack[top], items, out, outCount)
+            elseif node.count > 0 then
+                for i=node.first, node.first + node.count - 1 do
+                    local b = order[i] * 6
+                    local visible = true
+
+                    for p=1, 6 do
+                        local plane = planes[p]
+                        local fx = plane.x < 0 and bounds[b]   or bounds[b+3]
+                        local fy = plane.y < 0 and bounds[b+1] or bounds[b+4]
+                        local fz = plane.z < 0 and bounds[b+2] or bounds[b+5]
+
+                        if plane.x*fx + plane.y*fy + plane.z*fz + plane.w < 0 then
+                            visible = false
+                            break
+                        end
+                    end
+
+                    if visible then
+                        outCount = outCount + 1
+                        out[outCount] = items and items[order[i]+1] or order[i]+1
+                    end
+                end
+            else
+                stack[top], stack[top+1] = node.first, node.first+1
+                top = top + 2
+            end
+        end
+    end
+
+    return outCount
+end
+
+
+--- Finds all items whose bounds intersect a box
+---@param minx number
+---@param miny number
+---@param minz number
+---@param maxx number
+---@param maxy number
+---@param maxz number
+---@param items any[]?: If set, `out` receives `items[index]` instead of the item index
+---@param out any[]: Where to store the results
+---@param outCount integer?: Number of elements already in `out`. Defaults to 0
+---@return integer: The new number of elements in `out`
+function BVH:queryBox(minx, miny, minz, maxx, maxy, maxz, items, out, outCount)
+    outCount = outCount or 0
+
+    if self.itemCount == 0 or self.nodeCount == 0 then
+        return outCount
+    end
+
+    local nodes, order, bounds = self._nodes, self._order, self._bounds
+    local stack, top = self._stack, 1
+    stack[0] = 0
+
+    while top > 0 do
+        top = top - 1
+        local node = nodes[stack[top]]
+
+        if node.minx <= maxx and node.maxx >= minx and node.miny <= maxy and node.maxy >= miny and node.minz <= maxz and node.maxz >= minz then
+            if node.count > 0 then
+                for i=node.first, node.first + node.count - 1 do
+                    local b = order[i] * 6
+
+                    if bounds[b] <= maxx and bounds[b+3] >= minx and bounds[b+1] <= maxy and bounds[b+4] >= miny and bounds[b+2] <= maxz and bounds[b+5] >= minz then
+                        outCount = outCount + 1
+                        out[outCount] = items and items[order[i]+1] or order[i]+1
+                    end
+                end
+            else
+                stack[top], stack[top+1] = node.first, node.first+1
+                top = top + 2
+            end
+        end
+    end
+
+    return outCount
+end
+
+
+-- Squared distance between a point and a box
+local function distance2(x, y, z, minx, miny, minz, maxx, maxy, maxz)
+    local dx = max(minx - x, 0, x - maxx)
+    local dy = max(miny - y, 0, y - maxy)
+    local dz = max(minz - z, 0, z - maxz)
+    return dx*dx + dy*dy + dz*dz
+end
+
+
+--- Finds all items whose bounds intersect a sphere
+---@param x number
+---@param y number
+---@param z number
+---@param radius number
+---@param items any[]?: If set, `out` receives `items[index]` instead of the item index
+---@param out any[]: Where to store the results
+---@param outCount integer?: Number of elements already in `out`. Defaults to 0
+---@return integer: The new number of elements in `out`
+function BVH:querySphere(x, y, z, radius, items, out, outCount)
+    outCount = outCount or 0
+
+    if self.itemCount == 0 or self.nodeCount == 0 then
+        return outCount
+    end
+
+    local nodes, order, bounds = self._nodes, self._order, self._bounds
+    local stack, top = self._stack, 1
+    local radius2 = radius * radius
+    stack[0] = 0
+
+    while top > 0 do
+        top = top - 1
+        local node = nodes[stack[top]]
+
+        if distance2(x, y, z, node.minx, node.miny, node.minz, node.maxx, node.maxy, node.maxz) <= radius2 then
+            if node.count > 0 then
+                for i=node.first, node.first + node.count - 1 do
+                    local b = order[i] * 6
+
+                    if distance2(x, y, z, bounds[b], bounds[b+1], bounds[b+2], bounds[b+3], bounds[b+4], bounds[b+5]) <= radius2 then
+                        outCount = outCount + 1
+                        out[outCount] = items and items[order[i]+1] or order[i]+1
+                    end
+                end
+            else
+                stack[top], stack[top+1] = node.first, node.first+1
+                top = top + 2
+            end
+        end
+    end
+
+    return outCount
+end
+
+
+return BVH
@@ -1,8 +1,14 @@
-local Vector3 = require "engine.math.vector3"
+local Vector3     = require "engine.math.vector3"
+local Matrix4     = require "engine.math.matrix4"
+local TriangleBVH = require "engine.math.triangleBVH"
 local Inter3d = {}
 
 local double_epsilon = 1e-6
 
+-- Trees of plain meshes, built on their first query
+local meshTrees = setmetatable({}, {__mode = "k"}) ---@type table<love.Mesh, TriangleBVH>
+local inverseTransform = Matrix4()
+
 -----------
 -- Point --
 -----------
@@ -99,31 +105,73 @@ function Inter3d.ray_triangle(rayPos,rayDir,   p1,p2,p3)
 end
 
 
+-- Casts a ray against the triangle tree of a mesh, in the mesh local space
+---@param mesh love.Mesh|MeshPart
+---@return number? distance, integer? triangle
+local function raycastMesh(rayPos, rayDir, mesh, transform, maxDistance, anyHit)
+    local tree = mesh.getTriangleBVH and mesh:getTriangleBVH() or meshTrees[mesh]
+
+    if not tree then
+        tree = TriangleBVH.FromMesh(mesh)
+        meshTrees[mesh] = tree
+    end
+
+    local ox, oy, oz = rayPos.x, rayPos.y, rayPos.z
+    local dx, dy, dz = rayDir.x, rayDir.y, rayDir.z
+
+    -- Distances along the ray are the same in both spaces, since the direction isn't normalized
+    if transform then
+        local m = Matrix4.InvertInto(inverseTransform, transform)
+
+        ox, oy, oz =
+            ox*m.m11 + oy*m.m21 + oz*m.m31 + m.m41,
+            ox*m.m12 + oy*m.m22 + oz*m.m32 + m.m42,
+            ox*m.m13 + oy*m.m23 + oz*m.m33 + m.m43
+
+        dx, dy, dz =
+            dx*m.m11 + dy*m.m21 + dz*m.m31,
+            dx*m.m12 + dy*m.m22 + dz*m.m32,
+            dx*m.m13 + dy*m.m23 + dz*m.m33
+    end
+
+    local distance, triangle = tree:raycast(ox, oy, oz, dx, dy, dz, maxDistance, anyHit)
+    return distance, triangle
+end
+
+
+--- Finds the closest triangle of a mesh hit by a ray. The triangle tree of the mesh is built on the first query
+--- (or by the importer, for mesh parts of models loaded with `triangleBVH`).
+---@param rayPos Vector3
+---@param rayDir Vector3
+---@param mesh love.Mesh|MeshPart: Must be a triangle list
+---@param transform Matrix4?: World matrix of the mesh
+---@return boolean hit, Vector3 position, number? distance: In multiples of `rayDir` length, integer? triangle: 0-based
 function Inter3d.ray_mesh(rayPos,rayDir,   mesh,transform)
-    local indices = mesh:getVertexMap()
-    local min, max = mesh:getDrawRange()
-
-    for i = min or 1, max or #indices, 3 do
-        local p1 = Vector3(mesh:getVertex(indices[i]))
-        local p2 = Vector3(mesh:getVertex(indices[i+1]))
-        local p3 = Vector3(mesh:getVertex(indices[i+2]))
-
-        if transform then
-            p1:transform(transform)
-            p2:transform(transform)
-            p3:transform(transform)
-        end
-
-        local hit, pos = Inter3d.ray_triangle(rayPos, rayDir, p1, p2, p3)
-        if hit then
-            return true, pos
-        end
+    local distance, triangle = raycastMesh(rayPos, rayDir, mesh, transform, nil, false)
+
+    if distance then
+        return true, rayPos + rayDir * distance, distance, triangle
     end
 
     return false, Vector3(0)
 end
 
 
+-------------
+-- Segment --
+-------------
+--- Checks if any triangle of a mesh is between two points, e.g for line of sight checks
+---@param p1 Vector3
+---@param p2 Vector3
+---@param mesh love.Mesh|MeshPart: Must be a triangle list
+---@param transform Matrix4?: World matrix of the mesh
+---@return boolean
+function Inter3d.segment_mesh(p1,p2,   mesh,transform)
+    return raycastMesh(p1, p2 - p1, mesh, transform, 1, true) ~= nil
+end
+
+
+
 ----------
 -- AABB --
 ----------
@@ -800,4 +800,159 @@ function Matrix4.CreateTransformationMatrix(rotation, scale, translation)
     return matScale:multiply(matRot):multiply(matTranslation)
 end
 
-return Matrix4
+
+
+-------------------------------
+----- In-place operations -----
+-------------------------------
+-- These write the result into an existing matrix instead of creating a new one,
+-- `out` can safely be one of the operands. Useful together with `Matrix4.Temp` in hot code.
+
+
+--- Stores `m1 * m2` into `out`
+--- @param out Matrix4: Where to store the result
+--- @param m1 Matrix4: The left hand operand
+--- @param m2 Matrix4: The right hand operand
+--- @return Matrix4: `out`
+function Matrix4.MultiplyInto(out, m1, m2)
+    local a11, a12, a13, a14 = m1.m11, m1.m12, m1.m13, m1.m14
+    local a21, a22, a23, a24 = m1.m21, m1.m22, m1.m23, m1.m24
+    local a31, a32, a33, a34 = m1.m31, m1.m32, m1.m33, m1.m34
+    local a41, a42, a43, a44 = m1.m41, m1.m42, m1.m43, m1.m44
+    local b11, b12, b13, b14 = m2.m11, m2.m12, m2.m13, m2.m14
+    local b21, b22, b23, b24 = m2.m21, m2.m22, m2.m23, m2.m24
+    local b31, b32, b33, b34 = m2.m31, m2.m32, m2.m33, m2.m34
+    local b41, b42, b43, b44 = m2.m41, m2.m42, m2.m43, m2.m44
+
+    out.m11 = a11 * b11 + a12 * b21 + a13 * b31 + a14 * b41
+    out.m12 = a11 * b12 + a12 * b22 + a13 * b32 + a14 * b42
+    out.m13 = a11 * b13 + a12 * b23 + a13 * b33 + a14 * b43
+    out.m14 = a11 * b14 + a12 * b24 + a13 * b34 + a14 * b44
+    out.m21 = a21 * b11 + a22 * b21 + a23 * b31 + a24 * b41
+    out.m22 = a21 * b12 + a22 * b22 + a23 * b32 + a24 * b42
+    out.m23 = a21 * b13 + a22 * b23 + a23 * b33 + a24 * b43
+    out.m24 = a21 * b14 + a22 * b24 + a23 * b34 + a24 * b44
+    out.m31 = a31 * b11 + a32 * b21 + a33 * b31 + a34 * b41
+    out.m32 = a31 * b12 + a32 * b22 + a33 * b32 + a34 * b42
+    out.m33 = a31 * b13 + a32 * b23 + a33 * b33 + a34 * b43
+    out.m34 = a31 * b14 + a32 * b24 + a33 * b34 + a34 * b44
+    out.m41 = a41 * b11 + a42 * b21 + a43 * b31 + a44 * b41
+    out.m42 = a41 * b12 + a42 * b22 + a43 * b32 + a44 * b42
+    out.m43 = a41 * b13 + a42 * b23 + a43 * b33 + a44 * b43
+    out.m44 = a41 * b14 + a42 * b24 + a43 * b34 + a44 * b44
+
+    return out
+end
+
+
+-- Copies the fields one by one, since matrices are plain tables when the JIT is not available
+---@param out Matrix4
+---@param mat Matrix4
+local function copyInto(out, mat)
+    out.m11, out.m12, out.m13, out.m14 = mat.m11, mat.m12, mat.m13, mat.m14
+    out.m21, out.m22, out.m23, out.m24 = mat.m21, mat.m22, mat.m23, mat.m24
+    out.m31, out.m32, out.m33, out.m34 = mat.m31, mat.m32, mat.m33, mat.m34
+    out.m41, out.m42, out.m43, out.m44 = mat.m41, mat.m42, mat.m43, mat.m44
+end
+
+
+--- Stores the inverse of `mat` into `out`
+--- @param out Matrix4: Where to store the result
+--- @param mat Matrix4: The matrix to invert
+--- @return Matrix4: `out`
+function Matrix4.InvertInto(out, mat)
+    if out ~= mat then
+        copyInto(out, mat)
+    end
+    return out:invert()
+end
+
+
+--- Stores the transpose of `mat` into `out`
+--- @param out Matrix4: Where to store the result
+--- @param mat Matrix4: The matrix to transpose
+--- @return Matrix4: `out`
+function Matrix4.TransposeInto(out, mat)
+    if out ~= mat then
+        copyInto(out, mat)
+    end
+    return out:transpose()
+end
+
+
+--- Stores a matrix with rotation, scale and translation informations into `out`.
+--- Same as `Matrix4.CreateTransformationMatrix`, but without the intermediate matrices.
+--- @param out Matrix4: Where to store the result
+--- @param rotation Quaternion: The rotation factor
+--- @param scale Vector3: The scaling factor
+--- @param translation Vector3: The translation coordinates
+--- @return Matrix4: `out`
+function Matrix4.CreateTransformationMatrixInto(out, rotation, scale, translation)
+    local xx, yy, zz = rotation.x * rotation.x, rotation.y * rotation.y, rotation.z * rotation.z
+    local xy, zw, zx = rotation.x * rotation.y, rotation.z * rotation.w, rotation.z * rotation.x
+    local yw, yz, xw = rotation.y * rotation.w, rotation.y * rotation.z, rotation.x * rotation.w
+    local sx, sy, sz = scale.x, scale.y, scale.z
+
+    out.m11, out.m12, out.m13, out.m14 = (1 - 2 * (yy + zz)) * sx, 2 * (xy + zw) * sx, 2 * (zx - yw) * sx, 0
+    out.m21, out.m22, out.m23, out.m24 = 2 * (xy - zw) * sy, (1 - 2 * (zz + xx)) * sy, 2 * (yz + xw) * sy, 0
+    out.m31, out.m32, out.m33, out.m34 = 2 * (zx + yw) * sz, 2 * (yz - xw) * sz, (1 - 2 * (yy + xx)) * sz, 0
+    out.m41, out.m42, out.m43, out.m44 = translation.x, translation.y, translation.z, 1
+
+    return out
+end
+
+
+--- Stores a view matrix looking at a specified direction into `out`.
+--- Same as `Matrix4.CreateLookAtDirection`, but without the intermediate vectors.
+--- @param out Matrix4: Where to store the result
+--- @param position Vector3: The view position
+--- @param direction Vector3: The view direction
+--- @param up Vector3: A vector pointing up from view's position
+--- @return Matrix4: `out`
+function Matrix4.CreateLookAtDirectionInto(out, position, direction, up)
+    local fx, fy, fz = -direction.x, -direction.y, -direction.z
+    local rx, ry, rz = up.y * fz - up.z * fy, up.z * fx - up.x * fz, up.x * fy - up.y * fx
+    local length = sqrt(rx * rx + ry * ry + rz * rz)
+    rx, ry, rz = rx / length, ry / length, rz / length
+    local ux, uy, uz = fy * rz - fz * ry, fz * rx - fx * rz, fx * ry - fy * rx
+    local px, py, pz = position.x, position.y, position.z
+
+    out.m11, out.m12, out.m13, out.m14 = rx, ux, fx, 0
+    out.m21, out.m22, out.m23, out.m24 = ry, uy, fy, 0
+    out.m31, out.m32, out.m33, out.m34 = rz, uz, fz, 0
+    out.m41, out.m42, out.m43, out.m44 = -(rx * px + ry * py + rz * pz), -(ux * px + uy * py + uz * pz), -(fx * px + fy * py + fz * pz), 1
+
+    return out
+end
+
+
+local rotationMatrix = Matrix4()
+
+--- Same as `Matrix4:decompose`, but stores the results in existing objects
+--- @param mat Matrix4: The matrix to decompose
+--- @param outTranslation Vector3: Where to store the translation
+--- @param outScale Vector3: Where to store the scale
+--- @param outRotation Quaternion: Where to store the rotation
+--- @return Vector3, Vector3, Quaternion
+function Matrix4.DecomposeInto(mat, outTranslation, outScale, outRotation)
+    local xs = (mat.m11 * mat.m12 * mat.m13 * mat.m14 < 0) and -1 or 1
+    local ys = (mat.m21 * mat.m22 * mat.m23 * mat.m24 < 0) and -1 or 1
+    local zs = (mat.m31 * mat.m32 * mat.m33 * mat.m34 < 0) and -1 or 1
+    local sx = xs * sqrt(mat.m11 * mat.m11 + mat.m12 * mat.m12 + mat.m13 * mat.m13)
+    local sy = ys * sqrt(mat.m21 * mat.m21 + mat.m22 * mat.m22 + mat.m23 * mat.m23)
+    local sz = zs * sqrt(mat.m31 * mat.m31 + mat.m32 * mat.m32 + mat.m33 * mat.m33)
+    local r = rotationMatrix
+
+    r.m11, r.m12, r.m13 = mat.m11 / sx, mat.m12 / sx, mat.m13 / sx
+    r.m21, r.m22, r.m23 = mat.m21 / sy, mat.m22 / sy, mat.m23 / sy
+    r.m31, r.m32, r.m33 = mat.m31 / sz, mat.m32 / sz, mat.m33 / sz
+
+    outTranslation.x, outTranslation.y, outTranslation.z = mat.m41, mat.m42, mat.m43
+    outScale.x, outScale.y, outScale.z = sx, sy, sz
+    Quaternion.CreateFromRotationMatrixInto(outRotation, r)
+
+    return outTranslation, outScale, outRotation
+end
+
+
+return Matrix4
\ No newline at end of file
@@ -0,0 +1,105 @@
+local StructArray = require "engine.math.structArray"
+local Matrix4     = require "engine.math.matrix4"
+
+
+---
+--- A packed array of `Matrix4` with batched operations. All operations work in place or
+--- write to an `out` array, none of them create new objects per element.
+---
+--- @class Matrix4Array: StructArray
+---
+--- @overload fun(capacity: integer, byteData: love.ByteData?): Matrix4Array
+local Matrix4Array = StructArray:extend("Matrix4Array")
+
+
+function Matrix4Array:new(capacity, byteData)
+    StructArray.new(self, Matrix4, capacity, byteData)
+end
+
+
+-- Makes sure `out` can hold as many elements as `src`
+local function prepareOutput(src, out)
+    out = out or src
+
+    if out ~= src then
+        out:reserve(src.length)
+        out.length = src.length
+    end
+
+    return out
+end
+
+
+local multiplyInto = Matrix4.MultiplyInto
+
+
+--- Multiplies every matrix of this array by `mat` (`self[i] * mat`)
+--- @param mat Matrix4: The right hand operand
+--- @param out Matrix4Array?: Where to store the results. Defaults to this array
+--- @return Matrix4Array: The output array
+function Matrix4Array:multiply(mat, out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+
+    for i=0, self.length-1 do
+        multiplyInto(dst[i], src[i], mat)
+    end
+
+    return out
+end
+
+
+--- Multiplies `mat` by every matrix of this array (`mat * self[i]`)
+--- @param mat Matrix4: The left hand operand
+--- @param out Matrix4Array?: Where to store the results. Defaults to this array
+--- @return Matrix4Array: The output array
+function Matrix4Array:premultiply(mat, out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+
+    for i=0, self.length-1 do
+        multiplyInto(dst[i], mat, src[i])
+    end
+
+    return out
+end
+
+
+--- Sets all matrices of this array to identity
+--- @return self
+function Matrix4Array:setIdentity()
+    local dst = self.data
+
+    for i=0, self.length-1 do
+        local m = dst[i]
+        m.m11, m.m12, m.m13, m.m14 = 1, 0, 0, 0
+        m.m21, m.m22, m.m23, m.m24 = 0, 1, 0, 0
+        m.m31, m.m32, m.m33, m.m34 = 0, 0, 1, 0
+        m.m41, m.m42, m.m43, m.m44 = 0, 0, 0, 1
+    end
+
+    return self
+end
+
+
+--- Multiplies each element of two arrays (`m1[i] * m2[i]`)
+--- @param m1 Matrix4Array: The left hand operands
+--- @param m2 Matrix4Array: The right hand operands
+--- @param out Matrix4Array: Where to store the results. Can be one of the inputs
+--- @return Matrix4Array: The output array
+function Matrix4Array.Multiply(m1, m2, out)
+    out = prepareOutput(m1, out)
+
+    local a, b, dst = m1.data, m2.data, out.data
+
+    for i=0, m1.length-1 do
+        multiplyInto(dst[i], a[i], b[i])
+    end
+
+    return out
+end
+
+
+return Matrix4Array
@@ -362,44 +362,7 @@ end
 --- @param mat Matrix4|Matrix3: The rotation matrix
 --- @return Quaternion: Result
 function Quaternion.CreateFromRotationMatrix(mat)
-    local scale = mat.m11 + mat.m22 + mat.m33;
-	local quat = Quaternion()
-
-	if scale > 0 then
-        local scaleSqrt = sqrt(scale + 1);
-        local half = 0.5 / scaleSqrt;
-
-		quat.x = (mat.m23 - mat.m32) * half
-	    quat.y = (mat.m31 - mat.m13) * half
-	    quat.z = (mat.m12 - mat.m21) * half
-	    quat.w = scaleSqrt * 0.5
-	elseif (mat.m11 >= mat.m22) and (mat.m11 >= mat.m33) then
-		local scaleSqrt = sqrt(1 + mat.m11 - mat.m22 - mat.m33);
-		local half = 0.5 / scaleSqrt;
-
-		quat.x = 0.5 * scaleSqrt
-		quat.y = (mat.m12 + mat.m21) * half
-	    quat.z = (mat.m13 + mat.m31) * half
-		quat.w = (mat.m23 - mat.m32) * half
-	elseif mat.m22 > mat.m33 then
-		local scaleSqrt = sqrt(1 + mat.m22 - mat.m11 - mat.m33);
-		local half = 0.5 / scaleSqrt;
-
-		quat.x = (mat.m21 + mat.m12) * half
-		quat.y = 0.5 * scaleSqrt
-	    quat.z = (mat.m32 + mat.m23) * half
-		quat.w = (mat.m31 - mat.m13) * half
-	else
-		local scaleSqrt = sqrt(1 + mat.m33 - mat.m11 - mat.m22);
-		local half = 0.5 / scaleSqrt;
-
-		quat.x = (mat.m31 + mat.m13) * half
-		quat.y = (mat.m32 + mat.m23) * half
-		quat.z = 0.5 * scaleSqrt
-		quat.w = (mat.m12 - mat.m21) * half
-	end
-
-	return quat
+	return Quaternion.CreateFromRotationMatrixInto(Quaternion(), mat)
 end
 
 
@@ -471,4 +434,162 @@ function Quaternion.CreateDualQuaternionTranslation(rotation, pos)
 end
 
 
+
+-------------------------------
+----- In-place operations -----
+-------------------------------
+-- These write the result into an existing quaternion instead of creating a new one,
+-- `out` can safely be one of the operands. Useful together with `Quaternion.Temp` in hot code.
+
+
+--- Stores `q1 * q2` into `out`
+--- @param out Quaternion: Where to store the result
+--- @param q1 Quaternion: The left hand operand
+--- @param q2 Quaternion: The right hand operand
+--- @return Quaternion: `out`
+function Quaternion.MultiplyInto(out, q1, q2)
+	local x, y, z, w = q1.x, q1.y, q1.z, q1.w
+	local vx = (y * q2.z) - (z * q2.y)
+	local vy = (z * q2.x) - (x * q2.z)
+	local vz = (x * q2.y) - (y * q2.x)
+	local vw = (x * q2.x) + (y * q2.y) + (z * q2.z)
+
+	out.x = (x * q2.w) + (q2.x * w) + vx
+	out.y = (y * q2.w) + (q2.y * w) + vy
+	out.z = (z * q2.w) + (q2.z * w) + vz
+	out.w = (w * q2.w) - vw
+
+	return out
+end
+
+
+--- Stores a normalized copy of `q` into `out`
+--- @param out Quaternion: Where to store the result
+--- @param q Quaternion: The quaternion to normalize
+--- @return Quaternion: `out`
+function Quaternion.NormalizeInto(out, q)
+	local inv = 1 / sqrt(q.x*q.x + q.y*q.y + q.z*q.z + q.w*q.w)
+	out.x, out.y, out.z, out.w = q.x * inv, q.y * inv, q.z * inv, q.w * inv
+	return out
+end
+
+
+--- Stores a normalized linear interpolation between two quaternions into `out`
+--- @param out Quaternion: Where to store the result
+--- @param q1 Quaternion: Initial value
+---	@param q2 Quaternion: Final value
+---	@param progress number: Interpolation progress (0-1)
+--- @return Quaternion: `out`
+function Quaternion.LerpInto(out, q1, q2, progress)
+	local invProgress = 1 - progress
+	local dir = (Quaternion.Dot(q1, q2) >= 0) and progress or -progress
+
+	out.x = (invProgress * q1.x) + (q2.x * dir)
+	out.y = (invProgress * q1.y) + (q2.y * dir)
+	out.z = (invProgress * q1.z) + (q2.z * dir)
+	out.w = (invProgress * q1.w) + (q2.w * dir)
+
+	return Quaternion.NormalizeInto(out, out)
+end
+
+
+--- Stores a spherical interpolation between two quaternions into `out`
+--- @param out Quaternion: Where to store the result
+--- @param q1 Quaternion: Initial value
+---	@param q2 Quaternion: Final value
+---	@param amount number: Interpolation progress (0-1)
+--- @return Quaternion: `out`
+function Quaternion.SlerpInto(out, q1, q2, amount)
+	local progress = 0
+	local invProgress = 0
+	local cosTheta = Quaternion.Dot(q1, q2)
+	local sign = 1
+
+	if cosTheta < 0 then
+		sign = -1
+		cosTheta = -cosTheta
+	end
+
+	if cosTheta > 0.999999 then
+		invProgress = 1 - amount
+		progress = amount * sign
+	else
+		local angle = acos(cosTheta)
+		local invSin = 1 / sin(angle)
+
+		invProgress = sin((1 - amount) * angle) * invSin
+		progress = sin(amount * angle) * invSin * sign
+	end
+
+	local x = (invProgress * q1.x) + (progress * q2.x)
+	local y = (invProgress * q1.y) + (progress * q2.y)
+	local z = (invProgress * q1.z) + (progress * q2.z)
+	local w = (invProgress * q1.w) + (progress * q2.w)
+
+	out.x, out.y, out.z, out.w = x, y, z, w
+	return out
+end
+
+
+--- Same as `Quaternion.CreateFromRotationMatrix`, but stores the result into `out`
+--- @param out Quaternion: Where to store the result
+--- @param mat Matrix4|Matrix3: The rotation matrix
+--- @return Quaternion: `out`
+function Quaternion.CreateFromRotationMatrixInto(out, mat)
+    local scale = mat.m11 + mat.m22 + mat.m33;
+
+	if scale > 0 then
+        local scaleSqrt = sqrt(scale + 1);
+        local half = 0.5 / scaleSqrt;
+
+		out.x = (mat.m23 - mat.m32) * half
+	    out.y = (mat.m31 - mat.m13) * half
+	    out.z = (mat.m12 - mat.m21) * half
+	    out.w = scaleSqrt * 0.5
+	elseif (mat.m11 >= mat.m22) and (mat.m11 >= mat.m33) then
+		local scaleSqrt = sqrt(1 + mat.m11 - mat.m22 - mat.m33);
+		local half = 0.5 / scaleSqrt;
+
+		out.x = 0.5 * scaleSqrt
+		out.y = (mat.m12 + mat.m21) * half
+	    out.z = (mat.m13 + mat.m31) * half
+		out.w = (mat.m23 - mat.m32) * half
+	elseif mat.m22 > mat.m33 then
+		local scaleSqrt = sqrt(1 + mat.m22 - mat.m11 - mat.m33);
+		local half = 0.5 / scaleSqrt;
+
+		out.x = (mat.m21 + mat.m12) * half
+		out.y = 0.5 * scaleSqrt
+	    out.z = (mat.m32 + mat.m23) * half
+		out.w = (mat.m31 - mat.m13) * half
+	else
+		local scaleSqrt = sqrt(1 + mat.m33 - mat.m11 - mat.m22);
+		local half = 0.5 / scaleSqrt;
+
+		out.x = (mat.m31 + mat.m13) * half
+		out.y = (mat.m32 + mat.m23) * half
+		out.z = 0.5 * scaleSqrt
+		out.w = (mat.m12 - mat.m21) * half
+	end
+
+	return out
+end
+
+
+--- Stores the dual part of a dual quaternion with the given rotation and translation into `out`
+--- @param out Quaternion: Where to store the result
+--- @param rotation Quaternion: The rotation (real part)
+--- @param pos Vector3: The translation
+--- @return Quaternion: `out`
+function Quaternion.CreateDualQuaternionTranslationInto(out, rotation, pos)
+	local x = 0.5*( pos.x * rotation.w + pos.y * rotation.z - pos.z * rotation.y)
+	local y = 0.5*(-pos.x * rotation.z + pos.y * rotation.w + pos.z * rotation.x)
+	local z = 0.5*( pos.x * rotation.y - pos.y * rotation.x + pos.z * rotation.w)
+	local w = -0.5*( pos.x * rotation.x + pos.y * rotation.y + pos.z * rotation.z)
+
+	out.x, out.y, out.z, out.w = x, y, z, w
+	return out
+end
+
+
 return Quaternion
\ No newline at end of file
@@ -0,0 +1,160 @@
+local StructArray = require "engine.math.structArray"
+local Quaternion  = require "engine.math.quaternion"
+local sin, acos, sqrt = math.sin, math.acos, math.sqrt
+
+
+---
+--- A packed array of `Quaternion` with batched operations. All operations work in place or
+--- write to an `out` array, none of them create new objects per element.
+---
+--- @class QuaternionArray: StructArray
+---
+--- @overload fun(capacity: integer, byteData: love.ByteData?): QuaternionArray
+local QuaternionArray = StructArray:extend("QuaternionArray")
+
+
+function QuaternionArray:new(capacity, byteData)
+    StructArray.new(self, Quaternion, capacity, byteData)
+end
+
+
+-- Makes sure `out` can hold as many elements as `src`
+local function prepareOutput(src, out)
+    out = out or src
+
+    if out ~= src then
+        out:reserve(src.length)
+        out.length = src.length
+    end
+
+    return out
+end
+
+
+--- Make all quaternions have a magnitude of 1
+--- @param out QuaternionArray?: Where to store the results. Defaults to this array
+--- @return QuaternionArray: The output array
+function QuaternionArray:normalize(out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+
+    for i=0, self.length-1 do
+        local x, y, z, w = src[i].x, src[i].y, src[i].z, src[i].w
+        local len = sqrt(x*x + y*y + z*z + w*w)
+        local inv = len > 0 and 1 / len or 1
+
+        dst[i].x = x * inv
+        dst[i].y = y * inv
+        dst[i].z = z * inv
+        dst[i].w = w * inv
+    end
+
+    return out
+end
+
+
+--- Multiplies every quaternion of this array by `quat` (`self[i] * quat`)
+--- @param quat Quaternion: The right hand operand
+--- @param out QuaternionArray?: Where to store the results. Defaults to this array
+--- @return QuaternionArray: The output array
+function QuaternionArray:multiply(quat, out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+    local ox, oy, oz, ow = quat.x, quat.y, quat.z, quat.w
+
+    for i=0, self.length-1 do
+        local x, y, z, w = src[i].x, src[i].y, src[i].z, src[i].w
+        local vx = (y * oz) - (z * oy)
+        local vy = (z * ox) - (x * oz)
+        local vz = (x * oy) - (y * ox)
+        local vw = (x * ox) + (y * oy) + (z * oz)
+
+        dst[i].x = (x * ow) + (ox * w) + vx
+        dst[i].y = (y * ow) + (oy * w) + vy
+        dst[i].z = (z * ow) + (oz * w) + vz
+        dst[i].w = (w * ow) - vw
+    end
+
+    return out
+end
+
+
+--- Peforms a normalized linear interpolation between each element of two arrays.
+--- Cheaper than `Slerp` and good enough for small angles (e.g. between animation keys).
+--- @param q1 QuaternionArray: Initial values
+--- @param q2 QuaternionArray: Final values
+--- @param t number: Interpolation progress (0-1)
+--- @param out QuaternionArray: Where to store the results. Can be one of the inputs
+--- @return QuaternionArray: The output array
+function QuaternionArray.Lerp(q1, q2, t, out)
+    out = prepareOutput(q1, out)
+
+    local a, b, dst = q1.data, q2.data, out.data
+    local invT = 1 - t
+
+    for i=0, q1.length-1 do
+        local ax, ay, az, aw = a[i].x, a[i].y, a[i].z, a[i].w
+        local bx, by, bz, bw = b[i].x, b[i].y, b[i].z, b[i].w
+        local dir = (ax*bx + ay*by + az*bz + aw*bw) >= 0 and t or -t
+
+        local x = ax * invT + bx * dir
+        local y = ay * invT + by * dir
+        local z = az * invT + bz * dir
+        local w = aw * invT + bw * dir
+        local inv = 1 / sqrt(x*x + y*y + z*z + w*w)
+
+        dst[i].x, dst[i].y, dst[i].z, dst[i].w = x * inv, y * inv, z * inv, w * inv
+    end
+
+    return out
+end
+
+
+--- Peforms a spherical interpolation between each element of two arrays
+--- @param q1 QuaternionArray: Initial values
+--- @param q2 QuaternionArray: Final values
+--- @param t number: Interpolation progress (0-1)
+--- @param out QuaternionArray: Where to store the results. Can be one of the inputs
+--- @return QuaternionArray: The output array
+function QuaternionArray.Slerp(q1, q2, t, out)
+    out = prepareOutput(q1, out)
+
+    local a, b, dst = q1.data, q2.data, out.data
+
+    for i=0, q1.length-1 do
+        local ax, ay, az, aw = a[i].x, a[i].y, a[i].z, a[i].w
+        local bx, by, bz, bw = b[i].x, b[i].y, b[i].z, b[i].w
+        local cosTheta = ax*bx + ay*by + az*bz + aw*bw
+        local sign = 1
+
+        if cosTheta < 0 then
+            sign = -1
+            cosTheta = -cosTheta
+        end
+
+        local invProgress, progress
+
+        if cosTheta > 0.999999 then
+            invProgress = 1 - t
+            progress = t * sign
+        else
+            local angle = acos(cosTheta)
+            local invSin = 1 / sin(angle)
+
+            invProgress = sin((1 - t) * angle) * invSin
+            progress = sin(t * angle) * invSin * sign
+        end
+
+        dst[i].x = invProgress * ax + progress * bx
+        dst[i].y = invProgress * ay + progress * by
+        dst[i].z = invProgress * az + progress * bz
+        dst[i].w = invProgress * aw + progress * bw
+    end
+
+    return out
+end
+
+
+return QuaternionArray
@@ -0,0 +1,186 @@
+local Object = require "engine.3rdparty.classic.classic"
+local ffi    = require "ffi"
+
+
+---
+--- A contiguous, fixed type array of C structs (e.g. `Vector3`, `Matrix4`).
+--- Elements are stored tightly packed in a single FFI buffer, so they can be processed
+--- in bulk without creating new objects and sent to shaders/meshes as raw memory.
+---
+--- Indices are 1-based like regular Lua tables, but `data` is a raw 0-based pointer
+--- that can be used directly in hot loops.
+---
+--- @class StructArray: Object
+---
+--- @field public struct CStruct: The type of the elements of this array
+--- @field public length integer: Number of elements in use
+--- @field public capacity integer: Number of elements that can be stored without reallocation
+--- @field public data ffi.cdata*: Pointer to the first element (0-based)
+--- @field private _storage ffi.cdata*|love.ByteData: Keeps the buffer memory alive
+---
+--- @overload fun(struct: CStruct, capacity: integer, byteData: love.ByteData?): StructArray
+local StructArray = Object:extend("StructArray")
+
+
+function StructArray:new(struct, capacity, byteData)
+    self.struct = struct
+    self.length = 0
+    self.capacity = 0
+
+    self:_allocate(capacity, byteData)
+end
+
+
+---@private
+---@param capacity integer
+---@param byteData love.ByteData?
+function StructArray:_allocate(capacity, byteData)
+    local oldData, oldLength = self.data, self.length
+    local ptrType = self.struct.typename.."*"
+
+    if byteData then
+        assert(byteData:getSize() >= ffi.sizeof(self.struct.typename) * capacity, "ByteData is too small for the requested capacity")
+
+        self._storage = byteData
+        self.data = ffi.cast(ptrType, byteData:getFFIPointer())
+    else
+        self._storage = ffi.new(self.struct.typename.."[?]", math.max(capacity, 1))
+        self.data = ffi.cast(ptrType, self._storage)
+    end
+
+    if oldData and oldLength > 0 then
+        ffi.copy(self.data, oldData, ffi.sizeof(self.struct.typename) * math.min(oldLength, capacity))
+    end
+
+    self.capacity = capacity
+end
+
+
+--- Gets a reference to the element at the specified index. Changing the returned
+--- value also changes the element inside the array.
+--- @param index integer
+--- @return CStruct
+function StructArray:get(index)
+    return self.data[index-1]
+end
+
+
+--- Sets the value of the element at the specified index
+--- @param index integer
+--- @param value CStruct
+--- @return self
+function StructArray:set(index, value)
+    self.data[index-1] = value
+    return self
+end
+
+
+--- Appends an element to the end of the array, growing it if necessary
+--- @param value CStruct
+--- @return integer: The index of the new element
+function StructArray:push(value)
+    if self.length >= self.capacity then
+        self:reserve(math.max(self.capacity * 2, 8))
+    end
+
+    self.data[self.length] = value
+    self.length = self.length + 1
+
+    return self.length
+end
+
+
+--- Ensures the array can hold at least `capacity` elements. Data already stored is preserved.
+--- @param capacity integer
+--- @return self
+function StructArray:reserve(capacity)
+    if capacity > self.capacity then
+        assert(not self:isByteDataBacked(), "Can't grow an array backed by external ByteData")
+        self:_allocate(capacity)
+    end
+
+    return self
+end
+
+
+--- Changes the number of elements in use. New elements are zero-filled.
+--- @param length integer
+--- @return self
+function StructArray:resize(length)
+    self:reserve(length)
+
+    if length > self.length then
+        local size = ffi.sizeof(self.struct.typename)
+        ffi.fill(self.data + self.length, size * (length - self.length))
+    end
+
+    self.length = length
+    return self
+end
+
+
+--- Removes all elements without releasing memory
+--- @return self
+function StructArray:clear()
+    self.length = 0
+    return self
+end
+
+
+--- Copies the contents of another array of the same type into this one
+--- @param other StructArray
+--- @return self
+function StructArray:copyFrom(other)
+    assert(other.struct == self.struct, "Array types don't match")
+
+    self:reserve(other.length)
+    ffi.copy(self.data, other.data, other:getDataSize())
+    self.length = other.length
+
+    return self
+end
+
+
+--- @return boolean
+function StructArray:isByteDataBacked()
+    return type(self._storage) == "userdata"
+end
+
+
+--- Gets the size in bytes of the elements in use
+--- @return integer
+function StructArray:getDataSize()
+    return ffi.sizeof(self.struct.typename) * self.length
+end
+
+
+--- Gets the underlying ByteData, if this array was created with one
+--- @return love.ByteData?
+function StructArray:getByteData()
+    return self:isByteDataBacked() and self._storage --[[@as love.ByteData]] or nil
+end
+
+
+local function iter(this, i)
+    i = i+1
+
+    if i <= this.length then
+        return i, this.data[i-1]
+    end
+end
+
+--- Loops through all elements of this array. Use this instead of `ipairs`
+---
+--- The loop signature should be:
+--- ```lua
+--- for index, element in this:iterate() do end
+--- ```
+--- @return function: Iterator
+--- @return StructArray: This array
+--- @return number: First index
+function StructArray:iterate()
+    return iter, self, 0
+end
+
+
+return StructArray
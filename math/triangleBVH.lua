@@ -0,0 +1,470 @@
+local Object = require "engine.3rdparty.classic.classic"
+local ffi    = require "ffi"
+local min, max, huge, floor = math.min, math.max, math.huge, math.floor
+
+require "love.data"
+require "engine.math.boundingVolumeHierarchy" -- For the BVHNode C type
+
+
+ffi.cdef [[
+    typedef struct {
+        float ox, oy, oz;  // Origin
+        float dx, dy, dz;  // Direction, doesn't need to be normalized
+        float maxDistance; // In multiples of the direction length
+    } BVHRay;
+
+    typedef struct {
+        float distance;
+        int32_t triangle; // Index of the triangle in the source index buffer, -1 if nothing was hit
+        float u, v;       // Barycentric coordinates of the hit
+    } BVHRayHit;
+]]
+
+
+local MAX_LEAF_SIZE = 8
+local BIN_COUNT = 12
+local EPSILON = 1e-9
+
+-- Relative cost of visiting a node compared to testing a triangle
+local TRAVERSAL_COST = 1
+
+
+--- @alias TriangleBVHData {triangleCount: integer, nodeCount: integer, nodes: love.ByteData, triangles: love.ByteData, ids: love.ByteData}
+
+
+---
+--- A bounding volume hierarchy of the triangles of a mesh, used for ray queries.
+---
+--- The tree is built top-down with the surface area heuristic (binned), and is immutable. Triangles are
+--- copied into the leaf order (9 floats each), so leaves read a contiguous block of memory.
+---
+--- Building is done by `TriangleBVH.Build`, which only creates `ByteData`, so it can run in the content
+--- loading threads and be stored in the model cache. Queries are done in the mesh local space.
+---
+--- @class TriangleBVH: Object
+---
+--- @field public triangleCount integer
+--- @field public nodeCount integer
+--- @field public nodes ffi.cdata*: `BVHNode*`, leaves reference ranges of `triangles`
+--- @field public triangles ffi.cdata*: 9 floats per triangle, sorted by leaf
+--- @field public ids ffi.cdata*: Index of each sorted triangle in the source index buffer
+--- @field private _data TriangleBVHData: Keeps the memory alive
+--- @field private _stack ffi.cdata*
+---
+--- @overload fun(data: TriangleBVHData): TriangleBVH
+local TriangleBVH = Object:extend("TriangleBVH")
+
+
+function TriangleBVH:new(data)
+    self.triangleCount = data.triangleCount
+    self.nodeCount = data.nodeCount
+    self.nodes = ffi.cast("BVHNode*", data.nodes:getFFIPointer())
+    self.triangles = ffi.cast("float*", data.triangles:getFFIPointer())
+    self.ids = ffi.cast("int32_t*", data.ids:getFFIPointer())
+
+    self._data = data
+    self._stack = ffi.new("int32_t[?]", self.nodeCount + 1)
+end
+
+
+
+local function surfaceArea(minx, miny, minz, maxx, maxy, maxz)
+    local x, y, z = maxx - minx, maxy - miny, maxz - minz
+    return x*y + y*z + z*x
+end
+
+
+--- Builds the tree of a triangle list
+---@param vertices ffi.cdata*: Vertex data, positions must be the first 3 floats of each vertex
+---@param vertexStride integer: Size of each vertex in bytes
+---@param indices ffi.cdata*: Triangle list, 0-based
+---@param indexCount integer
+---@return TriangleBVHData
+function TriangleBVH.Build(vertices, vertexStride, indices, indexCount)
+    local triangleCount = floor(indexCount / 3)
+    local vertexBytes = ffi.cast("const uint8_t*", vertices)
+
+    local bounds = ffi.new("float[?]", math.max(triangleCount, 1) * 6)
+    local centers = ffi.new("float[?]", math.max(triangleCount, 1) * 3)
+    local order = ffi.new("int32_t[?]", math.max(triangleCount, 1))
+    local stack = ffi.new("int32_t[?]", math.max(triangleCount, 1) * 2)
+
+    local nodeData = love.data.newByteData(math.max(triangleCount * 2, 1) * ffi.sizeof("BVHNode"))
+    local nodes = ffi.cast("BVHNode*", nodeData:getFFIPointer())
+
+    local binCounts = ffi.new("int32_t[?]", BIN_COUNT)
+    local binBounds = ffi.new("float[?]", BIN_COUNT * 6)
+    local rightAreas = ffi.new("double[?]", BIN_COUNT)
+
+    local positions = ffi.new("const float*[3]")
+
+    for t=0, triangleCount-1 do
+        for c=0, 2 do
+            positions[c] = ffi.cast("const float*", vertexBytes + indices[t*3+c] * vertexStride)
+        end
+
+        local p1, p2, p3 = positions[0], positions[1], positions[2]
+        local b = t*6
+
+        for a=0, 2 do
+            bounds[b+a] = min(p1[a], p2[a], p3[a])
+            bounds[b+a+3] = max(p1[a], p2[a], p3[a])
+            centers[t*3+a] = (bounds[b+a] + bounds[b+a+3]) * 0.5
+        end
+
+        order[t] = t
+    end
+
+    local nodeCount = 1
+    nodes[0].first, nodes[0].count = 0, triangleCount
+
+    local top = 1
+    stack[0] = 0
+
+    while top > 0 do
+        top = top - 1
+        local node = nodes[stack[top]]
+        local first, count = node.first, node.count
+
+        -- Node bounds and bounds of the triangle centers
+        local minx, miny, minz, maxx, maxy, maxz = huge, huge, huge, -huge, -huge, -huge
+        local cminx, cminy, cminz, cmaxx, cmaxy, cmaxz = huge, huge, huge, -huge, -huge, -huge
+
+        for i=first, first + count - 1 do
+            local b, c = order[i] * 6, order[i] * 3
+            minx, miny, minz = min(minx, bounds[b]),   min(miny, bounds[b+1]), min(minz, bounds[b+2])
+            maxx, maxy, maxz = max(maxx, bounds[b+3]), max(maxy, bounds[b+4]), max(maxz, bounds[b+5])
+            cminx, cminy, cminz = min(cminx, centers[c]), min(cminy, centers[c+1]), min(cminz, centers[c+2])
+            cmaxx, cmaxy, cmaxz = max(cmaxx, centers[c]), max(cmaxy, centers[c+1]), max(cmaxz, centers[c+2])
+        end
+
+        node.minx, node.miny, node.minz = minx, miny, minz
+        node.maxx, node.maxy, node.maxz = maxx, maxy, maxz
+
+        if count > 2 then
+            -- Find the cheapest split along the bins of each axis
+            local bestCost, bestAxis, bestBin = huge, -1, 0
+            local nodeArea = surfaceArea(minx, miny, minz, maxx, maxy, maxz)
+
+            for axis=0, 2 do
+                local cmin = axis == 0 and cminx or axis == 1 and cminy or cminz
+                local cmax = axis == 0 and cmaxx or axis == 1 and cmaxy or cmaxz
+
+                if cmax > cmin then
+                    local binScale = BIN_COUNT / (cmax - cmin)
+
+                    for k=0, BIN_COUNT-1 do
+                        binCounts[k] = 0
+                        binBounds[k*6], binBounds[k*6+1], binBounds[k*6+2] = huge, huge, huge
+                        binBounds[k*6+3], binBounds[k*6+4], binBounds[k*6+5] = -huge, -huge, -huge
+                    end
+
+                    for i=first, first + count - 1 do
+                        local tri = order[i]
+                        local bin = min(floor((centers[tri*3+axis] - cmin) * binScale), BIN_COUNT-1)
+                        local k, b = bin * 6, tri * 6
+
+                        binCounts[bin] = binCounts[bin] + 1
+                        for a=0, 2 do
+                            binBounds[k+a] = min(binBounds[k+a], bounds[b+a])
+                            binBounds[k+a+3] = max(binBounds[k+a+3], bounds[b+a+3])
+                        end
+                    end
+
+                    -- Sweep from the right to get the area of everything right of each split...
+                    local rminx, rminy, rminz, rmaxx, rmaxy, rmaxz = huge, huge, huge, -huge, -huge, -huge
+                    for k=BIN_COUNT-1, 1, -1 do
+                        local o = k*6
+                        if binCounts[k] > 0 then
+                            rminx, rminy, rminz = min(rminx, binBounds[o]),   min(rminy, binBounds[o+1]), min(rminz, binBounds[o+2])
+                            rmaxx, rmaxy, rmaxz = max(rmaxx, binBounds[o+3]), max(rmaxy, binBounds[o+4]), max(rmaxz, binBounds[o+5])
+                        end
+                        rightAreas[k] = rmaxx >= rminx and surfaceArea(rminx, rminy, rminz, rmaxx, rmaxy, rmaxz) or 0
+                    end
+
+                    -- ...then from the left to evaluate them
+                    local lminx, lminy, lminz, lmaxx, lmaxy, lmaxz = huge, huge, huge, -huge, -huge, -huge
+                    local leftCount = 0
+                    for k=0, BIN_COUNT-2 do
+                        local o = k*6
+                        if binCounts[k] > 0 then
+                            lminx, lminy, lminz = min(lminx, binBounds[o]),   min(lminy, binBounds[o+1]), min(lminz, binBounds[o+2])
+                            lmaxx, lmaxy, lmaxz = max(lmaxx, binBounds[o+3]), max(lmaxy, binBounds[o+4]), max(lmaxz, binBounds[o+5])
+                            leftCount = leftCount + binCounts[k]
+                        end
+
+                        local rightCount = count - leftCount
+                        if leftCount > 0 and rightCount > 0 then
+                            local cost = surfaceArea(lminx, lminy, lminz, lmaxx, lmaxy, lmaxz) * leftCount + rightAreas[k+1] * rightCount
+
+                            if cost < bestCost then
+                                bestCost, bestAxis, bestBin = cost, axis, k
+                            end
+                        end
+                    end
+                end
+            end
+
+            local splitCost = nodeArea > 0 and TRAVERSAL_COST + bestCost / nodeArea or huge
+            local leftCount = 0
+
+            if bestAxis >= 0 and (splitCost < count or count > MAX_LEAF_SIZE) then
+                local cmin = bestAxis == 0 and cminx or bestAxis == 1 and cminy or cminz
+                local cmax = bestAxis == 0 and cmaxx or bestAxis == 1 and cmaxy or cmaxz
+                local binScale = BIN_COUNT / (cmax - cmin)
+                local left, right = first, first + count - 1
+
+                while left <= right do
+                    local k = min(floor((centers[order[left]*3 + bestAxis] - cmin) * binScale), BIN_COUNT-1)
+
+                    if k <= bestBin then
+                        left = left + 1
+                    else
+                        order[left], order[right] = order[right], order[left]
+                        right = right - 1
+                    end
+                end
+
+                leftCount = left - first
+
+            elseif count > MAX_LEAF_SIZE then
+                -- All centers are in the same place
+                leftCount = floor(count / 2)
+            end
+
+            if leftCount > 0 and leftCount < count then
+                local left, right = nodes[nodeCount], nodes[nodeCount+1]
+
+                left.first, left.count = first, leftCount
+                right.first, right.count = first + leftCount, count - leftCount
+                node.first, node.count = nodeCount, 0
+
+                stack[top], stack[top+1] = nodeCount, nodeCount+1
+                top = top + 2
+                nodeCount = nodeCount + 2
+            end
+        end
+    end
+
+    -- Store the triangles in leaf order
+    local triangleData = love.data.newByteData(math.max(triangleCount, 1) * 9 * ffi.sizeof("float"))
+    local idData = love.data.newByteData(math.max(triangleCount, 1) * ffi.sizeof("int32_t"))
+    local triangles = ffi.cast("float*", triangleData:getFFIPointer())
+    local ids = ffi.cast("int32_t*", idData:getFFIPointer())
+
+    for i=0, triangleCount-1 do
+        local t = order[i]
+        ids[i] = t
+
+        for c=0, 2 do
+            local p = ffi.cast("const float*", vertexBytes + indices[t*3+c] * vertexStride)
+            triangles[i*9+c*3], triangles[i*9+c*3+1], triangles[i*9+c*3+2] = p[0], p[1], p[2]
+        end
+    end
+
+    return {
+        triangleCount = triangleCount,
+        nodeCount = nodeCount,
+        nodes = nodeData,
+        triangles = triangleData,
+        ids = idData,
+    }
+end
+
+
+--- Builds the tree of a `love.Mesh` with a triangle list. Reading vertices back from a mesh is slow,
+--- so prefer `TriangleBVH.Build` when the vertex data is still available.
+---@param mesh love.Mesh
+---@param quantization MeshPartQuantization?: Bounds of the positions, for meshes with the compact vertex layout
+---@return TriangleBVH
+function TriangleBVH.FromMesh(mesh, quantization)
+    local vertexMap = mesh:getVertexMap()
+    local start, count = mesh:getDrawRange()
+    local vertexCount = mesh:getVertexCount()
+
+    local positions = ffi.new("float[?]", math.max(vertexCount, 1) * 3)
+    for v=0, vertexCount-1 do
+        positions[v*3], positions[v*3+1], positions[v*3+2] = mesh:getVertexAttribute(v+1, 1)
+    end
+
+    -- Compact vertices store positions relative to the mesh bounds
+    if quantization then
+        local scale, offset = quantization.positionScale, quantization.positionOffset
+
+        for i=0, vertexCount*3-1 do
+            local axis = i % 3 + 1
+            positions[i] = positions[i] * scale[axis] + offset[axis]
+        end
+    end
+
+    start = start or 1
+    count = count or (vertexMap and #vertexMap or vertexCount)
+
+    local indices = ffi.new("int32_t[?]", math.max(count, 1))
+    for i=0, count-1 do
+        indices[i] = (vertexMap and vertexMap[start + i] or start + i) - 1
+    end
+
+    return TriangleBVH(TriangleBVH.Build(positions, 12, indices, count))
+end
+
+
+
+-- Distance where a ray enters a node, or `nil` if it misses
+local function intersectNode(node, ox, oy, oz, ix, iy, iz, maxDistance)
+    local t1, t2 = (node.minx - ox) * ix, (node.maxx - ox) * ix
+    local near, far = min(t1, t2), max(t1, t2)
+
+    t1, t2 = (node.miny - oy) * iy, (node.maxy - oy) * iy
+    near, far = max(near, min(t1, t2)), min(far, max(t1, t2))
+
+    t1, t2 = (node.minz - oz) * iz, (node.maxz - oz) * iz
+    near, far = max(near, min(t1, t2)), min(far, max(t1, t2))
+
+    if far >= max(near, 0) and near <= maxDistance then
+        return near
+    end
+    return nil
+end
+
+
+-- Möller–Trumbore intersection with the triangle starting at `tri[o]`
+local function intersectTriangle(tri, o, ox, oy, oz, dx, dy, dz)
+    local x1, y1, z1 = tri[o], tri[o+1], tri[o+2]
+    local e1x, e1y, e1z = tri[o+3] - x1, tri[o+4] - y1, tri[o+5] - z1
+    local e2x, e2y, e2z = tri[o+6] - x1, tri[o+7] - y1, tri[o+8] - z1
+
+    local hx, hy, hz = dy*e2z - dz*e2y, dz*e2x - dx*e2z, dx*e2y - dy*e2x
+    local a = e1x*hx + e1y*hy + e1z*hz
+
+    if a > -EPSILON and a < EPSILON then
+        return nil
+    end
+
+    local f = 1 / a
+    local sx, sy, sz = ox - x1, oy - y1, oz - z1
+    local u = f * (sx*hx + sy*hy + sz*hz)
+
+    if u < 0 or u > 1 then
+        return nil
+    end
+
+    local qx, qy, qz = sy*e1z - sz*e1y, sz*e1x - sx*e1z, sx*e1y - sy*e1x
+    local v = f * (dx*qx + dy*qy + dz*qz)
+
+    if v < 0 or u + v > 1 then
+        return nil
+    end
+
+    local t = f * (e2x*qx + e2y*qy + e2z*qz)
+    if t > EPSILON then
+        return t, u, v
+    end
+    return nil
+end
+
+
+-- Inverse of a direction component, without infinities
+local function inverse(d)
+    return 1 / (d ~= 0 and d or 1e-30)
+end
+
+
+
+--- Finds the closest triangle hit by a ray, in the mesh local space.
+--- With `anyHit`, returns as soon as any triangle is hit (e.g for line of sight checks).
+---@param ox number
+---@param oy number
+---@param oz number
+---@param dx number
+---@param dy number
+---@param dz number
+---@param maxDistance number?: In multiples of the direction length
+---@param anyHit boolean?
+---@return number? distance: In multiples of the direction length, `nil` if nothing was hit
+---@return integer? triangle: Index of the triangle in the source index buffer (0-based)
+---@return number? u: Barycentric coordinates of the hit
+---@return number? v
+function TriangleBVH:raycast(ox, oy, oz, dx, dy, dz, maxDistance, anyHit)
+    if self.triangleCount == 0 then
+        return nil
+    end
+
+    local nodes, triangles, stack = self.nodes, self.triangles, self._stack
+    local ix, iy, iz = inverse(dx), inverse(dy), inverse(dz)
+    local best, bestTriangle, bestU, bestV = maxDistance or huge, -1, 0, 0
+
+    if not intersectNode(nodes[0], ox, oy, oz, ix, iy, iz, best) then
+        return nil
+    end
+
+    local top = 1
+    stack[0] = 0
+
+    while top > 0 do
+        top = top - 1
+        local node = nodes[stack[top]]
+
+        if node.count > 0 then
+            for i=node.first, node.first + node.count - 1 do
+                local t, u, v = intersectTriangle(triangles, i*9, ox, oy, oz, dx, dy, dz)
+
+                if t and t < best then
+                    best, bestTriangle, bestU, bestV = t, i, u, v
+
+                    if anyHit then
+                        return best, self.ids[i], u, v
+                    end
+                end
+            end
+        else
+            -- Visit the nearest child first, so farther ones can be skipped
+            local leftIndex = node.first
+            local leftNear = intersectNode(nodes[leftIndex], ox, oy, oz, ix, iy, iz, best)
+            local rightNear = intersectNode(nodes[leftIndex+1], ox, oy, oz, ix, iy, iz, best)
+
+            if leftNear and rightNear then
+                if leftNear <= rightNear then
+                    stack[top], stack[top+1] = leftIndex+1, leftIndex
+                else
+                    stack[top], stack[top+1] = leftIndex, leftIndex+1
+                end
+                top = top + 2
+            elseif leftNear then
+                stack[top] = leftIndex
+                top = top + 1
+            elseif rightNear then
+                stack[top] = leftIndex+1
+                top = top + 1
+            end
+        end
+    end
+
+    if bestTriangle < 0 then
+        return nil
+    end
+    return best, self.ids[bestTriangle], bestU, bestV
+end
+
+
+
+--- Casts many rays at once, in the mesh local space
+---@param rays ffi.cdata*: `BVHRay*`, a `maxDistance` of 0 means no limit
+---@param hits ffi.cdata*: `BVHRayHit*` with room for `count` hits
+---@param count integer
+---@param anyHit boolean?: Stop each ray at its first hit, instead of the closest
+function TriangleBVH:raycastBatch(rays, hits, count, anyHit)
+    for r=0, count-1 do
+        local ray, hit = rays[r], hits[r]
+        local distance, triangle, u, v = self:raycast(ray.ox, ray.oy, ray.oz, ray.dx, ray.dy, ray.dz, ray.maxDistance > 0 and ray.maxDistance or huge, anyHit)
+
+        if distance then
+            hit.distance, hit.triangle, hit.u, hit.v = distance, triangle, u, v
+        else
+            hit.distance, hit.triangle, hit.u, hit.v = 0, -1, 0, 0
+        end
+    end
+end
+
+
+return TriangleBVH
@@ -433,4 +433,81 @@ function Vector2.Max(v1, v2)
     )
 end
 
+
+-------------------------------
+----- In-place operations -----
+-------------------------------
+-- These write the result into an existing vector instead of creating a new one,
+-- `out` can safely be one of the operands. Useful together with `Vector2.Temp` in hot code.
+
+
+--- Stores `v1 + v2` into `out`
+--- @param out Vector2: Where to store the result
+--- @param v1 Vector2: The left hand operand
+--- @param v2 Vector2 | number: The right hand operand
+--- @return Vector2: `out`
+function Vector2.AddInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y = v1.x + v2, v1.y + v2
+    else
+        out.x, out.y = v1.x + v2.x, v1.y + v2.y
+    end
+    return out
+end
+
+
+--- Stores `v1 - v2` into `out`
+--- @param out Vector2: Where to store the result
+--- @param v1 Vector2: The left hand operand
+--- @param v2 Vector2 | number: The right hand operand
+--- @return Vector2: `out`
+function Vector2.SubtractInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y = v1.x - v2, v1.y - v2
+    else
+        out.x, out.y = v1.x - v2.x, v1.y - v2.y
+    end
+    return out
+end
+
+
+--- Stores `v1 * v2` into `out`
+--- @param out Vector2: Where to store the result
+--- @param v1 Vector2: The left hand operand
+--- @param v2 Vector2 | number: The right hand operand
+--- @return Vector2: `out`
+function Vector2.MultiplyInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y = v1.x * v2, v1.y * v2
+    else
+        out.x, out.y = v1.x * v2.x, v1.y * v2.y
+    end
+    return out
+end
+
+
+--- Stores a normalized copy of `v` into `out`
+--- @param out Vector2: Where to store the result
+--- @param v Vector2: The vector to normalize
+--- @return Vector2: `out`
+function Vector2.NormalizeInto(out, v)
+    local inv = 1 / sqrt(v.x*v.x + v.y*v.y)
+    out.x, out.y = v.x * inv, v.y * inv
+    return out
+end
+
+
+--- Stores a linear interpolation between two vectors into `out`
+--- @param out Vector2: Where to store the result
+--- @param v1 Vector2: The first vector
+--- @param v2 Vector2: the second vector
+--- @param t number: The interpolation progress between 0 and 1
+--- @return Vector2: `out`
+function Vector2.LerpInto(out, v1, v2, t)
+    local invT = 1 - t
+    out.x = v1.x * invT + v2.x * t
+    out.y = v1.y * invT + v2.y * t
+    return out
+end
+
 return Vector2
\ No newline at end of file
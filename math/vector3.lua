@@ -502,4 +502,146 @@ function Vector3.Max(v1, v2)
     )
 end
 
+
+-------------------------------
+----- In-place operations -----
+-------------------------------
+-- These write the result into an existing vector instead of creating a new one,
+-- `out` can safely be one of the operands. Useful together with `Vector3.Temp` in hot code.
+
+
+--- Stores `v1 + v2` into `out`
+--- @param out Vector3: Where to store the result
+--- @param v1 Vector3: The left hand operand
+--- @param v2 Vector3 | number: The right hand operand
+--- @return Vector3: `out`
+function Vector3.AddInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y, out.z = v1.x + v2, v1.y + v2, v1.z + v2
+    else
+        out.x, out.y, out.z = v1.x + v2.x, v1.y + v2.y, v1.z + v2.z
+    end
+    return out
+end
+
+
+--- Stores `v1 - v2` into `out`
+--- @param out Vector3: Where to store the result
+--- @param v1 Vector3: The left hand operand
+--- @param v2 Vector3 | number: The right hand operand
+--- @return Vector3: `out`
+function Vector3.SubtractInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y, out.z = v1.x - v2, v1.y - v2, v1.z - v2
+    else
+        out.x, out.y, out.z = v1.x - v2.x, v1.y - v2.y, v1.z - v2.z
+    end
+    return out
+end
+
+
+--- Stores `v1 * v2` into `out`
+--- @param out Vector3: Where to store the result
+--- @param v1 Vector3: The left hand operand
+--- @param v2 Vector3 | number: The right hand operand
+--- @return Vector3: `out`
+function Vector3.MultiplyInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y, out.z = v1.x * v2, v1.y * v2, v1.z * v2
+    else
+        out.x, out.y, out.z = v1.x * v2.x, v1.y * v2.y, v1.z * v2.z
+    end
+    return out
+end
+
+
+--- Stores `v1 / v2` into `out`
+--- @param out Vector3: Where to store the result
+--- @param v1 Vector3: The left hand operand
+--- @param v2 Vector3 | number: The right hand operand
+--- @return Vector3: `out`
+function Vector3.DivideInto(out, v1, v2)
+    if type(v2) == "number" then
+        local inv = 1 / v2
+        out.x, out.y, out.z = v1.x * inv, v1.y * inv, v1.z * inv
+    else
+        out.x, out.y, out.z = v1.x / v2.x, v1.y / v2.y, v1.z / v2.z
+    end
+    return out
+end
+
+
+--- Stores a normalized copy of `v` into `out`
+--- @param out Vector3: Where to store the result
+--- @param v Vector3: The vector to normalize
+--- @return Vector3: `out`
+function Vector3.NormalizeInto(out, v)
+    local inv = 1 / sqrt(v.x*v.x + v.y*v.y + v.z*v.z)
+    out.x, out.y, out.z = v.x * inv, v.y * inv, v.z * inv
+    return out
+end
+
+
+--- Stores a linear interpolation between two vectors into `out`
+--- @param out Vector3: Where to store the result
+--- @param v1 Vector3: The first vector
+--- @param v2 Vector3: the second vector
+--- @param t number: The interpolation progress between 0 and 1
+--- @return Vector3: `out`
+function Vector3.LerpInto(out, v1, v2, t)
+    local invT = 1 - t
+    out.x = v1.x * invT + v2.x * t
+    out.y = v1.y * invT + v2.y * t
+    out.z = v1.z * invT + v2.z * t
+    return out
+end
+
+
+--- Stores the cross product between two vectors into `out`
+--- @param out Vector3: Where to store the result
+--- @param v1 Vector3: The first vector
+--- @param v2 Vector3: the second vector
+--- @return Vector3: `out`
+function Vector3.CrossInto(out, v1, v2)
+    local x =   v1.y * v2.z - v2.y * v1.z
+    local y = -(v1.x * v2.z - v2.x * v1.z)
+    local z =   v1.x * v2.y - v2.x * v1.y
+
+    out.x, out.y, out.z = x, y, z
+    return out
+end
+
+
+--- Stores `v` transformed by a matrix or quaternion into `out`
+--- @param out Vector3: Where to store the result
+--- @param v Vector3: The vector to transform
+--- @param value Matrix3 | Matrix4 | Quaternion: The transformation matrix or quaternion
+--- @return Vector3: `out`
+function Vector3.TransformInto(out, v, value)
+    out.x, out.y, out.z = v.x, v.y, v.z
+    return out:transform(value)
+end
+
+
+--- Stores the minimum values of two vectors into `out`
+--- @param out Vector3: Where to store the result
+--- @param v1 Vector3: The first vector
+--- @param v2 Vector3: The second vector
+--- @return Vector3: `out`
+function Vector3.MinInto(out, v1, v2)
+    out.x, out.y, out.z = min(v1.x, v2.x), min(v1.y, v2.y), min(v1.z, v2.z)
+    return out
+end
+
+
+--- Stores the maximum values of two vectors into `out`
+--- @param out Vector3: Where to store the result
+--- @param v1 Vector3: The first vector
+--- @param v2 Vector3: The second vector
+--- @return Vector3: `out`
+function Vector3.MaxInto(out, v1, v2)
+    out.x, out.y, out.z = max(v1.x, v2.x), max(v1.y, v2.y), max(v1.z, v2.z)
+    return out
+end
+
 return Vector3
\ No newline at end of file
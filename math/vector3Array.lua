@@ -0,0 +1,272 @@
+local StructArray = require "engine.math.structArray"
+local Vector3     = require "engine.math.vector3"
+local sqrt, min, max, abs, huge = math.sqrt, math.min, math.max, math.abs, math.huge
+
+
+---
+--- A packed array of `Vector3` with batched operations. All operations work in place or
+--- write to an `out` array, none of them create new objects per element.
+---
+--- @class Vector3Array: StructArray
+---
+--- @overload fun(capacity: integer, byteData: love.ByteData?): Vector3Array
+local Vector3Array = StructArray:extend("Vector3Array")
+
+
+function Vector3Array:new(capacity, byteData)
+    StructArray.new(self, Vector3, capacity, byteData)
+end
+
+
+-- Makes sure `out` can hold as many elements as `src`
+local function prepareOutput(src, out)
+    out = out or src
+
+    if out ~= src then
+        out:reserve(src.length)
+        out.length = src.length
+    end
+
+    return out
+end
+
+
+--- Transforms all points by a matrix, including translation (i.e `w = 1`)
+--- @param mat Matrix4: Transformation matrix
+--- @param out Vector3Array?: Where to store the results. Defaults to this array
+--- @return Vector3Array: The output array
+function Vector3Array:transform(mat, out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+    local m11, m12, m13 = mat.m11, mat.m12, mat.m13
+    local m21, m22, m23 = mat.m21, mat.m22, mat.m23
+    local m31, m32, m33 = mat.m31, mat.m32, mat.m33
+    local m41, m42, m43 = mat.m41, mat.m42, mat.m43
+
+    for i=0, self.length-1 do
+        local x, y, z = src[i].x, src[i].y, src[i].z
+
+        dst[i].x = x * m11 + y * m21 + z * m31 + m41
+        dst[i].y = x * m12 + y * m22 + z * m32 + m42
+        dst[i].z = x * m13 + y * m23 + z * m33 + m43
+    end
+
+    return out
+end
+
+
+--- Transforms all vectors by a matrix, ignoring translation (i.e `w = 0`).
+--- Useful for directions.
+--- @param mat Matrix4|Matrix3: Transformation matrix
+--- @param out Vector3Array?: Where to store the results. Defaults to this array
+--- @return Vector3Array: The output array
+function Vector3Array:transformDirections(mat, out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+    local m11, m12, m13 = mat.m11, mat.m12, mat.m13
+    local m21, m22, m23 = mat.m21, mat.m22, mat.m23
+    local m31, m32, m33 = mat.m31, mat.m32, mat.m33
+
+    for i=0, self.length-1 do
+        local x, y, z = src[i].x, src[i].y, src[i].z
+
+        dst[i].x = x * m11 + y * m21 + z * m31
+        dst[i].y = x * m12 + y * m22 + z * m32
+        dst[i].z = x * m13 + y * m23 + z * m33
+    end
+
+    return out
+end
+
+
+--- Rotates all vectors by a quaternion
+--- @param quat Quaternion: The rotation
+--- @param out Vector3Array?: Where to store the results. Defaults to this array
+--- @return Vector3Array: The output array
+function Vector3Array:rotate(quat, out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+    local qx, qy, qz, qw = quat.x, quat.y, quat.z, quat.w
+
+    for i=0, self.length-1 do
+        local vx, vy, vz = src[i].x, src[i].y, src[i].z
+        local x = 2 * (qy * vz - qz * vy)
+        local y = 2 * (qz * vx - qx * vz)
+        local z = 2 * (qx * vy - qy * vx)
+
+        dst[i].x = vx + x * qw + (qy * z - qz * y)
+        dst[i].y = vy + y * qw + (qz * x - qx * z)
+        dst[i].z = vz + z * qw + (qx * y - qy * x)
+    end
+
+    return out
+end
+
+
+--- Make all vectors have a magnitude of 1. Zero length vectors are left untouched.
+--- @param out Vector3Array?: Where to store the results. Defaults to this array
+--- @return Vector3Array: The output array
+function Vector3Array:normalize(out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+
+    for i=0, self.length-1 do
+        local x, y, z = src[i].x, src[i].y, src[i].z
+        local len = sqrt(x*x + y*y + z*z)
+        local inv = len > 0 and 1 / len or 1
+
+        dst[i].x = x * inv
+        dst[i].y = y * inv
+        dst[i].z = z * inv
+    end
+
+    return out
+end
+
+
+--- Multiplies all vectors by a number
+--- @param scalar number
+--- @param out Vector3Array?: Where to store the results. Defaults to this array
+--- @return Vector3Array: The output array
+function Vector3Array:scale(scalar, out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+
+    for i=0, self.length-1 do
+        dst[i].x = src[i].x * scalar
+        dst[i].y = src[i].y * scalar
+        dst[i].z = src[i].z * scalar
+    end
+
+    return out
+end
+
+
+--- Adds a vector to all elements
+--- @param vec Vector3
+--- @param out Vector3Array?: Where to store the results. Defaults to this array
+--- @return Vector3Array: The output array
+function Vector3Array:translate(vec, out)
+    out = prepareOutput(self, out)
+
+    local src, dst = self.data, out.data
+    local vx, vy, vz = vec.x, vec.y, vec.z
+
+    for i=0, self.length-1 do
+        dst[i].x = src[i].x + vx
+        dst[i].y = src[i].y + vy
+        dst[i].z = src[i].z + vz
+    end
+
+    return out
+end
+
+
+--- Gets the smallest and greatest components of all vectors in this array (i.e its bounding box)
+--- @param outMin Vector3?: Where to store the minimum value
+--- @param outMax Vector3?: Where to store the maximum value
+--- @return Vector3 min, Vector3 max
+function Vector3Array:getMinMax(outMin, outMax)
+    local src = self.data
+    local minx, miny, minz = huge, huge, huge
+    local maxx, maxy, maxz = -huge, -huge, -huge
+
+    for i=0, self.length-1 do
+        local x, y, z = src[i].x, src[i].y, src[i].z
+
+        minx, miny, minz = min(minx, x), min(miny, y), min(minz, z)
+        maxx, maxy, maxz = max(maxx, x), max(maxy, y), max(maxz, z)
+    end
+
+    outMin = outMin or Vector3()
+    outMax = outMax or Vector3()
+    outMin.x, outMin.y, outMin.z = minx, miny, minz
+    outMax.x, outMax.y, outMax.z = maxx, maxy, maxz
+
+    return outMin, outMax
+end
+
+
+--- Calculates the dot product between each element of two arrays
+--- @param v1 Vector3Array: The first array
+--- @param v2 Vector3Array: The second array
+--- @param out number[]|ffi.cdata*: Where to store the results (0-based if it's a pointer)
+--- @return number[]|ffi.cdata*: The output
+function Vector3Array.Dot(v1, v2, out)
+    local a, b = v1.data, v2.data
+    local offset = type(out) == "table" and 1 or 0
+
+    for i=0, v1.length-1 do
+        out[i + offset] = a[i].x*b[i].x + a[i].y*b[i].y + a[i].z*b[i].z
+    end
+
+    return out
+end
+
+
+--- Peforms a linear interpolation between each element of two arrays
+--- @param v1 Vector3Array: The first array
+--- @param v2 Vector3Array: The second array
+--- @param t number: The interpolation progress between 0 and 1
+--- @param out Vector3Array: Where to store the results. Can be one of the inputs
+--- @return Vector3Array: The output array
+function Vector3Array.Lerp(v1, v2, t, out)
+    out = prepareOutput(v1, out)
+
+    local a, b, dst = v1.data, v2.data, out.data
+    local invT = 1 - t
+
+    for i=0, v1.length-1 do
+        dst[i].x = a[i].x * invT + b[i].x * t
+        dst[i].y = a[i].y * invT + b[i].y * t
+        dst[i].z = a[i].z * invT + b[i].z * t
+    end
+
+    return out
+end
+
+
+--- Transforms a list of bounding boxes by a matrix, storing the new axis aligned bounds
+--- @param mins Vector3Array: Minimum corner of each box
+--- @param maxs Vector3Array: Maximum corner of each box
+--- @param mat Matrix4: Transformation matrix
+--- @param outMins Vector3Array: Where to store the transformed minimum corners. Can be `mins`
+--- @param outMaxs Vector3Array: Where to store the transformed maximum corners. Can be `maxs`
+function Vector3Array.TransformAABBs(mins, maxs, mat, outMins, outMaxs)
+    prepareOutput(mins, outMins)
+    prepareOutput(maxs, outMaxs)
+
+    local pmin, pmax = mins.data, maxs.data
+    local omin, omax = outMins.data, outMaxs.data
+    local m11, m12, m13 = mat.m11, mat.m12, mat.m13
+    local m21, m22, m23 = mat.m21, mat.m22, mat.m23
+    local m31, m32, m33 = mat.m31, mat.m32, mat.m33
+    local m41, m42, m43 = mat.m41, mat.m42, mat.m43
+    local a11, a12, a13 = abs(m11), abs(m12), abs(m13)
+    local a21, a22, a23 = abs(m21), abs(m22), abs(m23)
+    local a31, a32, a33 = abs(m31), abs(m32), abs(m33)
+
+    for i=0, mins.length-1 do
+        local cx, cy, cz = (pmin[i].x + pmax[i].x) * 0.5, (pmin[i].y + pmax[i].y) * 0.5, (pmin[i].z + pmax[i].z) * 0.5
+        local ex, ey, ez = (pmax[i].x - pmin[i].x) * 0.5, (pmax[i].y - pmin[i].y) * 0.5, (pmax[i].z - pmin[i].z) * 0.5
+
+        local tcx = cx * m11 + cy * m21 + cz * m31 + m41
+        local tcy = cx * m12 + cy * m22 + cz * m32 + m42
+        local tcz = cx * m13 + cy * m23 + cz * m33 + m43
+
+        local tex = ex * a11 + ey * a21 + ez * a31
+        local tey = ex * a12 + ey * a22 + ez * a32
+        local tez = ex * a13 + ey * a23 + ez * a33
+
+        omin[i].x, omin[i].y, omin[i].z = tcx - tex, tcy - tey, tcz - tez
+        omax[i].x, omax[i].y, omax[i].z = tcx + tex, tcy + tey, tcz + tez
+    end
+end
+
+
+return Vector3Array
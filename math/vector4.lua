@@ -462,4 +462,83 @@ function Vector4.Max(v1, v2)
     )
 end
 
+
+-------------------------------
+----- In-place operations -----
+-------------------------------
+-- These write the result into an existing vector instead of creating a new one,
+-- `out` can safely be one of the operands. Useful together with `Vector4.Temp` in hot code.
+
+
+--- Stores `v1 + v2` into `out`
+--- @param out Vector4: Where to store the result
+--- @param v1 Vector4: The left hand operand
+--- @param v2 Vector4 | number: The right hand operand
+--- @return Vector4: `out`
+function Vector4.AddInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y, out.z, out.w = v1.x + v2, v1.y + v2, v1.z + v2, v1.w + v2
+    else
+        out.x, out.y, out.z, out.w = v1.x + v2.x, v1.y + v2.y, v1.z + v2.z, v1.w + v2.w
+    end
+    return out
+end
+
+
+--- Stores `v1 - v2` into `out`
+--- @param out Vector4: Where to store the result
+--- @param v1 Vector4: The left hand operand
+--- @param v2 Vector4 | number: The right hand operand
+--- @return Vector4: `out`
+function Vector4.SubtractInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y, out.z, out.w = v1.x - v2, v1.y - v2, v1.z - v2, v1.w - v2
+    else
+        out.x, out.y, out.z, out.w = v1.x - v2.x, v1.y - v2.y, v1.z - v2.z, v1.w - v2.w
+    end
+    return out
+end
+
+
+--- Stores `v1 * v2` into `out`
+--- @param out Vector4: Where to store the result
+--- @param v1 Vector4: The left hand operand
+--- @param v2 Vector4 | number: The right hand operand
+--- @return Vector4: `out`
+function Vector4.MultiplyInto(out, v1, v2)
+    if type(v2) == "number" then
+        out.x, out.y, out.z, out.w = v1.x * v2, v1.y * v2, v1.z * v2, v1.w * v2
+    else
+        out.x, out.y, out.z, out.w = v1.x * v2.x, v1.y * v2.y, v1.z * v2.z, v1.w * v2.w
+    end
+    return out
+end
+
+
+--- Stores a normalized copy of `v` into `out`
+--- @param out Vector4: Where to store the result
+--- @param v Vector4: The vector to normalize
+--- @return Vector4: `out`
+function Vector4.NormalizeInto(out, v)
+    local inv = 1 / sqrt(v.x*v.x + v.y*v.y + v.z*v.z + v.w*v.w)
+    out.x, out.y, out.z, out.w = v.x * inv, v.y * inv, v.z * inv, v.w * inv
+    return out
+end
+
+
+--- Stores a linear interpolation between two vectors into `out`
+--- @param out Vector4: Where to store the result
+--- @param v1 Vector4: The first vector
+--- @param v2 Vector4: the second vector
+--- @param t number: The interpolation progress between 0 and 1
+--- @return Vector4: `out`
+function Vector4.LerpInto(out, v1, v2, t)
+    local invT = 1 - t
+    out.x = v1.x * invT + v2.x * t
+    out.y = v1.y * invT + v2.y * t
+    out.z = v1.z * invT + v2.z * t
+    out.w = v1.w * invT + v2.w * t
+    return out
+end
+
 return Vector4
\ No newline at end of file
@@ -0,0 +1,29 @@
+local ffi = require "ffi"
+
+
+-- Tests boxes against the planes of a frustum. Job data: boxes (6 floats each: min xyz, max xyz), visibility (1 byte each).
+-- `args.planes` has the 6 planes as 24 numbers (x, y, z, w)
+---@type JobKernel
+return function(first, last, data, args)
+    local boxes = ffi.cast("const float*", data[1]:getFFIPointer())
+    local visibility = ffi.cast("uint8_t*", data[2]:getFFIPointer())
+    local planes = args.planes
+
+    for i=first, last do
+        local b = i*6
+        local minx, miny, minz, maxx, maxy, maxz = boxes[b], boxes[b+1], boxes[b+2], boxes[b+3], boxes[b+4], boxes[b+5]
+        local visible = 1
+
+        -- Only the corner furthest along the plane normal needs to be tested
+        for p=1, 24, 4 do
+            local px, py, pz = planes[p], planes[p+1], planes[p+2]
+
+            if px * (px < 0 and minx or maxx) + py * (py < 0 and miny or maxy) + pz * (pz < 0 and minz or maxz) + planes[p+3] < 0 then
+                visible = 0
+                break
+            end
+        end
+
+        visibility[i] = visible
+    end
+end
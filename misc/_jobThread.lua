@@ -0,0 +1,22 @@
+require "love.data"
+require "love.filesystem"
+require "love.image"
+require "love.math"
+require "love.system"
+
+local chunkChannel, doneChannel = ... ---@type love.Channel, love.Channel
+local runChunk = require "engine.misc._runJobChunk"
+
+
+-- All workers take chunks from the same channel, so the ones that finish early take more work.
+-- They are persistent: they wait for chunks until the main thread tells one of them to quit
+while true do
+    local chunk = chunkChannel:demand() --[[@as JobChunk|string]]
+
+    if chunk == "quit" then
+        break
+    end
+
+    local message = runChunk(chunk)
+    doneChannel:push(message and {chunk.id, message} or chunk.id)
+end
@@ -0,0 +1,14 @@
+---@param chunk JobChunk
+local function run(chunk)
+    local kernel = require(chunk.module)
+    kernel(chunk.first, chunk.last, chunk.data, chunk.args, chunk.index)
+end
+
+
+-- Runs a chunk of a job. Used by the job threads, and by the main thread while it waits for a job
+---@param chunk JobChunk
+---@return string?: The error message, if the kernel failed
+return function(chunk)
+    local ok, message = pcall(run, chunk)
+    return not ok and tostring(message) or nil
+end
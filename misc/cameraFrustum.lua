@@ -1,5 +1,7 @@
 local Object = require "engine.3rdparty.classic.classic"
+local Vector3 = require "engine.math.vector3"
 local Vector4 = require "engine.math.vector4"
+local Job = require "engine.misc.job"
 
 
 ---@class CameraFrustum: Object
@@ -27,17 +29,36 @@ end
 ---@param viewProj Matrix4
 ---@return self
 function CameraFrustum:updatePlanes(viewProj)
-    self.nearPlane   = Vector4( viewProj.m13 + viewProj.m14, viewProj.m23 + viewProj.m24, viewProj.m33 + viewProj.m34, viewProj.m43 + viewProj.m44):normalize()
-    self.farPlane    = Vector4(-viewProj.m13 + viewProj.m14,-viewProj.m23 + viewProj.m24,-viewProj.m33 + viewProj.m34,-viewProj.m43 + viewProj.m44):normalize()
-    self.bottomPlane = Vector4( viewProj.m12 + viewProj.m14, viewProj.m22 + viewProj.m24, viewProj.m32 + viewProj.m34, viewProj.m42 + viewProj.m44):normalize()
-    self.topPlane    = Vector4(-viewProj.m12 + viewProj.m14,-viewProj.m22 + viewProj.m24,-viewProj.m32 + viewProj.m34,-viewProj.m42 + viewProj.m44):normalize()
-    self.leftPlane   = Vector4( viewProj.m11 + viewProj.m14, viewProj.m21 + viewProj.m24, viewProj.m31 + viewProj.m34, viewProj.m41 + viewProj.m44):normalize()
-    self.rightPlane  = Vector4(-viewProj.m11 + viewProj.m14,-viewProj.m21 + viewProj.m24,-viewProj.m31 + viewProj.m34,-viewProj.m41 + viewProj.m44):normalize()
+    self.nearPlane:new( viewProj.m13 + viewProj.m14, viewProj.m23 + viewProj.m24, viewProj.m33 + viewProj.m34, viewProj.m43 + viewProj.m44)
+    self.farPlane:new(-viewProj.m13 + viewProj.m14,-viewProj.m23 + viewProj.m24,-viewProj.m33 + viewProj.m34,-viewProj.m43 + viewProj.m44)
+    self.bottomPlane:new( viewProj.m12 + viewProj.m14, viewProj.m22 + viewProj.m24, viewProj.m32 + viewProj.m34, viewProj.m42 + viewProj.m44)
+    self.topPlane:new(-viewProj.m12 + viewProj.m14,-viewProj.m22 + viewProj.m24,-viewProj.m32 + viewProj.m34,-viewProj.m42 + viewProj.m44)
+    self.leftPlane:new( viewProj.m11 + viewProj.m14, viewProj.m21 + viewProj.m24, viewProj.m31 + viewProj.m34, viewProj.m41 + viewProj.m44)
+    self.rightPlane:new(-viewProj.m11 + viewProj.m14,-viewProj.m21 + viewProj.m24,-viewProj.m31 + viewProj.m34,-viewProj.m41 + viewProj.m44)
+
+    self.nearPlane:normalize()
+    self.farPlane:normalize()
+    self.bottomPlane:normalize()
+    self.topPlane:normalize()
+    self.leftPlane:normalize()
+    self.rightPlane:normalize()
 
     return self
 end
 
 
+-- Returns false if the box is completely behind the plane
+local function testPlane(plane, min, max)
+    local x = (plane.x < 0) and min.x or max.x
+    local y = (plane.y < 0) and min.y or max.y
+    local z = (plane.z < 0) and min.z or max.z
+
+    return plane.x * x + plane.y * y + plane.z * z + plane.w >= 0
+end
+
+
+local trMin, trMax = Vector3(), Vector3()
+
 ---@param bounding BoundingBox
 ---@param worldMatrix Matrix4?
 ---@return boolean
@@ -45,21 +66,35 @@ function CameraFrustum:testIntersection(bounding, worldMatrix)
     local min, max = bounding.min, bounding.max
 
     if worldMatrix then
-        min, max = bounding:getMinMaxTransformed(worldMatrix)
+        min, max = bounding:getMinMaxTransformedInto(worldMatrix, trMin, trMax)
     end
 
-    for i=1, 6 do
-        local plane = select(i, self.topPlane, self.bottomPlane, self.leftPlane, self.rightPlane, self.farPlane, self.nearPlane)
-        local pos = Vector4(0,0,0,1)
-        pos.x = (plane.x < 0) and min.x or max.x
-        pos.y = (plane.y < 0) and min.y or max.y
-        pos.z = (plane.z < 0) and min.z or max.z
+    return testPlane(self.topPlane, min, max)
+       and testPlane(self.bottomPlane, min, max)
+       and testPlane(self.leftPlane, min, max)
+       and testPlane(self.rightPlane, min, max)
+       and testPlane(self.farPlane, min, max)
+       and testPlane(self.nearPlane, min, max)
+end
+
 
-        if Vector4.Dot(plane, pos) < 0 then
-            return false
-        end
+--- Tests a large amount of boxes in the job threads. Boxes are stored as 6 floats (min xyz, max xyz),
+--- and the result for each box is written to `visibility` (1 if it intersects the frustum, 0 otherwise).
+--- The returned job is already scheduled, `wait` for it before reading `visibility`.
+---@param boxes love.Data
+---@param count integer
+---@param visibility love.Data: At least `count` bytes
+---@param chunkSize integer?
+---@return Job
+function CameraFrustum:cullBoxes(boxes, count, visibility, chunkSize)
+    local planes = {}
+
+    for i, plane in ipairs({self.topPlane, self.bottomPlane, self.leftPlane, self.rightPlane, self.farPlane, self.nearPlane}) do
+        local p = (i-1) * 4
+        planes[p+1], planes[p+2], planes[p+3], planes[p+4] = plane.x, plane.y, plane.z, plane.w
     end
-    return true
+
+    return Job("engine.misc._frustumCullJob", count, {boxes, visibility}, {planes = planes}):schedule(chunkSize)
 end
 
 return CameraFrustum
\ No newline at end of file
@@ -1,7 +1,8 @@
 -- Helper for creating C structs using FFI.
 -- If jit is disabled then it falls back to using tables, which are slower.
 
-local Kuro = require "engine.kuro"
+local Kuro       = require "engine.kuro"
+local FrameArena = require "engine.misc.frameArena"
 
 local ffi = nil
 local hasJit = false
@@ -20,6 +21,7 @@ end
 --- @class CStruct
 ---
 --- @field typename ffi.ctype*: The name of this struct
+--- @field Temp fun(...): CStruct: Creates a temporary instance from the frame arena. See [engine/misc/frameArena.lua]
 --- @field private _ctype ffi.ctype*: C type object for this struct
 --- @field private _flattable table: temporary storage for this object's data
 ---
@@ -91,6 +93,19 @@ end
 local function DefineStruct(structname, definition)
     local struct = setmetatable({typename = structname, _ctype = nil, _flattable = {}}, structmt)
 
+    -- Temporary instances are only valid until the next `FrameArena.reset()`,
+    -- if the arena is disabled or full this is the same as calling the constructor.
+    struct.Temp = function(...)
+        local instance = hasJit and FrameArena.allocate(struct)
+
+        if not instance then
+            return struct(...)
+        end
+
+        instance:new(...)
+        return instance
+    end
+
     if hasJit then
         local code = ("typedef struct {%s} %s;"):format(definition, structname)
 
@@ -0,0 +1,118 @@
+-- Per-frame scratch memory for C structs.
+--
+-- Temporaries created with `<Struct>.Temp(...)` are taken from a pre-sized FFI pool
+-- instead of being allocated individually, so they never reach the garbage collector.
+-- All pools are recycled at once when `FrameArena.reset()` is called (`BaseRenderer:render` does it
+-- at the start of every frame), so temporaries MUST NOT be stored anywhere that outlives the frame.
+--
+-- The arena is disabled by default, in that case `Temp` behaves exactly like a normal constructor.
+
+local ffi = require "ffi"
+
+
+---@alias FrameArenaPool {data: ffi.cdata*, size: integer, used: integer, elementSize: integer}
+---@alias FrameArenaStats {highWaterMark: integer, highWaterMarkBytes: integer, frameAllocations: integer, frameBytesSaved: integer, totalBytesSaved: integer, overflows: integer}
+
+local FrameArena = {
+    enabled = false,
+    defaultPoolSize = 1024,
+
+    ---@type FrameArenaStats
+    stats = {
+        highWaterMark = 0,      -- Most temporaries used in a single frame
+        highWaterMarkBytes = 0, -- Most bytes used in a single frame
+        frameAllocations = 0,   -- Temporaries taken from the arena since the last reset
+        frameBytesSaved = 0,    -- Bytes that didn't go to the GC since the last reset
+        totalBytesSaved = 0,    -- Bytes that didn't go to the GC since the program started
+        overflows = 0,          -- Temporaries that had to be allocated normally because a pool was full
+    }
+}
+
+local pools = {} ---@type table<string, FrameArenaPool>
+
+
+---@param typename string
+---@param size integer
+---@return FrameArenaPool
+local function createPool(typename, size)
+    local pool = {
+        data = ffi.new(typename.."[?]", size),
+        size = size,
+        used = 0,
+        elementSize = ffi.sizeof(typename),
+    }
+
+    pools[typename] = pool
+    return pool
+end
+
+
+--- Sets how many temporaries of a struct type can be used per frame. Pools are otherwise
+--- created lazily with `FrameArena.defaultPoolSize` elements.
+--- @param struct CStruct: The struct type
+--- @param size integer: Number of elements
+function FrameArena.setPoolSize(struct, size)
+    local old = pools[struct.typename]
+    assert(not old or old.used == 0, "Can't resize a pool that is in use")
+
+    createPool(struct.typename, size)
+end
+
+
+--- Takes an uninitialized struct from the arena. Returns `nil` if the arena is disabled or full.
+--- @param struct CStruct: The struct type
+--- @return ffi.cdata*?
+function FrameArena.allocate(struct)
+    if not FrameArena.enabled then
+        return nil
+    end
+
+    local typename = struct.typename
+    local pool = pools[typename] or createPool(typename, FrameArena.defaultPoolSize)
+    local stats = FrameArena.stats
+
+    if pool.used >= pool.size then
+        stats.overflows = stats.overflows + 1
+        return nil
+    end
+
+    local instance = pool.data[pool.used]
+    pool.used = pool.used + 1
+
+    stats.frameAllocations = stats.frameAllocations + 1
+    stats.frameBytesSaved = stats.frameBytesSaved + pool.elementSize
+    stats.totalBytesSaved = stats.totalBytesSaved + pool.elementSize
+
+    return instance
+end
+
+
+--- Recycles all temporaries. Call this once per frame, before any temporary is created.
+function FrameArena.reset()
+    local stats = FrameArena.stats
+
+    stats.highWaterMark = math.max(stats.highWaterMark, stats.frameAllocations)
+    stats.highWaterMarkBytes = math.max(stats.highWaterMarkBytes, stats.frameBytesSaved)
+    stats.frameAllocations = 0
+    stats.frameBytesSaved = 0
+
+    for _, pool in pairs(pools) do
+        pool.used = 0
+    end
+end
+
+
+--- Gets how many temporaries of a struct type are being used in this frame
+--- @param struct CStruct: The struct type
+--- @return integer used, integer size
+function FrameArena.getPoolUsage(struct)
+    local pool = pools[struct.typename]
+
+    if pool then
+        return pool.used, pool.size
+    end
+    return 0, FrameArena.defaultPoolSize
+end
+
+
+return FrameArena
@@ -0,0 +1,348 @@
+local Object   = require "engine.3rdparty.classic.classic"
+local Event    = require "engine.misc.event"
+local runChunk = require "engine.misc._runJobChunk"
+local ceil, min, max = math.ceil, math.min, math.max
+
+-- Default number of chunks per thread, so threads that finish early can take more work
+local CHUNKS_PER_THREAD = 4
+
+local chunkChannel = nil ---@type love.Channel
+local doneChannel = nil ---@type love.Channel
+local threads = {} ---@type love.Thread[]
+local workerCount = math.max(love.system.getProcessorCount() - 1, 1)
+local runningJobs = {} ---@type table<integer, Job>
+local lastJobId = 0
+
+
+---@alias JobKernel fun(first: integer, last: integer, data: love.Data[], args: table, chunk: integer)
+---@alias JobChunk {id: integer, module: string, first: integer, last: integer, index: integer, data: love.Data[], args: table}
+---@alias JobState "idle"|"waiting"|"running"|"done"
+---@alias JobStats {scheduled: integer, completed: integer, failed: integer, chunks: integer, mainThreadChunks: integer}
+
+
+---
+--- Work that runs in a pool of persistent worker threads, split into chunks (a parallel for).
+---
+--- A job is defined by the path of a kernel module, which returns a `JobKernel` function. The kernel is called
+--- once per chunk with an inclusive, 0-based range of the items of the job. Large data is shared through
+--- `love.Data` objects (e.g `love.data.newByteData`), which are passed to the threads without copying, so the
+--- kernels read and write them with FFI pointers. `args` is copied to every chunk, so it should be small.
+---
+--- Kernels run in other Lua states: they can only use thread-safe modules, and can't see any main thread state.
+--- Jobs only write to their own data, so the main thread shouldn't touch it until the job is done.
+--- ```lua
+--- local job = Job("engine.misc._frustumCullJob", boxCount, {boxes, visibility}, {planes = planes}):schedule()
+--- -- ...other work...
+--- job:wait()
+--- ```
+---
+--- `wait` also runs chunks on the main thread, so it's never idle and jobs still complete without workers.
+--- Finished jobs are only noticed by `wait`, `isDone` and `Job.Update`.
+---
+--- @class Job: Object
+---
+--- @field public module string
+--- @field public count integer: Number of items
+--- @field public data love.Data[]
+--- @field public args table
+--- @field public chunkCount integer: Set when scheduled
+--- @field public error string?: First error raised by the kernel
+--- @field public onCompleteEvent Event: Triggered on the main thread when the job is done, even if it failed
+--- @field private _id integer
+--- @field private _state JobState
+--- @field private _dependencies Job[]
+--- @field private _pendingDependencies integer
+--- @field private _dependents Job[]
+--- @field private _remainingChunks integer
+--- @field private _chunkSize integer
+---
+--- @overload fun(module: string, count: integer?, data: love.Data[]?, args: table?): Job
+local Job = Object:extend("Job")
+
+Job.stats = {
+    scheduled = 0,        -- Jobs scheduled
+    completed = 0,        -- Jobs finished successfully
+    failed = 0,           -- Jobs finished with an error, or with a failed dependency
+    chunks = 0,           -- Chunks run
+    mainThreadChunks = 0, -- Chunks run by the main thread while waiting
+} ---@type JobStats
+
+
+function Job:new(module, count, data, args)
+    self.module = module
+    self.count = count or 1
+    self.data = data or {}
+    self.args = args or {}
+    self.chunkCount = 0
+    self.error = nil
+    self.onCompleteEvent = Event()
+
+    self._id = 0
+    self._state = "idle"
+    self._dependencies = {}
+    self._pendingDependencies = 0
+    self._dependents = {}
+    self._remainingChunks = 0
+    self._chunkSize = 1
+end
+
+
+
+--- Makes this job only start after other jobs are done. Must be called before `schedule`
+---@param ... Job
+---@return self
+function Job:after(...)
+    assert(self._state == "idle", "Dependencies must be added before scheduling the job")
+
+    for i=1, select("#", ...) do
+        local dependency = select(i, ...) ---@type Job
+        assert(dependency._state ~= "idle", "Dependencies must be scheduled first")
+
+        table.insert(self._dependencies, dependency)
+    end
+
+    return self
+end
+
+
+--- Sends the job to the worker threads, or keeps it waiting until its dependencies are done
+---@param chunkSize integer?: Items per chunk. By default the items are split in a few chunks per thread
+---@return self
+function Job:schedule(chunkSize)
+    assert(self._state == "idle", "Job is already scheduled")
+
+    lastJobId = lastJobId + 1
+    self._id = lastJobId
+    self._chunkSize = max(chunkSize or ceil(self.count / ((workerCount + 1) * CHUNKS_PER_THREAD)), 1)
+    self.chunkCount = ceil(self.count / self._chunkSize)
+    self._state = "waiting"
+
+    runningJobs[self._id] = self
+    Job.stats.scheduled = Job.stats.scheduled + 1
+
+    for _, dependency in ipairs(self._dependencies) do
+        if dependency._state ~= "done" then
+            self._pendingDependencies = self._pendingDependencies + 1
+            table.insert(dependency._dependents, self)
+        elseif dependency.error then
+            self.error = self.error or "Dependency failed: "..dependency.error
+        end
+    end
+
+    if self.error then
+        self:_finish()
+    elseif self._pendingDependencies == 0 then
+        self:_dispatch()
+    end
+
+    return self
+end
+
+
+---@private
+function Job:_dispatch()
+    Job.StartThreads()
+
+    self._state = "running"
+    self._remainingChunks = self.chunkCount
+
+    if self.chunkCount == 0 then
+        self:_finish()
+        return
+    end
+
+    for index=0, self.chunkCount-1 do
+        local first = index * self._chunkSize
+
+        chunkChannel:push({
+            id = self._id,
+            module = self.module,
+            first = first,
+            last = min(first + self._chunkSize, self.count) - 1,
+            index = index,
+            data = self.data,
+            args = self.args,
+        })
+    end
+end
+
+
+---@private
+---@param message string?
+function Job:_completeChunk(message)
+    self._remainingChunks = self._remainingChunks - 1
+    self.error = self.error or message
+    Job.stats.chunks = Job.stats.chunks + 1
+
+    if self._remainingChunks == 0 then
+        self:_finish()
+    end
+end
+
+
+---@private
+function Job:_finish()
+    local stats = Job.stats
+
+    self._state = "done"
+    runningJobs[self._id] = nil
+
+    if self.error then
+        stats.failed = stats.failed + 1
+    else
+        stats.completed = stats.completed + 1
+    end
+
+    self.onCompleteEvent:trigger(self)
+
+    for _, dependent in ipairs(self._dependents) do
+        dependent._pendingDependencies = dependent._pendingDependencies - 1
+
+        if self.error then
+            dependent.error = dependent.error or "Dependency failed: "..self.error
+        end
+
+        if dependent._pendingDependencies == 0 then
+            if dependent.error then
+                dependent:_finish()
+            else
+                dependent:_dispatch()
+            end
+        end
+    end
+
+    self._dependents = {}
+end
+
+
+
+--- Blocks until the job is done, running chunks on the main thread meanwhile. Raises the error of the job if it failed
+---@return self
+function Job:wait()
+    assert(self._state ~= "idle", "Job is not scheduled")
+
+    while self._state ~= "done" do
+        local message = doneChannel:pop()
+
+        if message then
+            Job._ProcessMessage(message)
+        else
+            local chunk = chunkChannel:pop() --[[@as JobChunk|string]]
+
+            if chunk == "quit" then
+                -- Meant for a worker, there must be one alive to take it
+                chunkChannel:push(chunk)
+                Job._ProcessMessage(doneChannel:demand())
+
+            elseif chunk then
+                Job.stats.mainThreadChunks = Job.stats.mainThreadChunks + 1
+                runningJobs[chunk.id]:_completeChunk(runChunk(chunk))
+            else
+                Job._ProcessMessage(doneChannel:demand())
+            end
+        end
+    end
+
+    if self.error then
+        error("Job '"..self.module.."' failed: "..self.error)
+    end
+
+    return self
+end
+
+
+--- Checks if the job finished, without blocking
+---@return boolean
+function Job:isDone()
+    Job.Update()
+    return self._state == "done"
+end
+
+
+---@return JobState
+function Job:getState()
+    return self._state
+end
+
+
+
+---@private
+---@param message integer|{[1]: integer, [2]: string}
+function Job._ProcessMessage(message)
+    if type(message) == "table" then
+        runningJobs[message[1]]:_completeChunk(message[2])
+    else
+        runningJobs[message]:_completeChunk(nil)
+    end
+end
+
+
+--- Handles the chunks finished by the workers, triggering `onCompleteEvent` and starting dependent jobs.
+--- Call it once per frame if jobs are checked with `onCompleteEvent` instead of `wait`
+function Job.Update()
+    if not doneChannel then
+        return
+    end
+
+    local message = doneChannel:pop()
+
+    while message do
+        Job._ProcessMessage(message)
+        message = doneChannel:pop()
+    end
+end
+
+
+--- Starts the worker threads, if they're not running yet. Called automatically when the first job starts
+function Job.StartThreads()
+    if not chunkChannel then
+        chunkChannel = love.thread.newChannel()
+        doneChannel = love.thread.newChannel()
+    end
+
+    for i=#threads+1, workerCount do
+        local thread = love.thread.newThread("engine/misc/_jobThread.lua")
+
+        thread:start(chunkChannel, doneChannel)
+        threads[i] = thread
+    end
+end
+
+
+--- Changes the number of worker threads, besides the main thread. Extra workers stop after their current chunk
+---@param count integer: Can be 0, then all chunks run on the main thread when waiting
+function Job.SetWorkerCount(count)
+    workerCount = max(count, 0)
+
+    for i=#threads, workerCount+1, -1 do
+        chunkChannel:push("quit")
+        threads[i] = nil
+    end
+end
+
+
+---@return integer
+function Job.GetWorkerCount()
+    return workerCount
+end
+
+
+--- Stops the worker threads after they finish their current chunk
+function Job.Quit()
+    if not chunkChannel then
+        return
+    end
+
+    for _ in ipairs(threads) do
+        chunkChannel:push("quit")
+    end
+
+    for _, thread in ipairs(threads) do
+        thread:wait()
+    end
+
+    threads = {}
+end
+
+
+return Job
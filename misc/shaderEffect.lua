@@ -1,8 +1,9 @@
-local Object  = require "engine.3rdparty.classic.classic"
-local Vector3 = require "engine.math.vector3"
-local Matrix3 = require "engine.math.matrix3"
-local Utils   = require "engine.misc.utils"
-local ffi     = require "ffi"
+local Object        = require "engine.3rdparty.classic.classic"
+local Vector3       = require "engine.math.vector3"
+local Matrix3       = require "engine.math.matrix3"
+local Utils         = require "engine.misc.utils"
+local ModelAnimator = require "engine.3D.model.animation.modelAnimator"
+local ffi           = require "ffi"
 
 
 ---@class ShaderEffect: Object
@@ -12,11 +13,23 @@ local ffi     = require "ffi"
 ---@field private _shadercode string
 ---@field private _defines table
 ---@field private _isDirty boolean
+---@field private _uniformCache table<love.Shader, table<string, any>>
 ---
 ---@overload fun(vertexshader: string, pixelshader: string, defines: table?): ShaderEffect
 ---@overload fun(shader: string, defines: table?): ShaderEffect
 local ShaderEffect = Object:extend("ShaderEffect")
 
+ffi.cdef "int memcmp(const void *s1, const void *s2, size_t n);"
+
+---@alias ShaderEffectStats {uniformUploads: integer, uniformUploadsSkipped: integer}
+
+--- Counters shared by all shader effects, see `ShaderEffect.ResetStats`
+---@type ShaderEffectStats
+ShaderEffect.stats = {
+    uniformUploads = 0,        -- Uniforms sent to the GPU
+    uniformUploadsSkipped = 0, -- Uniforms that already had the same value
+}
+
 function ShaderEffect:new(vertexshader, pixelshader, defines)
     if type(pixelshader) ~= "string" then
         defines = pixelshader
@@ -30,6 +43,7 @@ function ShaderEffect:new(vertexshader, pixelshader, defines)
     self._defines = defines or {}
     self._isDirty = true
     self._cache = {}
+    self._uniformCache = setmetatable({}, {__mode = "k"})
 
     self:_updateShader()
 end
@@ -105,6 +119,79 @@ local function getArrayPtr(ctype, count)
 end
 
 
+-- Checks if a uniform value is the same as a cached copy
+---@param cached any
+---@param value any
+---@return boolean
+local function isSameUniformValue(cached, value)
+    local vtype = type(value)
+
+    if vtype == "cdata" then
+        return type(cached) == "cdata" and ffi.sizeof(cached) == ffi.sizeof(value) and ffi.C.memcmp(cached, value, ffi.sizeof(value)) == 0
+    end
+
+    if vtype == "table" then
+        if type(cached) ~= "table" or #cached ~= #value then
+            return false
+        end
+
+        for i=1, #value do
+            if cached[i] ~= value[i] then
+                return false
+            end
+        end
+
+        return true
+    end
+
+    return rawequal(cached, value)
+end
+
+
+-- Stores a copy of a uniform value that can be compared later, reusing the previous copy if possible.
+-- Returns nil for values that can't be compared (e.g data objects, which can be modified without changing the reference)
+---@param value any
+---@param cached any
+---@return any
+local function copyUniformValue(value, cached)
+    local vtype = type(value)
+
+    if vtype == "cdata" then
+        if type(cached) ~= "cdata" or ffi.sizeof(cached) ~= ffi.sizeof(value) then
+            cached = ffi.new("uint8_t[?]", ffi.sizeof(value))
+        end
+
+        ffi.copy(cached, value, ffi.sizeof(value))
+        return cached
+    end
+
+    if vtype == "table" then
+        cached = type(cached) == "table" and cached or {}
+
+        for i=1, #value do
+            if type(value[i]) ~= "number" then
+                return nil
+            end
+
+            cached[i] = value[i]
+        end
+        for i=#value+1, #cached do
+            cached[i] = nil
+        end
+
+        return cached
+    end
+
+    if vtype == "userdata" and value:typeOf("Data") then
+        return nil
+    end
+
+    return value
+end
+
+
+--- Sends a value to a uniform. Single values are compared with the last one sent to the same uniform
+--- and aren't uploaded again if they didn't change
 ---@param name string
 ---@param ... any
 ---@overload fun(self: ShaderEffect, name: string, matLayout: love.MatrixLayout, ...)
@@ -113,6 +200,29 @@ function ShaderEffect:sendUniform(name, ...)
     local matLayout = select(1, ...)
     local firstIndex = (type(matLayout) == "string" and 2 or 1)
     local first = select(firstIndex, ...)
+    local stats = ShaderEffect.stats
+    local shader = self.shader
+
+    local cache = self._uniformCache[shader]
+    if not cache then
+        cache = {}
+        self._uniformCache[shader] = cache
+    end
+
+    if argcount == firstIndex then
+        local cached = cache[name]
+
+        if cached ~= nil and isSameUniformValue(cached, first) then
+            stats.uniformUploadsSkipped = stats.uniformUploadsSkipped + 1
+            return
+        end
+
+        cache[name] = copyUniformValue(first, cached)
+    else
+        cache[name] = nil
+    end
+
+    stats.uniformUploads = stats.uniformUploads + 1
 
     if Utils.isType(first, "cstruct") then
         local ptr, size = getArrayPtr(first.typename, argcount - firstIndex + 1)
@@ -122,12 +232,12 @@ function ShaderEffect:sendUniform(name, ...)
         end
 
         if firstIndex == 2 then
-            self.shader:send(name, matLayout, uData, 0, size)
+            shader:send(name, matLayout, uData, 0, size)
         else
-            self.shader:send(name, uData, 0, size)
+            shader:send(name, uData, 0, size)
         end
     else
-        self.shader:send(name, ...)
+        shader:send(name, ...)
     end
 end
 
@@ -175,6 +285,19 @@ end
 
 
 
+--- Selects the skinning variant needed by an animator: armatures with more than `ModelAnimator.MAX_BONES` bones
+--- don't fit in the uniform arrays, so their pose is read from a texture (`BONE_TEXTURE`)
+---@param animator ModelAnimator?
+function ShaderEffect:setAnimationDefines(animator)
+    if animator and animator.maxBones > ModelAnimator.MAX_BONES then
+        self:define("BONE_TEXTURE")
+    else
+        self:undefine("BONE_TEXTURE")
+    end
+end
+
+
+
 ---@return boolean
 function ShaderEffect:isInUse()
     return love.graphics.getShader() == self.shader
@@ -248,8 +371,15 @@ function ShaderEffect:sendMeshConfigUniforms(config)
     end
 
     if config.animator then
-        self:trySendUniform("uBoneQuaternions", unpack(config.animator.finalQuaternions))
-        self:trySendUniform("uBoneScaling", unpack(config.animator.finalScaling))
+        config.animator:waitForPose()
+        local quaternions, scaling = config.animator.boneQuaternions, config.animator.boneScaling
+
+        if self:hasUniform("uBoneTexture") then
+            self:sendUniform("uBoneTexture", ModelAnimator.GetBoneTexture(quaternions, scaling))
+        else
+            self:trySendUniform("uBoneQuaternions", quaternions:getByteData(), 0, quaternions:getDataSize())
+            self:trySendUniform("uBoneScaling", scaling:getByteData(), 0, scaling:getDataSize())
+        end
         self:trySendUniform("uHasAnimation", true)
     else
         self:trySendUniform("uHasAnimation", false)
@@ -259,4 +389,12 @@ function ShaderEffect:sendMeshConfigUniforms(config)
 end
 
 
+
+--- Resets `ShaderEffect.stats`, usually once per frame
+function ShaderEffect.ResetStats()
+    ShaderEffect.stats.uniformUploads = 0
+    ShaderEffect.stats.uniformUploadsSkipped = 0
+end
+
+
 return ShaderEffect
\ No newline at end of file
@@ -249,12 +249,20 @@ function Utils.getCurrentFont()
 	return Utils.fontcache[Utils.fontName..Utils.fontSize]
 end
 
-Utils.dummySquare = love.graphics.newMesh({
-	{0,0,0,0},
-	{1,0,1,0},
-	{0,1,0,1},
-	{1,1,1,1}
-}, "strip", "static")
+-- Created on first use, so the math modules that require Utils can still be loaded in threads without `love.graphics`
+setmetatable(Utils, {__index = function(t, k)
+	if k == "dummySquare" then
+		local mesh = love.graphics.newMesh({
+			{0,0,0,0},
+			{1,0,1,0},
+			{0,1,0,1},
+			{1,1,1,1}
+		}, "strip", "static")
+
+		rawset(t, k, mesh)
+		return mesh
+	end
+end})
 
 
 ---@param size Vector2
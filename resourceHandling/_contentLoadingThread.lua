@@ -1,29 +1,23 @@
 require "love.image"
 require "love.audio"
+require "love.sound"
+require "love.font"
+require "love.filesystem"
 require "love.event"
-require "love.timer"
+require "love.data"
 
-local id = ...
-print("Content loading thread started. ID: "..id)
-
-local requestChannel = love.thread.getChannel("contentRequest")
+local workerId, requestChannel = ... ---@type integer, love.Channel
 local loadData = require "engine.resourceHandling._loadContentData"
 
-local THREAD_LIFETIME = 3
-local initTime = love.timer.getTime()
-
-
-while (love.timer.getTime() - initTime) < THREAD_LIFETIME do
-    local request = requestChannel:pop() --[[@as ContentPromiseRequest]]
 
-    if request then
-        local response = loadData(request)
-        initTime = love.timer.getTime()
+-- Workers are persistent: they wait for requests until the main thread tells them to quit
+while true do
+    local request = requestChannel:demand() --[[@as ContentPromiseRequest|string]]
 
-        love.event.push("promiseRequestLoaded", request, response) ---@diagnostic disable-line param-type-mismatch
-
-        print("Thread "..id..": finished loading promise: "..request.filepath)
+    if request == "quit" then
+        break
     end
-end
 
-print("Content loading thread finnished. ID: "..id)
\ No newline at end of file
+    local response = loadData(request)
+    love.event.push("promiseRequestLoaded", workerId, request.id, response) ---@diagnostic disable-line param-type-mismatch
+end
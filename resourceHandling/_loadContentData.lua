@@ -1,14 +1,50 @@
+-- Decoders of the built-in type hints. They run on the loading threads, so they can only use thread-safe modules
+local decoders = {
+    image = function(filepath)
+        return love.image.newImageData(filepath)
+    end,
+
+    compressedimage = function(filepath)
+        return love.image.newCompressedData(filepath)
+    end,
+
+    source = function(filepath, args)
+        return love.audio.newSource(filepath, args[1])
+    end,
+
+    sounddata = function(filepath)
+        return love.sound.newSoundData(filepath)
+    end,
+
+    font = function(filepath, args)
+        return love.font.newRasterizer(filepath, args[1])
+    end,
+
+    filedata = function(filepath)
+        return love.filesystem.newFileData(filepath)
+    end,
+}
+decoders.imagedata = decoders.image
+
+
+---@param request ContentPromiseRequest
+---@return ContentPromiseResponse
 return function(request)
     local ok, value = pcall(function()
-        if request.hint == "image" or request.hint == "imagedata" then
-            return love.image.newImageData(request.filepath)
-            
-        elseif request.hint == "source" then
-            return love.audio.newSource(request.filepath, request.args[1])
+        local decode = decoders[request.hint]
+
+        -- Custom hints are decoded by a module, which must return the decoding function
+        if not decode and request.decoder then
+            decode = require(request.decoder)
+        end
+
+        if not decode then
+            error("Unknown type hint: "..request.hint)
         end
 
-        error("Unknown type hint: "..request.hint)
+        return decode(request.filepath, request.args)
     end)
 
-    return {success = ok, value = value}
-end
\ No newline at end of file
+    local info = ok and love.filesystem.getInfo(request.filepath, "file")
+    return {success = ok, value = value, bytes = info and info.size or 0}
+end
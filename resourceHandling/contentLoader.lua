@@ -2,7 +2,7 @@ local Object = require "engine.3rdparty.classic.classic"
 local ContentPromise = require "engine.resourceHandling.contentPromise"
 
 
----@alias ContentTypeHint "image"|"imagedata"|"source"
+---@alias ContentTypeHint "image"|"imagedata"|"compressedimage"|"source"|"sounddata"|"font"|"filedata"|string
 
 ---@class ContentLoader: Object
 ---
@@ -56,7 +56,41 @@ end
 ---@param type love.SourceType
 ---@return ContentPromise
 function ContentLoader:getSource(filename, type)
-    return self:getContent(filename, "image", type)
+    return self:getContent(filename, "source", type)
+end
+
+
+
+---@param filename string
+---@return ContentPromise
+function ContentLoader:getSoundData(filename)
+    return self:getContent(filename, "sounddata")
+end
+
+
+
+---@param filename string
+---@param settings table?
+---@return ContentPromise
+function ContentLoader:getCompressedImage(filename, settings)
+    return self:getContent(filename, "compressedimage", settings)
+end
+
+
+
+---@param filename string
+---@param size number?
+---@return ContentPromise
+function ContentLoader:getFont(filename, size)
+    return self:getContent(filename, "font", size)
+end
+
+
+
+---@param filename string
+---@return ContentPromise
+function ContentLoader:getFileData(filename)
+    return self:getContent(filename, "filedata")
 end
 
 
@@ -71,16 +105,48 @@ end
 
 
 
+---@param priority ContentPriority?
 ---@return self
-function ContentLoader:loadAllAsync()
+function ContentLoader:loadAllAsync(priority)
     for _, promise in pairs(self.promises) do
-        promise:loadAsync()
+        promise:loadAsync(priority)
     end
     return self
 end
 
 
 
+--- Cancels the contents that are still loading
+---@return self
+function ContentLoader:cancelAll()
+    for _, promise in pairs(self.promises) do
+        promise:cancel()
+    end
+    return self
+end
+
+
+
+--- Gets how many contents of this loader were loaded
+---@return number: Loaded fraction, from 0 to 1
+---@return integer: Number of loaded contents
+---@return integer: Total number of contents
+function ContentLoader:getProgress()
+    local loaded, total = 0, 0
+
+    for _, promise in pairs(self.promises) do
+        total = total + 1
+
+        if promise.content then
+            loaded = loaded + 1
+        end
+    end
+
+    return total > 0 and loaded / total or 1, loaded, total
+end
+
+
+
 ---@return self
 function ContentLoader:unloadAll()
     for filename, promise in pairs(self.promises) do
@@ -1,15 +1,24 @@
-local Object = require "engine.3rdparty.classic.classic"
-local Event  = require "engine.misc.event"
-local loadData = require "engine.resourceHandling._loadContentData"
+local Object        = require "engine.3rdparty.classic.classic"
+local Event         = require "engine.misc.event"
+local PriorityQueue = require "engine.collections.priorityQueue"
+local loadData      = require "engine.resourceHandling._loadContentData"
 
-local requestChannel = love.thread.getChannel("contentRequest")
+-- Each worker gets this many requests ahead, so it doesn't wait a frame for the next one
+local PIPELINE_DEPTH = 2
+local LANE_PRIORITIES = {low = 0, normal = 1, high = 2}
+local LANE_SIZE = 2^40
 
-local allPromises = setmetatable({}, {__mode = 'v'})
-local threads = {}
+local requestQueue = PriorityQueue()
+local pendingPromises = {} ---@type table<integer, ContentPromise>
+---@alias ContentPromiseWorker {id: integer, thread: love.Thread, channel: love.Channel, inFlight: integer, retired: boolean}
 
-for i=1, math.min(love.system.getProcessorCount(), 4) do
-    threads[i] = love.thread.newThread("engine/resourceHandling/_contentLoadingThread.lua")
-end
+local workers = {} ---@type ContentPromiseWorker[]: Workers that take new requests
+local workersById = {} ---@type table<integer, ContentPromiseWorker>: Also has the retired workers that still have requests in flight
+local workerCount = math.max(love.system.getProcessorCount() - 1, 1)
+local lastWorkerId = 0 -- Never reused, so results of retired workers can't be mistaken for a new worker's
+local lastRequestId = 0
+local batchStartTime = 0
+local batchBytes = 0
 
 
 local function defaultErrorHandler(promise, message)
@@ -17,14 +26,32 @@ local function defaultErrorHandler(promise, message)
 end
 
 
----@alias ContentPromiseRequest {filepath: string, hint: ContentTypeHint, args: table}
----@alias ContentPromiseResponse {success: boolean, value: any}
+---@alias ContentPromiseRequest {id: integer, filepath: string, hint: ContentTypeHint, decoder: string?, args: table}
+---@alias ContentPromiseResponse {success: boolean, value: any, bytes: integer}
 ---@alias ContentPromiseErrorHandler fun(promise: ContentPromise, message: string)
+---@alias ContentPromiseFinisher fun(value: any, args: table, promise: ContentPromise): any
+---@alias ContentPriority "high"|"normal"|"low"
+
+---@alias ContentPromiseStats {queued: integer, loading: integer, loaded: integer, failed: integer, cancelled: integer, bytesLoaded: integer, bytesPerSecond: number}
+
+
+-- How each type hint is decoded off the main thread, and turned into the final content on the main thread
+local hints = {
+    image = {finish = function(value, args) return love.graphics.newImage(value, args[1]) end},
+    compressedimage = {finish = function(value, args) return love.graphics.newImage(value, args[1]) end},
+    font = {finish = function(value) return love.graphics.newFont(value) end},
+    imagedata = {},
+    source = {},
+    sounddata = {},
+    filedata = {},
+} ---@type table<string, {decoder: string?, finish: ContentPromiseFinisher?}>
+
 
 ---@class ContentPromise: Object
 ---
 ---@field public content any
 ---@field public isLoading boolean
+---@field public priority ContentPriority
 ---@field public onCompleteEvent Event
 ---@field private _errorHandler ContentPromiseErrorHandler
 ---@field private _request ContentPromiseRequest
@@ -32,15 +59,27 @@ end
 ---@overload fun(file: string, hint: ContentTypeHint, ...): ContentPromise
 local ContentPromise = Object:extend("ContentPromise")
 
+ContentPromise.stats = {
+    queued = 0,         -- Requests waiting for a worker
+    loading = 0,        -- Requests being decoded by the workers
+    loaded = 0,         -- Requests finished successfully
+    failed = 0,         -- Requests finished with an error
+    cancelled = 0,      -- Requests cancelled before being finished
+    bytesLoaded = 0,    -- Size of the files loaded
+    bytesPerSecond = 0, -- Loading speed since the workers were last idle
+} ---@type ContentPromiseStats
+
+
 function ContentPromise:new(file, hint, ...)
+    assert(hints[hint], "Unknown type hint: "..tostring(hint))
+
     self.content = nil
     self.isLoading = false
+    self.priority = "normal"
     self.onCompleteEvent = Event()
 
     self._errorHandler = defaultErrorHandler
-    self._request = {filepath = file, hint = hint, args = {...}}
-
-    allPromises[file] = self
+    self._request = {id = 0, filepath = file, hint = hint, decoder = hints[hint].decoder, args = {...}}
 end
 
 
@@ -49,30 +88,41 @@ end
 ---@param response ContentPromiseResponse
 function ContentPromise:_finishLoading(response)
     if not self.isLoading then
-        print("promise content discarted: "..self._request.filepath)
+        return
+    end
 
-    elseif response.success then
-        if self._request.hint == "image" then
-            self.content = love.graphics.newImage(response.value, self._request.args[1])
-        end
+    self.isLoading = false
+
+    if response.success then
+        local finish = hints[self._request.hint].finish
+        self.content = finish and finish(response.value, self._request.args, self) or response.value
 
         self.onCompleteEvent:trigger(self)
     else
         self._errorHandler(self, response.value)
     end
-
-    self.isLoading = false
 end
 
 
 
+--- Loads the content in the worker threads. Requests with higher priority are loaded first
+---@param priority ContentPriority?
 ---@return self
-function ContentPromise:loadAsync()
+function ContentPromise:loadAsync(priority)
+    if priority then
+        self:setPriority(priority)
+    end
+
     if not self.isLoading and not self.content then
-        requestChannel:push(self._request)
-        ContentPromise.UpdateThreads()
+        lastRequestId = lastRequestId + 1
+        self._request.id = lastRequestId
+
+        pendingPromises[lastRequestId] = self
+        requestQueue:push(LANE_PRIORITIES[self.priority] * LANE_SIZE - lastRequestId, lastRequestId)
+        ContentPromise.stats.queued = ContentPromise.stats.queued + 1
 
         self.isLoading = true
+        ContentPromise.UpdateThreads()
     end
     return self
 end
@@ -82,6 +132,8 @@ end
 ---@return self
 function ContentPromise:load()
     if not self.content then
+        self:cancel()
+
         self.isLoading = true
         self:_finishLoading(loadData(self._request))
     end
@@ -90,10 +142,48 @@ end
 
 
 
+--- Stops loading the content. If a worker is already decoding it, the result is discarded
+---@return self
+function ContentPromise:cancel()
+    local stats = ContentPromise.stats
+    local id = self._request.id
+
+    if self.isLoading and pendingPromises[id] == self then
+        if requestQueue:remove(id) then
+            stats.queued = stats.queued - 1
+        end
+
+        pendingPromises[id] = nil
+        stats.cancelled = stats.cancelled + 1
+    end
+
+    self.isLoading = false
+    return self
+end
+
+
+
 ---@return self
 function ContentPromise:unload()
+    self:cancel()
     self.content = nil
-    self.isLoading = false
+    return self
+end
+
+
+
+--- Changes the priority of the content, also moving it in the queue if it's waiting to be loaded
+---@param priority ContentPriority
+---@return self
+function ContentPromise:setPriority(priority)
+    assert(LANE_PRIORITIES[priority], "Invalid priority: "..tostring(priority))
+
+    local id = self._request.id
+    self.priority = priority
+
+    if requestQueue:contains(id) then
+        requestQueue:setPriority(id, LANE_PRIORITIES[priority] * LANE_SIZE - id)
+    end
     return self
 end
 
@@ -111,32 +201,147 @@ end
 
 
 
+--- Registers a new type hint. `decoder` is the path of a module that returns a `fun(filepath: string, args: table): any`
+--- function, which is called in the worker threads, so it can only use thread-safe modules. The decoded value is passed
+--- to `finish` on the main thread, which returns the final content.
+---@param hint string
+---@param decoder string?: Not needed to change only the `finish` function of built-in hints
+---@param finish ContentPromiseFinisher?
+function ContentPromise.RegisterHint(hint, decoder, finish)
+    hints[hint] = {decoder = decoder, finish = finish}
+end
+
+
+--- Changes the number of worker threads. Extra workers stop after their current requests
+---@param count integer
+function ContentPromise.SetWorkerCount(count)
+    workerCount = math.max(count, 1)
+
+    for i=#workers, workerCount+1, -1 do
+        local worker = workers[i]
+
+        worker.channel:push("quit")
+        worker.retired = true
+        workers[i] = nil
+
+        if worker.inFlight == 0 then
+            workersById[worker.id] = nil
+        end
+    end
+
+    ContentPromise.UpdateThreads()
+end
+
+
+--- Sends the queued requests to the workers, starting them if needed
 function ContentPromise.UpdateThreads()
-    for i, thread in ipairs(threads) do
-        if not thread:isRunning() and requestChannel:getCount() > 0 then
-            thread:start(i)
+    local stats = ContentPromise.stats
+
+    if stats.queued == 0 then
+        return
+    end
+
+    if stats.loading == 0 then
+        batchStartTime = love.timer.getTime()
+        batchBytes = 0
+    end
+
+    for i=#workers+1, workerCount do
+        local channel = love.thread.newChannel()
+        local thread = love.thread.newThread("engine/resourceHandling/_contentLoadingThread.lua")
+
+        lastWorkerId = lastWorkerId + 1
+        thread:start(lastWorkerId, channel)
+
+        workers[i] = {id = lastWorkerId, thread = thread, channel = channel, inFlight = 0, retired = false}
+        workersById[lastWorkerId] = workers[i]
+    end
+
+    for depth=1, PIPELINE_DEPTH do
+        for _, worker in ipairs(workers) do
+            if requestQueue:getLength() == 0 then
+                return
+            end
+
+            if worker.inFlight < depth then
+                local _, id = requestQueue:pop()
+
+                worker.channel:push(pendingPromises[id]._request)
+                worker.inFlight = worker.inFlight + 1
+                stats.queued = stats.queued - 1
+                stats.loading = stats.loading + 1
+            end
         end
     end
 end
 
 
+--- Stops all the workers, and cancels the requests that weren't loaded yet
 function ContentPromise.Quit()
-    requestChannel:clear()
+    requestQueue:clear()
+
+    for _, worker in pairs(workersById) do
+        worker.channel:clear()
+        worker.channel:push("quit")
+    end
+
+    for _, worker in pairs(workersById) do
+        worker.thread:wait()
+    end
+
+    for _, promise in pairs(pendingPromises) do
+        promise.isLoading = false
+    end
+
+    workers = {}
+    workersById = {}
+    pendingPromises = {}
+    batchStartTime, batchBytes = 0, 0
 
-    for i, thread in ipairs(threads) do
-        thread:wait()
+    for k in pairs(ContentPromise.stats) do
+        ContentPromise.stats[k] = 0
     end
 end
 
 
 ---@diagnostic disable-next-line undefined-field
-function love.handlers.promiseRequestLoaded(request, response)
-    local promise = allPromises[request.filepath]
-    assert(promise)
+function love.handlers.promiseRequestLoaded(workerId, id, response)
+    local stats = ContentPromise.stats
+    local worker = workersById[workerId]
+    local promise = pendingPromises[id]
+
+    -- Results sent before `Quit`
+    if not worker then
+        return
+    end
+
+    worker.inFlight = worker.inFlight - 1
+
+    -- Workers removed by `SetWorkerCount` are forgotten after their last request
+    if worker.retired and worker.inFlight == 0 then
+        workersById[workerId] = nil
+    end
+
+    stats.loading = stats.loading - 1
+    stats.bytesLoaded = stats.bytesLoaded + response.bytes
+    batchBytes = batchBytes + response.bytes
+    stats.bytesPerSecond = batchBytes / math.max(love.timer.getTime() - batchStartTime, 1e-3)
+
+    if promise then
+        pendingPromises[id] = nil
+
+        if response.success then
+            stats.loaded = stats.loaded + 1
+        else
+            stats.failed = stats.failed + 1
+        end
+
+        promise:_finishLoading(response)
+    end
 
-    promise:_finishLoading(response)
+    ContentPromise.UpdateThreads()
 end
 
 
 
-return ContentPromise
\ No newline at end of file
+return ContentPromise
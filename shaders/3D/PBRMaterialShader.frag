@@ -7,6 +7,7 @@
 #define MATERIAL_GBUFFER_PASS materialGBufferPass
 #define MATERIAL_LIGHT_PASS materialLightingPass
 #define MATERIAL_AMBIENT_PASS materialAmbientPass
+#define MATERIAL_CLUSTERED_LIGHT_PASS materialClusteredLightingPass
 
 #pragma include "engine/shaders/include/incl_utils.glsl"
 #pragma include "engine/shaders/include/incl_commonBuffers.glsl"
@@ -78,5 +79,21 @@ vec4 materialLightingPass(FragmentData fragData, LightData light, MaterialInput
 	vec3 result = CalculateDirectPBRLighting(light, lightDir, viewFragDirection, normal, albedo, roughness, metallic);
 	result *= CalculateLightInfluence(light, fragData.position);
 
+	return vec4(result, 1.0);
+}
+
+
+vec4 materialClusteredLightingPass(FragmentData fragData, ClusterLight light, MaterialInput matInput, vec4 data[MATERIAL_DATA_CHANNELS]) {
+	vec3 lightFragDirection = normalize(light.position - fragData.position);
+    vec3 viewFragDirection = normalize(uViewPosition - fragData.position);
+
+	vec3 normal     = DecodeOctahedron(data[0].rg);
+	float metallic  = data[0].b;
+	float roughness = data[0].a;
+	vec3 albedo     = data[1].rgb;
+
+	vec3 result = CalculateDirectPBRLighting(light, lightFragDirection, viewFragDirection, normal, albedo, roughness, metallic);
+	result *= CalculateLightInfluence(light, fragData.position);
+
 	return vec4(result, 1.0);
 }
\ No newline at end of file
@@ -19,13 +19,17 @@ out mat3 v_tbnMatrix;
 uniform mat4 u_volumeTransform;
 
 vec4 position(mat4 transformProjection, vec4 position) {
-    DualQuaternion dqSkinning = uHasAnimation ? GetDualQuaternionSkinning(uBoneQuaternions, VertexBoneIDs, VertexWeights) : dq_identity();
-    vec3 scaleSkinning = uHasAnimation ? GetScalingSkinning(uBoneScaling, VertexBoneIDs, VertexWeights) : vec3(1.0);
+    vec4 boneIDs = GetVertexBoneIDs(VertexBoneIDs);
+    vec4 weights = GetVertexWeights(VertexWeights);
 
-    vec4 worldPos = uWorldMatrix * vec4(scaleSkinning * dq_transform(dqSkinning, position.xyz), 1.0);
+    DualQuaternion dqSkinning = uHasAnimation ? GetDualQuaternionSkinning(uBoneQuaternions, boneIDs, weights) : dq_identity();
+    vec3 scaleSkinning = uHasAnimation ? GetScalingSkinning(uBoneScaling, boneIDs, weights) : vec3(1.0);
+
+    mat4 worldMatrix = GetWorldMatrix();
+    vec4 worldPos = worldMatrix * vec4(scaleSkinning * dq_transform(dqSkinning, GetVertexPosition(position.xyz)), 1.0);
     vec4 screen = uViewProjMatrix * worldPos;
-    vec3 normal = dq_rotate(dqSkinning, VertexNormal);
-    vec3 tangent = dq_rotate(dqSkinning, VertexTangent);
+    vec3 normal = dq_rotate(dqSkinning, GetVertexNormal(VertexNormal));
+    vec3 tangent = dq_rotate(dqSkinning, GetVertexTangent(VertexTangent));
 
 #   if CURRENT_RENDER_PASS == RENDER_PASS_DEPTH_PREPASS
         screen.z += 0.00001;
@@ -33,18 +37,18 @@ vec4 position(mat4 transformProjection, vec4 position) {
 
 #   elif CURRENT_RENDER_PASS == RENDER_PASS_SHADOWMAPPING
         v_fragPos = worldPos.xyz;
-        v_normal  = uInverseTransposedWorldMatrix * normal;
+        v_normal  = GetInverseTransposedWorldMatrix() * normal;
 
 #   elif CURRENT_RENDER_PASS == RENDER_PASS_DEFERRED_LIGHTPASS
         screen = u_volumeTransform * position;
 
 #   elif CURRENT_RENDER_PASS == RENDER_PASS_DEFERRED
-        v_tbnMatrix = GetTBNMatrix(uWorldMatrix, normal, tangent);
-        v_texCoords = VertexTexCoords;
+        v_tbnMatrix = GetTBNMatrix(worldMatrix, normal, tangent);
+        v_texCoords = GetVertexTexCoords(VertexTexCoords);
 
 #   elif CURRENT_RENDER_PASS == RENDER_PASS_FORWARD
-        v_tbnMatrix = GetTBNMatrix(uWorldMatrix, normal, tangent);
-        v_texCoords = VertexTexCoords;
+        v_tbnMatrix = GetTBNMatrix(worldMatrix, normal, tangent);
+        v_texCoords = GetVertexTexCoords(VertexTexCoords);
         v_fragPos = worldPos.xyz;
 #   else
 #       error Invalid render pass
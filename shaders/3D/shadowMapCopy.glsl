@@ -0,0 +1,30 @@
+#pragma language glsl3
+
+#ifdef PIXEL
+#ifdef SOURCE_IS_CUBE
+uniform samplerCube u_source;
+uniform int u_face;
+#else
+uniform sampler2D u_source;
+#endif
+
+
+void effect() {
+#ifdef SOURCE_IS_CUBE
+	// Direction of the texel with the same storage coordinates in the source face (see the cube map section of the GL spec)
+	vec2 st = gl_FragCoord.xy / vec2(textureSize(u_source, 0)) * 2.0 - 1.0;
+	vec3 dir;
+
+	if      (u_face == 0) dir = vec3( 1.0, -st.y, -st.x);
+	else if (u_face == 1) dir = vec3(-1.0, -st.y,  st.x);
+	else if (u_face == 2) dir = vec3( st.x,  1.0,  st.y);
+	else if (u_face == 3) dir = vec3( st.x, -1.0, -st.y);
+	else if (u_face == 4) dir = vec3( st.x, -st.y,  1.0);
+	else                  dir = vec3(-st.x, -st.y, -1.0);
+
+	gl_FragDepth = texture(u_source, dir).r;
+#else
+	gl_FragDepth = texelFetch(u_source, ivec2(gl_FragCoord.xy), 0).r;
+#endif
+}
+#endif
@@ -3,7 +3,17 @@
 #define HALF_PI PI/2.0
 #define RAD_STEP PI/180.0
 
-#define MAX_BONE_COUNT 20
+// Uniform skinning takes 3 vectors per bone, and many drivers only have 256 vertex uniform vectors
+// in total, so bigger rigs need BONE_TEXTURE, which reads the pose from a float texture instead.
+// Must match ModelAnimator.MAX_BONES (see [engine/3D/model/animation/modelAnimator.lua])
+#ifndef MAX_BONE_COUNT
+#   ifdef BONE_TEXTURE
+#       define MAX_BONE_COUNT 1024
+#   else
+#       define MAX_BONE_COUNT 64
+#   endif
+#endif
+
 #define VELOCITY_ENCODE_PRECISION 3.0
 
 #define EFFECTARGS vec4 _color, sampler2D _tex, vec2 _texcoords, vec2 _screencoords
@@ -12,4 +22,5 @@
 #define RENDER_PASS_DEFERRED 1
 #define RENDER_PASS_DEFERRED_LIGHTPASS 2
 #define RENDER_PASS_DEPTH_PREPASS 3
-#define RENDER_PASS_SHADOWMAPPING 4
\ No newline at end of file
+#define RENDER_PASS_SHADOWMAPPING 4
+#define RENDER_PASS_FORWARD_CLUSTERED 5
\ No newline at end of file
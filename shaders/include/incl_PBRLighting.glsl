@@ -43,7 +43,7 @@ float GeometrySmith(float NdotV, float NdotL, float roughness) {
 
 
 
-vec3 CalculateDirectPBRLighting(LightData light, vec3 lightDirection, vec3 viewFragDirection, vec3 normal, vec3 albedo, float roughness, float metallic) {
+vec3 CalculateDirectPBRLighting(vec3 lightColor, vec3 lightDirection, vec3 viewFragDirection, vec3 normal, vec3 albedo, float roughness, float metallic) {
     vec3 F0 = BaseFresnelReflection(albedo, metallic);
     
     vec3 N = normal;
@@ -66,7 +66,15 @@ vec3 CalculateDirectPBRLighting(LightData light, vec3 lightDirection, vec3 viewF
     float denom = 4.0 * NdotV * NdotL + 0.0001;
     vec3 specular = num / denom;
 
-    return (kD * albedo / PI + specular) * light.color * NdotL;
+    return (kD * albedo / PI + specular) * lightColor * NdotL;
+}
+
+vec3 CalculateDirectPBRLighting(LightData light, vec3 lightDirection, vec3 viewFragDirection, vec3 normal, vec3 albedo, float roughness, float metallic) {
+    return CalculateDirectPBRLighting(light.color, lightDirection, viewFragDirection, normal, albedo, roughness, metallic);
+}
+
+vec3 CalculateDirectPBRLighting(ClusterLight light, vec3 lightDirection, vec3 viewFragDirection, vec3 normal, vec3 albedo, float roughness, float metallic) {
+    return CalculateDirectPBRLighting(light.color, lightDirection, viewFragDirection, normal, albedo, roughness, metallic);
 }
 
 
@@ -12,8 +12,15 @@ uniform mat4 uInvProjMatrix;
 uniform mat4 uInvViewProjMatrix;
 
 uniform bool uHasAnimation;
+#ifdef BONE_TEXTURE
+// Both names refer to the same texture, so skinning code is the same for both paths
+uniform sampler2D uBoneTexture;
+#   define uBoneScaling uBoneTexture
+#   define uBoneQuaternions uBoneTexture
+#else
 uniform vec3 uBoneScaling[MAX_BONE_COUNT];
 uniform vec4 uBoneQuaternions[MAX_BONE_COUNT*2];
+#endif
 
 uniform vec3 uViewPosition;
 uniform vec3 uViewDirection;
@@ -22,4 +29,31 @@ uniform sampler2D uDepthBuffer;
 uniform sampler2D uColorBuffer;
 
 uniform bool uIsCanvasActive;
-uniform float uTime;
\ No newline at end of file
+uniform float uTime;
+
+
+
+// World matrix of the mesh being rendered. With MESH_INSTANCING it comes
+// from a per-instance attribute instead of a uniform (see MeshPart:drawInstanced)
+#if defined(VERTEX) && defined(MESH_INSTANCING)
+in vec4 InstanceTransform1;
+in vec4 InstanceTransform2;
+in vec4 InstanceTransform3;
+in vec4 InstanceTransform4;
+
+mat4 GetWorldMatrix() {
+    return mat4(InstanceTransform1, InstanceTransform2, InstanceTransform3, InstanceTransform4);
+}
+
+mat3 GetInverseTransposedWorldMatrix() {
+    return transpose(inverse(mat3(GetWorldMatrix())));
+}
+#else
+mat4 GetWorldMatrix() {
+    return uWorldMatrix;
+}
+
+mat3 GetInverseTransposedWorldMatrix() {
+    return uInverseTransposedWorldMatrix;
+}
+#endif
\ No newline at end of file
@@ -57,4 +57,81 @@ float CalculateLightInfluence(LightData light, vec3 fragPos) {
         default:
             return 1.0;
     }
-}
\ No newline at end of file
+}
+
+
+////////////////////////////
+// Clustered light lists //
+////////////////////////////
+// Filled by `LightClusterGrid`, see `ClusteredForwardRenderer`
+
+#define CLUSTER_INDEX_TEXTURE_WIDTH 1024
+
+struct ClusterLight {
+    int type;
+
+    vec3 position;
+    vec3 direction;
+    vec3 color;
+    float radius;
+
+    float cutOff;
+    float outerCutOff;
+
+    float constant;
+    float linear;
+    float quadratic;
+};
+
+uniform sampler2D uClusterLights;   // 4 texels per light (one light per row)
+uniform sampler2D uClusterGrid;     // Offset and count of each cluster in uClusterIndices
+uniform sampler2D uClusterIndices;  // Light indices of all clusters
+uniform vec3 uClusterGridSize;
+uniform vec2 uClusterDepthParams;   // Depth slice scale and bias
+
+
+// Gets the offset and count of the lights in the cluster containing a fragment
+ivec2 GetLightClusterRange(vec3 viewPos, vec2 ndc) {
+    ivec3 size = ivec3(uClusterGridSize);
+    ivec2 tile = ivec2(floor((ndc * 0.5 + 0.5) * vec2(size.xy)));
+    int slice = int(floor(log(-viewPos.z) * uClusterDepthParams.x + uClusterDepthParams.y));
+
+    ivec3 cell = clamp(ivec3(tile, slice), ivec3(0), size - 1);
+    vec2 range = texelFetch(uClusterGrid, ivec2(cell.x + cell.y * size.x, cell.z), 0).rg;
+
+    return ivec2(range);
+}
+
+
+ClusterLight GetClusterLight(int listIndex) {
+    int index = int(texelFetch(uClusterIndices, ivec2(listIndex % CLUSTER_INDEX_TEXTURE_WIDTH, listIndex / CLUSTER_INDEX_TEXTURE_WIDTH), 0).r);
+
+    vec4 data0 = texelFetch(uClusterLights, ivec2(0, index), 0);
+    vec4 data1 = texelFetch(uClusterLights, ivec2(1, index), 0);
+    vec4 data2 = texelFetch(uClusterLights, ivec2(2, index), 0);
+    vec4 data3 = texelFetch(uClusterLights, ivec2(3, index), 0);
+
+    ClusterLight light;
+    light.position    = data0.xyz;
+    light.radius      = data0.w;
+    light.color       = data1.rgb;
+    light.type        = int(data1.a);
+    light.direction   = data2.xyz;
+    light.cutOff      = data2.w;
+    light.constant    = data3.x;
+    light.linear      = data3.y;
+    light.quadratic   = data3.z;
+    light.outerCutOff = data3.w;
+
+    return light;
+}
+
+
+float CalculateLightInfluence(ClusterLight light, vec3 fragPos) {
+    float attenuation = CalculateAttenuation(light.position, light.constant, light.linear, light.quadratic, fragPos);
+
+    if (light.type == LIGHT_TYPE_SPOT)
+        attenuation *= CalculateSpotCone(light.position, light.direction, light.cutOff, light.outerCutOff, fragPos);
+    
+    return attenuation;
+}
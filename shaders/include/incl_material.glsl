@@ -31,6 +31,10 @@
 #   define MATERIAL_LIGHT_PASS defaultLightPass
 #endif
 
+#ifndef MATERIAL_CLUSTERED_LIGHT_PASS
+#   define MATERIAL_CLUSTERED_LIGHT_PASS defaultClusteredLightPass
+#endif
+
 #ifndef MATERIAL_INPUT_STRUCT
 #   define MATERIAL_INPUT_STRUCT DefaultMaterialInput
 #endif
@@ -72,12 +76,14 @@ void MATERIAL_DEPTH_PASS(FragmentData fragData, MATERIAL_INPUT_STRUCT materialIn
 void MATERIAL_GBUFFER_PASS(FragmentData fragData, MATERIAL_INPUT_STRUCT materialInput, out vec4 data[MATERIAL_DATA_CHANNELS]);
 vec4 MATERIAL_AMBIENT_PASS(FragmentData fragData, MATERIAL_INPUT_STRUCT materialInput, vec4 data[MATERIAL_DATA_CHANNELS]);
 vec4 MATERIAL_LIGHT_PASS(FragmentData fragData, LightData light, MATERIAL_INPUT_STRUCT materialInput, vec4 data[MATERIAL_DATA_CHANNELS]);
+vec4 MATERIAL_CLUSTERED_LIGHT_PASS(FragmentData fragData, ClusterLight light, MATERIAL_INPUT_STRUCT materialInput, vec4 data[MATERIAL_DATA_CHANNELS]);
 
 
 void defaultDepthPass(FragmentData fragData, MATERIAL_INPUT_STRUCT materialInput) {}
 void defaultGBufferPass(FragmentData fragData, MATERIAL_INPUT_STRUCT materialInput, out vec4 data[MATERIAL_DATA_CHANNELS]) {}
 vec4 defaultAmbientPass(FragmentData fragData, MATERIAL_INPUT_STRUCT materialInput, vec4 data[MATERIAL_DATA_CHANNELS]) {return vec4(0,0,0,1);}
 vec4 defaultLightPass(FragmentData fragData, LightData light, MATERIAL_INPUT_STRUCT materialInput, vec4 data[MATERIAL_DATA_CHANNELS]) {return vec4(0,0,0,1);}
+vec4 defaultClusteredLightPass(FragmentData fragData, ClusterLight light, MATERIAL_INPUT_STRUCT materialInput, vec4 data[MATERIAL_DATA_CHANNELS]) {return vec4(0,0,0,1);}
 
 
 
@@ -120,18 +126,22 @@ in vec4 VertexWeights;
 
 
 vec4 position(mat4 transformProjection, vec4 position) {
-    DualQuaternion dqSkinning = uHasAnimation ? GetDualQuaternionSkinning(uBoneQuaternions, VertexBoneIDs, VertexWeights) : dq_identity();
-    vec3 scaleSkinning = uHasAnimation ? GetScalingSkinning(uBoneScaling, VertexBoneIDs, VertexWeights) : vec3(1.0);
+    vec4 boneIDs = GetVertexBoneIDs(VertexBoneIDs);
+    vec4 weights = GetVertexWeights(VertexWeights);
+
+    DualQuaternion dqSkinning = uHasAnimation ? GetDualQuaternionSkinning(uBoneQuaternions, boneIDs, weights) : dq_identity();
+    vec3 scaleSkinning = uHasAnimation ? GetScalingSkinning(uBoneScaling, boneIDs, weights) : vec3(1.0);
 
-    vec4 worldPos = uWorldMatrix * vec4(scaleSkinning * dq_transform(dqSkinning, position.xyz), 1.0);
+    mat4 worldMatrix = GetWorldMatrix();
+    vec4 worldPos = worldMatrix * vec4(scaleSkinning * dq_transform(dqSkinning, GetVertexPosition(position.xyz)), 1.0);
     vec4 screen = uViewProjMatrix * worldPos;
-    vec3 normal = dq_rotate(dqSkinning, VertexNormal);
-    vec3 tangent = dq_rotate(dqSkinning, VertexTangent);
+    vec3 normal = dq_rotate(dqSkinning, GetVertexNormal(VertexNormal));
+    vec3 tangent = dq_rotate(dqSkinning, GetVertexTangent(VertexTangent));
 
     v_fragPos = worldPos.xyz;
-    v_tbnMatrix = GetTBNMatrix(uWorldMatrix, normal, tangent);
-    v_texCoords = VertexTexCoords;
-    v_normal  = uInverseTransposedWorldMatrix * normal;
+    v_tbnMatrix = GetTBNMatrix(worldMatrix, normal, tangent);
+    v_texCoords = GetVertexTexCoords(VertexTexCoords);
+    v_normal  = GetInverseTransposedWorldMatrix() * normal;
 
 #   if ISRENDERPASS(RENDER_PASS_DEFERRED_LIGHTPASS)
         screen = uWorldMatrix * position;
@@ -186,6 +196,35 @@ void effect() {
 
 
 
+#if defined(PIXEL) && ISRENDERPASS(RENDER_PASS_FORWARD_CLUSTERED)
+uniform MATERIAL_INPUT_STRUCT u_input;
+
+out vec4 oFragColor;
+
+void effect() {
+	FragmentData fragData = _getFragmentData(gl_FragCoord.xy);
+
+    vec4 inData[MATERIAL_DATA_CHANNELS];
+    MATERIAL_GBUFFER_PASS(fragData, u_input, inData);
+
+    // Shadowless point and spot lights, all of them in a single pass
+    vec4 viewPos = uViewMatrix * vec4(fragData.position, 1.0);
+    vec4 clipPos = uProjMatrix * viewPos;
+    ivec2 range = GetLightClusterRange(viewPos.xyz, clipPos.xy / clipPos.w);
+    vec3 result = vec3(0.0);
+
+    for (int i = 0; i < range.y; i++) {
+        ClusterLight light = GetClusterLight(range.x + i);
+        result += MATERIAL_CLUSTERED_LIGHT_PASS(fragData, light, u_input, inData).rgb;
+    }
+
+	oFragColor = vec4(result, 1.0);
+}
+#endif // RENDER_PASS_FORWARD_CLUSTERED
+
+
+
+
 
 
 #if defined(PIXEL) && ISRENDERPASS(RENDER_PASS_DEFERRED)
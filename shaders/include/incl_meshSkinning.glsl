@@ -1,3 +1,4 @@
+#pragma include "engine/shaders/include/incl_utils.glsl"
 #pragma include "engine/shaders/include/incl_dualQuaternion.glsl"
 
 mat4 GetLinearBlendingSkinningMatrix(mat4 boneMatrices[MAX_BONE_COUNT], vec4 boneIDs, vec4 weights) {
@@ -69,4 +70,101 @@ DualQuaternion GetDualQuaternionSkinning(vec4 boneQuaternions[MAX_BONE_COUNT*2],
 	}
 
     return dq_identity();
-}
\ No newline at end of file
+}
+
+
+#ifdef BONE_TEXTURE
+// Bone texture layout (see ModelAnimator.GetBoneTexture): 3 texels per bone, the real
+// and dual parts of its dual quaternion followed by its scale
+
+vec3 GetScalingSkinning(sampler2D boneTexture, vec4 boneIDs, vec4 weights) {
+    vec3 boneScale = vec3(0);
+    bool hasBones = false;
+
+    for (int i=0; i < 4; i++) {
+        if (boneIDs[i] < 0)
+            continue;
+        if (boneIDs[i] >= MAX_BONE_COUNT) {
+            hasBones = false;
+            break;
+        }
+
+        boneScale += texelFetch(boneTexture, ivec2(int(boneIDs[i])*3 + 2, 0), 0).xyz * weights[i];
+        hasBones = true;
+    }
+
+    if (hasBones)
+        return boneScale;
+
+    return vec3(1.0);
+}
+
+
+DualQuaternion GetDualQuaternionSkinning(sampler2D boneTexture, vec4 boneIDs, vec4 weights) {
+    bool hasBones = false;
+    DualQuaternion dqBlend = DualQuaternion(vec4(0), vec4(0));
+
+    for (int i=0; i < 4; i++) {
+        if (boneIDs[i] < 0)
+            continue;
+        if (boneIDs[i] >= MAX_BONE_COUNT) {
+            hasBones = false;
+            break;
+        }
+        int x = int(boneIDs[i]) * 3;
+        DualQuaternion dq = DualQuaternion(texelFetch(boneTexture, ivec2(x, 0), 0), texelFetch(boneTexture, ivec2(x+1, 0), 0));
+
+        dqBlend = dq_add(dqBlend, dq_multiply(dq, weights[i]));
+        hasBones = true;
+    }
+
+    if (hasBones) {
+        return dq_normalize(dqBlend);
+    }
+
+    return dq_identity();
+}
+#endif // BONE_TEXTURE
+
+
+// Compact vertex layout (see vertexFormat.lua). Positions and UVs are unorm16 relative to the bounds of the
+// mesh part, which MeshPart sends in the uniforms below, and uCompactVertices is false for the standard layout
+#ifdef VERTEX
+in vec4 VertexPackedNormalTangent;
+in vec4 VertexPackedBoneIDs;
+in vec4 VertexPackedWeights;
+
+uniform bool uCompactVertices;
+uniform vec3 uVertexPositionScale;
+uniform vec3 uVertexPositionOffset;
+uniform vec4 uVertexTexCoordsTransform; // Scale in xy, offset in zw
+
+vec3 GetVertexPosition(vec3 position) {
+    return uCompactVertices ? position * uVertexPositionScale + uVertexPositionOffset : position;
+}
+
+vec2 GetVertexTexCoords(vec2 texCoords) {
+    return uCompactVertices ? texCoords * uVertexTexCoordsTransform.xy + uVertexTexCoordsTransform.zw : texCoords;
+}
+
+vec3 GetVertexNormal(vec3 normal) {
+    return uCompactVertices ? DecodeOctahedron(VertexPackedNormalTangent.xy) : normal;
+}
+
+vec3 GetVertexTangent(vec3 tangent) {
+    return uCompactVertices ? DecodeOctahedron(VertexPackedNormalTangent.zw) : tangent;
+}
+
+vec4 GetVertexBoneIDs(vec4 boneIDs) {
+    if (!uCompactVertices)
+        return boneIDs;
+
+    // 255 means no bone
+    vec4 ids = floor(VertexPackedBoneIDs * 255.0 + 0.5);
+    return mix(ids, vec4(-1.0), equal(ids, vec4(255.0)));
+}
+
+vec4 GetVertexWeights(vec4 weights) {
+    return uCompactVertices ? VertexPackedWeights : weights;
+}
+#endif // VERTEX